@@ -90,6 +90,14 @@ void OpenGLWindow::paintGL()
         painter.setFont(QFont("Sans", 12));
         QStaticText text(QString("Frame rate: %1 fps").arg(framerate));
         painter.drawStaticText(5, 20, text);
+
+        //what the last click picked
+        if (view.getPickedObject()>=0)
+        {
+            QStaticText picked(QString("Picked object %1, triangle %2")
+                               .arg(view.getPickedObject()).arg(view.getPickedTriangle()));
+            painter.drawStaticText(5, 40, picked);
+        }
 }
 
 void OpenGLWindow::resizeGL(int w,int h)
@@ -3,6 +3,7 @@
 
 #include <glm/glm.hpp>
 #include "IVertexData.h"
+#include "VertexLayout.h"
 
 
 
@@ -47,7 +48,6 @@ public:
     vector<float> getData(string attribName) throw(runtime_error)
     {
         vector<float> result;
-        stringstream message;
 
 
         if (attribName == "position")
@@ -73,8 +73,7 @@ public:
         }
         else
         {
-            message << "No attribute: " << attribName << " found!";
-            throw runtime_error(message.str());
+            throw runtime_error("No attribute: "+attribName+" found!");
         }
 
         return result;
@@ -82,8 +81,6 @@ public:
 
     void setData(string attribName, const vector<float>& data) throw(runtime_error)
     {
-        stringstream message;
-
         if (attribName == "position")
         {
             position = glm::vec4(0,0,0,1);
@@ -94,8 +91,7 @@ public:
             case 1: position.x = data[0];
                 break;
             default:
-                message << "Too much data for attribute: " << attribName;
-                throw runtime_error(message.str());
+                throw runtime_error("Too much data for attribute: "+attribName);
             }
         }
         else if (attribName == "normal")
@@ -108,8 +104,7 @@ public:
             case 1: normal.x = data[0];
                 break;
             default:
-                message << "Too much data for attribute: " << attribName;
-                throw runtime_error(message.str());
+                throw runtime_error("Too much data for attribute: "+attribName);
             }
         }
         else if (attribName == "texcoord")
@@ -122,14 +117,12 @@ public:
             case 1: texcoord.x = data[0];
                 break;
             default:
-                message << "Too much data for attribute: " << attribName;
-                throw runtime_error(message.str());
+                throw runtime_error("Too much data for attribute: "+attribName);
             }
         }
         else
         {
-            message << "Attribute: " << attribName << " unsupported!";
-            throw runtime_error(message.str());
+            throw runtime_error("Attribute: "+attribName+" unsupported!");
         }
     }
 
@@ -144,9 +137,51 @@ public:
     }
 
 private:
+    friend class util::VertexLayout<VertexAttrib>;
+
     glm::vec4 position;
     glm::vec4 normal;
     glm::vec4 texcoord;
 };
 
+namespace util
+{
+/*
+ * Where the attributes of VertexAttrib are, so that meshes of VertexAttrib
+ * can be packed and filled without going through getData and setData
+ */
+template <>
+class VertexLayout<VertexAttrib>
+{
+public:
+    enum { KNOWN = 1, ATTRIBUTE_COUNT = 3 };
+
+    static const char *name(unsigned int attribute)
+    {
+        static const char *names[ATTRIBUTE_COUNT] = {"position","normal","texcoord"};
+        return names[attribute];
+    }
+
+    static unsigned int components(unsigned int)
+    {
+        return 4;
+    }
+
+    static const float *data(const VertexAttrib& v,unsigned int attribute)
+    {
+        switch (attribute)
+        {
+        case 0: return &v.position.x;
+        case 1: return &v.normal.x;
+        default: return &v.texcoord.x;
+        }
+    }
+
+    static float *data(VertexAttrib& v,unsigned int attribute)
+    {
+        return const_cast<float *>(data((const VertexAttrib&)v,attribute));
+    }
+};
+}
+
 #endif
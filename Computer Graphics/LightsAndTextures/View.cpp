@@ -15,12 +15,14 @@ View::View()
 {   
   WINDOW_WIDTH = WINDOW_HEIGHT = 0;
   proj = glm::mat4(1.0);
-  modelview = glm::mat4(1.0);
+  modelview = util::AffineTransform();
   textureTransform = glm::mat4(1.0);
   trackballRadius = 300;
-  trackballTransform = glm::mat4(1.0);
+  trackballTransform = util::AffineTransform();
   mipmapped = false;
   time = 0.0f;
+  pickedObject = -1;
+  pickedTriangle = 0;
 }
 
 View::~View()
@@ -42,8 +44,8 @@ void View::initScenegraph(util::OpenGLFunctions &gl, const string& filename) thr
       delete scenegraph;
 
   program.enable(gl);
-  sgraph::ScenegraphInfo<VertexAttrib> sinfo;
-  sinfo = sgraph::SceneXMLReader::importScenegraph<VertexAttrib>(filename);
+  sgraph::ScenegraphInfo<VertexAttrib> sinfo =
+      sgraph::SceneXMLReader::importScenegraph<VertexAttrib>(filename);
   scenegraph = sinfo.scenegraph;
 
   renderer.setContext(&gl);
@@ -52,6 +54,10 @@ void View::initScenegraph(util::OpenGLFunctions &gl, const string& filename) thr
   shaderVarsToVertexAttribs["vNormal"] = "normal";
   shaderVarsToVertexAttribs["vTexCoord"] = "texcoord";
   renderer.initShaderProgram(program,shaderVarsToVertexAttribs);
+  //the meshes are only needed until they are in their buffers, so they are
+  //freed when sinfo goes out of scope
+  renderer.setKeepMeshes(false);
+  renderer.setVertexFormat(util::VertexFormat::compact());
   scenegraph->setRenderer<VertexAttrib>(&renderer,sinfo.meshes);
   program.disable(gl);
 
@@ -60,10 +66,13 @@ void View::initScenegraph(util::OpenGLFunctions &gl, const string& filename) thr
 void View::initObjects(util::OpenGLFunctions& gl) throw(runtime_error)
 {
   util::PolygonMesh<VertexAttrib> tmesh;
+  util::ObjImportOptions options;
 
-  ifstream in("models/sphere.obj");
-
-  tmesh = util::ObjImporter<VertexAttrib>::importFile(in,true);
+  options.scaleAndCenter = true;
+  options.useCache = true;
+  options.optimizeVertexCache = true;
+  options.weldVertices = true;
+  tmesh = util::ObjImporter<VertexAttrib>::importFile(string("models/sphere.obj"),options);
 
   map<string,string> shaderToVertexAttrib;
 
@@ -78,12 +87,16 @@ void View::initObjects(util::OpenGLFunctions& gl) throw(runtime_error)
                                             program,
                                             shaderLocations,
                                             shaderToVertexAttrib,
-                                            tmesh);
+                                            tmesh,
+                                            util::VertexFormat::compact());
 
   meshObjects.push_back(meshObject);
+  //the mesh is not kept, so its hierarchy is built now
+  meshBVHs.push_back(util::MeshBVH());
+  tmesh.buildBVH(meshBVHs.back(),0);
 
-  glm::mat4 t = glm::translate(glm::mat4(1.0),glm::vec3(0.0f,0.0f,0.0f)) *
-      glm::scale(glm::mat4(1.0),glm::vec3(50.0f,50.0f,50.0f));
+  util::AffineTransform t = util::AffineTransform::translate(glm::vec3(0.0f,0.0f,0.0f)) *
+      util::AffineTransform::scale(glm::vec3(50.0f,50.0f,50.0f));
 
   transforms.push_back(t);
 
@@ -130,6 +143,8 @@ void View::initShaderVariables()
   modelviewLocation = shaderLocations.getLocation("modelview");
   normalmatrixLocation = shaderLocations.getLocation("normalmatrix");
   texturematrixLocation = shaderLocations.getLocation("texturematrix");
+  positionScaleLocation = shaderLocations.getLocation("positionScale");
+  positionOffsetLocation = shaderLocations.getLocation("positionOffset");
   materialAmbientLocation = shaderLocations.getLocation("material.ambient");
   materialDiffuseLocation = shaderLocations.getLocation("material.diffuse");
   materialSpecularLocation = shaderLocations.getLocation("material.specular");
@@ -189,10 +204,9 @@ void View::draw(util::OpenGLFunctions& gl)
   //enable the shader program
   program.enable(gl);
 
-  modelview = glm::mat4(1.0);
-  modelview = modelview * glm::lookAt(glm::vec3(0.0f, 0.0f, 60.0f),
-                                      glm::vec3(0.0f, 0.0f, 0.0f),
-                                      glm::vec3(0.0f, 1.0f, 0.0f));
+  modelview = util::AffineTransform(glm::lookAt(glm::vec3(0.0f, 0.0f, 60.0f),
+                                                glm::vec3(0.0f, 0.0f, 0.0f),
+                                                glm::vec3(0.0f, 1.0f, 0.0f)));
 
   //modelview currently represents world-to-view transformation
   //transform all lights into the view coordinate system before passing to
@@ -202,7 +216,7 @@ void View::draw(util::OpenGLFunctions& gl)
   for (int i = 0; i < lights.size(); i++)
     {
       glm::vec4 pos = lights[i].getPosition();
-      glm::mat4 lightTransformation;
+      util::AffineTransform lightTransformation;
 
       if (lightCoordinateSystems[i]==meshObjects.size())
         {
@@ -210,13 +224,13 @@ void View::draw(util::OpenGLFunctions& gl)
         }
       else if (lightCoordinateSystems[i]==meshObjects.size()+1)
         {
-          lightTransformation = glm::mat4(1.0);
+          lightTransformation = util::AffineTransform();
         }
       else
         {
           lightTransformation = modelview * trackballTransform * transforms[i];
         }
-      pos = lightTransformation * pos;
+      pos = lightTransformation.toMat4() * pos;
       gl.glUniform4fv(lightLocations[i].position, 1, glm::value_ptr(pos));
     }
 
@@ -253,12 +267,13 @@ void View::draw(util::OpenGLFunctions& gl)
   gl.glUniform1i(textureLocation, 0);
 
   for (int i = 0; i < meshObjects.size(); i++) {
-      glm::mat4 transformation = modelview * trackballTransform * transforms[i];
+      util::AffineTransform transformation = modelview * trackballTransform * transforms[i];
       //the matrix applied to the normal should be the inverse transpose of
-      //whatever is applied to the object
-      glm::mat4 normalmatrix = glm::inverse(glm::transpose((transformation)));
+      //whatever is applied to the object. As that is affine, only its 3x3
+      //part needs inverting
+      glm::mat4 normalmatrix(transformation.normalMatrix());
 
-      gl.glUniformMatrix4fv(modelviewLocation, 1, false, glm::value_ptr(transformation));
+      gl.glUniformMatrix4fv(modelviewLocation, 1, false, glm::value_ptr(transformation.toMat4()));
       gl.glUniformMatrix4fv(normalmatrixLocation, 1, false,glm::value_ptr(normalmatrix));
 
       /*if (textures.get(i).getTexture()getMustFlipVertically()) //for
@@ -270,6 +285,8 @@ void View::draw(util::OpenGLFunctions& gl)
       textureTransform = glm::mat4(1.0);
 
       gl.glUniformMatrix4fv(texturematrixLocation, 1, false, glm::value_ptr(textureTransform));
+      gl.glUniform3fv(positionScaleLocation, 1, glm::value_ptr(meshObjects[i]->getPositionScale()));
+      gl.glUniform3fv(positionOffsetLocation, 1, glm::value_ptr(meshObjects[i]->getPositionOffset()));
       gl.glUniform3fv(materialAmbientLocation, 1, glm::value_ptr(materials[i].getAmbient()));
       gl.glUniform3fv(materialDiffuseLocation, 1, glm::value_ptr(materials[i].getDiffuse()));
       gl.glUniform3fv(materialSpecularLocation, 1,glm::value_ptr(materials[i].getSpecular()));
@@ -295,6 +312,51 @@ void View::draw(util::OpenGLFunctions& gl)
 void View::mousePressed(int x,int y)
 {
   mousePos = glm::vec2(x,y);
+  pick(x,y);
+}
+
+void View::pick(int x,int y)
+{
+  if ((WINDOW_WIDTH<=0) || (WINDOW_HEIGHT<=0))
+    return;
+
+  //the point on the near and far planes under the mouse, in normalized
+  //device coordinates. The window's y goes down, OpenGL's up
+  glm::vec4 nearPoint(2.0f*(x+0.5f)/WINDOW_WIDTH-1.0f,1.0f-2.0f*(y+0.5f)/WINDOW_HEIGHT,-1.0f,1.0f);
+  glm::vec4 farPoint(nearPoint.x,nearPoint.y,1.0f,1.0f);
+  int picked = -1;
+  util::RayHit closest;
+
+  for (unsigned int i=0;i<meshObjects.size();i++)
+    {
+      //the ray in the coordinates of the object. A point divides the ray
+      //in the same ratio in every coordinate system, so distances along it
+      //can be compared between objects
+      glm::mat4 toObject = glm::inverse(proj * (modelview * trackballTransform * transforms[i]));
+      glm::vec4 from = toObject * nearPoint;
+      glm::vec4 to = toObject * farPoint;
+      glm::vec3 origin = glm::vec3(from)/from.w;
+      util::RayHit hit;
+
+      if (meshBVHs[i].intersect(origin,glm::vec3(to)/to.w-origin,hit,closest.distance))
+        {
+          picked = i;
+          closest = hit;
+        }
+    }
+
+  pickedObject = picked;
+  pickedTriangle = (picked<0)?0:closest.triangle;
+}
+
+int View::getPickedObject() const
+{
+  return pickedObject;
+}
+
+unsigned int View::getPickedTriangle() const
+{
+  return pickedTriangle;
 }
 
 void View::mouseReleased(int x,int y)
@@ -310,8 +372,8 @@ void View::mouseDragged(int x,int y)
   mousePos = newM;
 
   trackballTransform =
-      glm::rotate(glm::mat4(1.0),delta.x/trackballRadius,glm::vec3(0.0f,1.0f,0.0f)) *
-      glm::rotate(glm::mat4(1.0),delta.y/trackballRadius,glm::vec3(1.0f,0.0f,0.0f)) *
+      util::AffineTransform::rotate(delta.x/trackballRadius,glm::vec3(0.0f,1.0f,0.0f)) *
+      util::AffineTransform::rotate(delta.y/trackballRadius,glm::vec3(1.0f,0.0f,0.0f)) *
       trackballTransform;
 }
 
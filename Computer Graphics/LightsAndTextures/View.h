@@ -12,6 +12,8 @@ using namespace std;
 #include "Light.h"
 #include "VertexAttrib.h"
 #include "Material.h"
+#include "MeshBVH.h"
+#include "AffineTransform.h"
 #include "sgraph/Scenegraph.h"
 
 /*
@@ -61,6 +63,9 @@ public:
   void mousePressed(int x,int y);
   void mouseReleased(int x,int y);
   void mouseDragged(int x,int y);
+  //the object and triangle found by the last click, -1 if it hit nothing
+  int getPickedObject() const;
+  unsigned int getPickedTriangle() const;
 
 protected:
   void initObjects(util::OpenGLFunctions& gl) throw(runtime_error);
@@ -69,6 +74,12 @@ protected:
   void initShaderVariables();
   void initScenegraph(util::OpenGLFunctions& e,const string& in) throw(runtime_error);
   void toggleMipmapping();
+  /*
+   * Find the object and triangle under a point of the window, by tracing
+   * a ray through it against the bounding volume hierarchy of every
+   * object, and remember them
+   */
+  void pick(int x,int y);
 
 private:
   //record the current window width and height
@@ -76,15 +87,17 @@ private:
   //the projection matrix
   glm::mat4 proj;
   //the modelview matrix
-  glm::mat4 modelview;
+  util::AffineTransform modelview;
   //the objects which we are rendering
   vector<util::ObjectInstance *> meshObjects;
+  //the bounding volume hierarchies of their meshes, for picking
+  vector<util::MeshBVH> meshBVHs;
   //the textures we are using
   vector<util::TextureImage *> textures;
   //materials for our objects
   vector<util::Material> materials;
   //object-to-world transformations
-  vector<glm::mat4> transforms;
+  vector<util::AffineTransform> transforms;
   //the lights in our scene
   vector<util::Light> lights;
   //if 0-meshObjects.size()-1, then light[i] is in the coordinate system of that
@@ -94,11 +107,14 @@ private:
   //the texture matrix
   glm::mat4 textureTransform;
   //the trackball transform
-  glm::mat4 trackballTransform;
+  util::AffineTransform trackballTransform;
   //the radius of the virtual trackball
   float trackballRadius;
   //the mouse position
   glm::vec2 mousePos;
+  //what the last click hit
+  int pickedObject;
+  unsigned int pickedTriangle;
   //the list of shader variables and their locations within the shader program
   util::ShaderLocationsVault shaderLocations;
   // the scene graph
@@ -109,6 +125,7 @@ private:
   int modelviewLocation, projectionLocation, normalmatrixLocation, texturematrixLocation;
   int materialAmbientLocation, materialDiffuseLocation, materialSpecularLocation, materialShininessLocation;
   int textureLocation,numLightsLocation;
+  int positionScaleLocation,positionOffsetLocation;
 
   //the GLSL shader
   util::ShaderProgram program;
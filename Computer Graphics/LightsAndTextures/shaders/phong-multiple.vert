@@ -10,6 +10,10 @@ uniform mat4 projection;
 uniform mat4 modelview;
 uniform mat4 normalmatrix;
 uniform mat4 texturematrix;
+//packed positions are stored relative to the bounding box of the mesh:
+//these take them back to the coordinates of the mesh
+uniform vec3 positionScale;
+uniform vec3 positionOffset;
 out vec3 fNormal;
 out vec4 fPosition;
 out vec4 fTexCoord;
@@ -21,7 +25,9 @@ void main()
     vec3 ambient,diffuse,specular;
     float nDotL,rDotV;
 
-    fPosition = modelview * vec4(vPosition.xyzw);
+    vec4 position = vec4(vPosition.xyz*positionScale + positionOffset,vPosition.w);
+
+    fPosition = modelview * position;
     gl_Position = projection * fPosition;
 
 
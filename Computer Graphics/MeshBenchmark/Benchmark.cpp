@@ -0,0 +1,168 @@
+#include "Benchmark.h"
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <cstdlib>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+static atomic<unsigned long long> allocationCount(0);
+static atomic<unsigned long long> allocatedBytes(0);
+
+/*
+ * Every allocation made with new, by this program or the standard library,
+ * goes through these
+ */
+void *operator new(size_t size)
+{
+    allocationCount++;
+    allocatedBytes += size;
+    void *p = malloc(size>0?size:1);
+    if (p==NULL)
+        throw bad_alloc();
+    return p;
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void *p) throw()
+{
+    free(p);
+}
+
+void operator delete[](void *p) throw()
+{
+    free(p);
+}
+
+unsigned long long getAllocationCount()
+{
+    return allocationCount;
+}
+
+unsigned long long getAllocatedBytes()
+{
+    return allocatedBytes;
+}
+
+size_t getPeakResidentBytes()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(),&counters,sizeof(counters)))
+        return 0;
+    return counters.PeakWorkingSetSize;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF,&usage)!=0)
+        return 0;
+#ifdef __APPLE__
+    return (size_t)usage.ru_maxrss; //bytes
+#else
+    return (size_t)usage.ru_maxrss*1024; //kilobytes
+#endif
+#endif
+}
+
+Benchmark::Benchmark(double minSeconds,int minIterations)
+{
+    this->minSeconds = minSeconds;
+    this->minIterations = minIterations;
+}
+
+BenchmarkResult Benchmark::run(const string& stage,
+                               const string& model,
+                               size_t bytes,
+                               size_t vertices,
+                               const function<void()>& setup,
+                               const function<void()>& work)
+{
+    BenchmarkResult result;
+    double total = 0;
+    unsigned long long allocations = 0,allocated = 0;
+
+    result.stage = stage;
+    result.model = model;
+    result.bytes = bytes;
+    result.vertices = vertices;
+
+    while ((result.iterations<minIterations) || (total<minSeconds))
+    {
+        if (setup)
+            setup();
+
+        unsigned long long allocationsBefore = getAllocationCount();
+        unsigned long long allocatedBefore = getAllocatedBytes();
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+        work();
+
+        double seconds = chrono::duration<double>(chrono::steady_clock::now()-start).count();
+        allocations += getAllocationCount()-allocationsBefore;
+        allocated += getAllocatedBytes()-allocatedBefore;
+
+        if ((result.iterations==0) || (seconds<result.bestSeconds))
+            result.bestSeconds = seconds;
+        total += seconds;
+        result.iterations++;
+    }
+
+    result.meanSeconds = total/result.iterations;
+    result.allocations = (double)allocations/result.iterations;
+    result.allocatedBytes = (double)allocated/result.iterations;
+    result.peakResidentBytes = getPeakResidentBytes();
+    return result;
+}
+
+/*
+ * Write a string as a JSON string literal
+ */
+static void printString(ostream& out,const string& s)
+{
+    out << '"';
+    for (unsigned int i=0;i<s.length();i++)
+    {
+        if ((s[i]=='"') || (s[i]=='\\'))
+            out << '\\';
+        out << s[i];
+    }
+    out << '"';
+}
+
+void Benchmark::print(ostream& out,const BenchmarkResult& result)
+{
+    double best = (result.bestSeconds>0)?result.bestSeconds:1e-9;
+
+    out << "{\"stage\":";
+    printString(out,result.stage);
+    out << ",\"model\":";
+    printString(out,result.model);
+    out << ",\"bytes\":" << result.bytes
+        << ",\"vertices\":" << result.vertices
+        << ",\"iterations\":" << result.iterations
+        << ",\"best_seconds\":" << result.bestSeconds
+        << ",\"mean_seconds\":" << result.meanSeconds
+        << ",\"mb_per_second\":" << (result.bytes/best)/(1024.0*1024.0)
+        << ",\"vertices_per_second\":" << result.vertices/best
+        << ",\"allocations\":" << result.allocations
+        << ",\"allocated_bytes\":" << result.allocatedBytes
+        << ",\"peak_rss_bytes\":" << result.peakResidentBytes;
+    for (map<string,double>::const_iterator it=result.figures.begin();
+         it!=result.figures.end();it++)
+    {
+        out << ",";
+        printString(out,it->first);
+        out << ":" << it->second;
+    }
+    out << "}" << endl;
+}
@@ -0,0 +1,89 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <string>
+#include <functional>
+#include <ostream>
+#include <map>
+#include <cstddef>
+using namespace std;
+
+/*
+ * The number of memory allocations (calls to operator new) this program has
+ * made so far, and how many bytes they asked for. They are counted by the
+ * replacement operator new in Benchmark.cpp.
+ */
+unsigned long long getAllocationCount();
+unsigned long long getAllocatedBytes();
+
+/*
+ * The most physical memory this process has used at any one time so far,
+ * in bytes
+ */
+size_t getPeakResidentBytes();
+
+/*
+ * The measurements of one stage of the mesh pipeline on one model
+ */
+class BenchmarkResult
+{
+public:
+    BenchmarkResult()
+    {
+        bytes = vertices = 0;
+        iterations = 0;
+        bestSeconds = meanSeconds = 0;
+        allocations = allocatedBytes = 0;
+        peakResidentBytes = 0;
+    }
+
+    string stage;
+    string model;
+    //how much data one iteration processes, and how many vertices
+    size_t bytes;
+    size_t vertices;
+    int iterations;
+    //the fastest iteration, and the average of all of them
+    double bestSeconds,meanSeconds;
+    //per iteration
+    double allocations,allocatedBytes;
+    //of the whole process, after the stage
+    size_t peakResidentBytes;
+    //other figures a stage reports about its result, such as how good it
+    //is, printed after the measurements
+    map<string,double> figures;
+};
+
+/*
+ * Runs a piece of work repeatedly, timing each run, until it has run for a
+ * minimum time and a minimum number of times
+ */
+class Benchmark
+{
+public:
+    Benchmark(double minSeconds,int minIterations);
+
+    /*
+     * Measure one stage on one model
+     * \param setup run before every iteration, and not measured. May be empty
+     * \param work the work that is measured
+     */
+    BenchmarkResult run(const string& stage,
+                        const string& model,
+                        size_t bytes,
+                        size_t vertices,
+                        const function<void()>& setup,
+                        const function<void()>& work);
+
+    /*
+     * Write a result as one line of JSON, so that the output of a whole run
+     * can be compared with that of another by a script
+     */
+    static void print(ostream& out,const BenchmarkResult& result);
+
+private:
+    double minSeconds;
+    int minIterations;
+};
+
+#endif // BENCHMARK_H
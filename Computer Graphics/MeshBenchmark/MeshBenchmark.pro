@@ -0,0 +1,21 @@
+QT += core
+QT -= gui
+
+CONFIG += c++11
+
+TARGET = MeshBenchmark
+CONFIG += console
+CONFIG -= app_bundle
+
+TEMPLATE = app
+
+INCLUDEPATH += ../headers \
+    ../LightsAndTextures
+
+SOURCES += main.cpp \
+    Benchmark.cpp
+
+HEADERS += \
+    Benchmark.h
+
+win32: LIBS += -lpsapi
@@ -0,0 +1,1212 @@
+#include <QDir>
+#include <QFileInfo>
+#include <QStringList>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <set>
+#include <map>
+#include <cstdlib>
+#include <chrono>
+#include <random>
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include "Benchmark.h"
+#include "VertexAttrib.h"
+#include "PolygonMesh.h"
+#include "ObjImporter.h"
+#include "VertexInterleaver.h"
+#include "VertexPacker.h"
+#include "SoAPolygonMesh.h"
+#include "MeshRegistry.h"
+#include "OutOfCoreMesh.h"
+#include "NumberParser.h"
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/matrix_inverse.hpp>
+using namespace std;
+
+/*
+ * Measures the stages a mesh goes through between its OBJ file and the
+ * vertex buffer, on every model in a directory, without opening a window or
+ * using OpenGL:
+ *
+ * import      ObjImporter::importFile (bytes: the size of the file)
+ * registry    loading the file into a new MeshRegistry, as scenes do
+ * bounds      PolygonMesh::computeBoundingBox
+ * normals     PolygonMesh::computeNormals, with --threads threads. The
+ *             stages normals-area, normals-angle and normals-crease
+ *             weigh the polygons by area or angle, or split vertices at
+ *             a 60 degree crease
+ * transform   transforming the positions and normals by a matrix, and
+ *             finding the new bounding box
+ * interleave  packing the vertices as floats for a vertex buffer
+ * pack        packing the vertices in the compact VertexFormat, and the
+ *             indices, as ObjectInstance::initPolygonMesh does, reporting
+ *             the bytes a vertex and the indices take on the GPU
+ * vertex-cache
+ *             PolygonMesh::optimizeVertexCache, reporting the ACMR and ATVR
+ *             of the triangles before and after
+ * weld        PolygonMesh::weld, with --threads threads, reporting the
+ *             vertices and triangles before and after, and the vertices
+ *             welded and triangles removed
+ * strips      PolygonMesh::stripify, on the mesh after
+ *             PolygonMesh::optimizeVertexCache, reporting the indices and
+ *             index bytes of the strips and of the triangle list, and the
+ *             ACMR of both, and of strips made without a window
+ * simplify    PolygonMesh::buildLevelsOfDetail, making levels of a half, a
+ *             quarter and a tenth of the triangles, reporting the triangles
+ *             of each level and its error as a share of the diagonal of the
+ *             bounding box
+ * bvh         PolygonMesh::buildBVH, with --threads threads, reporting the
+ *             nodes and packs of triangles of the tree and the bytes they
+ *             take
+ * bvh-rays    MeshBVH::intersect, tracing 100000 rays from around the
+ *             bounding box to points inside it, reporting the rays a
+ *             second and how many hit, and the rays a second of testing
+ *             every triangle instead, and on how many of 1000 rays it finds
+ *             a different hit
+ * corner-table
+ *             PolygonMesh::buildCornerTable, reporting the time and bytes
+ *             it takes a triangle, the time going round the one-ring of
+ *             every vertex takes a vertex, and the border and non-manifold
+ *             edges and non-manifold vertices it finds
+ * edit        moving the 100 vertices nearest the first one with
+ *             PolygonMesh::setVertex, PolygonMesh::updateNormals, and
+ *             packing the dirty vertices with VertexPacker::packRange, as
+ *             ObjectInstance::updatePolygonMesh does, reporting the
+ *             vertices and bytes copied, and the time and bytes of
+ *             computing all the normals and packing all the vertices
+ *             instead
+ * out-of-core OutOfCoreMesh on a heightfield of --out-of-core-size squared
+ *             vertices, made on disk in --scratch a band of rows at a
+ *             time, with every band repeating the last row of the one
+ *             before so that there is something to weld. With
+ *             --memory-limit megabytes, it times finding the bounds,
+ *             computing the normals, welding and making a level of detail
+ *             of 256 cells across, reporting the bytes on disk, the most
+ *             working memory any step took and the vertices and triangles
+ *             of the results. As it writes several gigabytes, it is only
+ *             run when asked for, and not for every model
+ * numbers     NumberParser::parseFloat on a million coordinates written as
+ *             OBJ files write them, reporting the time strtof takes on the
+ *             same text. It first checks parseFloat against strtof on
+ *             edge cases and on random floats written with 6 to 9
+ *             significant digits, reporting how many strings it checked
+ *             and on how many the value or the characters read differ. Any
+ *             difference is printed to standard error and makes the exit
+ *             status 1. It is only run when asked for, and not for every
+ *             model
+ * import-check
+ *             ObjImporter::importBuffer on OBJ texts whose faces count back
+ *             with negative indices across the chunks the text is split
+ *             into, or past the start of the file, checking that 2, 3, 4
+ *             and 8 threads give the same mesh, or the same error, as one
+ *             thread. It reports how many imports it checked and how many
+ *             differ, and times the largest text with --threads threads.
+ *             Any difference is printed to standard error and makes the
+ *             exit status 1. It is only run when asked for, and not for
+ *             every model
+ *
+ * The stages bounds, normals, transform and interleave are each measured
+ * twice: on the mesh as a PolygonMesh (an array of vertex objects), and,
+ * under the stage's name with "-soa" appended, on the mesh as a
+ * SoAPolygonMesh (an array per component).
+ *
+ * For the stages after import, the bytes are those of the vertex attributes.
+ * Each result is printed to standard output as one line of JSON.
+ *
+ * Usage: MeshBenchmark [--models dir] [--min-time seconds]
+ *                      [--threads n] [--stage name]...
+ *                      [--out-of-core-size n] [--memory-limit megabytes]
+ *                      [--scratch dir]
+ */
+
+static void usage()
+{
+    cerr << "Usage: MeshBenchmark [--models dir] [--min-time seconds] "
+         << "[--threads n] [--stage name]... [--out-of-core-size n] "
+         << "[--memory-limit megabytes] [--scratch dir]" << endl;
+}
+
+/*
+ * The size of the vertex attributes of a mesh, in bytes
+ */
+template <class K>
+static size_t vertexBytes(const util::PolygonMesh<K>& mesh)
+{
+    const vector<K>& vertices = mesh.getVertexAttributesRef();
+    if (vertices.size()==0)
+        return 0;
+
+    K first = vertices[0];
+    vector<string> names = first.getAllAttributes();
+    size_t floats = 0;
+    for (unsigned int i=0;i<names.size();i++)
+        floats += first.getData(names[i]).size();
+    return vertices.size()*floats*sizeof(float);
+}
+
+/*
+ * The transform stage for a PolygonMesh, going through its vertices one at
+ * a time as SoAPolygonMesh::transform goes through its streams
+ */
+template <class K>
+static void transform(util::PolygonMesh<K>& mesh,const glm::mat4& m)
+{
+    vector<K> vertexData = mesh.getVertexAttributes();
+    util::VertexAccess<K> position("position"),normal("normal");
+    glm::mat3 n = glm::inverseTranspose(glm::mat3(m));
+    glm::vec4 minimum,maximum;
+
+    for (size_t i=0;i<vertexData.size();i++)
+    {
+        glm::vec4 p,q;
+
+        position.read(vertexData[i],&p.x);
+        normal.read(vertexData[i],&q.x);
+        p = m * p;
+        glm::vec3 t = n * glm::vec3(q);
+        if (glm::length(t)>0)
+            t = glm::normalize(t);
+        q = glm::vec4(t,q.w);
+        position.write(vertexData[i],&p.x,4);
+        normal.write(vertexData[i],&q.x,4);
+
+        if (i==0)
+            minimum = maximum = p;
+        minimum = glm::vec4(glm::min(glm::vec3(minimum),glm::vec3(p)),minimum.w);
+        maximum = glm::vec4(glm::max(glm::vec3(maximum),glm::vec3(p)),maximum.w);
+    }
+    mesh.setVertexData(std::move(vertexData),minimum,maximum);
+}
+
+/*
+ * The rays of the bvh-rays stage: from points around the bounding box of a
+ * mesh to points inside it, the same on every run
+ */
+static void makeRays(const glm::vec3& minimum,const glm::vec3& maximum,size_t count,
+                     vector<glm::vec3>& origins,vector<glm::vec3>& directions)
+{
+    mt19937 random(1);
+    uniform_real_distribution<float> unit(0.0f,1.0f);
+    glm::vec3 center = 0.5f*(minimum+maximum);
+    float radius = glm::length(maximum-minimum);
+
+    origins.resize(count);
+    directions.resize(count);
+    for (size_t i=0;i<count;i++)
+    {
+        glm::vec3 away(unit(random)-0.5f,unit(random)-0.5f,unit(random)-0.5f);
+        glm::vec3 target = minimum + (maximum-minimum)*glm::vec3(unit(random),unit(random),unit(random));
+
+        if (glm::length(away)==0)
+            away = glm::vec3(0,0,1);
+        origins[i] = center + radius*glm::normalize(away);
+        directions[i] = target-origins[i];
+    }
+}
+
+/*
+ * The nearest distance along a ray at which it hits a triangle, found by
+ * testing every triangle, to check MeshBVH::intersect against. Infinite if
+ * it hits none.
+ */
+static float intersectAll(const vector<glm::vec3>& positions,const vector<unsigned int>& indices,
+                          const glm::vec3& origin,const glm::vec3& direction)
+{
+    float nearest = numeric_limits<float>::infinity();
+
+    for (size_t t=0;t+2<indices.size();t+=3)
+    {
+        glm::vec3 a = positions[indices[t]];
+        glm::vec3 e1 = positions[indices[t+1]]-a;
+        glm::vec3 e2 = positions[indices[t+2]]-a;
+        glm::vec3 p = glm::cross(direction,e2);
+        float det = glm::dot(e1,p);
+
+        if (det==0)
+            continue;
+
+        glm::vec3 s = origin-a;
+        glm::vec3 q = glm::cross(s,e1);
+        float u = glm::dot(s,p)/det;
+        float v = glm::dot(direction,q)/det;
+        float distance = glm::dot(e2,q)/det;
+
+        if ((u>=0) && (v>=0) && (u+v<=1) && (distance>=0) && (distance<nearest))
+            nearest = distance;
+    }
+    return nearest;
+}
+
+/*
+ * The strings the numbers stage checks against strtof: edge cases, and
+ * random floats of every magnitude written with 6 to 9 significant digits
+ * (9 always reads back as the same float)
+ */
+static vector<string> numberCheckStrings()
+{
+    static const char *edges[] = {
+        "0","-0","+0",".5","5.","-.5e-3","1e","1e+","1e-","1.5E+3x","-",".","e5",
+        "3.4028235e38","3.4028236e38","3.40282357e38","1e39","-1e39","1e99999",
+        "1.17549435e-38","1.1754942e-38","1.4e-45","7e-46","7.1e-46","1e-46",
+        "1e-99999","0.000000000000000000000000000001",
+        "16777217","16777216.5","33554435","0.30000001192092896",
+        "1.00000005960464477539062499","1.00000005960464477539062501",
+        "1.000000059604644775390625","123456789012345678901234567890",
+        "0.1234567890123456789012345678901234567890e10",
+        "00000000000000000000000000000001.5","1.50000000000000000000000000000",
+        "inf","-inf","+INF","Infinity","-infinity","infinit","infx",
+        "nan","-NaN","nan()","nan(123)","NAN(abc_1)","nan(","nan(1","na","i"
+    };
+    vector<string> strings(edges,edges+sizeof(edges)/sizeof(edges[0]));
+    mt19937 random(1);
+    char text[64];
+
+    for (int i=0;i<250000;i++)
+    {
+        unsigned int bits = random();
+        float f;
+
+        memcpy(&f,&bits,sizeof(f));
+        if (!std::isfinite(f))
+            continue;
+        for (int digits=6;digits<=9;digits++)
+        {
+            snprintf(text,sizeof(text),"%.*g",digits,f);
+            strings.push_back(text);
+        }
+    }
+    return strings;
+}
+
+/*
+ * Check NumberParser::parseFloat against strtof, in the "C" locale
+ * \param mismatch set to the first string they differ on
+ * \return the number of strings they differ on
+ */
+static size_t checkNumbers(const vector<string>& strings,string& mismatch)
+{
+    size_t mismatches = 0;
+
+    for (size_t i=0;i<strings.size();i++)
+    {
+        const char *begin = strings[i].c_str();
+        const char *end = begin+strings[i].size();
+        char *expectedEnd;
+        float expected = strtof(begin,&expectedEnd);
+        float value;
+        const char *next = util::NumberParser::parseFloat(begin,end,value);
+        bool same = (next==expectedEnd)
+                && ((std::isnan(value) && std::isnan(expected))
+                    || (memcmp(&value,&expected,sizeof(value))==0));
+
+        if (!same)
+        {
+            if (mismatches==0)
+                mismatch = strings[i];
+            mismatches++;
+        }
+    }
+    return mismatches;
+}
+
+/*
+ * The texts of the import-check stage. The first, and largest, is valid.
+ */
+static vector<string> importCheckTexts()
+{
+    vector<string> texts;
+    char line[128];
+    string text;
+    int i;
+
+    //vertices, texture coordinates and normals throughout, with faces that
+    //reach back over hundreds of lines, and so into earlier chunks
+    for (i=0;i<20000;i++)
+    {
+        snprintf(line,sizeof(line),"v %d %d %d\nvt %d 0.5\nvn 0 %d 1\n",i,i%7,i%13,i%3,i%5);
+        text += line;
+        if (i>=500)
+        {
+            snprintf(line,sizeof(line),"f -1/-1/-1 -%d/-%d/-%d %d/%d/%d -500/-500/-500\n",
+                     2+i%400,2+i%400,2+i%400,i-300,i-300,i-300);
+            text += line;
+        }
+    }
+    texts.push_back(text);
+
+    //only vertices, and one face at the end that reaches back to the first
+    string vertices;
+    for (i=0;i<3000;i++)
+    {
+        snprintf(line,sizeof(line),"v %d 0 0\n",i);
+        vertices += line;
+    }
+    texts.push_back(vertices+"f -3000 -2999 -2998\n");
+    //...and that reaches back past the first vertex or texture coordinate
+    texts.push_back(vertices+"f -3001 -2999 -2998\n");
+    texts.push_back(vertices+"vt 0 0\nvt 1 0\nf -1/-1 -2/-2 -3/-3\n");
+    //an error on a later line than one that reaches back past the start
+    texts.push_back(vertices+"f -1 -2 -3001\nf 1 2\n");
+
+    //a face far from the vertices, with nothing but comments before them
+    text.clear();
+    for (i=0;i<3000;i++)
+        text += "# a comment\n";
+    texts.push_back(text+"v 0 0 0\nv 1 0 0\nf -1 -2 -3\n");
+    return texts;
+}
+
+/*
+ * Import an OBJ text, and write what came out as a string: the bytes of
+ * the vertices, indices and parts of the mesh, or the error
+ */
+static string importOutcome(const string& text,unsigned int threads)
+{
+    util::ObjImportOptions options;
+    util::PolygonMesh<VertexAttrib> mesh;
+    string outcome;
+
+    options.threads = threads;
+    try
+    {
+        mesh = util::ObjImporter<VertexAttrib>::importBuffer(text.data(),text.data()+text.size(),
+                                                             options);
+    }
+    catch (string& e)
+    {
+        return "error: "+e;
+    }
+
+    const vector<VertexAttrib>& vertices = mesh.getVertexAttributesRef();
+    for (size_t v=0;v<vertices.size();v++)
+    {
+        VertexAttrib vertex = vertices[v];
+        vector<string> names = vertex.getAllAttributes();
+        for (size_t n=0;n<names.size();n++)
+        {
+            vector<float> data = vertex.getData(names[n]);
+            outcome += names[n];
+            if (!data.empty())
+                outcome.append((const char *)&data[0],data.size()*sizeof(float));
+        }
+    }
+    vector<unsigned int> indices = mesh.getPrimitives();
+    if (!indices.empty())
+        outcome.append((const char *)&indices[0],indices.size()*sizeof(unsigned int));
+    const vector<util::SubMesh>& parts = mesh.getSubMeshesRef();
+    for (size_t p=0;p<parts.size();p++)
+    {
+        outcome.append((const char *)&parts[p].firstIndex,sizeof(unsigned int));
+        outcome.append((const char *)&parts[p].indexCount,sizeof(unsigned int));
+        outcome += parts[p].name+'\0'+parts[p].materialName+'\0';
+    }
+    return outcome;
+}
+
+/*
+ * The heightfield of the out-of-core stage: side by side vertices of
+ * waves, written a band of rows at a time. Every band starts with the last
+ * row of the band before, so the rows between bands are there twice.
+ */
+static void writeHeightfield(util::OutOfCoreMesh& mesh,unsigned int side)
+{
+    const unsigned int BAND = 64;
+    vector<glm::vec3> positions;
+    vector<glm::uvec3> triangles;
+    size_t first = 0;
+
+    mesh.clear();
+    for (unsigned int top=0;top+1<side;top+=BAND)
+    {
+        unsigned int rows = min(BAND,side-1-top)+1;
+
+        positions.clear();
+        triangles.clear();
+        for (unsigned int r=0;r<rows;r++)
+        {
+            for (unsigned int c=0;c<side;c++)
+            {
+                float x = (float)c/(side-1),z = (float)(top+r)/(side-1);
+
+                positions.push_back(glm::vec3(x,0.05f*sin(20*x)*cos(17*z)+0.01f*sin(150*x*z),z));
+            }
+        }
+        for (unsigned int r=0;r+1<rows;r++)
+        {
+            for (unsigned int c=0;c+1<side;c++)
+            {
+                unsigned int v = (unsigned int)(first+r*side+c);
+
+                triangles.push_back(glm::uvec3(v,v+side,v+1));
+                triangles.push_back(glm::uvec3(v+1,v+side,v+side+1));
+            }
+        }
+        mesh.addVertices(&positions[0],positions.size());
+        mesh.addTriangles(&triangles[0],triangles.size());
+        first += positions.size();
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    string models = "../LightsAndTextures/models";
+    double minTime = 0.25;
+    unsigned int threads = 1;
+    unsigned int outOfCoreSize = 8192;
+    size_t memoryLimit = 256;
+    string scratch = QDir::tempPath().toStdString();
+    set<string> stages;
+    int i;
+
+    for (i=1;i<argc;i++)
+    {
+        string arg = argv[i];
+
+        if ((arg=="--models") && (i+1<argc))
+            models = argv[++i];
+        else if ((arg=="--min-time") && (i+1<argc))
+            minTime = atof(argv[++i]);
+        else if ((arg=="--threads") && (i+1<argc))
+            threads = (unsigned int)atoi(argv[++i]);
+        else if ((arg=="--stage") && (i+1<argc))
+            stages.insert(argv[++i]);
+        else if ((arg=="--out-of-core-size") && (i+1<argc))
+            outOfCoreSize = max(atoi(argv[++i]),2);
+        else if ((arg=="--memory-limit") && (i+1<argc))
+            memoryLimit = (size_t)max(atoi(argv[++i]),1);
+        else if ((arg=="--scratch") && (i+1<argc))
+            scratch = argv[++i];
+        else
+        {
+            usage();
+            return 2;
+        }
+    }
+
+    Benchmark benchmark(minTime,3);
+    int failures = 0;
+    //the stages that are not run on the models
+    size_t standaloneStages = stages.count("out-of-core")+stages.count("numbers")
+            +stages.count("import-check");
+
+    if (stages.count("out-of-core"))
+    {
+        util::OutOfCoreOptions options;
+        options.memoryLimit = memoryLimit<<20;
+        util::OutOfCoreMesh mesh(scratch+"/MeshBenchmark-out-of-core",options);
+        BenchmarkResult result;
+        chrono::steady_clock::time_point start;
+        //the seconds since start, which is then reset
+        auto lap = [&]()
+        {
+            chrono::steady_clock::time_point now = chrono::steady_clock::now();
+            double seconds = chrono::duration<double>(now-start).count();
+            start = now;
+            return seconds;
+        };
+
+        try
+        {
+            start = chrono::steady_clock::now();
+            writeHeightfield(mesh,outOfCoreSize);
+            result.figures["write_seconds"] = lap();
+            result.figures["store_bytes"] = (double)(mesh.getVertexCount()*sizeof(glm::vec3)
+                                                     +mesh.getTriangleCount()*sizeof(glm::uvec3));
+            result.vertices = mesh.getVertexCount();
+            result.bytes = mesh.getVertexCount()*sizeof(glm::vec3);
+
+            mesh.getMinimumBounds();
+            result.figures["bounds_seconds"] = lap();
+            mesh.computeNormals();
+            result.figures["normals_seconds"] = lap();
+
+            util::WeldStats stats = mesh.weld();
+            result.figures["weld_seconds"] = lap();
+            result.figures["welded_vertices"] = (double)stats.verticesAfter;
+            result.figures["welded_triangles"] = (double)stats.trianglesAfter;
+
+            util::PolygonMesh<VertexAttrib> lod;
+            mesh.extractLevelOfDetail(256,lod);
+            result.figures["lod_seconds"] = lap();
+            result.figures["lod_vertices"] = (double)lod.getVertexCount();
+            result.figures["lod_triangles"] = (double)(lod.getPrimitives().size()/3);
+
+            result.stage = "out-of-core";
+            result.model = "heightfield";
+            result.iterations = 1;
+            result.bestSeconds = result.meanSeconds = result.figures["bounds_seconds"]
+                    +result.figures["normals_seconds"]+result.figures["weld_seconds"]
+                    +result.figures["lod_seconds"];
+            result.peakResidentBytes = getPeakResidentBytes();
+            result.figures["memory_limit"] = (double)options.memoryLimit;
+            result.figures["peak_working_bytes"] = (double)mesh.getPeakWorkingBytes();
+            Benchmark::print(cout,result);
+        }
+        catch (runtime_error& e)
+        {
+            cerr << "out-of-core: " << e.what() << endl;
+            mesh.clear();
+            return 1;
+        }
+        mesh.clear();
+    }
+
+    if (stages.count("numbers"))
+    {
+        vector<string> strings = numberCheckStrings();
+        string mismatch;
+        size_t mismatches = checkNumbers(strings,mismatch);
+
+        if (mismatches>0)
+        {
+            cerr << "numbers: parseFloat and strtof differ on " << mismatches
+                 << " strings, the first being \"" << mismatch << "\"" << endl;
+            failures++;
+        }
+
+        //coordinates as OBJ files write them, separated by spaces
+        const size_t COUNT = 1000000;
+        mt19937 random(2);
+        uniform_real_distribution<float> coordinate(-100.0f,100.0f);
+        string text;
+        char number[32];
+        for (size_t n=0;n<COUNT;n++)
+        {
+            snprintf(number,sizeof(number),"%.6f ",coordinate(random));
+            text += number;
+        }
+
+        float sum = 0;
+        const char *begin = text.c_str();
+        const char *end = begin+text.size();
+        BenchmarkResult result = benchmark.run("numbers","coordinates",text.size(),COUNT,
+                                               function<void()>(),
+                                               [&]()
+        {
+            float value;
+
+            sum = 0;
+            for (const char *p=begin;p<end;p++)
+            {
+                p = util::NumberParser::parseFloat(p,end,value);
+                sum += value;
+            }
+        });
+        float strtofSum = 0;
+        BenchmarkResult strtofResult = benchmark.run("numbers","coordinates",text.size(),COUNT,
+                                                     function<void()>(),
+                                                     [&]()
+        {
+            char *p = (char *)begin;
+
+            strtofSum = 0;
+            while (p<end)
+            {
+                strtofSum += strtof(p,&p);
+                p++;
+            }
+        });
+
+        result.figures["checked"] = (double)strings.size();
+        result.figures["mismatches"] = (double)mismatches;
+        result.figures["strtof_seconds"] = strtofResult.bestSeconds;
+        result.figures["speedup"] = (result.bestSeconds>0)?strtofResult.bestSeconds/result.bestSeconds:0;
+        result.figures["sums_differ"] = (sum!=strtofSum)?1:0;
+        Benchmark::print(cout,result);
+    }
+
+    if (stages.count("import-check"))
+    {
+        vector<string> texts = importCheckTexts();
+        static const unsigned int checkThreads[] = {2,3,4,8};
+        size_t checked = 0,mismatches = 0;
+
+        for (size_t t=0;t<texts.size();t++)
+        {
+            string serial = importOutcome(texts[t],1);
+
+            if ((t==0) && (serial.compare(0,7,"error: ")==0))
+            {
+                cerr << "import-check: text " << t << " does not load: " << serial << endl;
+                failures++;
+            }
+            for (size_t n=0;n<sizeof(checkThreads)/sizeof(checkThreads[0]);n++)
+            {
+                string parallel = importOutcome(texts[t],checkThreads[n]);
+
+                checked++;
+                if (parallel!=serial)
+                {
+                    cerr << "import-check: text " << t << " comes out differently with "
+                         << checkThreads[n] << " threads than with one";
+                    if (parallel.compare(0,7,"error: ")==0)
+                        cerr << " (" << parallel << ")";
+                    cerr << endl;
+                    mismatches++;
+                    failures++;
+                }
+            }
+        }
+
+        util::ObjImportOptions options;
+        util::PolygonMesh<VertexAttrib> imported;
+        const string& text = texts[0];
+
+        options.threads = threads;
+        BenchmarkResult result = benchmark.run("import-check","relative-indices",text.size(),0,
+                                               function<void()>(),
+                                               [&]()
+        {
+            imported = util::ObjImporter<VertexAttrib>::importBuffer(text.data(),
+                                                                     text.data()+text.size(),
+                                                                     options);
+        });
+        result.vertices = imported.getVertexCount();
+        result.figures["checked"] = (double)checked;
+        result.figures["mismatches"] = (double)mismatches;
+        Benchmark::print(cout,result);
+    }
+
+    if (!stages.empty() && (stages.size()==standaloneStages))
+        return (failures>0)?1:0;
+
+    QDir dir(QString::fromStdString(models));
+    QStringList files = dir.entryList(QStringList() << "*.obj",QDir::Files,QDir::Name);
+    if (files.size()==0)
+    {
+        cerr << "No OBJ files found in " << models << endl;
+        return 1;
+    }
+
+    map<string,string> shaderVarsToAttributeNames;
+
+    shaderVarsToAttributeNames["vPosition"] = "position";
+    shaderVarsToAttributeNames["vNormal"] = "normal";
+    shaderVarsToAttributeNames["vTexCoord"] = "texcoord";
+
+    glm::mat4 transformation = glm::rotate(glm::translate(glm::mat4(1.0f),glm::vec3(1,2,3)),
+                                           0.5f,glm::vec3(0,1,0))
+            * glm::scale(glm::mat4(1.0f),glm::vec3(2,1,0.5f));
+
+    for (i=0;i<files.size();i++)
+    {
+        string model = files[i].toStdString();
+        string path = dir.filePath(files[i]).toStdString();
+        size_t fileBytes = (size_t)QFileInfo(dir.filePath(files[i])).size();
+        util::ObjImportOptions options;
+        util::PolygonMesh<VertexAttrib> mesh;
+
+        options.threads = threads;
+        try
+        {
+            //the later stages work on this mesh, so it is made even if the
+            //import stage is not measured
+            mesh = util::ObjImporter<VertexAttrib>::importFile(path,options);
+        }
+        catch (string& e)
+        {
+            cerr << model << ": " << e << endl;
+            failures++;
+            continue;
+        }
+
+        size_t vertices = mesh.getVertexCount();
+        size_t bytes = vertexBytes(mesh);
+
+        if (stages.empty() || stages.count("import"))
+        {
+            util::PolygonMesh<VertexAttrib> imported;
+            Benchmark::print(cout,benchmark.run("import",model,fileBytes,vertices,
+                                                function<void()>(),
+                                                [&]()
+            {
+                imported = util::ObjImporter<VertexAttrib>::importFile(path,options);
+            }));
+        }
+
+        if (stages.empty() || stages.count("registry"))
+        {
+            Benchmark::print(cout,benchmark.run("registry",model,fileBytes,vertices,
+                                                function<void()>(),
+                                                [&]()
+            {
+                util::MeshRegistry<VertexAttrib> registry;
+                registry.load(path,options);
+            }));
+        }
+
+        util::SoAPolygonMesh soa(mesh);
+
+        if (stages.empty() || stages.count("bounds"))
+        {
+            Benchmark::print(cout,benchmark.run("bounds",model,bytes,vertices,
+                                                function<void()>(),
+                                                [&]()
+            {
+                mesh.computeBoundingBox();
+            }));
+        }
+
+        if (stages.empty() || stages.count("bounds-soa"))
+        {
+            Benchmark::print(cout,benchmark.run("bounds-soa",model,bytes,vertices,
+                                                function<void()>(),
+                                                [&]()
+            {
+                soa.computeBoundingBox();
+            }));
+        }
+
+        const char *normalStages[] = {"normals","normals-area","normals-angle","normals-crease"};
+        for (int n=0;n<4;n++)
+        {
+            if (!stages.empty() && !stages.count(normalStages[n]))
+                continue;
+
+            util::PolygonMesh<VertexAttrib> copy;
+            util::NormalOptions normalOptions;
+
+            normalOptions.threads = threads;
+            if (n==1)
+                normalOptions.weighting = util::NormalOptions::AREA;
+            else if (n>=2)
+                normalOptions.weighting = util::NormalOptions::ANGLE;
+            if (n==3)
+                normalOptions.creaseAngle = 60;
+            Benchmark::print(cout,benchmark.run(normalStages[n],model,bytes,vertices,
+                                                [&]()
+            {
+                copy = mesh;
+            },
+                                                [&]()
+            {
+                copy.computeNormals(normalOptions);
+            }));
+        }
+
+        if (stages.empty() || stages.count("normals-soa"))
+        {
+            util::SoAPolygonMesh copy;
+            Benchmark::print(cout,benchmark.run("normals-soa",model,bytes,vertices,
+                                                [&]()
+            {
+                copy = soa;
+            },
+                                                [&]()
+            {
+                copy.computeNormals();
+            }));
+        }
+
+        if (stages.empty() || stages.count("transform"))
+        {
+            util::PolygonMesh<VertexAttrib> copy;
+            Benchmark::print(cout,benchmark.run("transform",model,bytes,vertices,
+                                                [&]()
+            {
+                copy = mesh;
+            },
+                                                [&]()
+            {
+                transform(copy,transformation);
+            }));
+        }
+
+        if (stages.empty() || stages.count("transform-soa"))
+        {
+            util::SoAPolygonMesh copy;
+            Benchmark::print(cout,benchmark.run("transform-soa",model,bytes,vertices,
+                                                [&]()
+            {
+                copy = soa;
+            },
+                                                [&]()
+            {
+                copy.transform(transformation);
+            }));
+        }
+
+        if (stages.empty() || stages.count("interleave"))
+        {
+            util::InterleavedVertices interleaved;
+            Benchmark::print(cout,benchmark.run("interleave",model,bytes,vertices,
+                                                function<void()>(),
+                                                [&]()
+            {
+                util::VertexInterleaver::interleave(mesh,shaderVarsToAttributeNames,interleaved);
+            }));
+        }
+
+        if (stages.empty() || stages.count("interleave-soa"))
+        {
+            util::InterleavedVertices interleaved;
+            Benchmark::print(cout,benchmark.run("interleave-soa",model,bytes,vertices,
+                                                function<void()>(),
+                                                [&]()
+            {
+                util::VertexInterleaver::interleave(soa,shaderVarsToAttributeNames,interleaved);
+            }));
+        }
+
+        if (stages.empty() || stages.count("pack"))
+        {
+            util::PackedVertices packed;
+            vector<unsigned char> indices;
+            BenchmarkResult result = benchmark.run("pack",model,bytes,vertices,
+                                                   function<void()>(),
+                                                   [&]()
+            {
+                util::VertexPacker::pack(mesh,shaderVarsToAttributeNames,
+                                         util::VertexFormat::compact(),packed);
+                util::VertexPacker::packIndices(mesh.getPrimitivesRef(),vertices,indices);
+            });
+
+            result.figures["vertex_bytes"] = (double)packed.data.size();
+            result.figures["bytes_per_vertex"] = packed.bytesPerVertex;
+            result.figures["index_bytes"] = (double)indices.size();
+            result.figures["unpacked_bytes"] = (double)(bytes + mesh.getPrimitivesRef().size()*sizeof(unsigned int));
+            Benchmark::print(cout,result);
+        }
+
+        if (stages.empty() || stages.count("vertex-cache"))
+        {
+            util::PolygonMesh<VertexAttrib> copy;
+            BenchmarkResult result = benchmark.run("vertex-cache",model,bytes,vertices,
+                                                   [&]()
+            {
+                copy = mesh;
+            },
+                                                   [&]()
+            {
+                copy.optimizeVertexCache();
+            });
+            util::VertexCacheStats before = mesh.getVertexCacheStats();
+            util::VertexCacheStats after = copy.getVertexCacheStats();
+
+            result.figures["acmr_before"] = before.acmr;
+            result.figures["acmr_after"] = after.acmr;
+            result.figures["atvr_before"] = before.atvr;
+            result.figures["atvr_after"] = after.atvr;
+            Benchmark::print(cout,result);
+        }
+
+        if (stages.empty() || stages.count("weld"))
+        {
+            util::PolygonMesh<VertexAttrib> copy;
+            util::WeldOptions weldOptions;
+            util::WeldStats weldStats;
+
+            weldOptions.threads = threads;
+            BenchmarkResult result = benchmark.run("weld",model,bytes,vertices,
+                                                   [&]()
+            {
+                copy = mesh;
+            },
+                                                   [&]()
+            {
+                weldStats = copy.weld(weldOptions);
+            });
+
+            result.figures["vertices_before"] = (double)weldStats.verticesBefore;
+            result.figures["vertices_after"] = (double)weldStats.verticesAfter;
+            result.figures["triangles_before"] = (double)weldStats.trianglesBefore;
+            result.figures["triangles_after"] = (double)weldStats.trianglesAfter;
+            result.figures["welded_vertices"] = (double)weldStats.weldedVertices;
+            result.figures["unused_vertices"] = (double)weldStats.unusedVertices;
+            result.figures["degenerate_triangles"] = (double)weldStats.degenerateTriangles;
+            result.figures["duplicate_triangles"] = (double)weldStats.duplicateTriangles;
+            Benchmark::print(cout,result);
+        }
+
+        if (stages.empty() || stages.count("strips"))
+        {
+            util::PolygonMesh<VertexAttrib> list = mesh;
+            util::PolygonMesh<VertexAttrib> copy;
+            vector<unsigned char> listIndices,stripIndices;
+
+            //strips are made from a list already ordered for the vertex
+            //cache, as the importer makes them
+            list.optimizeVertexCache();
+            BenchmarkResult result = benchmark.run("strips",model,bytes,vertices,
+                                                   [&]()
+            {
+                copy = list;
+            },
+                                                   [&]()
+            {
+                copy.stripify();
+            });
+
+            const vector<unsigned int>& strips = copy.getPrimitivesRef();
+            vector<unsigned int> triangles;
+            util::Stripifier::unstripify(strips.empty()?NULL:&strips[0],strips.size(),triangles);
+            util::VertexCacheStats stripCache = util::VertexCache::measure(triangles.empty()?NULL:&triangles[0],
+                                                                           triangles.size(),vertices);
+            util::VertexPacker::packIndices(list.getPrimitivesRef(),vertices,listIndices);
+            util::VertexPacker::packIndices(strips,vertices,stripIndices);
+
+            result.figures["list_indices"] = (double)list.getPrimitivesRef().size();
+            result.figures["strip_indices"] = (double)strips.size();
+            result.figures["strips"] = (double)(count(strips.begin(),strips.end(),
+                                                      (unsigned int)util::Stripifier::RESTART_INDEX)
+                                                + (strips.empty()?0:1));
+            result.figures["list_index_bytes"] = (double)listIndices.size();
+            result.figures["strip_index_bytes"] = (double)stripIndices.size();
+            result.figures["acmr_list"] = list.getVertexCacheStats().acmr;
+            result.figures["acmr_strips"] = stripCache.acmr;
+
+            //strips as long as they can be, without the window
+            util::PolygonMesh<VertexAttrib> longest = list;
+            longest.stripify(0);
+            triangles.clear();
+            const vector<unsigned int>& longestStrips = longest.getPrimitivesRef();
+            util::Stripifier::unstripify(longestStrips.empty()?NULL:&longestStrips[0],
+                                         longestStrips.size(),triangles);
+            result.figures["unlimited_strip_indices"] = longest.getPrimitiveCount();
+            result.figures["acmr_unlimited_strips"] = util::VertexCache::measure(triangles.empty()?NULL:&triangles[0],
+                                                                                 triangles.size(),vertices).acmr;
+            Benchmark::print(cout,result);
+        }
+
+        if (stages.empty() || stages.count("simplify"))
+        {
+            vector<float> ratios;
+            vector<util::PolygonMesh<VertexAttrib> > levels;
+            vector<float> errors;
+
+            ratios.push_back(0.5f);
+            ratios.push_back(0.25f);
+            ratios.push_back(0.1f);
+            BenchmarkResult result = benchmark.run("simplify",model,bytes,vertices,
+                                                   function<void()>(),
+                                                   [&]()
+            {
+                mesh.buildLevelsOfDetail(ratios,levels,errors);
+            });
+            float diagonal = glm::length(glm::vec3(mesh.getMaximumBounds()-mesh.getMinimumBounds()));
+
+            for (unsigned int l=0;l<levels.size();l++)
+            {
+                string level = "level" + to_string(l);
+
+                result.figures[level+"_triangles"] = (double)levels[l].getPrimitivesRef().size()/3;
+                result.figures[level+"_error"] = (diagonal>0)?errors[l]/diagonal:0;
+            }
+            Benchmark::print(cout,result);
+        }
+
+        if (stages.empty() || stages.count("bvh"))
+        {
+            util::MeshBVH bvh;
+            BenchmarkResult result = benchmark.run("bvh",model,bytes,vertices,
+                                                   function<void()>(),
+                                                   [&]()
+            {
+                mesh.buildBVH(bvh,threads);
+            });
+
+            result.figures["triangles"] = (double)bvh.getTriangleCount();
+            result.figures["nodes"] = (double)bvh.getNodeCount();
+            result.figures["packs"] = (double)bvh.getPackCount();
+            result.figures["bvh_bytes"] = (double)bvh.getMemoryBytes();
+            Benchmark::print(cout,result);
+        }
+
+        if (stages.empty() || stages.count("bvh-rays"))
+        {
+            const size_t RAYS = 100000,CHECKED_RAYS = 1000;
+            util::MeshBVH bvh;
+            vector<glm::vec3> origins,directions;
+            size_t hits = 0;
+
+            mesh.buildBVH(bvh,threads);
+            makeRays(glm::vec3(mesh.getMinimumBounds()),glm::vec3(mesh.getMaximumBounds()),
+                     RAYS,origins,directions);
+            BenchmarkResult result = benchmark.run("bvh-rays",model,bytes,vertices,
+                                                   function<void()>(),
+                                                   [&]()
+            {
+                hits = 0;
+                for (size_t r=0;r<RAYS;r++)
+                {
+                    util::RayHit hit;
+                    if (bvh.intersect(origins[r],directions[r],hit))
+                        hits++;
+                }
+            });
+
+            //the same rays, testing every triangle
+            vector<glm::vec3> positions(vertices);
+            util::VertexAccess<VertexAttrib> position("position");
+            for (size_t v=0;v<vertices;v++)
+            {
+                glm::vec4 p;
+                position.read(mesh.getVertexAttributesRef()[v],&p.x);
+                positions[v] = glm::vec3(p);
+            }
+            size_t mismatches = 0;
+            chrono::steady_clock::time_point start = chrono::steady_clock::now();
+            for (size_t r=0;r<CHECKED_RAYS;r++)
+            {
+                util::RayHit hit;
+                float nearest = intersectAll(positions,mesh.getPrimitivesRef(),origins[r],directions[r]);
+
+                if (!bvh.intersect(origins[r],directions[r],hit))
+                    hit.distance = numeric_limits<float>::infinity();
+                if ((hit.distance!=nearest) && !(fabs(hit.distance-nearest)<=1e-5f*nearest))
+                    mismatches++;
+            }
+            double seconds = chrono::duration<double>(chrono::steady_clock::now()-start).count();
+
+            result.figures["rays"] = (double)RAYS;
+            result.figures["rays_per_second"] = (result.bestSeconds>0)?RAYS/result.bestSeconds:0;
+            result.figures["hits"] = (double)hits;
+            result.figures["brute_force_rays_per_second"] = (seconds>0)?CHECKED_RAYS/seconds:0;
+            result.figures["mismatches"] = (double)mismatches;
+            Benchmark::print(cout,result);
+        }
+
+        if (stages.empty() || stages.count("corner-table"))
+        {
+            util::CornerTable table;
+            BenchmarkResult result = benchmark.run("corner-table",model,bytes,vertices,
+                                                   function<void()>(),
+                                                   [&]()
+            {
+                mesh.buildCornerTable(table);
+            });
+
+            //going round every vertex, a few times to time it
+            const int RINGS = 10;
+            size_t neighbours = 0;
+            chrono::steady_clock::time_point start = chrono::steady_clock::now();
+            for (int r=0;r<RINGS;r++)
+            {
+                for (unsigned int v=0;v<table.getVertexCount();v++)
+                {
+                    table.forEachNeighbour(v,[&](unsigned int)
+                    {
+                        neighbours++;
+                    });
+                }
+            }
+            double seconds = chrono::duration<double>(chrono::steady_clock::now()-start).count();
+            size_t triangles = max<size_t>(table.getTriangleCount(),1);
+
+            result.figures["ns_per_triangle"] = result.bestSeconds*1e9/triangles;
+            result.figures["bytes_per_triangle"] = (double)table.getMemoryBytes()/triangles;
+            result.figures["one_ring_ns_per_vertex"] = seconds*1e9/max<size_t>(RINGS*table.getVertexCount(),1);
+            result.figures["mean_valence"] = (double)neighbours/max<size_t>(RINGS*table.getVertexCount(),1);
+            result.figures["border_edges"] = (double)table.getBorderEdgeCount();
+            result.figures["non_manifold_edges"] = (double)table.getNonManifoldEdgeCount();
+            result.figures["non_manifold_vertices"] = (double)table.getNonManifoldVertexCount();
+            result.figures["degenerate_triangles"] = (double)table.getDegenerateTriangleCount();
+            Benchmark::print(cout,result);
+        }
+
+        if (stages.empty() || stages.count("edit"))
+        {
+            const size_t EDITED = 100;
+            const vector<VertexAttrib>& original = mesh.getVertexAttributesRef();
+            util::PolygonMesh<VertexAttrib> copy;
+            util::PackedVertices layout;
+            vector<unsigned char> upload;
+
+            //the vertices nearest the first one, moved along their normals,
+            //as a brush would move them
+            vector<pair<float,unsigned int> > nearest;
+            vector<VertexAttrib> moved;
+            glm::vec3 diagonal(mesh.getMaximumBounds()-mesh.getMinimumBounds());
+            if (!original.empty())
+            {
+                VertexAttrib first = original[0];
+                vector<float> center = first.getData("position");
+
+                for (unsigned int v=0;v<original.size();v++)
+                {
+                    VertexAttrib a = original[v];
+                    vector<float> p = a.getData("position");
+                    glm::vec3 d(p[0]-center[0],p[1]-center[1],p[2]-center[2]);
+
+                    nearest.push_back(make_pair(glm::dot(d,d),v));
+                }
+                size_t count = min(EDITED,nearest.size());
+                partial_sort(nearest.begin(),nearest.begin()+count,nearest.end());
+                nearest.resize(count);
+                for (size_t i=0;i<count;i++)
+                {
+                    VertexAttrib a = original[nearest[i].second];
+                    vector<float> p = a.getData("position");
+                    vector<float> n = a.getData("normal");
+
+                    for (int c=0;c<3;c++)
+                        p[c] += 0.01f*glm::length(diagonal)*n[c];
+                    a.setData("position",p);
+                    moved.push_back(a);
+                }
+            }
+            util::VertexPacker::pack(mesh,shaderVarsToAttributeNames,
+                                     util::VertexFormat::compact(),layout);
+
+            size_t uploadBytes = 0;
+            BenchmarkResult result = benchmark.run("edit",model,bytes,vertices,
+                                                   [&]()
+            {
+                copy = mesh;
+                copy.clearDirtyRanges();
+            },
+                                                   [&]()
+            {
+                for (size_t i=0;i<moved.size();i++)
+                    copy.setVertex(nearest[i].second,moved[i]);
+                copy.updateNormals();
+
+                const vector<util::DirtyRange>& ranges = copy.getDirtyVertices().getRanges();
+                uploadBytes = 0;
+                for (size_t r=0;r<ranges.size();r++)
+                {
+                    upload.resize(ranges[r].count*layout.bytesPerVertex);
+                    if (!upload.empty())
+                        util::VertexPacker::packRange(copy,shaderVarsToAttributeNames,layout,
+                                                      ranges[r].first,ranges[r].count,&upload[0]);
+                    uploadBytes += upload.size();
+                }
+            });
+
+            size_t dirtyVertices = copy.getDirtyVertices().getCount();
+            size_t dirtyRanges = copy.getDirtyVertices().getRanges().size();
+
+            //doing it all again instead, the best of a few times
+            double fullSeconds = 0;
+            util::PackedVertices full;
+            for (int i=0;i<5;i++)
+            {
+                copy = mesh;
+                for (size_t m=0;m<moved.size();m++)
+                    copy.setVertex(nearest[m].second,moved[m]);
+
+                chrono::steady_clock::time_point start = chrono::steady_clock::now();
+                copy.computeNormals();
+                util::VertexPacker::pack(copy,shaderVarsToAttributeNames,
+                                         util::VertexFormat::compact(),full);
+                double seconds = chrono::duration<double>(chrono::steady_clock::now()-start).count();
+                if ((i==0) || (seconds<fullSeconds))
+                    fullSeconds = seconds;
+            }
+
+            result.figures["edited_vertices"] = (double)moved.size();
+            result.figures["dirty_vertices"] = (double)dirtyVertices;
+            result.figures["dirty_ranges"] = (double)dirtyRanges;
+            result.figures["upload_bytes"] = (double)uploadBytes;
+            result.figures["full_upload_bytes"] = (double)full.data.size();
+            result.figures["full_seconds"] = fullSeconds;
+            result.figures["speedup"] = (result.bestSeconds>0)?fullSeconds/result.bestSeconds:0;
+            Benchmark::print(cout,result);
+        }
+    }
+
+    return (failures>0)?1:0;
+}
@@ -0,0 +1,247 @@
+#ifndef _AFFINETRANSFORM_H_
+#define _AFFINETRANSFORM_H_
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+//SSE is always there on x86-64, and on 32-bit x86 when compiled for it
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP>=1))
+#define AFFINETRANSFORM_SSE
+#include <xmmintrin.h>
+#endif
+
+namespace util
+{
+
+/*
+ * A transform made of a linear part and a translation, as every modeling
+ * and viewing transform is: a 4x4 matrix whose last row is (0,0,0,1).
+ * Only the other three rows are stored, a row each (the linear part and
+ * then the translation), so it takes 48 bytes instead of 64, and
+ * multiplying two of them takes three rows of SSE multiplies and adds
+ * instead of four columns.
+ *
+ * As the last row is known, the inverse and the matrix for normals only
+ * need the inverse of the 3x3 linear part, which is its cofactors over its
+ * determinant, instead of a general 4x4 inverse.
+ */
+class AffineTransform
+{
+public:
+    /*
+     * The identity
+     */
+    AffineTransform()
+    {
+        for (int i=0;i<3;i++)
+        {
+            for (int j=0;j<4;j++)
+                rows[i][j] = (i==j)?1.0f:0.0f;
+        }
+    }
+
+    /*
+     * The affine part of a 4x4 matrix. Its last row is dropped, so it must
+     * be (0,0,0,1) for the two to be the same transform.
+     */
+    explicit AffineTransform(const glm::mat4& m)
+    {
+        //glm matrices are indexed by column, then row
+        for (int i=0;i<3;i++)
+        {
+            for (int j=0;j<4;j++)
+                rows[i][j] = m[j][i];
+        }
+    }
+
+    glm::mat4 toMat4() const
+    {
+        glm::mat4 m(1.0f);
+
+        for (int i=0;i<3;i++)
+        {
+            for (int j=0;j<4;j++)
+                m[j][i] = rows[i][j];
+        }
+        return m;
+    }
+
+    static AffineTransform translate(const glm::vec3& by)
+    {
+        AffineTransform t;
+
+        t.rows[0][3] = by.x;
+        t.rows[1][3] = by.y;
+        t.rows[2][3] = by.z;
+        return t;
+    }
+
+    static AffineTransform scale(const glm::vec3& by)
+    {
+        AffineTransform t;
+
+        t.rows[0][0] = by.x;
+        t.rows[1][1] = by.y;
+        t.rows[2][2] = by.z;
+        return t;
+    }
+
+    /*
+     * A rotation about an axis through the origin, as glm::rotate makes it
+     * \param angle the angle in radians
+     */
+    static AffineTransform rotate(float angle,const glm::vec3& axis)
+    {
+        return AffineTransform(glm::rotate(glm::mat4(1.0f),angle,axis));
+    }
+
+    /*
+     * This transform after another: the product this * other, which applies
+     * other first
+     */
+    AffineTransform operator*(const AffineTransform& other) const
+    {
+        AffineTransform product;
+
+#ifdef AFFINETRANSFORM_SSE
+        //every row of the product is a weighted sum of the rows of other,
+        //and of its implied last row for the translation
+        __m128 r0 = _mm_loadu_ps(other.rows[0]);
+        __m128 r1 = _mm_loadu_ps(other.rows[1]);
+        __m128 r2 = _mm_loadu_ps(other.rows[2]);
+        __m128 r3 = _mm_set_ps(1.0f,0.0f,0.0f,0.0f);
+
+        for (int i=0;i<3;i++)
+        {
+            __m128 row = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(rows[i][0]),r0),
+                                               _mm_mul_ps(_mm_set1_ps(rows[i][1]),r1)),
+                                    _mm_add_ps(_mm_mul_ps(_mm_set1_ps(rows[i][2]),r2),
+                                               _mm_mul_ps(_mm_set1_ps(rows[i][3]),r3)));
+            _mm_storeu_ps(product.rows[i],row);
+        }
+#else
+        for (int i=0;i<3;i++)
+        {
+            for (int j=0;j<4;j++)
+                product.rows[i][j] = rows[i][0]*other.rows[0][j]
+                        + rows[i][1]*other.rows[1][j]
+                        + rows[i][2]*other.rows[2][j];
+            product.rows[i][3] += rows[i][3];
+        }
+#endif
+        return product;
+    }
+
+    AffineTransform& operator*=(const AffineTransform& other)
+    {
+        *this = *this * other;
+        return *this;
+    }
+
+    glm::vec3 transformPoint(const glm::vec3& p) const
+    {
+        return glm::vec3(rows[0][0]*p.x + rows[0][1]*p.y + rows[0][2]*p.z + rows[0][3],
+                         rows[1][0]*p.x + rows[1][1]*p.y + rows[1][2]*p.z + rows[1][3],
+                         rows[2][0]*p.x + rows[2][1]*p.y + rows[2][2]*p.z + rows[2][3]);
+    }
+
+    /*
+     * A direction, which the translation does not move. Normals need the
+     * normal matrix instead.
+     */
+    glm::vec3 transformVector(const glm::vec3& v) const
+    {
+        return glm::vec3(rows[0][0]*v.x + rows[0][1]*v.y + rows[0][2]*v.z,
+                         rows[1][0]*v.x + rows[1][1]*v.y + rows[1][2]*v.z,
+                         rows[2][0]*v.x + rows[2][1]*v.y + rows[2][2]*v.z);
+    }
+
+    /*
+     * The inverse of this transform. If the linear part cannot be inverted
+     * (it flattens space), the result is not finite, as with glm::inverse.
+     */
+    AffineTransform inverse() const
+    {
+        glm::mat3 n = normalMatrix();
+        AffineTransform inverse;
+        glm::vec3 t(rows[0][3],rows[1][3],rows[2][3]);
+
+        //the inverse of the linear part is the transpose of the normal
+        //matrix, and it takes the translation back
+        for (int i=0;i<3;i++)
+        {
+            for (int j=0;j<3;j++)
+                inverse.rows[i][j] = n[i][j];
+            inverse.rows[i][3] = -glm::dot(n[i],t);
+        }
+        return inverse;
+    }
+
+    /*
+     * The matrix that transforms normals as this transforms the surfaces
+     * they are normal to: the inverse transpose of the linear part. Its
+     * columns are the cross products of the columns of the linear part,
+     * over its determinant.
+     */
+    glm::mat3 normalMatrix() const
+    {
+        glm::vec3 c0(rows[0][0],rows[1][0],rows[2][0]);
+        glm::vec3 c1(rows[0][1],rows[1][1],rows[2][1]);
+        glm::vec3 c2(rows[0][2],rows[1][2],rows[2][2]);
+        glm::vec3 n0 = glm::cross(c1,c2),n1 = glm::cross(c2,c0),n2 = glm::cross(c0,c1);
+        float inverseDeterminant = 1.0f/glm::dot(c0,n0);
+
+        return glm::mat3(n0*inverseDeterminant,n1*inverseDeterminant,n2*inverseDeterminant);
+    }
+
+    /*
+     * The element in a row (0-2) and column (0-3, the last being the
+     * translation)
+     */
+    float get(int row,int column) const
+    {
+        return rows[row][column];
+    }
+
+private:
+    float rows[3][4];
+};
+
+/*
+ * A 4x4 matrix, such as a projection or a modelview that may not be
+ * affine, times an affine transform. Only the first three columns of the
+ * matrix are weighed for every column of the product, and the last one
+ * added to the last.
+ */
+inline glm::mat4 operator*(const glm::mat4& m,const AffineTransform& a)
+{
+    glm::mat4 product;
+
+#ifdef AFFINETRANSFORM_SSE
+    __m128 c0 = _mm_loadu_ps(&m[0][0]);
+    __m128 c1 = _mm_loadu_ps(&m[1][0]);
+    __m128 c2 = _mm_loadu_ps(&m[2][0]);
+
+    for (int j=0;j<4;j++)
+    {
+        __m128 column = _mm_add_ps(_mm_add_ps(_mm_mul_ps(c0,_mm_set1_ps(a.get(0,j))),
+                                              _mm_mul_ps(c1,_mm_set1_ps(a.get(1,j)))),
+                                   _mm_mul_ps(c2,_mm_set1_ps(a.get(2,j))));
+        if (j==3)
+            column = _mm_add_ps(column,_mm_loadu_ps(&m[3][0]));
+        _mm_storeu_ps(&product[j][0],column);
+    }
+#else
+    for (int j=0;j<4;j++)
+    {
+        product[j] = m[0]*a.get(0,j) + m[1]*a.get(1,j) + m[2]*a.get(2,j);
+        if (j==3)
+            product[j] += m[3];
+    }
+#endif
+    return product;
+}
+
+}
+
+#endif
@@ -0,0 +1,482 @@
+#ifndef _BOUNDINGVOLUMES_H_
+#define _BOUNDINGVOLUMES_H_
+
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <cmath>
+#include <limits>
+
+//SSE2 is always there on x86-64, and on 32-bit x86 when compiled for it
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP>=2))
+#define BOUNDINGVOLUMES_SSE
+#include <emmintrin.h>
+#endif
+#if defined(BOUNDINGVOLUMES_SSE) && defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+namespace util
+{
+
+/*
+ * A sphere enclosing a set of points
+ */
+class BoundingSphere
+{
+public:
+    BoundingSphere()
+        :center(0,0,0)
+    {
+        radius = 0;
+    }
+
+    glm::vec3 center;
+    float radius;
+};
+
+/*
+ * A box enclosing a set of points, not necessarily aligned with the
+ * coordinate axes. The box is center + a*axes[0] + b*axes[1] + c*axes[2]
+ * for all |a|<=halfExtents.x, |b|<=halfExtents.y, |c|<=halfExtents.z. The
+ * axes are perpendicular and of unit length.
+ */
+class OrientedBox
+{
+public:
+    OrientedBox()
+        :center(0,0,0),halfExtents(0,0,0)
+    {
+        axes[0] = glm::vec3(1,0,0);
+        axes[1] = glm::vec3(0,1,0);
+        axes[2] = glm::vec3(0,0,1);
+    }
+
+    glm::vec3 center;
+    glm::vec3 axes[3];
+    glm::vec3 halfExtents;
+};
+
+/*
+ * Computes bounding volumes of points read straight from where they are
+ * stored. The points are given either as a strided array (the x, y and z
+ * of a point are consecutive floats, and the next point starts stride
+ * bytes later, as in an array of vertex objects), or as separate arrays of
+ * x, y and z.
+ *
+ * The boxes are computed with SSE (and AVX2 if the compiler is allowed to
+ * use it). Points with NaN coordinates are left out of the boxes.
+ */
+class BoundingVolumes
+{
+public:
+    /*
+     * The axis-aligned box of count points
+     * \param positions the first point. Four floats are read at every
+     *        point, so the point must be followed by at least one more
+     *        float (the w of a glm::vec4, for example)
+     * \param stride the distance from one point to the next, in bytes
+     */
+    static void box(const float *positions,size_t count,size_t stride,
+                    glm::vec3& minimum,glm::vec3& maximum)
+    {
+        if (count==0)
+            return;
+
+        const char *p = (const char *)positions;
+        size_t i = 0;
+
+#ifdef BOUNDINGVOLUMES_SSE
+        __m128 low = _mm_set1_ps(numeric_limits<float>::infinity());
+        __m128 high = _mm_set1_ps(-numeric_limits<float>::infinity());
+#ifdef __AVX2__
+        //two points at a time, one in each half
+        __m256 low2 = _mm256_set1_ps(numeric_limits<float>::infinity());
+        __m256 high2 = _mm256_set1_ps(-numeric_limits<float>::infinity());
+        for (;i+2<=count;i+=2,p+=2*stride)
+        {
+            __m256 v = _mm256_castps128_ps256(_mm_loadu_ps((const float *)p));
+            v = _mm256_insertf128_ps(v,_mm_loadu_ps((const float *)(p+stride)),1);
+            //the second operand is returned when either is NaN
+            low2 = _mm256_min_ps(v,low2);
+            high2 = _mm256_max_ps(v,high2);
+        }
+        low = _mm_min_ps(_mm256_castps256_ps128(low2),_mm256_extractf128_ps(low2,1));
+        high = _mm_max_ps(_mm256_castps256_ps128(high2),_mm256_extractf128_ps(high2,1));
+#else
+        //two sets of running bounds, so that consecutive points do not
+        //wait for each other
+        __m128 low1 = low,high1 = high;
+        for (;i+2<=count;i+=2,p+=2*stride)
+        {
+            __m128 a = _mm_loadu_ps((const float *)p);
+            __m128 b = _mm_loadu_ps((const float *)(p+stride));
+            //the second operand is returned when either is NaN
+            low = _mm_min_ps(a,low);
+            high = _mm_max_ps(a,high);
+            low1 = _mm_min_ps(b,low1);
+            high1 = _mm_max_ps(b,high1);
+        }
+        low = _mm_min_ps(low,low1);
+        high = _mm_max_ps(high,high1);
+#endif
+        for (;i<count;i++,p+=stride)
+        {
+            __m128 a = _mm_loadu_ps((const float *)p);
+            low = _mm_min_ps(a,low);
+            high = _mm_max_ps(a,high);
+        }
+
+        float l[4],h[4];
+        _mm_storeu_ps(l,low);
+        _mm_storeu_ps(h,high);
+        minimum = glm::vec3(l[0],l[1],l[2]);
+        maximum = glm::vec3(h[0],h[1],h[2]);
+#else
+        minimum = glm::vec3(numeric_limits<float>::infinity());
+        maximum = -minimum;
+        for (;i<count;i++,p+=stride)
+        {
+            const float *q = (const float *)p;
+            for (int c=0;c<3;c++)
+            {
+                if (q[c]<minimum[c])
+                    minimum[c] = q[c];
+                if (q[c]>maximum[c])
+                    maximum[c] = q[c];
+            }
+        }
+#endif
+    }
+
+    /*
+     * The axis-aligned box of count points given as separate arrays of x,
+     * y and z
+     */
+    static void box(const float *x,const float *y,const float *z,size_t count,
+                    glm::vec3& minimum,glm::vec3& maximum)
+    {
+        const float *streams[3] = {x,y,z};
+
+        if (count==0)
+            return;
+
+        for (int c=0;c<3;c++)
+        {
+            const float *s = streams[c];
+            float low = numeric_limits<float>::infinity(),high = -low;
+            size_t i = 0;
+
+#ifdef BOUNDINGVOLUMES_SSE
+#ifdef __AVX2__
+            __m256 low8 = _mm256_set1_ps(low),high8 = _mm256_set1_ps(high);
+            for (;i+8<=count;i+=8)
+            {
+                __m256 v = _mm256_loadu_ps(s+i);
+                low8 = _mm256_min_ps(v,low8);
+                high8 = _mm256_max_ps(v,high8);
+            }
+            __m128 low4 = _mm_min_ps(_mm256_castps256_ps128(low8),_mm256_extractf128_ps(low8,1));
+            __m128 high4 = _mm_max_ps(_mm256_castps256_ps128(high8),_mm256_extractf128_ps(high8,1));
+#else
+            __m128 low4 = _mm_set1_ps(low),high4 = _mm_set1_ps(high);
+#endif
+            for (;i+4<=count;i+=4)
+            {
+                __m128 v = _mm_loadu_ps(s+i);
+                low4 = _mm_min_ps(v,low4);
+                high4 = _mm_max_ps(v,high4);
+            }
+
+            float l[4],h[4];
+            _mm_storeu_ps(l,low4);
+            _mm_storeu_ps(h,high4);
+            for (int j=0;j<4;j++)
+            {
+                low = (l[j]<low)?l[j]:low;
+                high = (h[j]>high)?h[j]:high;
+            }
+#endif
+            for (;i<count;i++)
+            {
+                low = (s[i]<low)?s[i]:low;
+                high = (s[i]>high)?s[i]:high;
+            }
+            minimum[c] = low;
+            maximum[c] = high;
+        }
+    }
+
+    /*
+     * A sphere around count points (given as for box()). This is Ritter's
+     * sphere, or the sphere around the center of the axis-aligned box if
+     * that one is smaller. Neither is the smallest sphere, but both are
+     * found in a few passes over the points.
+     */
+    static BoundingSphere sphere(const float *positions,size_t count,size_t stride)
+    {
+        BoundingSphere result;
+        size_t i;
+        int c;
+
+        if (count==0)
+            return result;
+
+        //the points with the smallest and largest x, y and z
+        glm::vec3 extremes[6];
+        for (c=0;c<6;c++)
+            extremes[c] = point(positions,0,stride);
+        for (i=1;i<count;i++)
+        {
+            glm::vec3 p = point(positions,i,stride);
+            for (c=0;c<3;c++)
+            {
+                if (p[c]<extremes[2*c][c])
+                    extremes[2*c] = p;
+                if (p[c]>extremes[2*c+1][c])
+                    extremes[2*c+1] = p;
+            }
+        }
+
+        //start with the most distant of those pairs, and grow the sphere
+        //to take in every point outside it
+        int widest = 0;
+        for (c=1;c<3;c++)
+        {
+            if (glm::dot(extremes[2*c+1]-extremes[2*c],extremes[2*c+1]-extremes[2*c])
+                    > glm::dot(extremes[2*widest+1]-extremes[2*widest],extremes[2*widest+1]-extremes[2*widest]))
+                widest = c;
+        }
+        glm::vec3 center = 0.5f*(extremes[2*widest]+extremes[2*widest+1]);
+        float radius = 0.5f*glm::length(extremes[2*widest+1]-extremes[2*widest]);
+
+        for (i=0;i<count;i++)
+        {
+            glm::vec3 p = point(positions,i,stride);
+            glm::vec3 d = p-center;
+
+            //most points are inside, and need no square root
+            if (glm::dot(d,d)>radius*radius)
+            {
+                float distance = glm::length(d);
+                float grown = 0.5f*(radius+distance);
+                center += ((grown-radius)/distance)*(p-center);
+                radius = grown;
+            }
+        }
+
+        glm::vec3 minimum,maximum;
+        box(positions,count,stride,minimum,maximum);
+        glm::vec3 boxCenter = 0.5f*(minimum+maximum);
+        float boxRadius = 0;
+        for (i=0;i<count;i++)
+        {
+            glm::vec3 d = point(positions,i,stride)-boxCenter;
+            boxRadius = glm::max(boxRadius,glm::dot(d,d));
+        }
+        boxRadius = sqrt(boxRadius);
+
+        if (boxRadius<radius)
+        {
+            result.center = boxCenter;
+            result.radius = boxRadius;
+        }
+        else
+        {
+            result.center = center;
+            result.radius = radius;
+        }
+        return result;
+    }
+
+    /*
+     * An oriented box around count points (given as for box()), along the
+     * principal axes of the points. If the axis-aligned box is smaller, as
+     * it can be for boxy shapes whose points are unevenly spread, that one
+     * is returned instead.
+     */
+    static OrientedBox orientedBox(const float *positions,size_t count,size_t stride)
+    {
+        OrientedBox result;
+        size_t i;
+        int r,c;
+
+        if (count==0)
+            return result;
+
+        //the covariance of the points, in double so that large meshes far
+        //from the origin do not lose it to rounding
+        double mean[3] = {0,0,0};
+        for (i=0;i<count;i++)
+        {
+            glm::vec3 p = point(positions,i,stride);
+            for (c=0;c<3;c++)
+                mean[c] += p[c];
+        }
+        for (c=0;c<3;c++)
+            mean[c] /= count;
+
+        double covariance[3][3] = {{0,0,0},{0,0,0},{0,0,0}};
+        for (i=0;i<count;i++)
+        {
+            glm::vec3 p = point(positions,i,stride);
+            double d[3] = {p.x-mean[0],p.y-mean[1],p.z-mean[2]};
+            for (r=0;r<3;r++)
+                for (c=r;c<3;c++)
+                    covariance[r][c] += d[r]*d[c];
+        }
+        for (r=0;r<3;r++)
+            for (c=0;c<r;c++)
+                covariance[r][c] = covariance[c][r];
+
+        double vectors[3][3];
+        eigenvectors(covariance,vectors);
+
+        glm::vec3 axes[3];
+        for (c=0;c<3;c++)
+            axes[c] = glm::normalize(glm::vec3((float)vectors[0][c],(float)vectors[1][c],(float)vectors[2][c]));
+        //make the axes exactly perpendicular, and right-handed
+        axes[1] = glm::normalize(axes[1]-glm::dot(axes[1],axes[0])*axes[0]);
+        axes[2] = glm::cross(axes[0],axes[1]);
+
+        glm::vec3 origin((float)mean[0],(float)mean[1],(float)mean[2]);
+        glm::vec3 low,high;
+        for (i=0;i<count;i++)
+        {
+            glm::vec3 d = point(positions,i,stride)-origin;
+            glm::vec3 projected(glm::dot(d,axes[0]),glm::dot(d,axes[1]),glm::dot(d,axes[2]));
+
+            if (i==0)
+                low = high = projected;
+            low = glm::min(low,projected);
+            high = glm::max(high,projected);
+        }
+
+        glm::vec3 minimum,maximum;
+        box(positions,count,stride,minimum,maximum);
+        glm::vec3 size = high-low,boxSize = maximum-minimum;
+
+        if (boxSize.x*boxSize.y*boxSize.z<=size.x*size.y*size.z)
+        {
+            result.center = 0.5f*(minimum+maximum);
+            result.halfExtents = 0.5f*boxSize;
+            return result;
+        }
+
+        glm::vec3 middle = 0.5f*(low+high);
+        result.center = origin + middle.x*axes[0] + middle.y*axes[1] + middle.z*axes[2];
+        result.halfExtents = 0.5f*size;
+        for (c=0;c<3;c++)
+            result.axes[c] = axes[c];
+        return result;
+    }
+
+    /*
+     * Grow a sphere just enough to take in a point, keeping the side of it
+     * away from the point where it is
+     */
+    static void grow(BoundingSphere& sphere,const glm::vec3& p)
+    {
+        glm::vec3 d = p-sphere.center;
+
+        if (!(glm::dot(d,d)>sphere.radius*sphere.radius))
+            return;
+
+        float distance = glm::length(d);
+        float grown = 0.5f*(sphere.radius+distance);
+        sphere.center += ((grown-sphere.radius)/distance)*d;
+        sphere.radius = grown;
+    }
+
+    /*
+     * Grow an oriented box along its own axes just enough to take in a
+     * point
+     */
+    static void grow(OrientedBox& box,const glm::vec3& p)
+    {
+        glm::vec3 d = p-box.center;
+
+        for (int c=0;c<3;c++)
+        {
+            float x = glm::dot(d,box.axes[c]);
+            float low = min(x,-box.halfExtents[c]),high = max(x,box.halfExtents[c]);
+
+            if ((low<-box.halfExtents[c]) || (high>box.halfExtents[c]))
+            {
+                box.center += (0.5f*(low+high))*box.axes[c];
+                box.halfExtents[c] = 0.5f*(high-low);
+            }
+        }
+    }
+
+private:
+    static glm::vec3 point(const float *positions,size_t i,size_t stride)
+    {
+        const float *p = (const float *)((const char *)positions + i*stride);
+        return glm::vec3(p[0],p[1],p[2]);
+    }
+
+    /*
+     * The eigenvectors of a symmetric 3x3 matrix, as the columns of vectors,
+     * found with Jacobi rotations
+     */
+    static void eigenvectors(const double matrix[3][3],double vectors[3][3])
+    {
+        double a[3][3];
+        int r,c,k,sweep;
+
+        for (r=0;r<3;r++)
+        {
+            for (c=0;c<3;c++)
+            {
+                a[r][c] = matrix[r][c];
+                vectors[r][c] = (r==c)?1:0;
+            }
+        }
+
+        for (sweep=0;sweep<50;sweep++)
+        {
+            double off = a[0][1]*a[0][1] + a[0][2]*a[0][2] + a[1][2]*a[1][2];
+            double scale = a[0][0]*a[0][0] + a[1][1]*a[1][1] + a[2][2]*a[2][2];
+            if (off<=1e-24*scale)
+                break;
+
+            for (int p=0;p<2;p++)
+            {
+                for (int q=p+1;q<3;q++)
+                {
+                    if (a[p][q]==0)
+                        continue;
+
+                    //the rotation that zeroes a[p][q]
+                    double theta = (a[q][q]-a[p][p])/(2*a[p][q]);
+                    double t = ((theta>=0)?1:-1)/(fabs(theta)+sqrt(theta*theta+1));
+                    double cs = 1/sqrt(t*t+1),sn = t*cs;
+
+                    for (k=0;k<3;k++)
+                    {
+                        double kp = a[k][p],kq = a[k][q];
+                        a[k][p] = cs*kp - sn*kq;
+                        a[k][q] = sn*kp + cs*kq;
+                    }
+                    for (k=0;k<3;k++)
+                    {
+                        double pk = a[p][k],qk = a[q][k];
+                        a[p][k] = cs*pk - sn*qk;
+                        a[q][k] = sn*pk + cs*qk;
+                    }
+                    for (k=0;k<3;k++)
+                    {
+                        double kp = vectors[k][p],kq = vectors[k][q];
+                        vectors[k][p] = cs*kp - sn*kq;
+                        vectors[k][q] = sn*kp + cs*kq;
+                    }
+                }
+            }
+        }
+    }
+};
+}
+
+#endif
@@ -0,0 +1,351 @@
+#ifndef _CORNERTABLE_H_
+#define _CORNERTABLE_H_
+
+#include <vector>
+#include <cstddef>
+#include <algorithm>
+using namespace std;
+
+namespace util
+{
+
+/*
+ * The adjacency of the triangles of a mesh, as a corner table: a compact
+ * form of half-edges.
+ *
+ * Corner k of triangle t is corner 3t+k. Every corner has the vertex it is
+ * at, and the corner opposite it: the corner of the triangle on the other
+ * side of the edge facing it, at the far vertex of that triangle. The edge
+ * facing a corner is a half-edge, from the vertex of the next corner to
+ * that of the previous one, and the opposite corner faces its twin. That is
+ * 8 bytes a corner, 24 a triangle, and 4 more a vertex for a corner at
+ * every vertex.
+ *
+ * The table is built without hashing, in time linear in the number of
+ * triangles and vertices: the half-edges are sorted by the vertices at their
+ * ends with two passes of a counting sort, which brings the half-edges of
+ * every edge together. An edge of one half-edge is a border. An edge of two
+ * half-edges going opposite ways joins two triangles. Any other edge (more
+ * than two triangles, or two that face opposite ways) is non-manifold, and
+ * is treated as a border by all its triangles.
+ *
+ * A vertex whose triangles do not make one fan going round it, such as
+ * where two cones meet at their tips, is non-manifold too. The one-ring of
+ * such a vertex is that of only one of its fans.
+ */
+class CornerTable
+{
+public:
+    enum { NONE = -1 };
+
+    CornerTable()
+    {
+        borderEdges = nonManifoldEdges = 0;
+        nonManifoldVertices = degenerateTriangles = 0;
+    }
+
+    /*
+     * Build the table of a list of triangles. Triangles with a repeated
+     * corner or a corner that is not a vertex are left unconnected.
+     * \param indices the triangles, three indices each
+     * \param count the number of indices
+     * \param vertexCount the number of vertices the indices number
+     */
+    void build(const unsigned int *indices,size_t count,size_t vertexCount)
+    {
+        size_t cornerCount = count-count%3;
+        size_t c;
+
+        vertices.assign(indices,indices+cornerCount);
+        opposites.assign(cornerCount,(unsigned int)NONE);
+        vertexCorners.assign(vertexCount,(unsigned int)NONE);
+        borderEdges = nonManifoldEdges = 0;
+        nonManifoldVertices = degenerateTriangles = 0;
+
+        vector<unsigned char> used(cornerCount/3,1);
+        for (size_t t=0;t<used.size();t++)
+        {
+            const unsigned int *v = &indices[3*t];
+
+            if ((v[0]>=vertexCount) || (v[1]>=vertexCount) || (v[2]>=vertexCount)
+                    || (v[0]==v[1]) || (v[1]==v[2]) || (v[2]==v[0]))
+            {
+                used[t] = 0;
+                degenerateTriangles++;
+            }
+        }
+
+        //the half-edge facing every corner of a triangle that is used,
+        //sorted by the higher vertex at its ends, and then (keeping that
+        //order) by the lower one
+        vector<unsigned int> byHigh,byLow;
+        vector<unsigned int> starts(vertexCount+1);
+        byHigh.reserve(cornerCount);
+        for (c=0;c<cornerCount;c++)
+        {
+            if (used[c/3])
+                byHigh.push_back((unsigned int)c);
+        }
+        byLow.resize(byHigh.size());
+        countingSort(byHigh,byLow,starts,false);
+        countingSort(byLow,byHigh,starts,true);
+
+        //the half-edges of an edge are now next to each other
+        const vector<unsigned int>& sorted = byHigh;
+        size_t i,j;
+        for (i=0;i<sorted.size();i=j)
+        {
+            unsigned int low = lowEnd(sorted[i]),high = highEnd(sorted[i]);
+
+            for (j=i+1;(j<sorted.size()) && (lowEnd(sorted[j])==low) && (highEnd(sorted[j])==high);j++)
+                ;
+            if (j-i==1)
+                borderEdges++;
+            else if ((j-i==2) && (from(sorted[i])==to(sorted[i+1])))
+            {
+                opposites[sorted[i]] = sorted[i+1];
+                opposites[sorted[i+1]] = sorted[i];
+            }
+            else
+                nonManifoldEdges++;
+        }
+
+        //a corner at every vertex: the first of its fan, if the fan starts
+        //at a border, so that going round from it goes through the fan
+        for (c=0;c<cornerCount;c++)
+        {
+            if (!used[c/3])
+                continue;
+
+            unsigned int v = vertices[c];
+            if ((vertexCorners[v]==(unsigned int)NONE) || (opposites[next((unsigned int)c)]==(unsigned int)NONE))
+                vertexCorners[v] = (unsigned int)c;
+        }
+
+        //a vertex is non-manifold if its fan does not have all of its
+        //corners
+        vector<unsigned int> cornersAt(vertexCount,0);
+        for (c=0;c<cornerCount;c++)
+        {
+            if (used[c/3])
+                cornersAt[vertices[c]]++;
+        }
+        for (size_t v=0;v<vertexCount;v++)
+        {
+            if (vertexCorners[v]==(unsigned int)NONE)
+                continue;
+
+            unsigned int fan = 0;
+            unsigned int corner = vertexCorners[v];
+            do
+            {
+                fan++;
+                corner = nextAround(corner);
+            } while ((corner!=(unsigned int)NONE) && (corner!=vertexCorners[v]) && (fan<cornersAt[v]));
+            if (fan<cornersAt[v])
+                nonManifoldVertices++;
+        }
+    }
+
+    size_t getCornerCount() const
+    {
+        return vertices.size();
+    }
+
+    size_t getTriangleCount() const
+    {
+        return vertices.size()/3;
+    }
+
+    size_t getVertexCount() const
+    {
+        return vertexCorners.size();
+    }
+
+    /*
+     * The vertex a corner is at
+     */
+    unsigned int vertex(unsigned int corner) const
+    {
+        return vertices[corner];
+    }
+
+    /*
+     * The corner across the edge facing a corner, or NONE if that edge is a
+     * border or non-manifold
+     */
+    unsigned int opposite(unsigned int corner) const
+    {
+        return opposites[corner];
+    }
+
+    static unsigned int triangle(unsigned int corner)
+    {
+        return corner/3;
+    }
+
+    /*
+     * The next corner of the same triangle, going round it
+     */
+    static unsigned int next(unsigned int corner)
+    {
+        return (corner%3==2)?corner-2:corner+1;
+    }
+
+    /*
+     * The previous corner of the same triangle
+     */
+    static unsigned int previous(unsigned int corner)
+    {
+        return (corner%3==0)?corner+2:corner-1;
+    }
+
+    /*
+     * A corner at a vertex, or NONE if no triangle uses it. If the triangles
+     * round the vertex start at a border, it is the corner they start at.
+     */
+    unsigned int corner(unsigned int vertex) const
+    {
+        return vertexCorners[vertex];
+    }
+
+    /*
+     * The corner at the same vertex in the next triangle round it, going
+     * the way the triangles go round, or NONE at a border
+     */
+    unsigned int nextAround(unsigned int corner) const
+    {
+        unsigned int o = opposites[previous(corner)];
+        return (o==(unsigned int)NONE)?(unsigned int)NONE:previous(o);
+    }
+
+    /*
+     * Whether the edge facing a corner is a border (or non-manifold)
+     */
+    bool isBorder(unsigned int corner) const
+    {
+        return opposites[corner]==(unsigned int)NONE;
+    }
+
+    /*
+     * Call visit(neighbour) for every vertex that shares an edge with a
+     * vertex, going round it the way its triangles go
+     */
+    template <class F>
+    void forEachNeighbour(unsigned int vertex,F visit) const
+    {
+        unsigned int first = vertexCorners[vertex];
+        unsigned int c = first;
+
+        if (first==(unsigned int)NONE)
+            return;
+        //a fan that starts at a border has one more neighbour than corners
+        if (isBorder(next(first)))
+            visit(vertices[previous(first)]);
+        while (true)
+        {
+            visit(vertices[next(c)]);
+
+            c = nextAround(c);
+            if ((c==(unsigned int)NONE) || (c==first))
+                return;
+        }
+    }
+
+    /*
+     * The number of neighbours of a vertex
+     */
+    unsigned int getValence(unsigned int vertex) const
+    {
+        unsigned int valence = 0;
+
+        forEachNeighbour(vertex,[&](unsigned int)
+        {
+            valence++;
+        });
+        return valence;
+    }
+
+    size_t getBorderEdgeCount() const
+    {
+        return borderEdges;
+    }
+
+    size_t getNonManifoldEdgeCount() const
+    {
+        return nonManifoldEdges;
+    }
+
+    size_t getNonManifoldVertexCount() const
+    {
+        return nonManifoldVertices;
+    }
+
+    /*
+     * The number of triangles left unconnected because they have a repeated
+     * corner or a corner that is not a vertex
+     */
+    size_t getDegenerateTriangleCount() const
+    {
+        return degenerateTriangles;
+    }
+
+    /*
+     * The memory the table takes, in bytes
+     */
+    size_t getMemoryBytes() const
+    {
+        return (vertices.size()+opposites.size()+vertexCorners.size())*sizeof(unsigned int);
+    }
+
+private:
+    //the ends of the half-edge facing a corner
+    unsigned int from(unsigned int corner) const
+    {
+        return vertices[next(corner)];
+    }
+
+    unsigned int to(unsigned int corner) const
+    {
+        return vertices[previous(corner)];
+    }
+
+    unsigned int lowEnd(unsigned int corner) const
+    {
+        return min(from(corner),to(corner));
+    }
+
+    unsigned int highEnd(unsigned int corner) const
+    {
+        return max(from(corner),to(corner));
+    }
+
+    /*
+     * Sort half-edges by one of their ends, keeping the order of those with
+     * the same end
+     * \param starts scratch space, one more than the number of vertices
+     */
+    void countingSort(const vector<unsigned int>& in,vector<unsigned int>& out,
+                      vector<unsigned int>& starts,bool low) const
+    {
+        size_t i;
+
+        fill(starts.begin(),starts.end(),0);
+        for (i=0;i<in.size();i++)
+            starts[(low?lowEnd(in[i]):highEnd(in[i]))+1]++;
+        for (i=1;i<starts.size();i++)
+            starts[i] += starts[i-1];
+        for (i=0;i<in.size();i++)
+            out[starts[low?lowEnd(in[i]):highEnd(in[i])]++] = in[i];
+    }
+
+    vector<unsigned int> vertices;
+    vector<unsigned int> opposites;
+    vector<unsigned int> vertexCorners;
+    size_t borderEdges,nonManifoldEdges;
+    size_t nonManifoldVertices,degenerateTriangles;
+};
+
+}
+
+#endif
@@ -0,0 +1,133 @@
+#ifndef _DIRTYRANGES_H_
+#define _DIRTYRANGES_H_
+
+#include <vector>
+#include <cstddef>
+#include <algorithm>
+using namespace std;
+
+namespace util
+{
+
+/*
+ * A range of elements of an array: first to first+count-1
+ */
+class DirtyRange
+{
+public:
+    DirtyRange()
+    {
+        first = count = 0;
+    }
+
+    DirtyRange(size_t first,size_t count)
+    {
+        this->first = first;
+        this->count = count;
+    }
+
+    size_t first,count;
+};
+
+/*
+ * The parts of an array that have changed since they were last copied
+ * somewhere else, such as to a buffer on the GPU, so that only they need
+ * to be copied again.
+ *
+ * The ranges are kept in order, and ranges that overlap or touch are
+ * merged. There are never more than MAX_RANGES of them: when there would
+ * be, the two with the smallest gap between them are merged, so that
+ * changes all over an array make a few big copies rather than very many
+ * small ones.
+ */
+class DirtyRanges
+{
+public:
+    enum { MAX_RANGES = 64 };
+
+    /*
+     * Mark count elements from first as changed
+     */
+    void add(size_t first,size_t count)
+    {
+        if (count==0)
+            return;
+
+        size_t last = first+count;
+        //the ranges before the new one, and those after it that it does not
+        //overlap or touch
+        size_t begin = 0;
+        while ((begin<ranges.size()) && (ranges[begin].first+ranges[begin].count<first))
+            begin++;
+        size_t end = begin;
+        while ((end<ranges.size()) && (ranges[end].first<=last))
+        {
+            first = min(first,ranges[end].first);
+            last = max(last,ranges[end].first+ranges[end].count);
+            end++;
+        }
+        ranges.erase(ranges.begin()+begin,ranges.begin()+end);
+        ranges.insert(ranges.begin()+begin,DirtyRange(first,last-first));
+
+        if (ranges.size()>MAX_RANGES)
+        {
+            size_t closest = 0;
+            for (size_t i=1;i+1<ranges.size();i++)
+            {
+                if (gap(i)<gap(closest))
+                    closest = i;
+            }
+            ranges[closest].count = ranges[closest+1].first+ranges[closest+1].count-ranges[closest].first;
+            ranges.erase(ranges.begin()+closest+1);
+        }
+    }
+
+    /*
+     * Mark the whole of an array of count elements as changed
+     */
+    void addAll(size_t count)
+    {
+        ranges.clear();
+        add(0,count);
+    }
+
+    void clear()
+    {
+        ranges.clear();
+    }
+
+    bool isEmpty() const
+    {
+        return ranges.empty();
+    }
+
+    const vector<DirtyRange>& getRanges() const
+    {
+        return ranges;
+    }
+
+    /*
+     * The number of elements in all the ranges
+     */
+    size_t getCount() const
+    {
+        size_t count = 0;
+
+        for (size_t i=0;i<ranges.size();i++)
+            count += ranges[i].count;
+        return count;
+    }
+
+private:
+    //the number of elements between a range and the next
+    size_t gap(size_t i) const
+    {
+        return ranges[i+1].first-(ranges[i].first+ranges[i].count);
+    }
+
+    vector<DirtyRange> ranges;
+};
+
+}
+
+#endif
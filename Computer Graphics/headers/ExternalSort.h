@@ -0,0 +1,193 @@
+#ifndef _EXTERNALSORT_H_
+#define _EXTERNALSORT_H_
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <queue>
+#include <cstdio>
+#include <cstddef>
+#include <stdexcept>
+#include <algorithm>
+using namespace std;
+
+namespace util
+{
+
+/*
+ * Sorts a file of fixed-size records that may be far bigger than memory:
+ * as much of the file as fits in the memory given is read at a time,
+ * sorted and written out as a run, and then all the runs are merged at
+ * once, each read through a buffer of its share of the memory.
+ *
+ * The records are copied as bytes, so they must be plain data.
+ */
+class ExternalSort
+{
+public:
+    /*
+     * Sort the records of a file into another
+     * \param input the file of records
+     * \param output the file the sorted records are written to. It may be
+     *        the same as the input
+     * \param memoryBytes the most memory the records read in at once may
+     *        take
+     * \param less the order of the records
+     * \return the number of records
+     * \throws runtime_error if a file cannot be read or written
+     */
+    template <class T,class Less>
+    static size_t sort(const string& input,const string& output,size_t memoryBytes,
+                       Less less) throw(runtime_error)
+    {
+        string runsFile = output+".runs";
+        size_t runRecords = max(memoryBytes/sizeof(T),(size_t)1);
+        vector<size_t> runStarts;
+        size_t count = 0;
+
+        //sorted runs, one after the other in one file
+        {
+            ifstream in(input.c_str(),ios::binary);
+            ofstream runs(runsFile.c_str(),ios::binary | ios::trunc);
+            vector<T> run;
+
+            if (!in || !runs)
+                throw runtime_error("Could not open the files to sort: "+input);
+            in.seekg(0,ios::end);
+            size_t left = (size_t)in.tellg()/sizeof(T);
+            in.seekg(0);
+            while (left>0)
+            {
+                run.resize(min(runRecords,left));
+                in.read((char *)&run[0],run.size()*sizeof(T));
+                run.resize((size_t)in.gcount()/sizeof(T));
+                if (run.empty())
+                    break;
+
+                std::sort(run.begin(),run.end(),less);
+                runStarts.push_back(count);
+                runs.write((const char *)&run[0],run.size()*sizeof(T));
+                count += run.size();
+                left -= run.size();
+            }
+            if (!runs)
+                throw runtime_error("Could not write the runs of: "+input);
+        }
+        runStarts.push_back(count);
+
+        if (runStarts.size()<=2)
+        {
+            //one run is already sorted
+            remove(output.c_str());
+            if (rename(runsFile.c_str(),output.c_str())!=0)
+                throw runtime_error("Could not write the sorted file: "+output);
+            return count;
+        }
+
+        merge<T,Less>(runsFile,runStarts,output,memoryBytes,less);
+        remove(runsFile.c_str());
+        return count;
+    }
+
+private:
+    /*
+     * A run being merged: its next records, in a buffer
+     */
+    template <class T>
+    class Run
+    {
+    public:
+        vector<T> buffer;
+        size_t next;
+        //records of the run not read into the buffer yet
+        size_t position,end;
+    };
+
+    template <class T,class Less>
+    class Greater
+    {
+    public:
+        Greater(const vector<Run<T> > *runs,Less less)
+            :runs(runs),less(less)
+        {
+        }
+
+        bool operator()(size_t a,size_t b) const
+        {
+            return less((*runs)[b].buffer[(*runs)[b].next],(*runs)[a].buffer[(*runs)[a].next]);
+        }
+
+        const vector<Run<T> > *runs;
+        Less less;
+    };
+
+    template <class T,class Less>
+    static void merge(const string& runsFile,const vector<size_t>& runStarts,
+                      const string& output,size_t memoryBytes,Less less) throw(runtime_error)
+    {
+        size_t runCount = runStarts.size()-1;
+        //every run and the output get a buffer of the same size
+        size_t bufferRecords = max(memoryBytes/((runCount+1)*sizeof(T)),(size_t)1);
+        vector<Run<T> > runs(runCount);
+        ifstream in(runsFile.c_str(),ios::binary);
+        ofstream out(output.c_str(),ios::binary | ios::trunc);
+        vector<T> written;
+        size_t r;
+
+        if (!in || !out)
+            throw runtime_error("Could not open the files to merge into: "+output);
+
+        Greater<T,Less> greater(&runs,less);
+        priority_queue<size_t,vector<size_t>,Greater<T,Less> > heads(greater);
+        for (r=0;r<runCount;r++)
+        {
+            runs[r].position = runStarts[r];
+            runs[r].end = runStarts[r+1];
+            if (fill(in,runs[r],bufferRecords))
+                heads.push(r);
+        }
+
+        written.reserve(bufferRecords);
+        while (!heads.empty())
+        {
+            r = heads.top();
+            heads.pop();
+            written.push_back(runs[r].buffer[runs[r].next++]);
+            if (written.size()==bufferRecords)
+            {
+                out.write((const char *)&written[0],written.size()*sizeof(T));
+                written.clear();
+            }
+            if ((runs[r].next<runs[r].buffer.size()) || fill(in,runs[r],bufferRecords))
+                heads.push(r);
+        }
+        if (!written.empty())
+            out.write((const char *)&written[0],written.size()*sizeof(T));
+        if (!out)
+            throw runtime_error("Could not write the sorted file: "+output);
+    }
+
+    /*
+     * Read the next records of a run into its buffer
+     * \return false if the run has none left
+     */
+    template <class T>
+    static bool fill(ifstream& in,Run<T>& run,size_t bufferRecords)
+    {
+        size_t n = min(bufferRecords,run.end-run.position);
+
+        run.buffer.resize(n);
+        run.next = 0;
+        if (n==0)
+            return false;
+        in.clear();
+        in.seekg((streamoff)(run.position*sizeof(T)));
+        in.read((char *)&run.buffer[0],n*sizeof(T));
+        run.position += n;
+        return true;
+    }
+};
+
+}
+
+#endif
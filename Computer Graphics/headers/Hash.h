@@ -0,0 +1,88 @@
+#ifndef _HASH_H_
+#define _HASH_H_
+
+#include <cstring>
+#include <cstddef>
+#include <string>
+using namespace std;
+
+namespace util
+{
+
+/*
+ * A fast 64-bit, non-cryptographic hash, used to recognize content that
+ * has been seen before (for example to validate cached meshes). The input
+ * is consumed 8 bytes at a time. Different inputs may, very rarely, have
+ * the same hash.
+ *
+ * Hashes can be chained: pass the result of one call as the seed of the
+ * next to hash several pieces as if they were one.
+ */
+class Hash
+{
+public:
+    static unsigned long long bytes(const void *data,size_t size,unsigned long long seed=0)
+    {
+        const unsigned char *p = (const unsigned char *)data;
+        unsigned long long h = seed ^ (size*PRIME1);
+        size_t i;
+
+        for (i=0;i+8<=size;i+=8)
+        {
+            unsigned long long word;
+            memcpy(&word,p+i,8);
+            h = mixIn(h,word);
+        }
+
+        //the last few bytes
+        if (i<size)
+        {
+            unsigned long long word = 0;
+            memcpy(&word,p+i,size-i);
+            h = mixIn(h,word);
+        }
+
+        return finish(h);
+    }
+
+    static unsigned long long text(const string& s,unsigned long long seed=0)
+    {
+        return bytes(s.data(),s.length(),seed);
+    }
+
+    static unsigned long long value(unsigned long long v,unsigned long long seed=0)
+    {
+        return finish(mixIn(seed^PRIME1,v));
+    }
+
+private:
+    static const unsigned long long PRIME1 = 0x9E3779B185EBCA87ULL;
+    static const unsigned long long PRIME2 = 0xC2B2AE3D27D4EB4FULL;
+
+    static unsigned long long rotate(unsigned long long x,int r)
+    {
+        return (x<<r) | (x>>(64-r));
+    }
+
+    static unsigned long long mixIn(unsigned long long h,unsigned long long word)
+    {
+        word *= PRIME2;
+        word = rotate(word,31);
+        word *= PRIME1;
+        h ^= word;
+        return rotate(h,27)*PRIME1 + PRIME2;
+    }
+
+    static unsigned long long finish(unsigned long long h)
+    {
+        h ^= h>>33;
+        h *= PRIME2;
+        h ^= h>>29;
+        h *= PRIME1;
+        h ^= h>>32;
+        return h;
+    }
+};
+}
+
+#endif
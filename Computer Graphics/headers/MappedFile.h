@@ -0,0 +1,416 @@
+#ifndef _MAPPEDFILE_H_
+#define _MAPPEDFILE_H_
+
+#include <string>
+#include <stdexcept>
+#include <cstddef>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+using namespace std;
+
+namespace util
+{
+
+/*
+ * A read-only view of an entire file, mapped into memory by the operating
+ * system. The contents can be scanned in place without copying them into
+ * strings or streams first. The mapping is released when this object is
+ * closed or destroyed.
+ */
+class MappedFile
+{
+public:
+    MappedFile()
+    {
+        contents = NULL;
+        length = 0;
+#ifdef _WIN32
+        file = INVALID_HANDLE_VALUE;
+        mapping = NULL;
+#else
+        fd = -1;
+#endif
+    }
+
+    MappedFile(const string& filename) throw(runtime_error)
+    {
+        contents = NULL;
+        length = 0;
+#ifdef _WIN32
+        file = INVALID_HANDLE_VALUE;
+        mapping = NULL;
+#else
+        fd = -1;
+#endif
+        open(filename);
+    }
+
+    ~MappedFile()
+    {
+        close();
+    }
+
+    /*
+     * Map the given file into memory. Any previously mapped file is released.
+     * \param filename the path of the file to be mapped
+     * \throws runtime_error if the file cannot be opened or mapped
+     */
+    inline void open(const string& filename) throw(runtime_error);
+
+    /*
+     * Release the mapping, if any
+     */
+    inline void close();
+
+    /*
+     * \return a pointer to the first byte of the file, or NULL if the file
+     *         is empty or not open
+     */
+    const char *data() const
+    {
+        return contents;
+    }
+
+    /*
+     * \return the size of the file in bytes
+     */
+    size_t size() const
+    {
+        return length;
+    }
+
+    bool isOpen() const
+    {
+#ifdef _WIN32
+        return file!=INVALID_HANDLE_VALUE;
+#else
+        return fd>=0;
+#endif
+    }
+
+    /*
+     * Move a file over another in one step, so that whoever opens the other
+     * gets either all of the old file or all of the new one
+     * \return false if the file could not be moved
+     */
+    static inline bool replace(const string& from,const string& to);
+
+private:
+    //a mapping cannot be shared between two objects
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+
+    const char *contents;
+    size_t length;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#else
+    int fd;
+#endif
+};
+
+void MappedFile::open(const string& filename) throw(runtime_error)
+{
+    close();
+#ifdef _WIN32
+    file = CreateFileA(filename.c_str(),
+                       GENERIC_READ,
+                       FILE_SHARE_READ,
+                       NULL,
+                       OPEN_EXISTING,
+                       FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
+                       NULL);
+    if (file==INVALID_HANDLE_VALUE)
+        throw runtime_error("Could not open file: "+filename);
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file,&fileSize))
+    {
+        close();
+        throw runtime_error("Could not read the size of file: "+filename);
+    }
+    length = (size_t)fileSize.QuadPart;
+
+    //an empty file cannot be mapped, but it is still a valid file
+    if (length==0)
+        return;
+
+    mapping = CreateFileMappingA(file,NULL,PAGE_READONLY,0,0,NULL);
+    if (mapping==NULL)
+    {
+        close();
+        throw runtime_error("Could not map file: "+filename);
+    }
+    contents = (const char *)MapViewOfFile(mapping,FILE_MAP_READ,0,0,0);
+    if (contents==NULL)
+    {
+        close();
+        throw runtime_error("Could not map file: "+filename);
+    }
+#else
+    fd = ::open(filename.c_str(),O_RDONLY);
+    if (fd<0)
+        throw runtime_error("Could not open file: "+filename);
+
+    struct stat info;
+    if (fstat(fd,&info)!=0)
+    {
+        close();
+        throw runtime_error("Could not read the size of file: "+filename);
+    }
+    length = (size_t)info.st_size;
+
+    //an empty file cannot be mapped, but it is still a valid file
+    if (length==0)
+        return;
+
+    void *address = mmap(NULL,length,PROT_READ,MAP_PRIVATE,fd,0);
+    if (address==MAP_FAILED)
+    {
+        close();
+        throw runtime_error("Could not map file: "+filename);
+    }
+    //we read the file front to back, so let the kernel read ahead
+    madvise(address,length,MADV_SEQUENTIAL);
+    contents = (const char *)address;
+#endif
+}
+
+bool MappedFile::replace(const string& from,const string& to)
+{
+#ifdef _WIN32
+    return MoveFileExA(from.c_str(),to.c_str(),MOVEFILE_REPLACE_EXISTING)!=0;
+#else
+    return rename(from.c_str(),to.c_str())==0;
+#endif
+}
+
+void MappedFile::close()
+{
+#ifdef _WIN32
+    if (contents!=NULL)
+        UnmapViewOfFile(contents);
+    if (mapping!=NULL)
+        CloseHandle(mapping);
+    if (file!=INVALID_HANDLE_VALUE)
+        CloseHandle(file);
+    mapping = NULL;
+    file = INVALID_HANDLE_VALUE;
+#else
+    if (contents!=NULL)
+        munmap((void *)contents,length);
+    if (fd>=0)
+        ::close(fd);
+    fd = -1;
+#endif
+    contents = NULL;
+    length = 0;
+}
+
+/*
+ * A window onto part of a file, mapped into memory by the operating system
+ * for reading or for reading and writing. Unlike MappedFile, only the
+ * window is mapped, so a file far bigger than memory (or than the address
+ * space) can be worked through a window at a time, and only the pages of
+ * the window that is mapped are held. Changes are written back to the file
+ * by the operating system.
+ */
+class MappedWindow
+{
+public:
+    MappedWindow()
+    {
+        contents = NULL;
+        length = 0;
+        view = NULL;
+        viewLength = 0;
+    }
+
+    ~MappedWindow()
+    {
+        unmap();
+    }
+
+    /*
+     * Map length bytes of a file from offset on, releasing any window
+     * mapped before. The file must already be at least offset+length bytes
+     * long (see resize).
+     * \param writable whether the window may be written to
+     * \throws runtime_error if the file cannot be opened or mapped
+     */
+    inline void map(const string& filename,unsigned long long offset,size_t length,
+                    bool writable) throw(runtime_error);
+
+    /*
+     * Release the window, if any, after writing it back to the file
+     */
+    inline void unmap();
+
+    char *data() const
+    {
+        return contents;
+    }
+
+    size_t size() const
+    {
+        return length;
+    }
+
+    /*
+     * Make a file the given size, creating it if it does not exist. A file
+     * that grows is filled with zeros.
+     * \throws runtime_error if it cannot
+     */
+    static inline void resize(const string& filename,unsigned long long size) throw(runtime_error);
+
+    /*
+     * \return the size of a file in bytes, or 0 if it does not exist
+     */
+    static inline unsigned long long fileSize(const string& filename);
+
+private:
+    //a mapping cannot be shared between two objects
+    MappedWindow(const MappedWindow&);
+    MappedWindow& operator=(const MappedWindow&);
+
+    char *contents;
+    size_t length;
+    //the window starts where the operating system can start a mapping,
+    //which may be a little before the offset asked for
+    void *view;
+    size_t viewLength;
+};
+
+void MappedWindow::map(const string& filename,unsigned long long offset,size_t length,
+                       bool writable) throw(runtime_error)
+{
+    unmap();
+    if (length==0)
+        return;
+
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    unsigned long long start = offset-offset%info.dwAllocationGranularity;
+
+    HANDLE file = CreateFileA(filename.c_str(),
+                              writable?(GENERIC_READ | GENERIC_WRITE):GENERIC_READ,
+                              FILE_SHARE_READ | FILE_SHARE_WRITE,
+                              NULL,
+                              OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL,
+                              NULL);
+    if (file==INVALID_HANDLE_VALUE)
+        throw runtime_error("Could not open file: "+filename);
+
+    HANDLE mapping = CreateFileMappingA(file,NULL,writable?PAGE_READWRITE:PAGE_READONLY,0,0,NULL);
+    if (mapping!=NULL)
+    {
+        viewLength = (size_t)(offset-start)+length;
+        view = MapViewOfFile(mapping,writable?FILE_MAP_WRITE:FILE_MAP_READ,
+                             (DWORD)(start>>32),(DWORD)(start & 0xffffffff),viewLength);
+        //the view keeps the mapping and the file open
+        CloseHandle(mapping);
+    }
+    CloseHandle(file);
+    if (view==NULL)
+        throw runtime_error("Could not map file: "+filename);
+#else
+    unsigned long long pageSize = (unsigned long long)sysconf(_SC_PAGESIZE);
+    unsigned long long start = offset-offset%pageSize;
+
+    int fd = ::open(filename.c_str(),writable?O_RDWR:O_RDONLY);
+    if (fd<0)
+        throw runtime_error("Could not open file: "+filename);
+
+    viewLength = (size_t)(offset-start)+length;
+    view = mmap(NULL,viewLength,writable?(PROT_READ | PROT_WRITE):PROT_READ,
+                MAP_SHARED,fd,(off_t)start);
+    //the mapping keeps the file open
+    ::close(fd);
+    if (view==MAP_FAILED)
+    {
+        view = NULL;
+        throw runtime_error("Could not map file: "+filename);
+    }
+    //windows are worked through front to back
+    madvise(view,viewLength,MADV_SEQUENTIAL);
+#endif
+    contents = (char *)view+(offset-start);
+    this->length = length;
+}
+
+void MappedWindow::unmap()
+{
+    if (view!=NULL)
+    {
+#ifdef _WIN32
+        UnmapViewOfFile(view);
+#else
+        munmap(view,viewLength);
+#endif
+    }
+    view = NULL;
+    viewLength = 0;
+    contents = NULL;
+    length = 0;
+}
+
+void MappedWindow::resize(const string& filename,unsigned long long size) throw(runtime_error)
+{
+#ifdef _WIN32
+    HANDLE file = CreateFileA(filename.c_str(),
+                              GENERIC_READ | GENERIC_WRITE,
+                              FILE_SHARE_READ | FILE_SHARE_WRITE,
+                              NULL,
+                              OPEN_ALWAYS,
+                              FILE_ATTRIBUTE_NORMAL,
+                              NULL);
+    if (file==INVALID_HANDLE_VALUE)
+        throw runtime_error("Could not open file: "+filename);
+
+    LARGE_INTEGER end;
+    end.QuadPart = (LONGLONG)size;
+    bool resized = SetFilePointerEx(file,end,NULL,FILE_BEGIN) && SetEndOfFile(file);
+    CloseHandle(file);
+#else
+    int fd = ::open(filename.c_str(),O_RDWR | O_CREAT,0644);
+    if (fd<0)
+        throw runtime_error("Could not open file: "+filename);
+
+    bool resized = ftruncate(fd,(off_t)size)==0;
+    ::close(fd);
+#endif
+    if (!resized)
+        throw runtime_error("Could not resize file: "+filename);
+}
+
+unsigned long long MappedWindow::fileSize(const string& filename)
+{
+#ifdef _WIN32
+    WIN32_FILE_ATTRIBUTE_DATA info;
+
+    if (!GetFileAttributesExA(filename.c_str(),GetFileExInfoStandard,&info))
+        return 0;
+    return ((unsigned long long)info.nFileSizeHigh<<32) | info.nFileSizeLow;
+#else
+    struct stat info;
+
+    if (stat(filename.c_str(),&info)!=0)
+        return 0;
+    return (unsigned long long)info.st_size;
+#endif
+}
+}
+
+#endif
@@ -0,0 +1,922 @@
+#ifndef _MESHBVH_H_
+#define _MESHBVH_H_
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <cstddef>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <atomic>
+#include "Parallel.h"
+
+//SSE2 is always there on x86-64, and on 32-bit x86 when compiled for it
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP>=2))
+#define MESHBVH_SSE
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+namespace util
+{
+
+/*
+ * Where a ray hits a triangle: the point is
+ * (1-u-v)*corner0 + u*corner1 + v*corner2, and origin + distance*direction
+ */
+class RayHit
+{
+public:
+    RayHit()
+    {
+        triangle = 0;
+        u = v = 0;
+        distance = numeric_limits<float>::infinity();
+    }
+
+    //the number of the triangle: its corners are indices 3*triangle to
+    //3*triangle+2
+    unsigned int triangle;
+    float u,v;
+    //in lengths of the direction of the ray
+    float distance;
+};
+
+/*
+ * A bounding volume hierarchy of the triangles of a mesh, to find the
+ * triangle a ray hits first without testing every triangle.
+ *
+ * It is built as a binary tree, splitting every node where the surface
+ * area heuristic says a ray is cheapest to trace, among 16 evenly spaced
+ * planes along each axis (binning). Big nodes are binned on all the
+ * threads, and the subtrees below them are built on a thread each.
+ *
+ * The binary tree is then collapsed into a tree of four children a node,
+ * and the triangles of the leaves into packs of four. The boxes of the
+ * children of a node and the triangles of a pack are stored component by
+ * component, so that a ray is tested against all four at once with SSE
+ * (or one at a time, the same way, without it). A node is 128 bytes, two
+ * cache lines, and a pack 160.
+ */
+class MeshBVH
+{
+public:
+    //the most triangles a leaf has, unless the tree gets too deep
+    enum { MAX_LEAF_SIZE = 8 };
+
+    MeshBVH()
+    {
+        triangleCount = 0;
+    }
+
+    /*
+     * Build the tree of a list of triangles
+     * \param positions the position of the first vertex, as three floats
+     * \param stride the distance from one position to the next, in bytes
+     * \param vertexCount the number of vertices
+     * \param indices the triangles, three indices each
+     * \param count the number of indices
+     * \param threads the number of threads, 0 for one per core
+     */
+    void build(const float *positions,size_t stride,size_t vertexCount,
+               const unsigned int *indices,size_t count,unsigned int threads=1)
+    {
+        size_t i;
+
+        nodes.clear();
+        packs.clear();
+        triangleCount = count/3;
+
+        //the box of every triangle. Triangles with a corner that is not a
+        //vertex or not a proper number are left out
+        Builder builder;
+        vector<unsigned char> valid(triangleCount);
+        builder.triangles.resize(triangleCount);
+        parallelFor(0,triangleCount,threads,[&](size_t first,size_t last,unsigned int)
+        {
+            for (size_t t=first;t<last;t++)
+            {
+                glm::vec3 p[3];
+
+                valid[t] = 1;
+                for (int k=0;k<3;k++)
+                {
+                    if (indices[3*t+k]>=vertexCount)
+                    {
+                        valid[t] = 0;
+                        break;
+                    }
+                    p[k] = position(positions,stride,indices[3*t+k]);
+                    for (int c=0;c<3;c++)
+                    {
+                        if (!(fabs(p[k][c])<=numeric_limits<float>::max()))
+                            valid[t] = 0;
+                    }
+                }
+                if (!valid[t])
+                    continue;
+                builder.triangles[t].low = glm::min(p[0],glm::min(p[1],p[2]));
+                builder.triangles[t].high = glm::max(p[0],glm::max(p[1],p[2]));
+                builder.triangles[t].triangle = (unsigned int)t;
+            }
+        });
+
+        size_t kept = 0;
+        for (i=0;i<triangleCount;i++)
+        {
+            if (valid[i])
+                builder.triangles[kept++] = builder.triangles[i];
+        }
+        builder.triangles.resize(kept);
+        if (builder.triangles.empty())
+            return;
+
+        builder.build(resolveThreadCount(threads));
+        collapse(builder,positions,stride,indices);
+    }
+
+    /*
+     * Find the first triangle a ray hits, from either side
+     * \param origin where the ray starts
+     * \param direction which way it goes. It need not be of unit length:
+     *        distances are measured in its length
+     * \param hit set to where the ray hits, if it does
+     * \param maxDistance how far along the ray to look
+     * \return true if the ray hits a triangle
+     */
+    bool intersect(const glm::vec3& origin,const glm::vec3& direction,RayHit& hit,
+                   float maxDistance=numeric_limits<float>::infinity()) const
+    {
+        if (nodes.empty())
+            return false;
+
+        //a ray parallel to an axis divides by a huge number rather than 0,
+        //so that the slabs of that axis stay proper numbers
+        float inverse[3];
+        for (int c=0;c<3;c++)
+        {
+            if (fabs(direction[c])>1e-30f)
+                inverse[c] = 1.0f/direction[c];
+            else
+                inverse[c] = (direction[c]<0)?-1e30f:1e30f;
+        }
+
+        //the stack holds the children still to be visited and how far
+        //along the ray their boxes start; a node has four children and the
+        //tree is at most MAX_DEPTH deep, so it cannot overflow
+        StackEntry stack[4*MAX_DEPTH];
+        int top = 0;
+        float best = maxDistance;
+        bool found = false;
+
+        stack[top].child = 0;
+        stack[top].count = 0;
+        stack[top].distance = 0;
+        top++;
+        while (top>0)
+        {
+            StackEntry entry = stack[--top];
+
+            if (entry.distance>best)
+                continue;
+            if (entry.child<0)
+            {
+                for (unsigned int p=0;p<entry.count;p++)
+                {
+                    if (intersectPack(packs[~entry.child+p],origin,direction,best,hit))
+                        found = true;
+                }
+                continue;
+            }
+
+            //the children the ray goes through, nearest last so that it is
+            //visited first
+            float starts[4];
+            unsigned int mask = intersectBoxes(nodes[entry.child],origin,inverse,best,starts);
+            const Node& node = nodes[entry.child];
+            int first = top;
+            for (int k=0;k<4;k++)
+            {
+                if (!(mask & (1<<k)))
+                    continue;
+
+                StackEntry child;
+                child.child = node.child[k];
+                child.count = node.count[k];
+                child.distance = starts[k];
+
+                int j = top++;
+                while ((j>first) && (stack[j-1].distance<child.distance))
+                {
+                    stack[j] = stack[j-1];
+                    j--;
+                }
+                stack[j] = child;
+            }
+        }
+        return found;
+    }
+
+    bool isEmpty() const
+    {
+        return nodes.empty();
+    }
+
+    size_t getNodeCount() const
+    {
+        return nodes.size();
+    }
+
+    size_t getPackCount() const
+    {
+        return packs.size();
+    }
+
+    /*
+     * The number of triangles the tree was built from, including any that
+     * were left out of it
+     */
+    size_t getTriangleCount() const
+    {
+        return triangleCount;
+    }
+
+    /*
+     * The memory the nodes and packs take, in bytes
+     */
+    size_t getMemoryBytes() const
+    {
+        return nodes.size()*sizeof(Node) + packs.size()*sizeof(Pack);
+    }
+
+private:
+    //how deep the binary tree may get before nodes are made leaves anyway
+    enum { MAX_DEPTH = 64, BINS = 16, NONE = -1 };
+
+    /*
+     * Four children of a node. A child that is a node is its index; a leaf
+     * is ~ the index of its first pack, with count its number of packs. An
+     * unused child has a box that is inside out, which no ray goes through.
+     */
+    class Node
+    {
+    public:
+        Node()
+        {
+            for (int k=0;k<4;k++)
+            {
+                minX[k] = minY[k] = minZ[k] = numeric_limits<float>::infinity();
+                maxX[k] = maxY[k] = maxZ[k] = -numeric_limits<float>::infinity();
+                child[k] = 0;
+                count[k] = 0;
+            }
+        }
+
+        float minX[4],minY[4],minZ[4];
+        float maxX[4],maxY[4],maxZ[4];
+        int child[4];
+        unsigned int count[4];
+    };
+
+    /*
+     * Four triangles, as a corner and the edges from it to the other two.
+     * An unused triangle has no edges, which no ray hits.
+     */
+    class Pack
+    {
+    public:
+        Pack()
+        {
+            for (int k=0;k<4;k++)
+            {
+                x[k] = y[k] = z[k] = 0;
+                e1x[k] = e1y[k] = e1z[k] = 0;
+                e2x[k] = e2y[k] = e2z[k] = 0;
+                triangle[k] = (unsigned int)NONE;
+            }
+        }
+
+        float x[4],y[4],z[4];
+        float e1x[4],e1y[4],e1z[4];
+        float e2x[4],e2y[4],e2z[4];
+        unsigned int triangle[4];
+    };
+
+    class StackEntry
+    {
+    public:
+        int child;
+        unsigned int count;
+        float distance;
+    };
+
+    /*
+     * A triangle and its box, which the builder sorts into nodes. The box
+     * is kept with the triangle rather than looked up, so that the
+     * triangles of a node are read one after another.
+     */
+    class BuildTriangle
+    {
+    public:
+        glm::vec3 center() const
+        {
+            return 0.5f*(low+high);
+        }
+
+        glm::vec3 low,high;
+        unsigned int triangle;
+    };
+
+    /*
+     * A node of the binary tree: its box, and either its two children or
+     * its triangles, triangles[begin] to triangles[begin+count-1]. A node whose subtree
+     * was built on its own has task set to the number of the tree it is
+     * the root of.
+     */
+    class BuildNode
+    {
+    public:
+        BuildNode()
+        {
+            begin = count = 0;
+            left = right = NONE;
+            task = NONE;
+        }
+
+        glm::vec3 low,high;
+        unsigned int begin,count;
+        int left,right;
+        int task;
+    };
+
+    /*
+     * The triangles in one bin, or in a range of bins
+     */
+    class Bin
+    {
+    public:
+        Bin()
+            :low(numeric_limits<float>::infinity()),high(-numeric_limits<float>::infinity())
+        {
+            count = 0;
+        }
+
+        void add(const glm::vec3& l,const glm::vec3& h,unsigned int n)
+        {
+            low = glm::min(low,l);
+            high = glm::max(high,h);
+            count += n;
+        }
+
+        glm::vec3 low,high;
+        unsigned int count;
+    };
+
+    /*
+     * The boxes of the triangles of a range, and of their centers
+     */
+    class Extent
+    {
+    public:
+        Extent()
+            :low(numeric_limits<float>::infinity()),high(-numeric_limits<float>::infinity()),
+              centerLow(numeric_limits<float>::infinity()),centerHigh(-numeric_limits<float>::infinity())
+        {
+        }
+
+        void add(const Extent& other)
+        {
+            low = glm::min(low,other.low);
+            high = glm::max(high,other.high);
+            centerLow = glm::min(centerLow,other.centerLow);
+            centerHigh = glm::max(centerHigh,other.centerHigh);
+        }
+
+        glm::vec3 low,high,centerLow,centerHigh;
+    };
+
+    /*
+     * Builds the binary tree. The nodes near the root are in trees[0], and
+     * every subtree that is built on its own in a tree of its own.
+     */
+    class Builder
+    {
+    public:
+        void build(unsigned int threads)
+        {
+            //near the root, nodes are split on all the threads, until they
+            //are small enough for a thread to build the rest of the subtree
+            //on its own; a few subtrees a thread even out their sizes. With
+            //one thread the whole tree is one subtree
+            size_t taskSize = (threads>1)?max<size_t>(triangles.size()/(8*threads),4096):triangles.size();
+
+            trees.resize(1);
+            trees[0].push_back(BuildNode());
+            split(0,0,0,(unsigned int)triangles.size(),0,taskSize,threads);
+
+            //the biggest subtrees first, so that none is left for last
+            vector<unsigned int> order(tasks.size());
+            for (unsigned int t=0;t<tasks.size();t++)
+                order[t] = t;
+            sort(order.begin(),order.end(),[&](unsigned int a,unsigned int b)
+            {
+                return tasks[a].count>tasks[b].count;
+            });
+
+            trees.resize(1+tasks.size());
+            atomic<unsigned int> next(0);
+            parallelFor(0,threads,threads,[&](size_t,size_t,unsigned int)
+            {
+                unsigned int t;
+                while ((t=next++)<order.size())
+                {
+                    const Task& task = tasks[order[t]];
+
+                    trees[1+order[t]].push_back(BuildNode());
+                    split(1+order[t],0,task.begin,task.begin+task.count,task.depth,
+                          triangles.size(),1);
+                }
+            });
+        }
+
+        /*
+         * The node a node stands for: the root of its subtree if that was
+         * built on its own
+         */
+        const BuildNode& resolve(int tree,int node,int& resolvedTree) const
+        {
+            const BuildNode& n = trees[tree][node];
+
+            if (n.task!=NONE)
+            {
+                resolvedTree = 1+n.task;
+                return trees[1+n.task][0];
+            }
+            resolvedTree = tree;
+            return n;
+        }
+
+        vector<BuildTriangle> triangles;
+        vector<vector<BuildNode> > trees;
+
+    private:
+        class Task
+        {
+        public:
+            unsigned int begin,count,depth;
+        };
+
+        /*
+         * Make a node of the triangles from begin to end-1, and
+         * split it further if that makes rays cheaper
+         */
+        void split(int tree,int node,unsigned int begin,unsigned int end,
+                   unsigned int depth,size_t taskSize,unsigned int threads)
+        {
+            unsigned int count = end-begin;
+
+            if ((tree==0) && (count<=taskSize))
+            {
+                //far enough down, to be finished on a thread of its own
+                trees[tree][node].task = (int)tasks.size();
+                Task task;
+                task.begin = begin;
+                task.count = count;
+                task.depth = depth;
+                tasks.push_back(task);
+                return;
+            }
+
+            Extent extent = measure(begin,end,threads);
+            BuildNode& n = trees[tree][node];
+            n.low = extent.low;
+            n.high = extent.high;
+            n.begin = begin;
+            n.count = count;
+            if ((count<=2) || (depth>=MAX_DEPTH-1))
+                return;
+
+            //the cost of a split, relative to that of a leaf, is the chance
+            //that a ray through the node goes through each child times the
+            //packs of four triangles it has to test there, plus one for
+            //visiting the node
+            int axis = -1;
+            unsigned int plane = 0;
+            float bestCost = (count<=MAX_LEAF_SIZE)?(float)packCount(count)-1.0f:numeric_limits<float>::infinity();
+            glm::vec3 scale;
+            Bin bins[3][BINS];
+            bin(begin,end,extent,threads,scale,bins);
+
+            float area = halfArea(extent.low,extent.high);
+            for (int c=0;c<3;c++)
+            {
+                if (!(scale[c]>0))
+                    continue;
+
+                //the cost of every split, from the bins on the right
+                float rightCost[BINS];
+                Bin right;
+                for (int b=BINS-1;b>0;b--)
+                {
+                    right.add(bins[c][b].low,bins[c][b].high,bins[c][b].count);
+                    rightCost[b] = (right.count>0)?halfArea(right.low,right.high)*packCount(right.count):0;
+                }
+                Bin left;
+                for (int b=0;b<BINS-1;b++)
+                {
+                    left.add(bins[c][b].low,bins[c][b].high,bins[c][b].count);
+                    if ((left.count==0) || (left.count==count))
+                        continue;
+
+                    float cost = (halfArea(left.low,left.high)*packCount(left.count) + rightCost[b+1])/area;
+                    if (cost<bestCost)
+                    {
+                        bestCost = cost;
+                        axis = c;
+                        plane = b;
+                    }
+                }
+            }
+
+            unsigned int middle;
+            if (axis>=0)
+            {
+                float low = extent.centerLow[axis];
+                float s = scale[axis];
+                middle = (unsigned int)(partition(triangles.begin()+begin,triangles.begin()+end,
+                                                  [&](const BuildTriangle& t)
+                {
+                    return binOf(t.center()[axis],low,s)<=plane;
+                }) - triangles.begin());
+            }
+            else if (count>MAX_LEAF_SIZE)
+            {
+                //the centers are all in one place, so no plane splits them:
+                //split the triangles in two halves, whatever they are
+                middle = begin+count/2;
+            }
+            else
+                return;
+
+            int left = (int)trees[tree].size();
+            trees[tree].push_back(BuildNode());
+            trees[tree].push_back(BuildNode());
+            trees[tree][node].left = left;
+            trees[tree][node].right = left+1;
+            split(tree,left,begin,middle,depth+1,taskSize,threads);
+            split(tree,left+1,middle,end,depth+1,taskSize,threads);
+        }
+
+        Extent measure(unsigned int begin,unsigned int end,unsigned int threads) const
+        {
+            vector<Extent> blocks(threads);
+
+            parallelFor(begin,end,threads,[&](size_t first,size_t last,unsigned int block)
+            {
+                Extent& e = blocks[block];
+                for (size_t i=first;i<last;i++)
+                {
+                    const BuildTriangle& t = triangles[i];
+                    glm::vec3 center = t.center();
+
+                    e.low = glm::min(e.low,t.low);
+                    e.high = glm::max(e.high,t.high);
+                    e.centerLow = glm::min(e.centerLow,center);
+                    e.centerHigh = glm::max(e.centerHigh,center);
+                }
+            });
+            for (unsigned int b=1;b<threads;b++)
+                blocks[0].add(blocks[b]);
+            return blocks[0];
+        }
+
+        /*
+         * Sort the triangles of a range into BINS bins along each axis, by
+         * their centers
+         */
+        void bin(unsigned int begin,unsigned int end,const Extent& extent,
+                 unsigned int threads,glm::vec3& scale,Bin bins[3][BINS]) const
+        {
+            for (int c=0;c<3;c++)
+            {
+                float size = extent.centerHigh[c]-extent.centerLow[c];
+                scale[c] = (size>0)?BINS*(1-1e-6f)/size:0;
+            }
+
+            vector<Bin> blocks(threads*3*BINS);
+            parallelFor(begin,end,threads,[&](size_t first,size_t last,unsigned int block)
+            {
+                Bin *b = &blocks[block*3*BINS];
+                for (size_t i=first;i<last;i++)
+                {
+                    const BuildTriangle& t = triangles[i];
+                    glm::vec3 center = t.center();
+
+                    for (int c=0;c<3;c++)
+                    {
+                        if (scale[c]>0)
+                            b[c*BINS+binOf(center[c],extent.centerLow[c],scale[c])].add(t.low,t.high,1);
+                    }
+                }
+            });
+            for (int c=0;c<3;c++)
+            {
+                for (int b=0;b<BINS;b++)
+                {
+                    for (unsigned int block=0;block<threads;block++)
+                    {
+                        const Bin& other = blocks[(block*3+c)*BINS+b];
+                        bins[c][b].add(other.low,other.high,other.count);
+                    }
+                }
+            }
+        }
+
+        static float packCount(unsigned int triangles)
+        {
+            return (float)((triangles+3)/4);
+        }
+
+        static unsigned int binOf(float center,float low,float scale)
+        {
+            int b = (int)((center-low)*scale);
+            return (unsigned int)max(0,min((int)BINS-1,b));
+        }
+
+        vector<Task> tasks;
+    };
+
+    static glm::vec3 position(const float *positions,size_t stride,unsigned int v)
+    {
+        const float *p = (const float *)((const char *)positions + v*stride);
+        return glm::vec3(p[0],p[1],p[2]);
+    }
+
+    static float halfArea(const glm::vec3& low,const glm::vec3& high)
+    {
+        glm::vec3 d = high-low;
+        return d.x*d.y + d.y*d.z + d.z*d.x;
+    }
+
+    /*
+     * Turn the binary tree into nodes of four children and packs of four
+     * triangles
+     */
+    void collapse(const Builder& builder,const float *positions,size_t stride,
+                  const unsigned int *indices)
+    {
+        int tree;
+        const BuildNode& root = builder.resolve(0,0,tree);
+
+        nodes.reserve(builder.triangles.size()/4+1);
+        packs.reserve(builder.triangles.size()/2+1);
+        collapse(builder,tree,root,positions,stride,indices);
+    }
+
+    /*
+     * Make the node of four children for a node of the binary tree, by
+     * opening up its biggest children until there are four, and return its
+     * index. A leaf becomes a node with just that leaf, which only happens
+     * at the root.
+     */
+    int collapse(const Builder& builder,int tree,const BuildNode& node,
+                 const float *positions,size_t stride,const unsigned int *indices)
+    {
+        const BuildNode *children[4];
+        int childTrees[4];
+        int count = 0;
+
+        if (node.left==NONE)
+        {
+            children[count] = &node;
+            childTrees[count] = tree;
+            count++;
+        }
+        else
+        {
+            children[count] = &builder.resolve(tree,node.left,childTrees[count]);
+            count++;
+            children[count] = &builder.resolve(tree,node.right,childTrees[count]);
+            count++;
+        }
+        while (count<4)
+        {
+            int biggest = -1;
+            float area = -1;
+            for (int k=0;k<count;k++)
+            {
+                if ((children[k]->left!=NONE) && (halfArea(children[k]->low,children[k]->high)>area))
+                {
+                    biggest = k;
+                    area = halfArea(children[k]->low,children[k]->high);
+                }
+            }
+            if (biggest<0)
+                break;
+
+            const BuildNode *opened = children[biggest];
+            int openedTree = childTrees[biggest];
+            children[biggest] = &builder.resolve(openedTree,opened->left,childTrees[biggest]);
+            children[count] = &builder.resolve(openedTree,opened->right,childTrees[count]);
+            count++;
+        }
+
+        int index = (int)nodes.size();
+        nodes.push_back(Node());
+        for (int k=0;k<count;k++)
+        {
+            const BuildNode& c = *children[k];
+            Node& n = nodes[index];
+
+            n.minX[k] = c.low.x;
+            n.minY[k] = c.low.y;
+            n.minZ[k] = c.low.z;
+            n.maxX[k] = c.high.x;
+            n.maxY[k] = c.high.y;
+            n.maxZ[k] = c.high.z;
+            if (c.left==NONE)
+            {
+                n.child[k] = ~(int)packs.size();
+                n.count[k] = (c.count+3)/4;
+                addPacks(builder,c,positions,stride,indices);
+            }
+            else
+            {
+                //the nodes may move as they grow, so n is found again
+                int child = collapse(builder,childTrees[k],c,positions,stride,indices);
+                nodes[index].child[k] = child;
+            }
+        }
+        return index;
+    }
+
+    void addPacks(const Builder& builder,const BuildNode& leaf,const float *positions,
+                  size_t stride,const unsigned int *indices)
+    {
+        for (unsigned int i=0;i<leaf.count;i++)
+        {
+            if (i%4==0)
+                packs.push_back(Pack());
+
+            Pack& pack = packs.back();
+            unsigned int t = builder.triangles[leaf.begin+i].triangle;
+            glm::vec3 a = position(positions,stride,indices[3*t]);
+            glm::vec3 e1 = position(positions,stride,indices[3*t+1])-a;
+            glm::vec3 e2 = position(positions,stride,indices[3*t+2])-a;
+            int k = i%4;
+
+            pack.x[k] = a.x;
+            pack.y[k] = a.y;
+            pack.z[k] = a.z;
+            pack.e1x[k] = e1.x;
+            pack.e1y[k] = e1.y;
+            pack.e1z[k] = e1.z;
+            pack.e2x[k] = e2.x;
+            pack.e2y[k] = e2.y;
+            pack.e2z[k] = e2.z;
+            pack.triangle[k] = t;
+        }
+    }
+
+    /*
+     * Which of the four boxes of a node a ray goes through before maxDistance,
+     * as a bit for each, and how far along the ray it goes into each. The
+     * near side of a box is the one facing the ray, so that an inside out
+     * box is never gone through.
+     */
+    static unsigned int intersectBoxes(const Node& node,const glm::vec3& origin,
+                                       const float *inverse,float maxDistance,
+                                       float *starts)
+    {
+        const float *nearX = (inverse[0]>=0)?node.minX:node.maxX;
+        const float *farX = (inverse[0]>=0)?node.maxX:node.minX;
+        const float *nearY = (inverse[1]>=0)?node.minY:node.maxY;
+        const float *farY = (inverse[1]>=0)?node.maxY:node.minY;
+        const float *nearZ = (inverse[2]>=0)?node.minZ:node.maxZ;
+        const float *farZ = (inverse[2]>=0)?node.maxZ:node.minZ;
+#ifdef MESHBVH_SSE
+        __m128 ox = _mm_set1_ps(origin.x),oy = _mm_set1_ps(origin.y),oz = _mm_set1_ps(origin.z);
+        __m128 ix = _mm_set1_ps(inverse[0]),iy = _mm_set1_ps(inverse[1]),iz = _mm_set1_ps(inverse[2]);
+
+        __m128 tNear = _mm_max_ps(_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(nearX),ox),ix),
+                                  _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(nearY),oy),iy));
+        tNear = _mm_max_ps(tNear,_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(nearZ),oz),iz));
+        tNear = _mm_max_ps(tNear,_mm_setzero_ps());
+        __m128 tFar = _mm_min_ps(_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(farX),ox),ix),
+                                 _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(farY),oy),iy));
+        tFar = _mm_min_ps(tFar,_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(farZ),oz),iz));
+        tFar = _mm_min_ps(tFar,_mm_set1_ps(maxDistance));
+
+        _mm_storeu_ps(starts,tNear);
+        return (unsigned int)_mm_movemask_ps(_mm_cmple_ps(tNear,tFar));
+#else
+        unsigned int mask = 0;
+        for (int k=0;k<4;k++)
+        {
+            float tNear = max(max((nearX[k]-origin.x)*inverse[0],(nearY[k]-origin.y)*inverse[1]),
+                              max((nearZ[k]-origin.z)*inverse[2],0.0f));
+            float tFar = min(min((farX[k]-origin.x)*inverse[0],(farY[k]-origin.y)*inverse[1]),
+                             min((farZ[k]-origin.z)*inverse[2],maxDistance));
+            starts[k] = tNear;
+            if (tNear<=tFar)
+                mask |= 1<<k;
+        }
+        return mask;
+#endif
+    }
+
+    /*
+     * Test a ray against the four triangles of a pack (Moller and
+     * Trumbore), and if it hits one nearer than best, make that the hit
+     * \return true if the ray hits a triangle nearer than best
+     */
+    static bool intersectPack(const Pack& pack,const glm::vec3& origin,
+                              const glm::vec3& direction,float& best,RayHit& hit)
+    {
+        float t[4],u[4],v[4];
+        unsigned int mask;
+#ifdef MESHBVH_SSE
+        __m128 dx = _mm_set1_ps(direction.x),dy = _mm_set1_ps(direction.y),dz = _mm_set1_ps(direction.z);
+        __m128 e1x = _mm_loadu_ps(pack.e1x),e1y = _mm_loadu_ps(pack.e1y),e1z = _mm_loadu_ps(pack.e1z);
+        __m128 e2x = _mm_loadu_ps(pack.e2x),e2y = _mm_loadu_ps(pack.e2y),e2z = _mm_loadu_ps(pack.e2z);
+
+        //p = direction x e2
+        __m128 px = _mm_sub_ps(_mm_mul_ps(dy,e2z),_mm_mul_ps(dz,e2y));
+        __m128 py = _mm_sub_ps(_mm_mul_ps(dz,e2x),_mm_mul_ps(dx,e2z));
+        __m128 pz = _mm_sub_ps(_mm_mul_ps(dx,e2y),_mm_mul_ps(dy,e2x));
+        __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x,px),_mm_mul_ps(e1y,py)),_mm_mul_ps(e1z,pz));
+        __m128 inv = _mm_div_ps(_mm_set1_ps(1.0f),det);
+
+        //s = origin - corner
+        __m128 sx = _mm_sub_ps(_mm_set1_ps(origin.x),_mm_loadu_ps(pack.x));
+        __m128 sy = _mm_sub_ps(_mm_set1_ps(origin.y),_mm_loadu_ps(pack.y));
+        __m128 sz = _mm_sub_ps(_mm_set1_ps(origin.z),_mm_loadu_ps(pack.z));
+        __m128 uu = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx,px),_mm_mul_ps(sy,py)),
+                                          _mm_mul_ps(sz,pz)),inv);
+
+        //q = s x e1
+        __m128 qx = _mm_sub_ps(_mm_mul_ps(sy,e1z),_mm_mul_ps(sz,e1y));
+        __m128 qy = _mm_sub_ps(_mm_mul_ps(sz,e1x),_mm_mul_ps(sx,e1z));
+        __m128 qz = _mm_sub_ps(_mm_mul_ps(sx,e1y),_mm_mul_ps(sy,e1x));
+        __m128 vv = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx,qx),_mm_mul_ps(dy,qy)),
+                                          _mm_mul_ps(dz,qz)),inv);
+        __m128 tt = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x,qx),_mm_mul_ps(e2y,qy)),
+                                          _mm_mul_ps(e2z,qz)),inv);
+
+        //comparisons with a number that is not proper are false, so a
+        //triangle with no area is never hit
+        __m128 zero = _mm_setzero_ps();
+        __m128 inside = _mm_and_ps(_mm_cmpneq_ps(det,zero),
+                                   _mm_and_ps(_mm_cmpge_ps(uu,zero),_mm_cmpge_ps(vv,zero)));
+        inside = _mm_and_ps(inside,_mm_cmple_ps(_mm_add_ps(uu,vv),_mm_set1_ps(1.0f)));
+        inside = _mm_and_ps(inside,_mm_and_ps(_mm_cmpge_ps(tt,zero),_mm_cmplt_ps(tt,_mm_set1_ps(best))));
+        mask = (unsigned int)_mm_movemask_ps(inside);
+        if (mask==0)
+            return false;
+        _mm_storeu_ps(t,tt);
+        _mm_storeu_ps(u,uu);
+        _mm_storeu_ps(v,vv);
+#else
+        mask = 0;
+        for (int k=0;k<4;k++)
+        {
+            glm::vec3 e1(pack.e1x[k],pack.e1y[k],pack.e1z[k]);
+            glm::vec3 e2(pack.e2x[k],pack.e2y[k],pack.e2z[k]);
+            glm::vec3 p = glm::cross(direction,e2);
+            float det = glm::dot(e1,p);
+            float inv = 1.0f/det;
+            glm::vec3 s = origin-glm::vec3(pack.x[k],pack.y[k],pack.z[k]);
+            glm::vec3 q = glm::cross(s,e1);
+
+            u[k] = glm::dot(s,p)*inv;
+            v[k] = glm::dot(direction,q)*inv;
+            t[k] = glm::dot(e2,q)*inv;
+            if ((det!=0) && (u[k]>=0) && (v[k]>=0) && (u[k]+v[k]<=1) && (t[k]>=0) && (t[k]<best))
+                mask |= 1<<k;
+        }
+        if (mask==0)
+            return false;
+#endif
+        for (int k=0;k<4;k++)
+        {
+            if ((mask & (1<<k)) && (t[k]<best))
+            {
+                best = t[k];
+                hit.triangle = pack.triangle[k];
+                hit.u = u[k];
+                hit.v = v[k];
+                hit.distance = t[k];
+            }
+        }
+        return true;
+    }
+
+    vector<Node> nodes;
+    vector<Pack> packs;
+    size_t triangleCount;
+};
+
+}
+
+#endif
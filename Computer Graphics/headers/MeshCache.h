@@ -0,0 +1,429 @@
+#ifndef _MESHCACHE_H_
+#define _MESHCACHE_H_
+
+#include <glm/glm.hpp>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstdio>
+#include <thread>
+#include <chrono>
+#include <functional>
+#include "PolygonMesh.h"
+#include "MappedFile.h"
+#include "Hash.h"
+#include "Parallel.h"
+#include "VertexLayout.h"
+using namespace std;
+
+namespace util
+{
+
+/*
+ * Saves a PolygonMesh to a compact binary file, and loads it back, so that
+ * a mesh imported from a text file once can afterwards be loaded without
+ * being parsed and processed again.
+ *
+ * A cache file holds, in this order:
+ *
+ * <ul>
+ *     <li>A fixed-size header: a magic number and format version, the key
+ *         the mesh was saved under, the vertex and index counts, the
+ *         primitive type and size, the counts of what its source held, and
+ *         the bounding box, sphere and oriented box.</li>
+ *     <li>The name and number of floats of every vertex attribute.</li>
+ *     <li>The attributes of all the vertices, as floats, one vertex after
+ *         the other.</li>
+ *     <li>The indices.</li>
+ *     <li>The sub-meshes: the index range of each, followed by its name
+ *         and material name.</li>
+ * </ul>
+ *
+ * The key is chosen by the caller and should change whenever the mesh that
+ * would be built from the source changes (for example a hash of the source
+ * file and of the options it was imported with). A cache file whose key,
+ * version or size does not match is ignored. Cache files are written in the
+ * byte order of the machine that wrote them; a file from a machine with the
+ * other byte order fails the magic number check and is ignored too.
+ */
+/*
+ * The counts of what the source of a cached mesh held. They cannot be found
+ * from the mesh once it has been welded or made into strips, so they are
+ * kept in the cache file for a mesh loaded from it to report.
+ */
+class MeshSourceCounts
+{
+public:
+    MeshSourceCounts()
+    {
+        positions = texcoords = normals = 0;
+        triangles = corners = 0;
+    }
+
+    //the positions, texture coordinates and normals in the source
+    unsigned long long positions,texcoords,normals;
+    //the triangles in the source, and their corners
+    unsigned long long triangles,corners;
+};
+
+template <class K>
+class MeshCache
+{
+public:
+    /*
+     * \param sourceFile the file the mesh is built from
+     * \param variant what tells apart meshes built from the same file in
+     *        different ways, such as a hash of the options they are
+     *        imported with, so that each has a cache file of its own
+     * \return the name of the cache file kept next to the source file
+     */
+    static string cacheFileFor(const string& sourceFile,unsigned long long variant)
+    {
+        char hex[17];
+
+        snprintf(hex,sizeof(hex),"%016llx",variant);
+        return sourceFile + "." + hex + ".meshcache";
+    }
+
+    /*
+     * Load a mesh from a cache file. The file is memory-mapped and its
+     * contents are copied straight into the vertices.
+     * \param filename the path of the cache file
+     * \param key the key the mesh must have been saved under
+     * \param mesh set to the cached mesh if it could be loaded
+     * \param threads the number of threads used to fill in the vertices, 0
+     *        for one per core
+     * \return true if the mesh was loaded, false if the file does not exist,
+     *         is damaged, is out of date or was made for another vertex type
+     */
+    static bool load(const string& filename,
+                     unsigned long long key,
+                     PolygonMesh<K>& mesh,
+                     unsigned int threads=1)
+    {
+        MeshSourceCounts source;
+
+        return load(filename,key,mesh,source,threads);
+    }
+
+    /*
+     * Load a mesh from a cache file, and the counts of what its source held
+     * \param source set to the counts the mesh was saved with
+     */
+    static bool load(const string& filename,
+                     unsigned long long key,
+                     PolygonMesh<K>& mesh,
+                     MeshSourceCounts& source,
+                     unsigned int threads)
+    {
+        MappedFile file;
+
+        try
+        {
+            file.open(filename);
+        }
+        catch (runtime_error&)
+        {
+            return false;
+        }
+
+        const char *p = file.data();
+        const char *end = p + file.size();
+        Header header;
+
+        if ((size_t)(end-p)<sizeof(Header))
+            return false;
+        memcpy(&header,p,sizeof(Header));
+        p += sizeof(Header);
+
+        if ((header.magic!=MAGIC) || (header.version!=VERSION) || (header.key!=key))
+            return false;
+
+        //the attributes must be the ones this vertex type has, in its order
+        K probe;
+        vector<string> names = probe.getAllAttributes();
+        vector<unsigned int> components;
+        unsigned int floatsPerVertex = 0;
+        unsigned int i;
+
+        if (header.attributeCount!=names.size())
+            return false;
+
+        for (i=0;i<header.attributeCount;i++)
+        {
+            unsigned int record[2]; //name length, number of floats
+
+            if ((size_t)(end-p)<sizeof(record))
+                return false;
+            memcpy(record,p,sizeof(record));
+            p += sizeof(record);
+            if (((size_t)(end-p)<padded(record[0]))
+                    || (names[i]!=string(p,record[0])))
+                return false;
+            p += padded(record[0]);
+            components.push_back(record[1]);
+            floatsPerVertex += record[1];
+        }
+
+        if (floatsPerVertex!=header.floatsPerVertex)
+            return false;
+
+        size_t vertexBytes = (size_t)header.vertexCount*floatsPerVertex*sizeof(float);
+        size_t indexBytes = (size_t)header.indexCount*sizeof(unsigned int);
+        if ((size_t)(end-p)<vertexBytes+indexBytes)
+            return false;
+
+        vector<SubMesh> subMeshes;
+        const char *q = p+vertexBytes+indexBytes;
+        for (i=0;i<header.subMeshCount;i++)
+        {
+            unsigned int record[4]; //first index, index count, name lengths
+            SubMesh s;
+
+            if ((size_t)(end-q)<sizeof(record))
+                return false;
+            memcpy(record,q,sizeof(record));
+            q += sizeof(record);
+            if ((size_t)(end-q)<padded(record[2])+padded(record[3]))
+                return false;
+            s.firstIndex = record[0];
+            s.indexCount = record[1];
+            s.name = string(q,record[2]);
+            q += padded(record[2]);
+            s.materialName = string(q,record[3]);
+            q += padded(record[3]);
+            subMeshes.push_back(s);
+        }
+        if (q!=end)
+            return false;
+
+        const char *vertexBlock = p;
+        vector<K> vertexData(header.vertexCount);
+        vector<VertexAccess<K> > attributes;
+        for (i=0;i<names.size();i++)
+            attributes.push_back(VertexAccess<K>(names[i],probe));
+        parallelFor(0,vertexData.size(),threads,
+                    [&](size_t first,size_t last,unsigned int)
+        {
+            //the floats are not necessarily aligned within the mapped file
+            vector<float> data(floatsPerVertex);
+
+            for (size_t v=first;v<last;v++)
+            {
+                const float *f = data.empty()?NULL:&data[0];
+
+                if (!data.empty())
+                    memcpy(&data[0],vertexBlock + v*floatsPerVertex*sizeof(float),floatsPerVertex*sizeof(float));
+                for (unsigned int a=0;a<attributes.size();a++)
+                {
+                    attributes[a].write(vertexData[v],f,components[a]);
+                    f += components[a];
+                }
+            }
+        });
+        p += vertexBytes;
+
+        vector<unsigned int> primitives(header.indexCount);
+        if (indexBytes>0)
+            memcpy(&primitives[0],p,indexBytes);
+
+        BoundingSphere sphere;
+        OrientedBox box;
+        sphere.center = glm::vec3(header.sphere[0],header.sphere[1],header.sphere[2]);
+        sphere.radius = header.sphere[3];
+        box.center = glm::vec3(header.boxCenter[0],header.boxCenter[1],header.boxCenter[2]);
+        for (i=0;i<3;i++)
+            box.axes[i] = glm::vec3(header.boxAxes[i][0],header.boxAxes[i][1],header.boxAxes[i][2]);
+        box.halfExtents = glm::vec3(header.boxHalfExtents[0],header.boxHalfExtents[1],header.boxHalfExtents[2]);
+
+        mesh.setVertexData(std::move(vertexData),
+                           glm::vec4(header.minBounds[0],header.minBounds[1],
+                                     header.minBounds[2],header.minBounds[3]),
+                           glm::vec4(header.maxBounds[0],header.maxBounds[1],
+                                     header.maxBounds[2],header.maxBounds[3]),
+                           sphere,box);
+        mesh.setPrimitives(std::move(primitives));
+        mesh.setSubMeshes(std::move(subMeshes));
+        mesh.setPrimitiveType(header.primitiveType);
+        mesh.setPrimitiveSize(header.primitiveSize);
+        source.positions = header.sourcePositions;
+        source.texcoords = header.sourceTexcoords;
+        source.normals = header.sourceNormals;
+        source.triangles = header.sourceTriangles;
+        source.corners = header.sourceCorners;
+        return true;
+    }
+
+    /*
+     * Save a mesh to a cache file, replacing it if it exists
+     * \param filename the path of the cache file
+     * \param key the key that a later load must ask for
+     * \param mesh the mesh to be saved
+     * \return true if the whole file was written
+     */
+    static bool save(const string& filename,
+                     unsigned long long key,
+                     const PolygonMesh<K>& mesh)
+    {
+        return save(filename,key,mesh,MeshSourceCounts());
+    }
+
+    /*
+     * Save a mesh to a cache file, with the counts of what its source held
+     */
+    static bool save(const string& filename,
+                     unsigned long long key,
+                     const PolygonMesh<K>& mesh,
+                     const MeshSourceCounts& source)
+    {
+        const vector<K>& vertexData = mesh.getVertexAttributesRef();
+        const vector<unsigned int>& primitives = mesh.getPrimitivesRef();
+        const vector<SubMesh>& subMeshes = mesh.getSubMeshesRef();
+        K probe;
+        vector<string> names = probe.getAllAttributes();
+        vector<unsigned int> components;
+        vector<VertexAccess<K> > access;
+        Header header;
+        string attributes;
+        unsigned int i,j;
+
+        //the number of floats of each attribute is taken from the first vertex
+        header.floatsPerVertex = 0;
+        for (i=0;i<names.size();i++)
+        {
+            unsigned int record[2];
+
+            if (vertexData.size()>0)
+                access.push_back(VertexAccess<K>(names[i],vertexData[0]));
+            record[0] = (unsigned int)names[i].length();
+            record[1] = (vertexData.size()>0)?access[i].getSize():0;
+            attributes.append((const char *)record,sizeof(record));
+            attributes.append(names[i]);
+            attributes.append(padded(record[0])-record[0],'\0');
+            components.push_back(record[1]);
+            header.floatsPerVertex += record[1];
+        }
+
+        header.magic = MAGIC;
+        header.version = VERSION;
+        header.key = key;
+        header.vertexCount = (unsigned int)vertexData.size();
+        header.indexCount = (unsigned int)primitives.size();
+        header.primitiveType = mesh.getPrimitiveType();
+        header.primitiveSize = mesh.getPrimitiveSize();
+        header.attributeCount = (unsigned int)names.size();
+        header.subMeshCount = (unsigned int)subMeshes.size();
+        header.reserved = 0;
+        header.sourcePositions = source.positions;
+        header.sourceTexcoords = source.texcoords;
+        header.sourceNormals = source.normals;
+        header.sourceTriangles = source.triangles;
+        header.sourceCorners = source.corners;
+        glm::vec4 minimum = mesh.getMinimumBounds();
+        glm::vec4 maximum = mesh.getMaximumBounds();
+        for (i=0;i<4;i++)
+        {
+            header.minBounds[i] = minimum[i];
+            header.maxBounds[i] = maximum[i];
+        }
+        BoundingSphere sphere = mesh.getBoundingSphere();
+        OrientedBox box = mesh.getOrientedBox();
+        for (i=0;i<3;i++)
+        {
+            header.sphere[i] = sphere.center[i];
+            header.boxCenter[i] = box.center[i];
+            header.boxHalfExtents[i] = box.halfExtents[i];
+            for (j=0;j<3;j++)
+                header.boxAxes[i][j] = box.axes[i][j];
+        }
+        header.sphere[3] = sphere.radius;
+
+        vector<float> floats((size_t)vertexData.size()*header.floatsPerVertex);
+        unsigned int offset = 0;
+        for (j=0;j<access.size();j++)
+        {
+            if (components[j]>0)
+                access[j].read(&vertexData[0],vertexData.size(),&floats[offset],header.floatsPerVertex);
+            offset += components[j];
+        }
+
+        string ranges;
+        for (i=0;i<subMeshes.size();i++)
+        {
+            unsigned int record[4];
+
+            record[0] = subMeshes[i].firstIndex;
+            record[1] = subMeshes[i].indexCount;
+            record[2] = (unsigned int)subMeshes[i].name.length();
+            record[3] = (unsigned int)subMeshes[i].materialName.length();
+            ranges.append((const char *)record,sizeof(record));
+            ranges.append(subMeshes[i].name);
+            ranges.append(padded(record[2])-record[2],'\0');
+            ranges.append(subMeshes[i].materialName);
+            ranges.append(padded(record[3])-record[3],'\0');
+        }
+
+        //written to a file of its own next to the cache file and then renamed
+        //over it, so that a loader never maps a half-written cache
+        char suffix[32];
+        unsigned long long writer = Hash::value(hash<thread::id>()(this_thread::get_id()),
+                                                (unsigned long long)chrono::high_resolution_clock::now().time_since_epoch().count());
+        snprintf(suffix,sizeof(suffix),".%016llx.tmp",writer);
+        string temporary = filename + suffix;
+        ofstream out(temporary.c_str(),ios::out | ios::binary | ios::trunc);
+        if (!out)
+            return false;
+
+        out.write((const char *)&header,sizeof(header));
+        out.write(attributes.data(),attributes.length());
+        if (floats.size()>0)
+            out.write((const char *)&floats[0],floats.size()*sizeof(float));
+        if (primitives.size()>0)
+            out.write((const char *)&primitives[0],primitives.size()*sizeof(unsigned int));
+        out.write(ranges.data(),ranges.length());
+        out.close();
+
+        if (!out)
+        {
+            //do not leave a partial file behind
+            remove(temporary.c_str());
+            return false;
+        }
+        if (!MappedFile::replace(temporary,filename))
+        {
+            remove(temporary.c_str());
+            return false;
+        }
+        return true;
+    }
+
+private:
+    enum { MAGIC = 0x4853454D }; // "MESH" read as a little-endian number
+    enum { VERSION = 4 };
+
+    class Header
+    {
+    public:
+        unsigned int magic,version;
+        unsigned long long key;
+        unsigned int vertexCount,indexCount;
+        int primitiveType,primitiveSize;
+        unsigned int attributeCount,floatsPerVertex;
+        unsigned int subMeshCount,reserved;
+        unsigned long long sourcePositions,sourceTexcoords,sourceNormals;
+        unsigned long long sourceTriangles,sourceCorners;
+        float minBounds[4],maxBounds[4];
+        float sphere[4]; //center, radius
+        float boxCenter[3],boxAxes[3][3],boxHalfExtents[3];
+    };
+
+    //attribute names are padded so that the floats after them stay aligned
+    static size_t padded(size_t length)
+    {
+        return (length+3) & ~(size_t)3;
+    }
+};
+}
+
+#endif
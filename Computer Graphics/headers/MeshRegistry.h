@@ -0,0 +1,274 @@
+#ifndef _MESHREGISTRY_H_
+#define _MESHREGISTRY_H_
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <future>
+#include <exception>
+#include <cstdlib>
+#include <climits>
+#include <cctype>
+#include <sstream>
+#include "PolygonMesh.h"
+#include "ObjImporter.h"
+#include "Hash.h"
+#include "VertexLayout.h"
+using namespace std;
+
+namespace util
+{
+
+/*
+ * Hands out meshes loaded from OBJ files so that each distinct mesh is held
+ * in memory only once, however many scenes or scene nodes use it.
+ *
+ * A mesh is looked up first by the canonical path of its file (together
+ * with the import options that change the result), so a file named through
+ * different relative paths is read once. A newly loaded mesh is then
+ * compared with the ones already held by a hash of its contents, so that
+ * different files with identical geometry share one mesh as well.
+ *
+ * Meshes are returned as shared pointers to const meshes: they may be in
+ * use by several owners, so nobody may change them. A renderer can
+ * recognize a mesh it has already uploaded by its address.
+ *
+ * A registry may be used from several threads at once. If two threads ask
+ * for the same file, it is loaded once and both get the result.
+ */
+template <class K>
+class MeshRegistry
+{
+public:
+    typedef shared_ptr<const PolygonMesh<K> > MeshPointer;
+
+    /*
+     * Returns the mesh in the given file, loading it if it has not been
+     * loaded before with the same options
+     * \param path the path of the OBJ file
+     * \param options how the file is imported, if it has to be
+     * \throws string if the file has to be loaded, and cannot be
+     */
+    MeshPointer load(const string& path,const ObjImportOptions& options) throw(string)
+    {
+        ostringstream keyText;
+        keyText << canonicalPath(path) << (options.scaleAndCenter?"|scaled|":"||")
+                << options.normals.weighting << "|" << options.normals.creaseAngle
+                << (options.optimizeVertexCache?"|optimized":"|")
+                << (options.triangleStrips?"|strips":"|");
+        if (options.weldVertices)
+            keyText << "|welded|" << options.welding.tolerance << "|"
+                    << options.welding.attributeTolerance;
+        string key = keyText.str();
+        shared_ptr<promise<MeshPointer> > loading;
+        shared_future<MeshPointer> result;
+
+        {
+            unique_lock<mutex> lock(registryLock);
+            typename map<string,shared_future<MeshPointer> >::iterator it = byPath.find(key);
+            if (it!=byPath.end())
+            {
+                result = it->second;
+            }
+            else
+            {
+                loading = shared_ptr<promise<MeshPointer> >(new promise<MeshPointer>());
+                result = loading->get_future().share();
+                byPath[key] = result;
+            }
+        }
+
+        if (!loading)
+        {
+            //loaded, or being loaded by another thread
+            return result.get();
+        }
+
+        try
+        {
+            PolygonMesh<K> *mesh = new PolygonMesh<K>(ObjImporter<K>::importFile(path,options));
+            loading->set_value(share(MeshPointer(mesh)));
+        }
+        catch (...)
+        {
+            //let a later call try again
+            {
+                unique_lock<mutex> lock(registryLock);
+                byPath.erase(key);
+            }
+            loading->set_exception(current_exception());
+        }
+        return result.get();
+    }
+
+    /*
+     * Add a mesh that did not come from a file, or return an identical mesh
+     * that is already held
+     */
+    MeshPointer add(const PolygonMesh<K>& mesh)
+    {
+        return share(MeshPointer(new PolygonMesh<K>(mesh)));
+    }
+
+    /*
+     * \return the number of distinct meshes held
+     */
+    int getMeshCount()
+    {
+        unique_lock<mutex> lock(registryLock);
+
+        return (int)byContent.size();
+    }
+
+    /*
+     * Forget all the meshes. Meshes still in use elsewhere stay alive until
+     * their last owner lets go of them.
+     */
+    void clear()
+    {
+        unique_lock<mutex> lock(registryLock);
+
+        byPath.clear();
+        byContent.clear();
+    }
+
+    /*
+     * Returns the absolute path of a file, with "." and ".." and symbolic
+     * links resolved, so that two paths name the same file exactly when
+     * they are equal. Paths are not case sensitive on Windows, so there the
+     * result is in lower case.
+     */
+    static string canonicalPath(const string& path)
+    {
+#ifdef _WIN32
+        char resolved[_MAX_PATH];
+        if (_fullpath(resolved,path.c_str(),_MAX_PATH)==NULL)
+            return path;
+        string result(resolved);
+        for (unsigned int i=0;i<result.length();i++)
+        {
+            result[i] = (char)tolower((unsigned char)result[i]);
+            if (result[i]=='/')
+                result[i] = '\\';
+        }
+        return result;
+#else
+        char resolved[PATH_MAX];
+        if (realpath(path.c_str(),resolved)==NULL)
+            return path;
+        return string(resolved);
+#endif
+    }
+
+private:
+    /*
+     * Return the mesh already held with the same contents as this one, or
+     * start holding this one
+     */
+    MeshPointer share(const MeshPointer& mesh)
+    {
+        vector<float> contents;
+        unsigned long long hash = contentHash(*mesh,contents);
+        unique_lock<mutex> lock(registryLock);
+
+        pair<typename multimap<unsigned long long,MeshPointer>::iterator,
+             typename multimap<unsigned long long,MeshPointer>::iterator> same = byContent.equal_range(hash);
+        for (typename multimap<unsigned long long,MeshPointer>::iterator it=same.first;it!=same.second;it++)
+        {
+            //equal hashes almost always mean equal meshes, but make sure
+            if (sameContents(*mesh,contents,*(it->second)))
+                return it->second;
+        }
+        byContent.insert(make_pair(hash,mesh));
+        return mesh;
+    }
+
+    /*
+     * Hash everything that would be drawn: the vertex attributes, the
+     * indices, how they are read, and the parts the mesh is divided into
+     * \param contents filled with the vertex attributes, one vertex after
+     *        the other
+     */
+    static unsigned long long contentHash(const PolygonMesh<K>& mesh,vector<float>& contents)
+    {
+        const vector<K>& vertexData = mesh.getVertexAttributesRef();
+        const vector<unsigned int>& primitives = mesh.getPrimitivesRef();
+        const vector<SubMesh>& subMeshes = mesh.getSubMeshesRef();
+        K probe;
+        vector<string> names = probe.getAllAttributes();
+        unsigned long long hash;
+        unsigned int i;
+
+        //the attributes of all the vertices, packed one vertex after the other
+        contents.clear();
+        if (vertexData.size()>0)
+        {
+            vector<VertexAccess<K> > attributes;
+            size_t floatsPerVertex = 0,offset = 0;
+
+            for (i=0;i<names.size();i++)
+            {
+                attributes.push_back(VertexAccess<K>(names[i],vertexData[0]));
+                floatsPerVertex += attributes[i].getSize();
+            }
+            contents.resize(vertexData.size()*floatsPerVertex);
+            for (i=0;i<attributes.size();i++)
+            {
+                if (attributes[i].getSize()>0)
+                    attributes[i].read(&vertexData[0],vertexData.size(),&contents[offset],floatsPerVertex);
+                offset += attributes[i].getSize();
+            }
+        }
+
+        hash = Hash::value(vertexData.size());
+        hash = Hash::bytes(contents.empty()?NULL:&contents[0],contents.size()*sizeof(float),hash);
+        hash = Hash::bytes(primitives.empty()?NULL:&primitives[0],primitives.size()*sizeof(unsigned int),hash);
+        hash = Hash::value(mesh.getPrimitiveType(),hash);
+        hash = Hash::value(mesh.getPrimitiveSize(),hash);
+        for (i=0;i<subMeshes.size();i++)
+        {
+            hash = Hash::value(subMeshes[i].firstIndex,hash);
+            hash = Hash::value(subMeshes[i].indexCount,hash);
+            hash = Hash::text(subMeshes[i].name,hash);
+            hash = Hash::text(subMeshes[i].materialName,hash);
+        }
+        return hash;
+    }
+
+    static bool sameContents(const PolygonMesh<K>& a,const vector<float>& aContents,const PolygonMesh<K>& b)
+    {
+        vector<float> bContents;
+        const vector<SubMesh>& aParts = a.getSubMeshesRef();
+        const vector<SubMesh>& bParts = b.getSubMeshesRef();
+
+        if ((a.getVertexCount()!=b.getVertexCount())
+                || (a.getPrimitiveType()!=b.getPrimitiveType())
+                || (a.getPrimitiveSize()!=b.getPrimitiveSize())
+                || (aParts.size()!=bParts.size())
+                || (a.getPrimitivesRef()!=b.getPrimitivesRef()))
+            return false;
+
+        for (unsigned int i=0;i<aParts.size();i++)
+        {
+            if ((aParts[i].firstIndex!=bParts[i].firstIndex)
+                    || (aParts[i].indexCount!=bParts[i].indexCount)
+                    || (aParts[i].name!=bParts[i].name)
+                    || (aParts[i].materialName!=bParts[i].materialName))
+                return false;
+        }
+
+        contentHash(b,bContents);
+        return aContents==bContents;
+    }
+
+    mutex registryLock;
+    //the meshes by file (and import options)
+    map<string,shared_future<MeshPointer> > byPath;
+    //the distinct meshes by the hash of their contents
+    multimap<unsigned long long,MeshPointer> byContent;
+};
+}
+
+#endif
@@ -0,0 +1,755 @@
+#ifndef _MESHSIMPLIFIER_H_
+#define _MESHSIMPLIFIER_H_
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <cstddef>
+#include <cstring>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+using namespace std;
+
+namespace util
+{
+
+/*
+ * Simplifies a triangle list by collapsing edges, choosing the cheapest
+ * collapses by the quadric error metric of Garland and Heckbert.
+ *
+ * An edge is collapsed by moving one of its vertices onto the other, so
+ * no new vertices are made: the triangles around the vertex that moves use
+ * the other one instead, and the two triangles on the edge disappear. The
+ * quadric of a vertex measures the squared distance to the planes of the
+ * triangles that have been merged into it, so the cost of a collapse is
+ * about how far it moves the surface.
+ *
+ * Vertices at the same position are one point of the surface. How a point
+ * may move depends on where it is:
+ *
+ * <ul>
+ *     <li>inside a smooth surface (one vertex, every edge shared by two
+ *         triangles that agree on its vertices): onto any neighbour</li>
+ *     <li>on the border of an open surface: only along the border</li>
+ *     <li>on an attribute seam, where two vertices share a position but
+ *         differ in texture coordinates or normals: only along the seam,
+ *         each vertex onto the vertex on its own side</li>
+ *     <li>anywhere else (where seams or borders meet or end, where parts
+ *         meet, on edges of more than two triangles): not at all</li>
+ * </ul>
+ *
+ * so seams, borders and the borders between parts keep their place and, as
+ * far as the error allows, their shape.
+ *
+ * The simplifier keeps its state between calls, so that a chain of levels
+ * of detail can be made by simplifying to smaller and smaller targets, each
+ * level continuing from the one before and its error measured against the
+ * original surface.
+ */
+class MeshSimplifier
+{
+public:
+    /*
+     * \param positions the position of the first vertex, as three floats
+     * \param stride the distance from one position to the next, in bytes
+     * \param vertexCount the number of vertices
+     * \param indices the triangles, three indices each
+     * \param indexCount the number of indices
+     * \param parts the part of every triangle, or NULL if there are no
+     *        parts
+     */
+    MeshSimplifier(const float *positions,size_t stride,size_t vertexCount,
+                   const unsigned int *indices,size_t indexCount,
+                   const unsigned int *parts)
+    {
+        size_t i;
+
+        this->indices.assign(indices,indices+indexCount/3*3);
+        triangleCount = this->indices.size()/3;
+        removed.assign(triangleCount,false);
+        if (parts!=NULL)
+            this->parts.assign(parts,parts+triangleCount);
+        error = 0;
+
+        this->positions.resize(vertexCount);
+        for (i=0;i<vertexCount;i++)
+        {
+            const float *p = (const float *)((const char *)positions + i*stride);
+            this->positions[i] = glm::vec3(p[0],p[1],p[2]);
+        }
+
+        //any index out of range leaves the triangles as they are
+        for (i=0;i<this->indices.size();i++)
+        {
+            if (this->indices[i]>=vertexCount)
+            {
+                triangleCount = 0;
+                return;
+            }
+        }
+
+        findPoints();
+
+        //a triangle with two corners at the same point covers nothing, but
+        //would get in the way of collapses around it
+        for (i=0;i<triangleCount;i++)
+        {
+            const unsigned int *v = &this->indices[3*i];
+
+            if ((point[v[0]]==point[v[1]]) || (point[v[1]]==point[v[2]])
+                    || (point[v[2]]==point[v[0]]))
+                removed[i] = true;
+        }
+        triangleCount -= count(removed.begin(),removed.end(),true);
+
+        classifyPoints();
+        computeQuadrics();
+    }
+
+    /*
+     * Collapse edges until at most targetTriangles triangles are left, or
+     * no more can be collapsed
+     * \param maxError collapses that would make the error more than this,
+     *        in the units of the positions, are not made
+     */
+    void simplify(size_t targetTriangles,
+                  float maxError=numeric_limits<float>::max())
+    {
+        while (triangleCount>targetTriangles)
+        {
+            if (pass(targetTriangles,maxError)==0)
+                break;
+        }
+    }
+
+    /*
+     * The triangles left
+     */
+    size_t getTriangleCount() const
+    {
+        return triangleCount;
+    }
+
+    /*
+     * Whether a triangle of those given has been collapsed away
+     */
+    bool isRemoved(size_t triangle) const
+    {
+        return removed[triangle];
+    }
+
+    /*
+     * The three indices of a triangle of those given, after the collapses
+     */
+    const unsigned int *getTriangle(size_t triangle) const
+    {
+        return &indices[3*triangle];
+    }
+
+    /*
+     * The largest error of the collapses made so far: the root mean square
+     * distance from the point that moved to the planes of the original
+     * triangles merged into it, in the units of the positions
+     */
+    float getError() const
+    {
+        return error;
+    }
+
+private:
+    enum { NONE = -1 };
+    //how a point may move
+    enum Kind { MANIFOLD, BORDER, SEAM, LOCKED };
+
+    /*
+     * A symmetric 4x4 matrix summing the squared distance to planes
+     */
+    class Quadric
+    {
+    public:
+        Quadric()
+        {
+            memset(q,0,sizeof(q));
+            weight = 0;
+        }
+
+        void addPlane(const glm::dvec3& n,double d,double w)
+        {
+            q[0] += w*n.x*n.x; q[1] += w*n.x*n.y; q[2] += w*n.x*n.z; q[3] += w*n.x*d;
+            q[4] += w*n.y*n.y; q[5] += w*n.y*n.z; q[6] += w*n.y*d;
+            q[7] += w*n.z*n.z; q[8] += w*n.z*d;
+            q[9] += w*d*d;
+        }
+
+        void add(const Quadric& other)
+        {
+            for (int i=0;i<10;i++)
+                q[i] += other.q[i];
+            weight += other.weight;
+        }
+
+        //the sum divided by the weight: with planes weighted by the areas of
+        //their triangles and weight their total area, the mean squared
+        //distance over the surface
+        double evaluate(const glm::vec3& p) const
+        {
+            double x = p.x,y = p.y,z = p.z;
+            double e = q[0]*x*x + 2*q[1]*x*y + 2*q[2]*x*z + 2*q[3]*x
+                    + q[4]*y*y + 2*q[5]*y*z + 2*q[6]*y
+                    + q[7]*z*z + 2*q[8]*z
+                    + q[9];
+
+            return (weight>0)?max(e,0.0)/weight:0;
+        }
+
+        double q[10];
+        double weight;
+    };
+
+    class Collapse
+    {
+    public:
+        Collapse(float cost,unsigned int from,unsigned int to)
+        {
+            this->cost = cost;
+            this->from = from;
+            this->to = to;
+        }
+
+        bool operator<(const Collapse& other) const
+        {
+            return cost<other.cost;
+        }
+
+        float cost;
+        unsigned int from,to;
+    };
+
+    class PositionBits
+    {
+    public:
+        bool operator<(const PositionBits& other) const
+        {
+            if (bits[0]!=other.bits[0])
+                return bits[0]<other.bits[0];
+            if (bits[1]!=other.bits[1])
+                return bits[1]<other.bits[1];
+            return bits[2]<other.bits[2];
+        }
+
+        unsigned int bits[3];
+    };
+
+    /*
+     * One side of an edge: the edge from one corner of a triangle to the
+     * next, keyed by the points at its ends
+     */
+    class HalfEdge
+    {
+    public:
+        bool operator<(const HalfEdge& other) const
+        {
+            return key<other.key;
+        }
+
+        unsigned long long key;
+        unsigned int from,to,triangle;
+    };
+
+    /*
+     * Number the distinct positions. Positions are compared by their bits,
+     * so that a NaN cannot upset the sort.
+     */
+    void findPoints()
+    {
+        size_t vertexCount = positions.size();
+        vector<pair<PositionBits,unsigned int> > order(vertexCount);
+        size_t i;
+
+        for (i=0;i<vertexCount;i++)
+        {
+            memcpy(order[i].first.bits,&positions[i].x,sizeof(order[i].first.bits));
+            order[i].second = (unsigned int)i;
+        }
+        sort(order.begin(),order.end());
+
+        point.assign(vertexCount,0);
+        pointCount = 0;
+        for (i=0;i<vertexCount;i++)
+        {
+            if ((i>0) && (order[i-1].first<order[i].first))
+                pointCount++;
+            point[order[i].second] = (unsigned int)pointCount;
+        }
+        if (vertexCount>0)
+            pointCount++;
+
+        //a point without a proper position cannot be measured, and a point
+        //between parts keeps them together
+        fixed.assign(pointCount,false);
+        for (i=0;i<vertexCount;i++)
+        {
+            const glm::vec3& p = positions[i];
+
+            if (!((fabs(p.x)<=numeric_limits<float>::max())
+                  && (fabs(p.y)<=numeric_limits<float>::max())
+                  && (fabs(p.z)<=numeric_limits<float>::max())))
+                fixed[point[i]] = true;
+        }
+        vector<unsigned int> partOfPoint(pointCount,(unsigned int)NONE);
+        for (i=0;(parts.size()>0) && (i<indices.size());i++)
+        {
+            unsigned int& part = partOfPoint[point[indices[i]]];
+
+            if (part==(unsigned int)NONE)
+                part = parts[i/3];
+            else if (part!=parts[i/3])
+                fixed[point[indices[i]]] = true;
+        }
+    }
+
+    /*
+     * Find how every point may move, from the triangles left. This changes
+     * as the surface is simplified: a point whose neighbour along a border
+     * has collapsed onto the next one moves along the border to that one.
+     */
+    void classifyPoints()
+    {
+        size_t i,t;
+
+        //the vertices at every point, up to two
+        vertexAt.assign(2*pointCount,(unsigned int)NONE);
+        vector<unsigned char> vertexCount(pointCount,0);
+        for (t=0;t<removed.size();t++)
+        {
+            for (int k=0;(k<3) && !removed[t];k++)
+            {
+                unsigned int v = indices[3*t+k];
+                unsigned int p = point[v];
+
+                if ((vertexCount[p]==0) || ((vertexCount[p]==1) && (vertexAt[2*p]!=v)))
+                    vertexAt[2*p+vertexCount[p]++] = v;
+                else if ((vertexCount[p]==2) && (vertexAt[2*p]!=v) && (vertexAt[2*p+1]!=v))
+                    vertexCount[p] = 3;
+            }
+        }
+
+        //the two sides of every edge
+        edges.clear();
+        for (t=0;t<removed.size();t++)
+        {
+            for (int k=0;(k<3) && !removed[t];k++)
+            {
+                HalfEdge e;
+                e.from = indices[3*t+k];
+                e.to = indices[3*t+(k+1)%3];
+                e.triangle = (unsigned int)t;
+
+                unsigned long long a = point[e.from],b = point[e.to];
+                if (a==b)
+                    continue;
+                e.key = (min(a,b)<<32) | max(a,b);
+                edges.push_back(e);
+            }
+        }
+        sort(edges.begin(),edges.end());
+
+        //the border and seam edges at every point, and the points at their
+        //other ends
+        vector<unsigned char> borders(pointCount,0),seams(pointCount,0);
+        vector<bool> tangled(pointCount,false);
+        along.assign(2*pointCount,(unsigned int)NONE);
+        boundary.clear();
+        for (i=0;i<edges.size();)
+        {
+            size_t j = i;
+            while ((j<edges.size()) && (edges[j].key==edges[i].key))
+                j++;
+
+            unsigned int a = (unsigned int)(edges[i].key>>32);
+            unsigned int b = (unsigned int)(edges[i].key & 0xffffffff);
+            vector<unsigned char> *count = NULL;
+
+            if (j-i==1)
+                count = &borders;
+            else if (j-i==2)
+            {
+                const HalfEdge& e = edges[i];
+                const HalfEdge& f = edges[i+1];
+
+                //if the two triangles share the vertices of the edge it is
+                //smooth, otherwise it is a seam. Which way round they run
+                //does not matter: some models are not wound consistently
+                if (!(((e.from==f.to) && (e.to==f.from))
+                      || ((e.from==f.from) && (e.to==f.to))))
+                    count = &seams;
+            }
+            else
+                tangled[a] = tangled[b] = true;
+
+            if (count!=NULL)
+            {
+                if ((*count)[a]<2)
+                    along[2*a+(*count)[a]] = b;
+                if ((*count)[b]<2)
+                    along[2*b+(*count)[b]] = a;
+                (*count)[a]++;
+                (*count)[b]++;
+                for (size_t k=i;k<j;k++)
+                    boundary.push_back(edges[k]);
+            }
+            i = j;
+        }
+
+        kind.assign(pointCount,LOCKED);
+        for (i=0;i<pointCount;i++)
+        {
+            if (fixed[i] || tangled[i])
+                continue;
+            if ((vertexCount[i]==1) && (borders[i]==0) && (seams[i]==0))
+                kind[i] = MANIFOLD;
+            else if ((vertexCount[i]==1) && (borders[i]==2) && (seams[i]==0))
+                kind[i] = BORDER;
+            else if ((vertexCount[i]==2) && (borders[i]==0) && (seams[i]==2))
+                kind[i] = SEAM;
+        }
+    }
+
+    void computeQuadrics()
+    {
+        quadrics.assign(pointCount,Quadric());
+
+        for (size_t t=0;t<removed.size();t++)
+        {
+            if (removed[t])
+                continue;
+
+            const unsigned int *v = &indices[3*t];
+            glm::dvec3 p0(positions[v[0]]),p1(positions[v[1]]),p2(positions[v[2]]);
+            glm::dvec3 n = glm::cross(p1-p0,p2-p0);
+            double length = glm::length(n);
+
+            if (!(length>0))
+                continue;
+            n /= length;
+            for (int k=0;k<3;k++)
+            {
+                Quadric& q = quadrics[point[v[k]]];
+
+                q.addPlane(n,-glm::dot(n,p0),0.5*length);
+                q.weight += 0.5*length;
+            }
+        }
+
+        //a border or seam edge also holds its ends to the plane through it
+        //at right angles to its triangle, so that moving along the border
+        //is cheap and moving off it is not
+        for (size_t i=0;i<boundary.size();i++)
+        {
+            const unsigned int *v = &indices[3*boundary[i].triangle];
+            glm::dvec3 p0(positions[v[0]]),p1(positions[v[1]]),p2(positions[v[2]]);
+            glm::dvec3 n = glm::cross(p1-p0,p2-p0);
+            glm::dvec3 from(positions[boundary[i].from]),to(positions[boundary[i].to]);
+            glm::dvec3 m = glm::cross(to-from,n);
+            double length = glm::length(m);
+
+            if (!(length>0))
+                continue;
+            m /= length;
+            double w = glm::dot(to-from,to-from);
+            quadrics[point[boundary[i].from]].addPlane(m,-glm::dot(m,from),w);
+            quadrics[point[boundary[i].to]].addPlane(m,-glm::dot(m,from),w);
+        }
+    }
+
+    /*
+     * Whether the point at a may move onto the point at b
+     */
+    bool mayMove(unsigned int a,unsigned int b) const
+    {
+        unsigned int p = point[a],q = point[b];
+
+        switch (kind[p])
+        {
+        case MANIFOLD:
+            return true;
+        case BORDER:
+        case SEAM:
+            return (along[2*p]==q) || (along[2*p+1]==q);
+        default:
+            return false;
+        }
+    }
+
+    /*
+     * Make as many collapses as can be made independently of each other,
+     * cheapest first
+     * \return the number of collapses made
+     */
+    size_t pass(size_t targetTriangles,float maxError)
+    {
+        size_t i,t;
+
+        classifyPoints();
+
+        //the triangles around every point, with a counting sort
+        vector<size_t> start(pointCount+1,0);
+        for (t=0;t<removed.size();t++)
+        {
+            for (int k=0;(k<3) && !removed[t];k++)
+                start[point[indices[3*t+k]]+1]++;
+        }
+        for (i=0;i<pointCount;i++)
+            start[i+1] += start[i];
+        vector<unsigned int> around(start[pointCount]);
+        {
+            vector<size_t> next(start.begin(),start.end()-1);
+            for (t=0;t<removed.size();t++)
+            {
+                for (int k=0;(k<3) && !removed[t];k++)
+                    around[next[point[indices[3*t+k]]]++] = (unsigned int)t;
+            }
+        }
+
+        //the cheapest way for every point to move
+        vector<float> bestCost(pointCount,numeric_limits<float>::infinity());
+        vector<unsigned int> bestTo(pointCount,(unsigned int)NONE);
+        vector<unsigned int> bestFrom(pointCount,(unsigned int)NONE);
+        for (i=0;i<edges.size();i++)
+        {
+            unsigned int a = edges[i].from,b = edges[i].to;
+
+            for (int k=0;k<2;k++)
+            {
+                if (mayMove(a,b))
+                {
+                    float c = cost(a,b);
+
+                    //a collapse onto a point without a proper position
+                    //cannot be measured, or sorted
+                    if (c<bestCost[point[a]])
+                    {
+                        bestCost[point[a]] = c;
+                        bestFrom[point[a]] = a;
+                        bestTo[point[a]] = b;
+                    }
+                }
+                swap(a,b);
+            }
+        }
+        vector<Collapse> collapses;
+        for (i=0;i<pointCount;i++)
+        {
+            if (bestTo[i]!=(unsigned int)NONE)
+                collapses.push_back(Collapse(bestCost[i],bestFrom[i],bestTo[i]));
+        }
+        if (collapses.empty())
+            return 0;
+
+        //only the cheapest quarter is tried in one pass, so that a costly
+        //collapse is not made while cheaper ones wait for the next pass
+        size_t considered = max(collapses.size()/4,(size_t)1);
+        nth_element(collapses.begin(),collapses.begin()+(considered-1),collapses.end());
+        collapses.erase(collapses.begin()+considered,collapses.end());
+        sort(collapses.begin(),collapses.end());
+
+        //a collapse changes the triangles around the point that moves; no
+        //other collapse in this pass may touch them, so that every check is
+        //made on the triangles as they are
+        vector<bool> touched(pointCount,false);
+        size_t made = 0;
+        for (i=0;(i<collapses.size()) && (triangleCount>targetTriangles);i++)
+        {
+            const Collapse& c = collapses[i];
+            unsigned int p = point[c.from],q = point[c.to];
+            float collapseError = sqrt(c.cost);
+
+            if (touched[p] || touched[q])
+                continue;
+            if (!(collapseError<=maxError))
+                break;
+
+            const unsigned int *first = &around[start[p]];
+            const unsigned int *last = &around[start[p+1]];
+
+            //where each vertex at the point goes: on a seam, the vertex on
+            //the other side goes to the vertex on its own side of the seam
+            unsigned int from[2] = {c.from,(unsigned int)NONE};
+            unsigned int to[2] = {c.to,(unsigned int)NONE};
+            if (kind[p]==SEAM)
+            {
+                from[1] = (vertexAt[2*p]==c.from)?vertexAt[2*p+1]:vertexAt[2*p];
+                for (const unsigned int *it=first;(it!=last) && (to[1]==(unsigned int)NONE);it++)
+                {
+                    const unsigned int *v = &indices[3*(*it)];
+
+                    if ((v[0]==from[1]) || (v[1]==from[1]) || (v[2]==from[1]))
+                    {
+                        for (int k=0;k<3;k++)
+                        {
+                            if (point[v[k]]==q)
+                                to[1] = v[k];
+                        }
+                    }
+                }
+                if (to[1]==(unsigned int)NONE)
+                    continue;
+            }
+
+            if (!canCollapse(p,q,from,to,first,last-first,
+                             &around[start[q]],start[q+1]-start[q]))
+                continue;
+
+            for (const unsigned int *it=first;it!=last;it++)
+            {
+                unsigned int *v = &indices[3*(*it)];
+
+                for (int k=0;k<3;k++)
+                    touched[point[v[k]]] = true;
+                if ((point[v[0]]==q) || (point[v[1]]==q) || (point[v[2]]==q))
+                {
+                    removed[*it] = true;
+                    triangleCount--;
+                }
+                else
+                {
+                    for (int k=0;k<3;k++)
+                    {
+                        if (v[k]==from[0])
+                            v[k] = to[0];
+                        else if (v[k]==from[1])
+                            v[k] = to[1];
+                    }
+                }
+            }
+            quadrics[q].add(quadrics[p]);
+            error = max(error,collapseError);
+            made++;
+        }
+        return made;
+    }
+
+    float cost(unsigned int from,unsigned int to) const
+    {
+        Quadric q = quadrics[point[from]];
+
+        q.add(quadrics[point[to]]);
+        return (float)q.evaluate(positions[to]);
+    }
+
+    /*
+     * Whether moving point p onto point q, each vertex from[i] at p onto
+     * to[i] at q, keeps the surface as it is apart from its shape: no
+     * triangle flips over, the surface does not fold onto itself, and the
+     * triangles at p that meet q meet it at the vertex their own vertex
+     * goes to
+     */
+    bool canCollapse(unsigned int p,unsigned int q,
+                     const unsigned int *from,const unsigned int *to,
+                     const unsigned int *aroundP,size_t countP,
+                     const unsigned int *aroundQ,size_t countQ) const
+    {
+        const glm::vec3& target = positions[to[0]];
+        size_t shared = 0;
+        size_t i;
+
+        for (i=0;i<countP;i++)
+        {
+            const unsigned int *v = &indices[3*aroundP[i]];
+            unsigned int goesTo = (unsigned int)NONE;
+            int k,atQ = -1;
+
+            for (k=0;k<3;k++)
+            {
+                if (v[k]==from[0])
+                    goesTo = to[0];
+                else if (v[k]==from[1])
+                    goesTo = to[1];
+                if (point[v[k]]==q)
+                    atQ = k;
+            }
+            if (goesTo==(unsigned int)NONE)
+                return false;
+            if (atQ>=0)
+            {
+                if (v[atQ]!=goesTo)
+                    return false;
+                shared++;
+                continue;
+            }
+
+            //the triangle keeps its two other corners, and p moves to q
+            glm::vec3 corners[3] = {positions[v[0]],positions[v[1]],positions[v[2]]};
+            glm::vec3 before = glm::cross(corners[1]-corners[0],corners[2]-corners[0]);
+            for (k=0;k<3;k++)
+            {
+                if (point[v[k]]==p)
+                    corners[k] = target;
+            }
+            glm::vec3 after = glm::cross(corners[1]-corners[0],corners[2]-corners[0]);
+
+            //no more than about 75 degrees of turn
+            if (!(glm::dot(before,after)>0.25f*glm::length(before)*glm::length(after)))
+                return false;
+        }
+
+        //the points next to both p and q must be just those of the
+        //triangles on the edge, or the surface would pinch
+        vector<unsigned int> nextToP;
+        for (i=0;i<countP;i++)
+        {
+            const unsigned int *v = &indices[3*aroundP[i]];
+
+            for (int k=0;k<3;k++)
+            {
+                if ((point[v[k]]!=p) && (point[v[k]]!=q))
+                    nextToP.push_back(point[v[k]]);
+            }
+        }
+        sort(nextToP.begin(),nextToP.end());
+        nextToP.erase(unique(nextToP.begin(),nextToP.end()),nextToP.end());
+
+        vector<unsigned int> common;
+        for (i=0;i<countQ;i++)
+        {
+            const unsigned int *v = &indices[3*aroundQ[i]];
+
+            for (int k=0;k<3;k++)
+            {
+                unsigned int r = point[v[k]];
+
+                if ((r!=p) && (r!=q) && binary_search(nextToP.begin(),nextToP.end(),r))
+                    common.push_back(r);
+            }
+        }
+        sort(common.begin(),common.end());
+        common.erase(unique(common.begin(),common.end()),common.end());
+        return common.size()==shared;
+    }
+
+    vector<glm::vec3> positions;
+    vector<unsigned int> indices;
+    vector<unsigned int> parts;
+    vector<bool> removed;
+    size_t triangleCount;
+    //the distinct position of every vertex, and how many there are
+    vector<unsigned int> point;
+    size_t pointCount;
+    //by point: the ones that may never move, and the quadrics
+    vector<bool> fixed;
+    vector<Quadric> quadrics;
+    //by point, found again before every pass: how it may move, the points
+    //it may move to if along a border or seam, and its vertices (two for a
+    //seam)
+    vector<Kind> kind;
+    vector<unsigned int> along;
+    vector<unsigned int> vertexAt;
+    //the sides of the edges left, sorted by their points, and those on
+    //borders and seams
+    vector<HalfEdge> edges;
+    vector<HalfEdge> boundary;
+    float error;
+};
+}
+
+#endif
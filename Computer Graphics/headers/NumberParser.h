@@ -0,0 +1,287 @@
+#ifndef _NUMBERPARSER_H_
+#define _NUMBERPARSER_H_
+
+#include <string>
+#include <sstream>
+#include <locale>
+#include <cstring>
+#include <cctype>
+#include <cfloat>
+#include <limits>
+using namespace std;
+
+namespace util
+{
+
+/*
+ * Fast conversion of decimal text to numbers, used by the mesh and scene
+ * loaders.
+ *
+ * Unlike strtof, sscanf and streams, these functions do not look at the
+ * current locale: the decimal separator is always '.'. They work directly
+ * on a range of characters, which does not have to be null-terminated.
+ *
+ * Floats are converted exactly (the result is always the float nearest to
+ * the decimal value, the same as strtof in the "C" locale). Most numbers
+ * found in model files have few enough digits to be converted with a
+ * couple of exact double operations. The rare number that does not (more
+ * than 19 significant digits, a very large exponent, or a value that lies
+ * exactly between two floats after rounding to double) is handed to the
+ * standard library, in the classic locale.
+ */
+class NumberParser
+{
+public:
+    /*
+     * Read a float from the start of [begin,end). Accepts an optional sign,
+     * digits with an optional '.', and an optional exponent, or as strtof
+     * does, "inf", "infinity" or "nan" (optionally followed by characters
+     * in parentheses) in any case. Hexadecimal floats are not read.
+     * \param begin the first character
+     * \param end one past the last character that may be read
+     * \param value the number read, or 0 if there is no number
+     * \return a pointer to the first character after the number, or begin if
+     *         there is no number
+     */
+    static const char *parseFloat(const char *begin,const char *end,float& value)
+    {
+        const char *p = begin;
+        bool negative = false;
+        unsigned long long mantissa = 0;
+        int digits = 0; //significant digits accumulated in mantissa
+        int exponent = 0;
+        bool anyDigits = false;
+        bool truncated = false;
+
+        value = 0.0f;
+
+        if ((p<end) && ((*p=='-') || (*p=='+')))
+        {
+            negative = (*p=='-');
+            p++;
+        }
+
+        if ((p<end) && (((*p|0x20)=='i') || ((*p|0x20)=='n')))
+        {
+            if (matchWord(p,end,"inf"))
+            {
+                matchWord(p,end,"inity");
+                value = negative?-numeric_limits<float>::infinity():numeric_limits<float>::infinity();
+                return p;
+            }
+            if (matchWord(p,end,"nan"))
+            {
+                const char *q = p;
+
+                if ((q<end) && (*q=='('))
+                {
+                    q++;
+                    while ((q<end) && (isalnum((unsigned char)*q) || (*q=='_')))
+                        q++;
+                    if ((q<end) && (*q==')'))
+                        p = q+1;
+                }
+                value = negative?-numeric_limits<float>::quiet_NaN():numeric_limits<float>::quiet_NaN();
+                return p;
+            }
+            return begin;
+        }
+
+        //integer part. Leading zeros are not significant
+        while ((p<end) && (*p>='0') && (*p<='9'))
+        {
+            anyDigits = true;
+            if (digits<19)
+            {
+                mantissa = 10*mantissa + (unsigned)(*p-'0');
+                if (mantissa>0)
+                    digits++;
+            }
+            else
+            {
+                exponent++;
+                if (*p!='0')
+                    truncated = true;
+            }
+            p++;
+        }
+
+        //fractional part
+        if ((p<end) && (*p=='.'))
+        {
+            p++;
+            while ((p<end) && (*p>='0') && (*p<='9'))
+            {
+                anyDigits = true;
+                if (digits<19)
+                {
+                    mantissa = 10*mantissa + (unsigned)(*p-'0');
+                    if (mantissa>0)
+                        digits++;
+                    exponent--;
+                }
+                else if (*p!='0')
+                {
+                    truncated = true;
+                }
+                p++;
+            }
+        }
+
+        if (!anyDigits)
+            return begin;
+
+        //exponent
+        if ((p<end) && ((*p=='e') || (*p=='E')))
+        {
+            const char *q = p+1;
+            bool negativeExponent = false;
+            int e = 0;
+
+            if ((q<end) && ((*q=='-') || (*q=='+')))
+            {
+                negativeExponent = (*q=='-');
+                q++;
+            }
+            if ((q<end) && (*q>='0') && (*q<='9'))
+            {
+                while ((q<end) && (*q>='0') && (*q<='9'))
+                {
+                    if (e<100000)
+                        e = 10*e + (*q-'0');
+                    q++;
+                }
+                exponent += negativeExponent?-e:e;
+                p = q;
+            }
+            //else "1e" is the number 1 followed by the text "e"
+        }
+
+        if (mantissa==0)
+        {
+            value = negative?-0.0f:0.0f;
+            return p;
+        }
+
+        if (!truncated && (mantissa<=(1ULL<<53)) && (exponent>=-22) && (exponent<=22))
+        {
+            //both operands are exact doubles, so this is rounded only once
+            double d = (double)mantissa;
+            if (exponent<0)
+                d /= powerOfTen(-exponent);
+            else
+                d *= powerOfTen(exponent);
+
+            if (roundsToFloatSafely(d))
+            {
+                value = (float)(negative?-d:d);
+                return p;
+            }
+        }
+
+        value = slowParseFloat(begin,p);
+        return p;
+    }
+
+    /*
+     * Read a float from the whole of [begin,end).
+     * \return true if the entire range is one number
+     */
+    static bool toFloat(const char *begin,const char *end,float& value)
+    {
+        const char *p = parseFloat(begin,end,value);
+        return (p!=begin) && (p==end);
+    }
+
+    /*
+     * Read a signed integer from the start of [begin,end).
+     * \param value the number read, or 0 if there is no number
+     * \return a pointer to the first character after the number, or begin if
+     *         there is no number
+     */
+    static const char *parseInt(const char *begin,const char *end,int& value)
+    {
+        const char *p = begin;
+        bool negative = false;
+        unsigned int magnitude = 0;
+
+        value = 0;
+        if ((p<end) && ((*p=='-') || (*p=='+')))
+        {
+            negative = (*p=='-');
+            p++;
+        }
+        if ((p==end) || (*p<'0') || (*p>'9'))
+            return begin;
+
+        while ((p<end) && (*p>='0') && (*p<='9'))
+        {
+            magnitude = 10*magnitude + (unsigned)(*p-'0');
+            p++;
+        }
+        value = negative?-(int)magnitude:(int)magnitude;
+        return p;
+    }
+
+private:
+    /*
+     * If [p,end) starts with a word, in any case, move p past it
+     * \param word the word, in lower case
+     */
+    static bool matchWord(const char *&p,const char *end,const char *word)
+    {
+        const char *q = p;
+
+        for (;*word!=0;word++,q++)
+        {
+            if ((q==end) || ((*q|0x20)!=*word))
+                return false;
+        }
+        p = q;
+        return true;
+    }
+
+    static double powerOfTen(int e)
+    {
+        //every power of ten up to 10^22 is exactly representable as a double
+        static const double powers[] = {
+            1e0,1e1,1e2,1e3,1e4,1e5,1e6,1e7,1e8,1e9,1e10,1e11,
+            1e12,1e13,1e14,1e15,1e16,1e17,1e18,1e19,1e20,1e21,1e22
+        };
+        return powers[e];
+    }
+
+    /*
+     * A correctly rounded double, rounded once more to float, gives the
+     * correctly rounded float unless the double landed exactly halfway
+     * between two floats (in which case the exact value might have been
+     * slightly above or below it), or is too small to be a normal float.
+     */
+    static bool roundsToFloatSafely(double d)
+    {
+        unsigned long long bits;
+
+        if (d<(double)FLT_MIN)
+            return false;
+
+        memcpy(&bits,&d,sizeof(bits));
+        //a double has 29 more mantissa bits than a float
+        return (bits & ((1ULL<<29)-1)) != (1ULL<<28);
+    }
+
+    static float slowParseFloat(const char *begin,const char *end)
+    {
+        istringstream str(string(begin,end));
+        float f = 0.0f;
+
+        str.imbue(locale::classic());
+        str >> f;
+        //streams report overflow as the largest float, strtof as infinity
+        if (str.fail() && ((f==FLT_MAX) || (f==-FLT_MAX)))
+            f = (f>0)?numeric_limits<float>::infinity():-numeric_limits<float>::infinity();
+        return f;
+    }
+};
+}
+
+#endif
@@ -2,250 +2,779 @@
 #define _OBJIMPORTER_H_
 
 #include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
 #include <fstream>
+#include <sstream>
 #include <vector>
+#include <algorithm>
+#include <utility>
+#include <memory>
+#include "MappedFile.h"
+#include "MeshCache.h"
+#include "Hash.h"
+#include "ObjReader.h"
+#include "Parallel.h"
+#include "VertexLayout.h"
 using namespace std;
 
+//the importer only makes triangles. Define the OpenGL constant for them if no
+//OpenGL header has, so that meshes can be imported by programs without OpenGL
+#ifndef GL_TRIANGLES
+#define GL_TRIANGLES 0x0004
+#endif
+
 namespace util
 {
 
+/*
+ * Settings that control how an OBJ file is imported
+ */
+class ObjImportOptions
+{
+public:
+    ObjImportOptions()
+    {
+        scaleAndCenter = false;
+        threads = 1;
+        useCache = false;
+        optimizeVertexCache = false;
+        triangleStrips = false;
+        weldVertices = false;
+    }
 
+    /*
+     * If true, the mesh is centered at the origin and scaled to fit in a
+     * cube of side 1
+     */
+    bool scaleAndCenter;
+    /*
+     * The number of threads used to parse the file. The file is split at
+     * line boundaries into this many chunks that are parsed at the same
+     * time. 0 means one thread per core. The result does not depend on
+     * this number.
+     */
+    unsigned int threads;
+    /*
+     * If true, a mesh imported from a file is also saved to a binary cache
+     * file next to it (see MeshCache), one for each set of options that
+     * affect the mesh, and later imports of the same file with the same
+     * options load the cache instead of parsing the text.
+     * The cache is keyed by a hash of the file's contents, so editing the
+     * file makes it go stale. A cache that cannot be written is not an
+     * error.
+     */
+    bool useCache;
+    /*
+     * How normals are computed for a file that does not have them for
+     * every face corner. The threads of these options are not used: normals
+     * are computed with as many threads as the file is parsed with.
+     */
+    NormalOptions normals;
+    /*
+     * If true, vertices at (about) the same position with the same
+     * attributes are welded, and triangles with no area or that repeat
+     * another are removed, as PolygonMesh::weld does with the welding
+     * options, before normals are computed. Faces that index the same
+     * position twice, or two copies of a position, leave such vertices and
+     * triangles behind, and exported CAD and scan meshes are full of them.
+     * The threads of the welding options are not used: the mesh is welded
+     * with as many threads as the file is parsed with.
+     */
+    bool weldVertices;
+    WeldOptions welding;
+    /*
+     * If true, the triangles and vertices of the mesh are reordered for the
+     * vertex cache and for fetching, as PolygonMesh::optimizeVertexCache
+     * does, once everything else is done. OBJ files list faces in whatever
+     * order their authors wrote them, which is often poor for both.
+     */
+    bool optimizeVertexCache;
+    /*
+     * If true, the triangles are turned into triangle strips with restart
+     * indices, as PolygonMesh::stripify does, after they are reordered for
+     * the vertex cache if that was asked for too. The index buffer is then
+     * about half as big, but the mesh can no longer be changed as a
+     * triangle list.
+     */
+    bool triangleStrips;
+};
+
+/*
+ * Counts describing what was read from an OBJ file, and what the mesh built
+ * from it contains
+ */
+class ObjImportStats
+{
+public:
+    ObjImportStats()
+    {
+        positions = texcoords = normals = 0;
+        triangles = corners = vertices = 0;
+        fromCache = false;
+    }
+
+    //the number of v, vt and vn records in the file
+    size_t positions,texcoords,normals;
+    //the number of triangles after polygons are broken into fans
+    size_t triangles;
+    //the number of triangle corners: the vertex count if no vertex were shared
+    size_t corners;
+    //the number of vertices in the mesh, after corners with the same
+    //(position,texcoord,normal) indices have been welded into one vertex
+    size_t vertices;
+    //true if the mesh came from the cache. The counts above are known then,
+    //but not the figures below
+    bool fromCache;
+    //how well the triangles used the vertex cache before and after they
+    //were reordered, if the options asked for that
+    VertexCacheStats cacheBefore,cacheAfter;
+    //what welding did, if the options asked for it
+    WeldStats welding;
+};
 
 /*
  * A helper class to import a PolygonMesh object from an OBJ file.
  * It imports only position, normal and texture coordinate data (if present)
+ *
+ * The text is read by an ObjReader, which passes each record to a handler
+ * that collects what is needed for the mesh. Code that does not need a
+ * PolygonMesh can use ObjReader with its own ObjHandler instead.
+ *
+ * In an OBJ file each face corner has its own position, texture coordinate
+ * and normal index. A mesh vertex is made for every distinct combination of
+ * the three that the faces use, so that attributes are never lost and
+ * vertices are shared wherever the file allows it.
+ *
+ * Wherever the o, g or usemtl records change the object, group or material,
+ * the mesh gets a new SubMesh, so that a model made of several parts is
+ * still one mesh with one set of buffers.
  */
 template <class K>
 class ObjImporter
 {
 public:
-    static PolygonMesh<K> importFile(ifstream& in, bool scaleAndCenter) throw(string)
+    /*
+     * Import a mesh from a file on disk. The file is memory-mapped and
+     * parsed in place.
+     * \param filename the path of the OBJ file
+     * \param scaleAndCenter if true, the mesh is centered at the origin and
+     *        scaled to fit in a cube of side 1
+     * \throws string if the file cannot be read or is malformed
+     */
+    static PolygonMesh<K> importFile(const string& filename,bool scaleAndCenter) throw(string)
     {
-        vector<glm::vec4> vertices,normals,texcoords;
-        vector<unsigned int> triangles, triangle_texture_indices, triangle_normal_indices;
-        int i,j;
-        int lineno;
-        PolygonMesh<K> mesh;
+        ObjImportOptions options;
 
+        options.scaleAndCenter = scaleAndCenter;
+        return importFile(filename,options);
+    }
 
-        lineno = 0;
+    static PolygonMesh<K> importFile(const string& filename,const ObjImportOptions& options) throw(string)
+    {
+        ObjImportStats stats;
 
-        string line;
+        return importFile(filename,options,stats);
+    }
 
+    /*
+     * Import a mesh from a file on disk, and report what was found in it
+     * \param stats filled with the counts of what was read and built
+     */
+    static PolygonMesh<K> importFile(const string& filename,
+                                     const ObjImportOptions& options,
+                                     ObjImportStats& stats) throw(string)
+    {
+        MappedFile file;
 
+        stats = ObjImportStats();
 
-        while (getline(in,line))
+        try
         {
-            lineno++;
-            if ((line.length()<=0) || (line[0] == '#'))
-            {
-                //line is a comment, ignore
-                continue;
-            }
+            file.open(filename);
+        }
+        catch (runtime_error& e)
+        {
+            throw string(e.what());
+        }
 
-            stringstream str;
+        if (!options.useCache)
+            return importBuffer(file.data(),file.data()+file.size(),options,stats);
 
-            str << line;
+        string cacheFile = MeshCache<K>::cacheFileFor(filename,optionsKey(options));
+        unsigned long long key = cacheKey(file.data(),file.size(),options);
+        PolygonMesh<K> mesh;
+        MeshSourceCounts source;
 
-            vector<string> tokens;
-            string symbol;
+        if (MeshCache<K>::load(cacheFile,key,mesh,source,options.threads))
+        {
+            stats.fromCache = true;
+            stats.positions = (size_t)source.positions;
+            stats.texcoords = (size_t)source.texcoords;
+            stats.normals = (size_t)source.normals;
+            stats.triangles = (size_t)source.triangles;
+            stats.corners = (size_t)source.corners;
+            stats.vertices = mesh.getVertexCount();
+            return mesh;
+        }
 
-            while (str>>symbol)
-                tokens.push_back(symbol);
+        mesh = importBuffer(file.data(),file.data()+file.size(),options,stats);
+        source.positions = stats.positions;
+        source.texcoords = stats.texcoords;
+        source.normals = stats.normals;
+        source.triangles = stats.triangles;
+        source.corners = stats.corners;
+        MeshCache<K>::save(cacheFile,key,mesh,source);
+        return mesh;
+    }
 
-            if (tokens[0]=="v")
-            {
-                if ((tokens.size()<4) || (tokens.size()>7))
-                {
-                    str.str("");
-                    str.clear();
-                    str << "Line " << lineno << ": Vertex coordinate has an invalid number of values";
-                    throw str.str();
-                }
+    /*
+     * Import a mesh from an already opened stream. The stream is read a
+     * block at a time, so the text is never held in memory all at once.
+     */
+    static PolygonMesh<K> importFile(ifstream& in, bool scaleAndCenter) throw(string)
+    {
+        ObjData data;
+        ObjImportStats stats;
 
-                float num;
-                glm::vec4 v;
+        ObjImportOptions options;
 
-                str.str("");
-                str.clear();
+        options.scaleAndCenter = scaleAndCenter;
+        ObjReader::readStream(in,data);
+        return buildMesh(data,options,1,stats);
+    }
 
-                str << tokens[1] << " " << tokens[2] << " " << tokens[3];
+    /*
+     * Import a mesh from OBJ text held in memory
+     * \param begin the first character of the text
+     * \param end one past the last character of the text
+     */
+    static PolygonMesh<K> importBuffer(const char *begin,const char *end,bool scaleAndCenter) throw(string)
+    {
+        ObjImportOptions options;
 
-                str >> v.x >> v.y >> v.z;
-                v.w = 1.0f;
+        options.scaleAndCenter = scaleAndCenter;
+        return importBuffer(begin,end,options);
+    }
 
-                if (tokens.size()==5)
-                {
-                    str.str("");
-                    str.clear();
-                    str << tokens[4];
-                    str >> num;
-                    if (num!=0)
-                    {
-                        v.x/=num;
-                        v.y/=num;
-                        v.z/=num;
-                    }
-                }
+    static PolygonMesh<K> importBuffer(const char *begin,const char *end,const ObjImportOptions& options) throw(string)
+    {
+        ObjImportStats stats;
 
-                vertices.push_back(v);
-            }
-            else if (tokens[0]=="vt")
+        return importBuffer(begin,end,options,stats);
+    }
+
+    static PolygonMesh<K> importBuffer(const char *begin,
+                                       const char *end,
+                                       const ObjImportOptions& options,
+                                       ObjImportStats& stats) throw(string)
+    {
+        vector<ObjData> chunks;
+        unsigned int threads = resolveThreadCount(options.threads);
+        unsigned int i;
+
+        //split the text at line boundaries, roughly evenly
+        vector<const char *> bounds;
+        bounds.push_back(begin);
+        for (i=1;i<threads;i++)
+        {
+            const char *p = begin + (size_t)(end-begin)*i/threads;
+            if (p<bounds.back())
+                p = bounds.back();
+            const char *newline = (const char *)memchr(p,'\n',end-p);
+            p = (newline!=NULL)?newline+1:end;
+            bounds.push_back(p);
+        }
+        bounds.push_back(end);
+
+        //each chunk is read by its own reader into its own arrays. Errors are
+        //recorded instead of thrown, as the readers run on worker threads.
+        //Only the first chunk can tell that a negative index counts back
+        //past the start of the file
+        chunks.resize(bounds.size()-1);
+        vector<ObjReader> readers(chunks.size());
+        for (i=1;i<readers.size();i++)
+            readers[i].setMidFile(true);
+        parallelFor(0,chunks.size(),threads,
+                    [&](size_t first,size_t last,unsigned int)
+        {
+            for (size_t c=first;c<last;c++)
+                readers[c].parse(bounds[c],bounds[c+1],chunks[c]);
+        });
+
+        //report the first error in file order, with its line number in the
+        //whole file. An index that counts back past the start of the file
+        //comes before any error on its own line, as the reader met it first
+        int linesBefore = 0;
+        unsigned int before[3] = {0,0,0};
+        for (i=0;i<chunks.size();i++)
+        {
+            const vector<ObjBackReference>& references = readers[i].getBackReferences();
+
+            for (size_t r=0;r<references.size();r++)
             {
-                if ((tokens.size()<3) || (tokens.size()>4))
-                {
-                    str.str("");
-                    str.clear();
-                    str << "Line " << lineno << ": Texture coordinate has an invalid number of values";
-                    throw str.str();
-                }
+                if (references[r].reach>before[references[r].kind>>1])
+                    throw ObjReader::lineError(linesBefore+references[r].line,
+                                               ObjReader::indexError(references[r].kind));
+            }
+            if (readers[i].getErrorLine()>0)
+                throw ObjReader::lineError(linesBefore+readers[i].getErrorLine(),
+                                           readers[i].getErrorMessage());
+            linesBefore += readers[i].getLineCount();
+            before[0] += (unsigned int)chunks[i].vertices.size();
+            before[1] += (unsigned int)chunks[i].texcoords.size();
+            before[2] += (unsigned int)chunks[i].normals.size();
+        }
 
-                glm::vec4 v;
+        if (chunks.size()==1)
+            return buildMesh(chunks[0],options,threads,stats);
 
-                float n;
+        ObjData data;
+        merge(chunks,data,threads);
+        return buildMesh(data,options,threads,stats);
+    }
+
+private:
+    //marks a face corner that has no texture coordinate or normal
+    enum { NO_INDEX = ObjFaceCorner::NO_INDEX };
+    //change this whenever the mesh built from a file changes, so that
+    //caches made by older versions of the importer are not used
+    enum { IMPORTER_VERSION = 3 };
+
+    /*
+     * The key a cached mesh is stored under: everything that determines the
+     * mesh, namely the text of the file and the options that affect the
+     * result. The number of threads does not.
+     */
+    static unsigned long long cacheKey(const char *text,size_t size,const ObjImportOptions& options)
+    {
+        return Hash::bytes(text,size,optionsKey(options));
+    }
+
+    /*
+     * The part of the cache key that comes from the options (and the
+     * version of this importer). A file imported with different options is
+     * cached in a file of its own, named after this.
+     */
+    static unsigned long long optionsKey(const ObjImportOptions& options)
+    {
+        unsigned long long key = Hash::value(IMPORTER_VERSION);
+
+        key = Hash::value(options.scaleAndCenter?1:0,key);
+        key = Hash::value(options.normals.weighting,key);
+        key = Hash::bytes(&options.normals.creaseAngle,sizeof(float),key);
+        key = Hash::value(options.optimizeVertexCache?1:0,key);
+        key = Hash::value(options.triangleStrips?1:0,key);
+        key = Hash::value(options.weldVertices?1:0,key);
+        if (options.weldVertices)
+        {
+            key = Hash::bytes(&options.welding.tolerance,sizeof(float),key);
+            key = Hash::bytes(&options.welding.attributeTolerance,sizeof(float),key);
+        }
+        return key;
+    }
 
-                str.str("");
-                str.clear();
-                str << tokens[1] << " " << tokens[2];
+    /*
+     * The raw contents of an OBJ file (or of one chunk of it), before they
+     * are turned into a mesh. Polygons are broken into triangle fans as they
+     * arrive.
+     */
+    class ObjData: public ObjHandler
+    {
+    public:
+        vector<glm::vec4> vertices,normals,texcoords;
+        //one entry per triangle corner in each of these, NO_INDEX if absent
+        vector<unsigned int> triangles, triangle_texture_indices, triangle_normal_indices;
+        /*
+         * Faces may use negative indices, which count back from the last
+         * vertex read so far. When a file is read in chunks, these are
+         * resolved within the chunk and recorded here (as positions in the
+         * index arrays above), so that they can be shifted once it is known
+         * how many vertices the chunks before this one contain.
+         */
+        vector<unsigned int> relativeTriangles, relativeTextures, relativeNormals;
+        /*
+         * The faces, split into parts wherever the object, group or material
+         * changes. The ranges are in the triangle index arrays above.
+         * Adjacent parts with the same names are kept as one.
+         */
+        vector<SubMesh> parts;
+        /*
+         * The object or group name and material in effect at the end of the
+         * text read so far. A chunk that does not start at the beginning of
+         * the file does not know them until it meets an o, g or usemtl
+         * record: until then, the Known flags are false and the parts it
+         * makes are listed in inheritsName and inheritsMaterial, to be given
+         * the names in effect at the end of the chunk before it.
+         */
+        string name,material;
+        bool nameKnown,materialKnown;
+        vector<unsigned int> inheritsName,inheritsMaterial;
+
+        ObjData()
+        {
+            nameKnown = materialKnown = false;
+        }
 
-                str >> v.x >> v.y;
-                v.z = 0.0f;
-                v.w = 1.0f;
+        void onVertex(const glm::vec4& position)
+        {
+            vertices.push_back(position);
+        }
 
+        void onTexcoord(const glm::vec4& texcoord)
+        {
+            texcoords.push_back(texcoord);
+        }
 
-                if (tokens.size()>3)
-                {
-                    str.str("");
-                    str.clear();
-                    str << tokens[3];
-                    str >> v.z;
-                }
+        void onNormal(const glm::vec4& normal)
+        {
+            normals.push_back(normal);
+        }
 
-                texcoords.push_back(v);
+        void onFace(const ObjFaceCorner *corners,unsigned int count)
+        {
+            if (parts.empty() || (parts.back().name!=name) || (parts.back().materialName!=material))
+            {
+                if (!nameKnown)
+                    inheritsName.push_back((unsigned int)parts.size());
+                if (!materialKnown)
+                    inheritsMaterial.push_back((unsigned int)parts.size());
+                parts.push_back(SubMesh((unsigned int)triangles.size(),0,name,material));
             }
-            else if (tokens[0]=="vn")
+            parts.back().indexCount += 3*(count-2);
+
+            //if face has more than 3 vertices, break down into a triangle fan
+            for (unsigned int i=2;i<count;i++)
             {
-                if (tokens.size()!=4)
-                {
-                    str.str("");
-                    str.clear();
-                    str << "Line " << lineno << ": Normal has an invalid number of values";
-                    throw str.str();
-                }
+                addCorner(corners[0]);
+                addCorner(corners[i-1]);
+                addCorner(corners[i]);
+            }
+        }
 
+        void onObject(const string& name)
+        {
+            this->name = name;
+            nameKnown = true;
+        }
 
-                float num;
-                glm::vec3 v;
+        void onGroup(const string& name)
+        {
+            this->name = name;
+            nameKnown = true;
+        }
 
-                str.str("");
-                str.clear();
-                str << tokens[1] << " " << tokens[2] << " " << tokens[3];
-                str >> v.x >> v.y >> v.z;
+        void onMaterial(const string& name)
+        {
+            material = name;
+            materialKnown = true;
+        }
 
-                v = glm::normalize(v);
-                normals.push_back(glm::vec4(v,0.0f));
+        /*
+         * Free all the memory held
+         */
+        void clear()
+        {
+            vector<glm::vec4>().swap(vertices);
+            vector<glm::vec4>().swap(normals);
+            vector<glm::vec4>().swap(texcoords);
+            vector<unsigned int>().swap(triangles);
+            vector<unsigned int>().swap(triangle_texture_indices);
+            vector<unsigned int>().swap(triangle_normal_indices);
+            vector<unsigned int>().swap(relativeTriangles);
+            vector<unsigned int>().swap(relativeTextures);
+            vector<unsigned int>().swap(relativeNormals);
+            vector<SubMesh>().swap(parts);
+            vector<unsigned int>().swap(inheritsName);
+            vector<unsigned int>().swap(inheritsMaterial);
+        }
+
+    private:
+        void addCorner(const ObjFaceCorner& corner)
+        {
+            if (corner.relative & ObjFaceCorner::RELATIVE_POSITION)
+                relativeTriangles.push_back((unsigned int)triangles.size());
+            if (corner.relative & ObjFaceCorner::RELATIVE_TEXCOORD)
+                relativeTextures.push_back((unsigned int)triangles.size());
+            if (corner.relative & ObjFaceCorner::RELATIVE_NORMAL)
+                relativeNormals.push_back((unsigned int)triangles.size());
+            triangles.push_back(corner.position);
+            triangle_texture_indices.push_back(corner.texcoord);
+            triangle_normal_indices.push_back(corner.normal);
+        }
+    };
+
+    /*
+     * Shift the negative (relative) indices of a chunk by the number of
+     * elements in all the chunks before it. The arithmetic wraps around, so
+     * an index that points into an earlier chunk comes out right.
+     */
+    static void fixRelativeIndices(ObjData& chunk,
+                                   unsigned int vertexOffset,
+                                   unsigned int texcoordOffset,
+                                   unsigned int normalOffset)
+    {
+        unsigned int i;
+
+        for (i=0;i<chunk.relativeTriangles.size();i++)
+            chunk.triangles[chunk.relativeTriangles[i]] += vertexOffset;
+        for (i=0;i<chunk.relativeTextures.size();i++)
+            chunk.triangle_texture_indices[chunk.relativeTextures[i]] += texcoordOffset;
+        for (i=0;i<chunk.relativeNormals.size();i++)
+            chunk.triangle_normal_indices[chunk.relativeNormals[i]] += normalOffset;
+    }
+
+    /*
+     * Concatenate the parsed chunks, in file order, into one. Each chunk's
+     * relative indices are fixed up using prefix sums of the element counts
+     * of the chunks before it, and then the chunks are copied into their
+     * slots of the result in parallel.
+     */
+    static void merge(vector<ObjData>& chunks,ObjData& result,unsigned int threads)
+    {
+        size_t n = chunks.size();
+        vector<size_t> vertexStart(n+1,0),texcoordStart(n+1,0),normalStart(n+1,0);
+        vector<size_t> triangleStart(n+1,0),textureIndexStart(n+1,0),normalIndexStart(n+1,0);
+        size_t c;
+
+        for (c=0;c<n;c++)
+        {
+            vertexStart[c+1] = vertexStart[c] + chunks[c].vertices.size();
+            texcoordStart[c+1] = texcoordStart[c] + chunks[c].texcoords.size();
+            normalStart[c+1] = normalStart[c] + chunks[c].normals.size();
+            triangleStart[c+1] = triangleStart[c] + chunks[c].triangles.size();
+            textureIndexStart[c+1] = textureIndexStart[c] + chunks[c].triangle_texture_indices.size();
+            normalIndexStart[c+1] = normalIndexStart[c] + chunks[c].triangle_normal_indices.size();
+        }
+
+        mergeParts(chunks,triangleStart,result);
+
+        result.vertices.resize(vertexStart[n]);
+        result.texcoords.resize(texcoordStart[n]);
+        result.normals.resize(normalStart[n]);
+        result.triangles.resize(triangleStart[n]);
+        result.triangle_texture_indices.resize(textureIndexStart[n]);
+        result.triangle_normal_indices.resize(normalIndexStart[n]);
+
+        parallelFor(0,n,threads,
+                    [&](size_t first,size_t last,unsigned int)
+        {
+            for (size_t c=first;c<last;c++)
+            {
+                ObjData& chunk = chunks[c];
+
+                fixRelativeIndices(chunk,
+                                   (unsigned int)vertexStart[c],
+                                   (unsigned int)texcoordStart[c],
+                                   (unsigned int)normalStart[c]);
+                copy(chunk.vertices.begin(),chunk.vertices.end(),result.vertices.begin()+vertexStart[c]);
+                copy(chunk.texcoords.begin(),chunk.texcoords.end(),result.texcoords.begin()+texcoordStart[c]);
+                copy(chunk.normals.begin(),chunk.normals.end(),result.normals.begin()+normalStart[c]);
+                copy(chunk.triangles.begin(),chunk.triangles.end(),result.triangles.begin()+triangleStart[c]);
+                copy(chunk.triangle_texture_indices.begin(),chunk.triangle_texture_indices.end(),
+                     result.triangle_texture_indices.begin()+textureIndexStart[c]);
+                copy(chunk.triangle_normal_indices.begin(),chunk.triangle_normal_indices.end(),
+                     result.triangle_normal_indices.begin()+normalIndexStart[c]);
+
+                //release the chunk as soon as it has been copied
+                chunk.clear();
             }
-            else if (tokens[0]=="f")
+        });
+    }
+
+    /*
+     * Concatenate the parts of the chunks, in file order. A chunk's parts
+     * that began before it set a name or material take the one in effect
+     * at the end of the chunks before it, and a part that continues the
+     * last part of the previous chunk is joined to it, so that the result
+     * is the same as if the file had been read in one piece.
+     */
+    static void mergeParts(vector<ObjData>& chunks,
+                           const vector<size_t>& triangleStart,
+                           ObjData& result)
+    {
+        for (size_t c=0;c<chunks.size();c++)
+        {
+            ObjData& chunk = chunks[c];
+            size_t i;
+
+            for (i=0;i<chunk.inheritsName.size();i++)
+                chunk.parts[chunk.inheritsName[i]].name = result.name;
+            for (i=0;i<chunk.inheritsMaterial.size();i++)
+                chunk.parts[chunk.inheritsMaterial[i]].materialName = result.material;
+
+            for (i=0;i<chunk.parts.size();i++)
             {
-                if (tokens.size()<4)
-                {
-                    str.str("");
-                    str.clear();
-                    str << "Line " << lineno << ": Face has too few vertices, must be at least 3";
-                }
+                SubMesh part = chunk.parts[i];
+
+                part.firstIndex += (unsigned int)triangleStart[c];
+                if (!result.parts.empty()
+                        && (result.parts.back().name==part.name)
+                        && (result.parts.back().materialName==part.materialName))
+                    result.parts.back().indexCount += part.indexCount;
+                else
+                    result.parts.push_back(part);
+            }
 
+            if (chunk.nameKnown)
+                result.name = chunk.name;
+            if (chunk.materialKnown)
+                result.material = chunk.material;
+        }
+    }
 
-                vector <unsigned int> t_triangles,t_tex,t_normal;
+    /*
+     * The indices that one mesh vertex takes its attributes from
+     */
+    class ObjCorner
+    {
+    public:
+        unsigned int position,texcoord,normal;
 
+        bool operator==(const ObjCorner& c) const
+        {
+            return (position==c.position) && (texcoord==c.texcoord) && (normal==c.normal);
+        }
+    };
+
+    /*
+     * An open-addressing hash table (linear probing) from a corner's index
+     * triple to the mesh vertex made for it. Slots hold vertex numbers, and
+     * the triples themselves live in the vertex list, so a slot is 4 bytes.
+     * The table doubles whenever it would be more than half full.
+     */
+    class CornerMap
+    {
+    public:
+        CornerMap(size_t expected)
+        {
+            size_t size = 16;
+            //keep the table at most half full so probe sequences stay short
+            while (size<2*expected)
+                size *= 2;
+            slots.assign(size,(unsigned int)NO_INDEX);
+            mask = size-1;
+        }
 
-                for (i=1;i<tokens.size();i++)
-                {
-                    str.str("");
-                    str.clear();
-                    str << tokens[i];
-
-                    vector<string> data;
-                    string temp;
-
-                    while (getline(str,temp,'/'))
-                        data.push_back(temp);
-
-
-                    if ((data.size() < 1) && (data.size() > 3))
-                    {
-                        str.str("");
-                        str.clear();
-                        str << "Line " << lineno << ": Face specification has an incorrect number of values";
-                        throw str.str();
-                    }
-
-
-                    //in OBJ file format all indices begin at 1, so must subtract 1 here
-                    int vi;
-                    str.str("");
-                    str.clear();
-                    str << data[0];
-                    str >> vi;
-                    t_triangles.push_back(vi-1); //vertex index
-                    if (data.size() > 1) {
-                        if (data[1].length() > 0) //a vertex texture index exists
-                        {
-                            str.str("");
-                            str.clear();
-                            str << data[1];
-                            str >> vi;
-                            t_tex.push_back(vi-1);
-                        }
-
-
-                        if (data.size() > 2) //a vertex normal index exists
-                        {
-                            str.str("");
-                            str.clear();
-                            str << data[2];
-                            str >> vi;
-                            t_normal.push_back(vi-1);
-                        }
-
-                    }
-                }
+        /*
+         * Returns the vertex for this corner, adding one to vertices if this
+         * triple has not been seen before
+         */
+        unsigned int find(const ObjCorner& c,vector<ObjCorner>& vertices)
+        {
+            size_t slot = hash(c) & mask;
 
-                if (t_triangles.size()<3)
+            while (true)
+            {
+                unsigned int v = slots[slot];
+                if (v==(unsigned int)NO_INDEX)
                 {
-                    str.str("");
-                    str.clear();
-                    str << "Line " << lineno << ": Fewer than 3 vertices for a polygon";
-                    throw str.str();
+                    v = (unsigned int)vertices.size();
+                    vertices.push_back(c);
+                    slots[slot] = v;
+                    if (2*vertices.size()>slots.size())
+                        grow(vertices);
+                    return v;
                 }
+                if (vertices[v]==c)
+                    return v;
+                slot = (slot+1) & mask;
+            }
+        }
 
-                //if face has more than 3 vertices, break down into a triangle fan
-                for (i=2;i<t_triangles.size();i++)
-                {
-                    triangles.push_back(t_triangles[0]);
-                    triangles.push_back(t_triangles[i-1]);
-                    triangles.push_back(t_triangles[i]);
-
-                    if (t_tex.size()>0)
-                    {
-                        triangle_texture_indices.push_back(t_tex[0]);
-                        triangle_texture_indices.push_back(t_tex[i-1]);
-                        triangle_texture_indices.push_back(t_tex[i]);
-                    }
-
-                    if (t_normal.size()>0)
-                    {
-                        triangle_normal_indices.push_back(t_normal[0]);
-                        triangle_normal_indices.push_back(t_normal[i-1]);
-                        triangle_normal_indices.push_back(t_normal[i]);
-                    }
+    private:
+        /*
+         * Double the table, putting every vertex back in
+         */
+        void grow(const vector<ObjCorner>& vertices)
+        {
+            slots.assign(2*slots.size(),(unsigned int)NO_INDEX);
+            mask = slots.size()-1;
+            for (size_t v=0;v<vertices.size();v++)
+            {
+                size_t slot = hash(vertices[v]) & mask;
 
-                }
+                while (slots[slot]!=(unsigned int)NO_INDEX)
+                    slot = (slot+1) & mask;
+                slots[slot] = (unsigned int)v;
+            }
+        }
 
+        static size_t hash(const ObjCorner& c)
+        {
+            unsigned int h = c.position*0x9E3779B1u;
+            h ^= c.texcoord*0x85EBCA77u;
+            h ^= c.normal*0xC2B2AE3Du;
+            //final mix so that nearby triples spread over the whole table
+            h ^= h>>16;
+            h *= 0x7FEB352Du;
+            h ^= h>>15;
+            return h;
+        }
 
-            }
+        vector<unsigned int> slots;
+        size_t mask;
+    };
+
+    /*
+     * \throws string if a face refers to an element that does not exist.
+     *          Only texture coordinates and normals may be left out.
+     */
+    static void checkIndex(unsigned int index,size_t count,const char *what,bool optional=true) throw(string)
+    {
+        if (index==(unsigned int)NO_INDEX)
+        {
+            if (optional)
+                return;
+            throw string("Face has a corner without a ")+what;
+        }
+        if (index>=count)
+        {
+            stringstream str;
+            str << "Face refers to " << what << " " << index+1 << ", which does not exist";
+            throw str.str();
+        }
+    }
+
+    /*
+     * Make one mesh vertex per distinct (position,texcoord,normal) triple
+     * used by the faces, and rewrite the triangles in terms of those
+     * vertices.
+     */
+    static void weld(const ObjData& objData,
+                     vector<ObjCorner>& vertices,
+                     vector<unsigned int>& triangles) throw(string)
+    {
+        size_t corners = objData.triangles.size();
+        CornerMap table(std::min(corners,
+                                   objData.vertices.size()+objData.texcoords.size()+objData.normals.size()));
+
+        triangles.resize(corners);
+        for (size_t i=0;i<corners;i++)
+        {
+            ObjCorner c;
+
+            c.position = objData.triangles[i];
+            c.texcoord = objData.triangle_texture_indices[i];
+            c.normal = objData.triangle_normal_indices[i];
+            checkIndex(c.position,objData.vertices.size(),"vertex",false);
+            checkIndex(c.texcoord,objData.texcoords.size(),"texture coordinate");
+            checkIndex(c.normal,objData.normals.size(),"normal");
+            triangles[i] = table.find(c,vertices);
         }
+    }
+
+    static PolygonMesh<K> buildMesh(ObjData& objData,
+                                    const ObjImportOptions& options,
+                                    unsigned int threads,
+                                    ObjImportStats& stats) throw(string)
+    {
+        vector<glm::vec4>& vertices = objData.vertices;
+        vector<glm::vec4>& normals = objData.normals;
+        vector<glm::vec4>& texcoords = objData.texcoords;
+        unsigned int i;
+        PolygonMesh<K> mesh;
 
-        if (scaleAndCenter)
+        if ((options.scaleAndCenter) && (vertices.size()>0))
         {
             //center about the origin and within a cube of side 1 centered at the origin
             //find the centroid
@@ -256,7 +785,6 @@ public:
 
             for (i=1;i<vertices.size();i++)
             {
-                //center = center.add(vertices.get(i).x,vertices.get(i).y,vertices.get(i).z,0.0f);
                 minimum = glm::min(minimum,vertices[i]);
                 maximum = glm::max(maximum,vertices[i]);
             }
@@ -286,47 +814,142 @@ public:
             }
         }
 
+        //do the faces say which texture coordinate and normal each corner uses?
+        bool cornersHaveTexcoords = false;
+        bool cornersHaveNormals = false;
+        bool allCornersHaveNormals = true;
+        for (i=0;i<objData.triangles.size();i++)
+        {
+            if (objData.triangle_texture_indices[i]!=(unsigned int)NO_INDEX)
+                cornersHaveTexcoords = true;
+            if (objData.triangle_normal_indices[i]!=(unsigned int)NO_INDEX)
+                cornersHaveNormals = true;
+            else
+                allCornersHaveNormals = false;
+        }
+
+        vector<ObjCorner> corners;
+        vector<unsigned int> triangles;
+        bool welded = cornersHaveTexcoords || cornersHaveNormals;
+        bool computeNormals;
+
+        if (welded)
+        {
+            weld(objData,corners,triangles);
+            computeNormals = !allCornersHaveNormals;
+        }
+        else
+        {
+            //faces only index positions: attributes are matched by position
+            //index, if there is exactly one per position
+            for (i=0;i<objData.triangles.size();i++)
+                checkIndex(objData.triangles[i],vertices.size(),"vertex",false);
+            triangles.swap(objData.triangles);
+            computeNormals = (normals.size()==0) || (normals.size()!=vertices.size());
+        }
+
+        //a file without objects, groups or materials is one unnamed part,
+        //and the mesh is left undivided
+        vector<SubMesh> parts;
+        if ((objData.parts.size()>1)
+                || ((objData.parts.size()==1)
+                    && ((objData.parts[0].name.length()>0) || (objData.parts[0].materialName.length()>0))))
+            parts.swap(objData.parts);
+
+        //the face index arrays are no longer needed
+        vector<unsigned int>().swap(objData.triangles);
+        vector<unsigned int>().swap(objData.triangle_texture_indices);
+        vector<unsigned int>().swap(objData.triangle_normal_indices);
+
+        stats.positions = vertices.size();
+        stats.texcoords = texcoords.size();
+        stats.normals = normals.size();
+        stats.corners = triangles.size();
+        stats.triangles = triangles.size()/3;
+        stats.vertices = welded?corners.size():vertices.size();
+        stats.fromCache = false;
+
         vector<K> vertexData;
-        vector<float> data;
-        for (i=0;i<vertices.size();i++) {
-            K v;
-			
-			data.clear();
-			data.push_back(vertices[i].x);
-			data.push_back(vertices[i].y);
-			data.push_back(vertices[i].z);
-			data.push_back(vertices[i].w);
-			
-            v.setData("position",data);
-            if (texcoords.size()==vertices.size())
-            {
-				data.clear();
-				data.push_back(texcoords[i].x);
-				data.push_back(texcoords[i].y);
-				data.push_back(texcoords[i].z);
-				data.push_back(texcoords[i].w);
-				v.setData("texcoord",data);
-			}    
-            if (normals.size()==vertices.size())
-			{
-				data.clear();
-				data.push_back(normals[i].x);
-				data.push_back(normals[i].y);
-				data.push_back(normals[i].z);
-				data.push_back(normals[i].w);
-				v.setData("normal",data);
-			}
-
-            vertexData.push_back(v);
-        }
-
-        if ((normals.size()==0) || (normals.size()!=vertices.size()))
-            mesh.computeNormals();
-
-        mesh.setVertexData(vertexData);
-        mesh.setPrimitives(triangles);
+        //every vertex is independent of the others, so fill them in parallel
+        vertexData.resize(stats.vertices);
+        //the attributes are looked up once, and only those the file has, so
+        //that a vertex type without texture coordinates can still be used
+        VertexAccess<K> positionAccess("position");
+        unique_ptr<VertexAccess<K> > texcoordAccess,normalAccess;
+        if (texcoords.size()>0)
+            texcoordAccess.reset(new VertexAccess<K>("texcoord"));
+        if (normals.size()>0)
+            normalAccess.reset(new VertexAccess<K>("normal"));
+
+        parallelFor(0,vertexData.size(),threads,
+                    [&](size_t first,size_t last,unsigned int)
+        {
+            for (size_t i=first;i<last;i++) {
+                K& v = vertexData[i];
+                unsigned int p,t,n;
+
+                if (welded)
+                {
+                    p = corners[i].position;
+                    t = corners[i].texcoord;
+                    n = corners[i].normal;
+                }
+                else
+                {
+                    p = (unsigned int)i;
+                    t = (texcoords.size()==vertices.size())?p:(unsigned int)NO_INDEX;
+                    n = (normals.size()==vertices.size())?p:(unsigned int)NO_INDEX;
+                }
+
+                positionAccess.write(v,&vertices[p].x,4);
+                if (t!=(unsigned int)NO_INDEX)
+                    texcoordAccess->write(v,&texcoords[t].x,4);
+                if (n!=(unsigned int)NO_INDEX)
+                    normalAccess->write(v,&normals[n].x,4);
+            }
+        });
+
+        //nothing else is read from the file, so hand its memory back before
+        //the mesh takes over the vertices
+        vector<ObjCorner>().swap(corners);
+        objData.clear();
+
+        mesh.setVertexData(std::move(vertexData));
+        mesh.setPrimitives(std::move(triangles));
+        mesh.setSubMeshes(std::move(parts));
         mesh.setPrimitiveType(GL_TRIANGLES);
         mesh.setPrimitiveSize(3);
+
+        //before normals are computed, so that the polygons around a
+        //position that had several copies are smoothed together
+        if (options.weldVertices)
+        {
+            WeldOptions weldOptions = options.welding;
+
+            weldOptions.threads = threads;
+            stats.welding = mesh.weld(weldOptions);
+            stats.vertices = mesh.getVertexCount();
+        }
+
+        //only once the mesh has its vertices and triangles
+        if (computeNormals)
+        {
+            NormalOptions normalOptions = options.normals;
+
+            normalOptions.threads = threads;
+            mesh.computeNormals(normalOptions);
+            stats.vertices = mesh.getVertexCount();
+        }
+
+        //last, as splitting vertices at creases changes the indices
+        if (options.optimizeVertexCache)
+        {
+            stats.cacheBefore = mesh.getVertexCacheStats();
+            mesh.optimizeVertexCache();
+            stats.cacheAfter = mesh.getVertexCacheStats();
+        }
+        if (options.triangleStrips)
+            mesh.stripify();
         return mesh;
     }
 };
@@ -0,0 +1,565 @@
+#ifndef _OBJREADER_H_
+#define _OBJREADER_H_
+
+#include <glm/glm.hpp>
+#include <istream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "MappedFile.h"
+#include "StringSlice.h"
+#include "NumberParser.h"
+using namespace std;
+
+namespace util
+{
+
+/*
+ * One corner of a face in an OBJ file. The indices are 0-based and refer to
+ * the positions, texture coordinates and normals in the order they were read.
+ */
+class ObjFaceCorner
+{
+public:
+    //used for a texture coordinate or normal that the corner does not have
+    enum { NO_INDEX = 0xFFFFFFFFu };
+    //bits of relative, one for each index that was negative in the file
+    enum { RELATIVE_POSITION = 1, RELATIVE_TEXCOORD = 2, RELATIVE_NORMAL = 4 };
+
+    unsigned int position,texcoord,normal;
+    /*
+     * A negative index counts back from the last record of its kind read so
+     * far. It has already been resolved here, but the bit is set so that a
+     * reader that was only given part of a file can shift it later.
+     */
+    unsigned int relative;
+};
+
+/*
+ * A negative index that counts back past the first record of its kind that
+ * a reader has seen, in text that does not start the file (see
+ * ObjReader::setMidFile). Whether it is valid depends on how many records
+ * the text before holds.
+ */
+class ObjBackReference
+{
+public:
+    //the line, counted from the first text given to the reader
+    int line;
+    //one of the ObjFaceCorner::RELATIVE_ bits
+    unsigned int kind;
+    //the number of records of its kind the text before must hold
+    unsigned int reach;
+};
+
+/*
+ * Receives the contents of an OBJ file one record at a time, as the file is
+ * read, in the spirit of a SAX parser. Override the functions for the
+ * records of interest; the others do nothing.
+ *
+ * Nothing is kept by the reader, so a handler can write straight into its
+ * final storage, or compute statistics without holding the mesh at all.
+ */
+class ObjHandler
+{
+public:
+    virtual ~ObjHandler(){}
+
+    /*
+     * A "v" record. w is 1, and x, y and z have already been divided by the
+     * w in the file, if there was one.
+     */
+    virtual void onVertex(const glm::vec4& /*position*/){}
+
+    /*
+     * A "vt" record. z is 0 and w is 1 unless the file says otherwise
+     */
+    virtual void onTexcoord(const glm::vec4& /*texcoord*/){}
+
+    /*
+     * A "vn" record, normalized, with w = 0
+     */
+    virtual void onNormal(const glm::vec4& /*normal*/){}
+
+    /*
+     * An "f" record: a polygon with count (at least 3) corners. The array is
+     * only valid during the call.
+     */
+    virtual void onFace(const ObjFaceCorner * /*corners*/,unsigned int /*count*/){}
+
+    /*
+     * An "o" record: the faces that follow belong to the object with this
+     * name
+     */
+    virtual void onObject(const string& /*name*/){}
+
+    /*
+     * A "g" record: the faces that follow belong to this group. If several
+     * group names are given they are passed as one, separated by spaces.
+     */
+    virtual void onGroup(const string& /*name*/){}
+
+    /*
+     * A "usemtl" record: the faces that follow are drawn with this material
+     */
+    virtual void onMaterial(const string& /*name*/){}
+};
+
+/*
+ * Reads OBJ text and passes every record it recognizes to an ObjHandler.
+ *
+ * The text is scanned in place: each line is split into slices of the
+ * original buffer and numbers are read directly out of those slices, so
+ * no strings or streams are created per line or per token.
+ *
+ * A reader remembers how many lines and records it has seen, so a file can
+ * be given to it in consecutive pieces that each end at a line boundary.
+ */
+class ObjReader
+{
+public:
+    ObjReader()
+    {
+        lines = 0;
+        positions = texcoords = normals = 0;
+        errorLine = 0;
+        midFile = false;
+        maxReach[0] = maxReach[1] = maxReach[2] = 0;
+    }
+
+    /*
+     * Read a whole file. It is memory-mapped, so the operating system pages
+     * it in and out as needed instead of it being copied.
+     * \throws string if the file cannot be read or is malformed
+     */
+    static void readFile(const string& filename,ObjHandler& handler) throw(string)
+    {
+        MappedFile file;
+
+        try
+        {
+            file.open(filename);
+        }
+        catch (runtime_error& e)
+        {
+            throw string(e.what());
+        }
+
+        ObjReader reader;
+        if (!reader.parse(file.data(),file.data()+file.size(),handler))
+            throw reader.getError();
+    }
+
+    /*
+     * Read a stream a block at a time. Only one block, and the part of a
+     * line that straddles two blocks, is held in memory at once.
+     * \throws string if the stream is malformed
+     */
+    static void readStream(istream& in,ObjHandler& handler) throw(string)
+    {
+        const size_t blockSize = 1<<20;
+        vector<char> block(blockSize);
+        string carry;
+        ObjReader reader;
+
+        while (in)
+        {
+            in.read(&block[0],blockSize);
+            size_t n = (size_t)in.gcount();
+            if (n==0)
+                break;
+
+            //parse up to the last complete line in this block
+            const char *begin = &block[0];
+            const char *end = begin+n;
+            const char *last = end;
+            while ((last>begin) && (last[-1]!='\n'))
+                last--;
+
+            if (last==begin)
+            {
+                //no line ends in this block
+                carry.append(begin,end);
+                continue;
+            }
+
+            if (carry.length()>0)
+            {
+                //finish the line started in the previous block
+                const char *newline = (const char *)memchr(begin,'\n',end-begin);
+                carry.append(begin,newline+1);
+                if (!reader.parse(carry.data(),carry.data()+carry.length(),handler))
+                    throw reader.getError();
+                carry.clear();
+                begin = newline+1;
+            }
+
+            if (!reader.parse(begin,last,handler))
+                throw reader.getError();
+            carry.append(last,end);
+        }
+
+        if (!reader.parse(carry.data(),carry.data()+carry.length(),handler))
+            throw reader.getError();
+    }
+
+    /*
+     * Read the lines in [begin,end). If the text is malformed, parsing stops
+     * at the offending line and false is returned: nothing is thrown, so this
+     * can run on a worker thread.
+     * \return true if the text was read without error
+     */
+    inline bool parse(const char *begin,const char *end,ObjHandler& handler);
+
+    /*
+     * Tell the reader whether the text it is given follows text that it
+     * does not see, as when a file is read in chunks. If it does, a negative
+     * index that counts back past the records the reader has seen is not an
+     * error: it wraps around, to be shifted once the counts before are
+     * known, and is listed in getBackReferences to be checked then.
+     */
+    void setMidFile(bool midFile)
+    {
+        this->midFile = midFile;
+    }
+
+    /*
+     * \return the indices that counted back past the records seen, in the
+     *         order they were read. Only an index that reaches further back
+     *         than every one of its kind before it is listed, so the first
+     *         that reaches past the start of the file is always among them.
+     */
+    const vector<ObjBackReference>& getBackReferences() const
+    {
+        return backReferences;
+    }
+
+    /*
+     * \return the error for an index of a kind (one of the
+     *         ObjFaceCorner::RELATIVE_ bits) that does not resolve
+     */
+    static const char *indexError(unsigned int kind)
+    {
+        switch (kind)
+        {
+        case ObjFaceCorner::RELATIVE_TEXCOORD:
+            return "Face has an invalid texture coordinate index";
+        case ObjFaceCorner::RELATIVE_NORMAL:
+            return "Face has an invalid normal index";
+        default:
+            return "Face has an invalid vertex index";
+        }
+    }
+
+    /*
+     * \return the number of lines read so far
+     */
+    int getLineCount() const
+    {
+        return lines;
+    }
+
+    /*
+     * \return the line (counted from the first text given to this reader)
+     *         on which an error was found, or 0 if there was none
+     */
+    int getErrorLine() const
+    {
+        return errorLine;
+    }
+
+    const string& getErrorMessage() const
+    {
+        return errorMessage;
+    }
+
+    /*
+     * \return the error, with its line number, as it would be thrown
+     */
+    string getError() const
+    {
+        return lineError(errorLine,errorMessage);
+    }
+
+    static string lineError(int lineno,const string& message)
+    {
+        stringstream str;
+        str << "Line " << lineno << ": " << message;
+        return str.str();
+    }
+
+private:
+    static bool isSpace(char c)
+    {
+        return (c==' ') || (c=='\t') || (c=='\r') || (c=='\f') || (c=='\v');
+    }
+
+    /*
+     * Split [begin,end) into whitespace-separated slices
+     */
+    static void tokenize(const char *begin,const char *end,vector<StringSlice>& tokens)
+    {
+        tokens.clear();
+        while (begin<end)
+        {
+            while ((begin<end) && isSpace(*begin))
+                begin++;
+            if (begin==end)
+                break;
+            const char *start = begin;
+            while ((begin<end) && !isSpace(*begin))
+                begin++;
+            tokens.push_back(StringSlice(start,begin));
+        }
+    }
+
+    static float toFloat(const StringSlice& s)
+    {
+        float value;
+
+        NumberParser::parseFloat(s.begin(),s.end(),value);
+        return value;
+    }
+
+    /*
+     * Read an OBJ index and convert it to a 0-based index. In OBJ files
+     * indices begin at 1, so 1 must be subtracted. Negative indices count
+     * back from the last element read so far.
+     * \param begin the index as written in the file
+     * \param end the end of the index
+     * \param count the number of elements of this kind read so far
+     * \param kind the ObjFaceCorner::RELATIVE_ bit of this kind
+     * \param index set to the 0-based index
+     * \param relative set to true if the index was negative
+     * \return false if the index is not a whole number, is 0, or counts
+     *         back past the first element of a text that starts the file
+     */
+    bool resolveIndex(const char *begin,const char *end,unsigned int count,
+                      unsigned int kind,unsigned int& index,bool& relative)
+    {
+        int value;
+
+        if ((NumberParser::parseInt(begin,end,value)!=end) || (value==0))
+            return false;
+        relative = (value<0);
+        if (relative)
+        {
+            unsigned int back = (unsigned int)-(long long)value;
+
+            if (back>count)
+            {
+                if (!midFile)
+                    return false;
+                noteBackReference(kind,back-count);
+            }
+            //wraps around if it counts back into the text before
+            index = count - back;
+        }
+        else
+            index = (unsigned int)(value-1);
+        return true;
+    }
+
+    void noteBackReference(unsigned int kind,unsigned int reach)
+    {
+        unsigned int& most = maxReach[kind>>1];
+
+        if (reach<=most)
+            return;
+        most = reach;
+
+        ObjBackReference reference;
+        reference.line = lines;
+        reference.kind = kind;
+        reference.reach = reach;
+        backReferences.push_back(reference);
+    }
+
+    bool fail(const char *message)
+    {
+        errorLine = lines;
+        errorMessage = message;
+        return false;
+    }
+
+    int lines;
+    unsigned int positions,texcoords,normals;
+    int errorLine;
+    string errorMessage;
+    bool midFile;
+    //the furthest each kind has counted back past the records seen
+    unsigned int maxReach[3];
+    vector<ObjBackReference> backReferences;
+    //reused from line to line, to avoid allocating
+    vector<StringSlice> tokens;
+    vector<ObjFaceCorner> corners;
+};
+
+bool ObjReader::parse(const char *begin,const char *end,ObjHandler& handler)
+{
+    unsigned int i;
+
+    while (begin<end)
+    {
+        const char *lineEnd = (const char *)memchr(begin,'\n',end-begin);
+        if (lineEnd==NULL)
+            lineEnd = end;
+
+        const char *line = begin;
+        begin = (lineEnd<end)?lineEnd+1:end;
+        lines++;
+
+        if ((line==lineEnd) || (line[0] == '#'))
+        {
+            //line is a comment, ignore
+            continue;
+        }
+
+        tokenize(line,lineEnd,tokens);
+        if (tokens.size()==0)
+            continue;
+
+        if (tokens[0]=="v")
+        {
+            if ((tokens.size()<4) || (tokens.size()>7))
+                return fail("Vertex coordinate has an invalid number of values");
+
+            glm::vec4 v;
+
+            v.x = toFloat(tokens[1]);
+            v.y = toFloat(tokens[2]);
+            v.z = toFloat(tokens[3]);
+            v.w = 1.0f;
+
+            if (tokens.size()==5)
+            {
+                float num = toFloat(tokens[4]);
+                if (num!=0)
+                {
+                    v.x/=num;
+                    v.y/=num;
+                    v.z/=num;
+                }
+            }
+
+            positions++;
+            handler.onVertex(v);
+        }
+        else if (tokens[0]=="vt")
+        {
+            if ((tokens.size()<3) || (tokens.size()>4))
+                return fail("Texture coordinate has an invalid number of values");
+
+            glm::vec4 v;
+
+            v.x = toFloat(tokens[1]);
+            v.y = toFloat(tokens[2]);
+            v.z = 0.0f;
+            v.w = 1.0f;
+
+            if (tokens.size()>3)
+            {
+                v.z = toFloat(tokens[3]);
+            }
+
+            texcoords++;
+            handler.onTexcoord(v);
+        }
+        else if (tokens[0]=="vn")
+        {
+            if (tokens.size()!=4)
+                return fail("Normal has an invalid number of values");
+
+            glm::vec3 v;
+
+            v.x = toFloat(tokens[1]);
+            v.y = toFloat(tokens[2]);
+            v.z = toFloat(tokens[3]);
+
+            v = glm::normalize(v);
+            normals++;
+            handler.onNormal(glm::vec4(v,0.0f));
+        }
+        else if (tokens[0]=="f")
+        {
+            if (tokens.size()<4)
+                return fail("Face has too few vertices, must be at least 3");
+
+            corners.resize(tokens.size()-1);
+
+            for (i=1;i<tokens.size();i++)
+            {
+                //split v/vt/vn in place
+                const char *field[3];
+                const char *fieldEnd[3];
+                int fields = 0;
+                const char *p = tokens[i].begin();
+                const char *tokenEnd = tokens[i].end();
+                ObjFaceCorner& corner = corners[i-1];
+                bool relative;
+
+                while (true)
+                {
+                    const char *slash = p;
+                    while ((slash<tokenEnd) && (*slash!='/'))
+                        slash++;
+                    if (fields==3)
+                        return fail("Face specification has an incorrect number of values");
+                    field[fields] = p;
+                    fieldEnd[fields] = slash;
+                    fields++;
+                    if (slash==tokenEnd)
+                        break;
+                    p = slash+1;
+                }
+
+                corner.relative = 0;
+                if (!resolveIndex(field[0],fieldEnd[0],positions,ObjFaceCorner::RELATIVE_POSITION,
+                                      corner.position,relative))
+                    return fail(indexError(ObjFaceCorner::RELATIVE_POSITION));
+                if (relative)
+                    corner.relative |= ObjFaceCorner::RELATIVE_POSITION;
+
+                corner.texcoord = ObjFaceCorner::NO_INDEX;
+                if ((fields > 1) && (field[1]<fieldEnd[1])) //a vertex texture index exists
+                {
+                    if (!resolveIndex(field[1],fieldEnd[1],texcoords,ObjFaceCorner::RELATIVE_TEXCOORD,
+                                          corner.texcoord,relative))
+                        return fail(indexError(ObjFaceCorner::RELATIVE_TEXCOORD));
+                    if (relative)
+                        corner.relative |= ObjFaceCorner::RELATIVE_TEXCOORD;
+                }
+
+                corner.normal = ObjFaceCorner::NO_INDEX;
+                if ((fields > 2) && (field[2]<fieldEnd[2])) //a vertex normal index exists
+                {
+                    if (!resolveIndex(field[2],fieldEnd[2],normals,ObjFaceCorner::RELATIVE_NORMAL,
+                                          corner.normal,relative))
+                        return fail(indexError(ObjFaceCorner::RELATIVE_NORMAL));
+                    if (relative)
+                        corner.relative |= ObjFaceCorner::RELATIVE_NORMAL;
+                }
+            }
+
+            handler.onFace(&corners[0],(unsigned int)corners.size());
+        }
+        else if ((tokens[0]=="o") || (tokens[0]=="g") || (tokens[0]=="usemtl"))
+        {
+            //the name is the rest of the line. It is empty for a bare "g"
+            string name;
+            if (tokens.size()>1)
+                name = string(tokens[1].begin(),tokens.back().end());
+
+            if (tokens[0]=="o")
+                handler.onObject(name);
+            else if (tokens[0]=="g")
+                handler.onGroup(name);
+            else
+                handler.onMaterial(name);
+        }
+    }
+    return true;
+}
+}
+
+#endif
@@ -2,6 +2,8 @@
 #define _OBJECTINSTANCE_H_
 
 #include "PolygonMesh.h"
+#include "VertexPacker.h"
+#include "Stripifier.h"
 #include <string>
 using namespace std;
 #include "OpenGLFunctions.h"
@@ -31,11 +33,20 @@ namespace util
 
   public:
     ObjectInstance(const string& name)
+      :positionScale(1,1,1),positionOffset(0,0,0)
     {
       //set the name
       setName(name);
-
-
+      vao = 0;
+      vbo[0] = vbo[1] = 0;
+      primitiveType = primitiveCount = 0;
+      indexType = GL_UNSIGNED_INT;
+      indexSize = sizeof(GLuint);
+      primitiveRestart = false;
+      vertexBufferBytes = indexBufferBytes = 0;
+      vertexCount = indexCount = 0;
+      usage = GL_STATIC_DRAW;
+      lastUpdateBytes = 0;
     }
     ~ObjectInstance(){}
 
@@ -44,20 +55,71 @@ namespace util
                          ShaderProgram& program,
                          const ShaderLocationsVault& shaderLocations,
                          const map<string,string>& shaderVarsToAttributeNames,
-                         const PolygonMesh<K>& mesh) ;
+                         const PolygonMesh<K>& mesh,
+                         const VertexFormat& format=VertexFormat()) ;
     template <class K>
     void initPolygonMesh(OpenGLFunctions& gl,
                          const ShaderLocationsVault& shaderLocations,
                          const map<string,string>& shaderVarsToAttributeNames,
-                         const PolygonMesh<K>& mesh) ;
+                         const PolygonMesh<K>& mesh,
+                         const VertexFormat& format=VertexFormat()) ;
+    /*
+     * Copy what has changed in a mesh since this object was set up from it,
+     * or last updated from it, to the buffers: only the dirty ranges of the
+     * mesh (see PolygonMesh::getDirtyVertices), which are then cleared. If
+     * the number of vertices or indices has changed, or a vertex has moved
+     * out of the box packed positions are stored relative to, the buffers
+     * are filled again as a whole.
+     */
+    template <class K>
+    void updatePolygonMesh(OpenGLFunctions& gl,PolygonMesh<K>& mesh);
+    /*
+     * How the buffers will be used, to be given to OpenGL when they are
+     * filled: GL_STATIC_DRAW (the default) for a mesh that does not change,
+     * GL_DYNAMIC_DRAW for one that is updated often, such as every frame.
+     * Set it before initPolygonMesh.
+     */
+    inline void setUsage(GLenum usage);
+    inline GLenum getUsage() const;
     inline void draw(OpenGLFunctions& gl) const;
+    inline void draw(OpenGLFunctions& gl,unsigned int subMesh) const;
+    inline int getSubMeshCount() const;
+    inline SubMesh getSubMesh(unsigned int subMesh) const;
     inline void setName(string name);
     inline string getName() const;
     inline glm::vec4 getMinimumBounds() const;
     inline glm::vec4 getMaximumBounds() const;
     inline void cleanup(OpenGLFunctions& gl);
+    /*
+     * What a packed position is scaled by and offset by to get the position
+     * in the mesh. The vertex shader must be given these as the uniforms
+     * positionScale and positionOffset; for unpacked positions they are 1
+     * and 0.
+     */
+    inline glm::vec3 getPositionScale() const;
+    inline glm::vec3 getPositionOffset() const;
+    /*
+     * The GPU memory taken by the vertices and indices of this object, in
+     * bytes
+     */
+    inline size_t getVertexBufferBytes() const;
+    inline size_t getIndexBufferBytes() const;
+    /*
+     * The bytes copied to the buffers by the last updatePolygonMesh
+     */
+    inline size_t getLastUpdateBytes() const;
   private:
     inline void initVertexObjects(OpenGLFunctions& gl);
+    inline void enablePrimitiveRestart(OpenGLFunctions& gl) const;
+    inline void disablePrimitiveRestart(OpenGLFunctions& gl) const;
+    template <class K>
+    void initBuffers(OpenGLFunctions& gl,
+                     const ShaderLocationsVault& shaderLocations,
+                     const map<string,string>& shaderVarsToAttributeNames,
+                     const PolygonMesh<K>& mesh,
+                     const VertexFormat& format);
+    template <class K>
+    void fillBuffers(OpenGLFunctions& gl,const PolygonMesh<K>& mesh);
 
   protected:
     GLuint vao; //our VAO
@@ -65,6 +127,19 @@ namespace util
     string name; //a unique "name" for this object
     unsigned int primitiveType;
     unsigned int primitiveCount;
+    vector<SubMesh> subMeshes; //index ranges of the parts of the mesh
+    GLenum indexType; //GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+    unsigned int indexSize; //in bytes
+    bool primitiveRestart; //if the indices are strips with restart indices
+    glm::vec3 positionScale,positionOffset;
+    size_t vertexBufferBytes,indexBufferBytes;
+    //what the buffers were filled from, to update them
+    map<string,string> attributeNames;
+    VertexFormat format;
+    PackedVertices layout; //without its data
+    size_t vertexCount,indexCount;
+    GLenum usage;
+    size_t lastUpdateBytes;
   };
 
 
@@ -91,81 +166,72 @@ namespace util
  * \param shaderVarsToAttributeNames a mapping of
  *        shader variable -> vertex attributes in the underlying mesh
  * \param mesh the underlying polygon mesh
+ * \param format how the vertex attributes are stored in the vertex buffer.
+ *        A packed format needs a vertex shader that scales positions by
+ *        getPositionScale() and getPositionOffset()
  */
   template<class K>
   void ObjectInstance::initPolygonMesh(OpenGLFunctions& gl,
                                        ShaderProgram& program,
                                        const ShaderLocationsVault& shaderLocations,
                                        const map<string,string>& shaderVarsToAttributeNames,
-                                       const PolygonMesh<K>& mesh)
+                                       const PolygonMesh<K>& mesh,
+                                       const VertexFormat& format)
   {
-    unsigned int i,j;
-
-    initVertexObjects(gl);
-
+    //enable the program
+    program.enable(gl);
 
-    primitiveType = mesh.getPrimitiveType();
-    primitiveCount = mesh.getPrimitiveCount();
-    //get a list of all the vertex attributes from the mesh
-    vector<K> vertexDataList = mesh.getVertexAttributes();
-    vector<unsigned int> primitives = mesh.getPrimitives();
+    initBuffers(gl,shaderLocations,shaderVarsToAttributeNames,mesh,format);
 
+    program.disable(gl);
+  }
 
-    //No need to create buffers in C++!
+  /*
+ * A helper method that sets this object up for rendering, with whatever
+ * shader program is enabled
+ * \param shaderLocations the locations of various shader variables relevant
+ *        to this object
+ * \param shaderVarsToAttributeNames a mapping of
+ *        shader variable -> vertex attributes in the underlying mesh
+ * \param mesh the underlying polygon mesh
+ * \param format how the vertex attributes are stored in the vertex buffer
+ */
+  template<class K>
+  void ObjectInstance::initPolygonMesh(OpenGLFunctions& gl,
+                                       const ShaderLocationsVault& shaderLocations,
+                                       const map<string,string>& shaderVarsToAttributeNames,
+                                       const PolygonMesh<K>& mesh,
+                                       const VertexFormat& format)
+  {
+    initBuffers(gl,shaderLocations,shaderVarsToAttributeNames,mesh,format);
+  }
 
-    int sizeOfOneVertex=0;
-    map<string,int> offsets;
+  template<class K>
+  void ObjectInstance::initBuffers(OpenGLFunctions& gl,
+                                   const ShaderLocationsVault& shaderLocations,
+                                   const map<string,string>& shaderVarsToAttributeNames,
+                                   const PolygonMesh<K>& mesh,
+                                   const VertexFormat& format)
+  {
+    initVertexObjects(gl);
 
-    for (map<string,string>::const_iterator it=shaderVarsToAttributeNames.cbegin();it!=shaderVarsToAttributeNames.cend();it++)
-      {
-        offsets[it->second] = sizeOfOneVertex;
-        sizeOfOneVertex += vertexDataList[0].getData(it->second).size();
-      }
+    this->attributeNames = shaderVarsToAttributeNames;
+    this->format = format;
+    fillBuffers(gl,mesh);
 
     int stride;
 
     if (shaderVarsToAttributeNames.size()>1)
-      stride = sizeOfOneVertex;
+      stride = layout.bytesPerVertex;
     else
       stride = 0;
 
-
-    vector<float> vertexDataAsFloats;
-    vector<float> data;
-
-    for (i=0;i<vertexDataList.size();i++)
-      {
-        for (map<string,string>::const_iterator e = shaderVarsToAttributeNames.cbegin();e!=shaderVarsToAttributeNames.cend();e++)
-          {
-            data.clear();
-            data = vertexDataList[i].getData(e->second);
-            for (j=0;j<data.size();j++)
-              {
-                vertexDataAsFloats.push_back(data[j]);
-              }
-          }
-      }
-
-
-
-
-
     /*
      * Bind the VAO as the current VAO, so that all subsequent commands affect it
+     * (fillBuffers has already bound it, with the index buffer)
      */
     gl.glBindVertexArray(vao);
-
-    //enable the program
-    program.enable(gl);
-
-    //copy all the data to the vbo[0]
     gl.glBindBuffer(GL_ARRAY_BUFFER, vbo[0]);
-    gl.glBufferData(GL_ARRAY_BUFFER,
-                    sizeof(float) * vertexDataAsFloats.size(),
-                    &vertexDataAsFloats[0],
-        GL_STATIC_DRAW);
-
-
 
     /*
      * go through all variables and enable that
@@ -187,13 +253,31 @@ namespace util
 
         if (shaderLocation>=0)
           {
+            const PackedAttribute& attribute = layout.attributes[it->second];
+            GLenum type;
+
+            switch (attribute.type)
+              {
+              case PackedAttribute::HALF_FLOAT:
+                type = GL_HALF_FLOAT;
+                break;
+              case PackedAttribute::SHORT:
+                type = GL_SHORT;
+                break;
+              case PackedAttribute::INT_2_10_10_10_REV:
+                type = GL_INT_2_10_10_10_REV;
+                break;
+              default:
+                type = GL_FLOAT;
+              }
+
             //tell opengl how to interpret the above data
             gl.glVertexAttribPointer(shaderLocation,
-                                     vertexDataList[0].getData(it->second).size(),
-                GL_FLOAT,
-                GL_FALSE,
-                sizeof(float) * stride,
-                (void *)(sizeof(float) * offsets[it->second]));
+                                     attribute.components,
+                type,
+                attribute.normalized?GL_TRUE:GL_FALSE,
+                stride,
+                (void *)(size_t)attribute.offset);
             //enable this attribute so that when rendered, this is sent to the vertex shader
             gl.glEnableVertexAttribArray(shaderLocation);
           }
@@ -203,163 +287,146 @@ namespace util
 
 
 
-    /*
-     * Allocate the VBO for triangle indices and send it to GPU
-     */
-    gl.glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vbo[1]);
-    gl.glBufferData(GL_ELEMENT_ARRAY_BUFFER,
-                    primitives.size()*sizeof(GLuint),
-                    &primitives[0],
-        GL_STATIC_DRAW);
-
-    gl.glBindBuffer(GL_ARRAY_BUFFER, vbo[0]);
-
-
     /*
      * Unbind the VAO to prevent accidental change to all the settings
      * so at this point, this VAO has two VBOs and two enabled VertexAttribPointers.
      * It is going to remember all of that!
      */
     gl.glBindVertexArray(0);
-    program.disable(gl);
   }
 
+
   /*
- * A helper method that sets this object up for rendering
- * \param program the shader program to be used to render this object
- * \param shaderLocations the locations of various shader variables relevant
- *        to this object
- * \param shaderVarsToAttributeNames a mapping of
- *        shader variable -> vertex attributes in the underlying mesh
- * \param mesh the underlying polygon mesh
+ * Pack all the vertices and indices of a mesh and fill the buffers with
+ * them, leaving the VAO bound
  */
   template<class K>
-  void ObjectInstance::initPolygonMesh(OpenGLFunctions& gl,
-                                       const ShaderLocationsVault& shaderLocations,
-                                       const map<string,string>& shaderVarsToAttributeNames,
-                                       const PolygonMesh<K>& mesh)
+  void ObjectInstance::fillBuffers(OpenGLFunctions& gl,const PolygonMesh<K>& mesh)
   {
-    unsigned int i,j;
-
-    initVertexObjects(gl);
-
     primitiveType = mesh.getPrimitiveType();
     primitiveCount = mesh.getPrimitiveCount();
-    //get a list of all the vertex attributes from the mesh
-    vector<K> vertexDataList = mesh.getVertexAttributes();
-    vector<unsigned int> primitives = mesh.getPrimitives();
-
-
-    //No need to create buffers in C++!
-
-    int sizeOfOneVertex=0;
-    map<string,int> offsets;
-
-    for (map<string,string>::const_iterator it=shaderVarsToAttributeNames.cbegin();it!=shaderVarsToAttributeNames.cend();it++)
-      {
-        offsets[it->second] = sizeOfOneVertex;
-        sizeOfOneVertex += vertexDataList[0].getData(it->second).size();
-      }
-
-    int stride;
-
-    if (shaderVarsToAttributeNames.size()>1)
-      stride = sizeOfOneVertex;
-    else
-      stride = 0;
-
-
-    vector<float> vertexDataAsFloats;
-    vector<float> data;
-
-    for (i=0;i<vertexDataList.size();i++)
-      {
-        for (map<string,string>::const_iterator e = shaderVarsToAttributeNames.cbegin();e!=shaderVarsToAttributeNames.cend();e++)
-          {
-            data.clear();
-            data = vertexDataList[i].getData(e->second);
-            for (j=0;j<data.size();j++)
-              {
-                vertexDataAsFloats.push_back(data[j]);
-              }
-          }
-      }
-
-
+    subMeshes = mesh.getSubMeshesRef();
+    vertexCount = mesh.getVertexCount();
+    indexCount = mesh.getPrimitivesRef().size();
+    //pack all the vertex attributes from the mesh into one array
+    VertexPacker::pack(mesh,attributeNames,format,layout);
+    positionScale = layout.positionScale;
+    positionOffset = layout.positionOffset;
+
+    //indices take 16 bits when the vertices can be numbered in 16 bits
+    vector<unsigned char> indices;
+    VertexPacker::packIndices(mesh.getPrimitivesRef(),mesh.getVertexCount(),indices);
+    indexSize = VertexPacker::indexSize(mesh.getVertexCount());
+    indexType = (indexSize==2)?GL_UNSIGNED_SHORT:GL_UNSIGNED_INT;
+    primitiveRestart = find(mesh.getPrimitivesRef().begin(),mesh.getPrimitivesRef().end(),
+                            (unsigned int)Stripifier::RESTART_INDEX)!=mesh.getPrimitivesRef().end();
 
-
-
-    /*
-     * Bind the VAO as the current VAO, so that all subsequent commands affect it
-     */
     gl.glBindVertexArray(vao);
 
-
     //copy all the data to the vbo[0]
+    vertexBufferBytes = layout.data.size();
     gl.glBindBuffer(GL_ARRAY_BUFFER, vbo[0]);
     gl.glBufferData(GL_ARRAY_BUFFER,
-                    sizeof(float) * vertexDataAsFloats.size(),
-                    &vertexDataAsFloats[0],
-        GL_STATIC_DRAW);
-
-
+                    vertexBufferBytes,
+                    layout.data.empty()?NULL:&layout.data[0],
+                    usage);
 
     /*
-     * go through all variables and enable that
-     * attribute.
+     * Allocate the VBO for triangle indices and send it to GPU
      */
+    indexBufferBytes = indices.size();
+    gl.glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vbo[1]);
+    gl.glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+                    indexBufferBytes,
+                    indices.empty()?NULL:&indices[0],
+                    usage);
 
+    lastUpdateBytes = vertexBufferBytes+indexBufferBytes;
+    //only the layout is kept, to pack changed vertices the same way
+    vector<unsigned char>().swap(layout.data);
+  }
 
-    for (map<string,string>::const_iterator it=shaderVarsToAttributeNames.cbegin();
-         it!=shaderVarsToAttributeNames.cend();
-         it++)
+  /*
+ * Copy the dirty ranges of a mesh to the buffers, with glBufferSubData.
+ * The ranges are cleared, as the buffers now have them.
+ * \param mesh the mesh this object was set up from, and has been edited
+ *        since. Unless its dirty ranges were cleared after initPolygonMesh,
+ *        the first update copies all of it again.
+ */
+  template<class K>
+  void ObjectInstance::updatePolygonMesh(OpenGLFunctions& gl,PolygonMesh<K>& mesh)
+  {
+    const DirtyRanges& dirtyVertices = mesh.getDirtyVertices();
+    const DirtyRanges& dirtyPrimitives = mesh.getDirtyPrimitives();
+    const vector<unsigned int>& primitives = mesh.getPrimitivesRef();
+    bool refill = ((size_t)mesh.getVertexCount()!=vertexCount)
+        || (primitives.size()!=indexCount);
+    size_t i;
+
+    lastUpdateBytes = 0;
+    //pack the changed vertices first: one of them may have moved out of
+    //the box, and then everything is packed again
+    vector<vector<unsigned char> > vertices(dirtyVertices.getRanges().size());
+    for (i=0;(i<vertices.size()) && !refill && (layout.bytesPerVertex>0);i++)
       {
-        /*
-         * e.key: the name of the shader variable
-         * e.value: the name of the corresponding vertex attribute in polygon mesh
-         */
-
+        const DirtyRange& range = dirtyVertices.getRanges()[i];
 
-        int shaderLocation = shaderLocations.getLocation(it->first);
-
-        if (shaderLocation>=0)
-          {
-            //tell opengl how to interpret the above data
-            gl.glVertexAttribPointer(shaderLocation,
-                                     vertexDataList[0].getData(it->second).size(),
-                GL_FLOAT,
-                GL_FALSE,
-                sizeof(float) * stride,
-                (void *)(sizeof(float) * offsets[it->second]));
-            //enable this attribute so that when rendered, this is sent to the vertex shader
-            gl.glEnableVertexAttribArray(shaderLocation);
-          }
+        vertices[i].resize(range.count*layout.bytesPerVertex);
+        if (!VertexPacker::packRange(mesh,attributeNames,layout,range.first,range.count,&vertices[i][0]))
+          refill = true;
       }
+    //an index that was not a restart index may have become one, or the
+    //other way round
+    if (!refill && !dirtyPrimitives.isEmpty())
+      refill = (find(primitives.begin(),primitives.end(),
+                     (unsigned int)Stripifier::RESTART_INDEX)!=primitives.end())!=primitiveRestart;
 
-
-
-
-
-    /*
-     * Allocate the VBO for triangle indices and send it to GPU
-     */
-    gl.glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vbo[1]);
-    gl.glBufferData(GL_ELEMENT_ARRAY_BUFFER,
-                    primitives.size()*sizeof(GLuint),
-                    &primitives[0],
-        GL_STATIC_DRAW);
+    if (refill)
+      {
+        fillBuffers(gl,mesh);
+        gl.glBindVertexArray(0);
+        mesh.clearDirtyRanges();
+        return;
+      }
 
     gl.glBindBuffer(GL_ARRAY_BUFFER, vbo[0]);
+    for (i=0;i<vertices.size();i++)
+      {
+        const DirtyRange& range = dirtyVertices.getRanges()[i];
+
+        if (vertices[i].empty())
+          continue;
+        gl.glBufferSubData(GL_ARRAY_BUFFER,
+                           range.first*layout.bytesPerVertex,
+                           vertices[i].size(),
+                           &vertices[i][0]);
+        lastUpdateBytes += vertices[i].size();
+      }
 
-
-    /*
-     * Unbind the VAO to prevent accidental change to all the settings
-     * so at this point, this VAO has two VBOs and two enabled VertexAttribPointers.
-     * It is going to remember all of that!
-     */
+    //the index buffer is bound through the VAO
+    gl.glBindVertexArray(vao);
+    for (i=0;i<dirtyPrimitives.getRanges().size();i++)
+      {
+        const DirtyRange& range = dirtyPrimitives.getRanges()[i];
+        vector<unsigned int> part(primitives.begin()+range.first,
+                                  primitives.begin()+range.first+range.count);
+        vector<unsigned char> indices;
+
+        VertexPacker::packIndices(part,vertexCount,indices);
+        if (indices.empty())
+          continue;
+        gl.glBufferSubData(GL_ELEMENT_ARRAY_BUFFER,
+                           range.first*indexSize,
+                           indices.size(),
+                           &indices[0]);
+        lastUpdateBytes += indices.size();
+      }
     gl.glBindVertexArray(0);
-  }
 
+    primitiveType = mesh.getPrimitiveType();
+    subMeshes = mesh.getSubMeshesRef();
+    mesh.clearDirtyRanges();
+  }
 
   void ObjectInstance::cleanup(OpenGLFunctions& gl)
   {
@@ -382,16 +449,118 @@ namespace util
 
     //1. bind its VAO
     gl.glBindVertexArray(vao);
+    enablePrimitiveRestart(gl);
 
     //2. execute the "superpower" command
     //this effectively reads the index buffer, grabs the vertex data using
     //the indices and sends them to the shader
-    gl.glDrawElements(primitiveType,primitiveCount, GL_UNSIGNED_INT,(GLvoid *)0);
+    gl.glDrawElements(primitiveType,primitiveCount,indexType,(GLvoid *)0);
+
+    disablePrimitiveRestart(gl);
+    gl.glBindVertexArray(0);
+  }
+
+  /*
+ * Draw one part of this ObjectInstance, using the same buffers as the
+ * whole. Drawing every part in turn draws the same triangles as draw(gl),
+ * but lets a different material be set up before each part.
+ * \param subMesh the number of the part, less than getSubMeshCount()
+ */
+
+  void ObjectInstance::draw(OpenGLFunctions& gl,unsigned int subMesh) const
+  {
+    if (subMesh>=subMeshes.size())
+      return;
+
+    gl.glBindVertexArray(vao);
+    enablePrimitiveRestart(gl);
+
+    //the part is a range of the same index buffer
+    gl.glDrawElements(primitiveType,
+                      subMeshes[subMesh].indexCount,
+                      indexType,
+                      (GLvoid *)((size_t)indexSize*subMeshes[subMesh].firstIndex));
 
+    disablePrimitiveRestart(gl);
     gl.glBindVertexArray(0);
   }
 
+  /*
+ * Turn primitive restart on for drawing this object, if its indices are
+ * triangle strips separated by restart indices (see PolygonMesh::stripify).
+ * The restart index is the largest index of the index type. It is turned
+ * off again after drawing, so that it is only on for the objects that need
+ * it.
+ */
+
+  void ObjectInstance::enablePrimitiveRestart(OpenGLFunctions& gl) const
+  {
+    if (primitiveRestart)
+      {
+        gl.glEnable(GL_PRIMITIVE_RESTART);
+        gl.glPrimitiveRestartIndex((indexSize==2)?0xffff:(unsigned int)Stripifier::RESTART_INDEX);
+      }
+  }
+
+  void ObjectInstance::disablePrimitiveRestart(OpenGLFunctions& gl) const
+  {
+    if (primitiveRestart)
+      gl.glDisable(GL_PRIMITIVE_RESTART);
+  }
+
+  /*
+ * Gets the number of parts of this object. A mesh that was not divided into
+ * parts has none, and can only be drawn as a whole.
+ */
+
+  int ObjectInstance::getSubMeshCount() const
+  {
+    return subMeshes.size();
+  }
+
+  /*
+ * Gets the index range, name and material name of one part of this object
+ */
+
+  SubMesh ObjectInstance::getSubMesh(unsigned int subMesh) const
+  {
+    return subMeshes[subMesh];
+  }
+
+  glm::vec3 ObjectInstance::getPositionScale() const
+  {
+    return positionScale;
+  }
+
+  glm::vec3 ObjectInstance::getPositionOffset() const
+  {
+    return positionOffset;
+  }
+
+  size_t ObjectInstance::getVertexBufferBytes() const
+  {
+    return vertexBufferBytes;
+  }
+
+  size_t ObjectInstance::getIndexBufferBytes() const
+  {
+    return indexBufferBytes;
+  }
+
+  size_t ObjectInstance::getLastUpdateBytes() const
+  {
+    return lastUpdateBytes;
+  }
 
+  void ObjectInstance::setUsage(GLenum usage)
+  {
+    this->usage = usage;
+  }
+
+  GLenum ObjectInstance::getUsage() const
+  {
+    return usage;
+  }
 
   /*
  * Set the name of this object
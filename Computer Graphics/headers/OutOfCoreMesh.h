@@ -0,0 +1,1060 @@
+#ifndef _OUTOFCOREMESH_H_
+#define _OUTOFCOREMESH_H_
+
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <unordered_map>
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <algorithm>
+#include "MappedFile.h"
+#include "ExternalSort.h"
+#include "ObjReader.h"
+#include "PolygonMesh.h"
+#include "VertexLayout.h"
+using namespace std;
+
+namespace util
+{
+
+/*
+ * Settings for working on a mesh that does not fit in memory
+ */
+class OutOfCoreOptions
+{
+public:
+    OutOfCoreOptions()
+    {
+        memoryLimit = 256<<20;
+    }
+
+    /*
+     * The most memory, in bytes, that any step may take for its buffers,
+     * mapped windows and tables. The mesh itself may be any size. The
+     * PolygonMesh that extractLevelOfDetail or load fills in is the result
+     * and is not counted, but the grid cells and triangles a level of
+     * detail is made from are: extractLevelOfDetail throws runtime_error
+     * rather than go past this, and a coarser level must be asked for.
+     */
+    size_t memoryLimit;
+};
+
+/*
+ * A triangle mesh kept on disk, in files next to each other that are
+ * worked through a window at a time (see MappedWindow), so that meshes far
+ * bigger than memory can be cleaned up and simplified in bounded memory,
+ * and then brought into memory as a PolygonMesh at a level of detail that
+ * fits.
+ *
+ * The mesh is positions (path.positions, three floats a vertex) and
+ * triangles (path.triangles, three 32-bit indices each), and once they are
+ * computed, normals (path.normals, three floats a vertex). Other files next
+ * to them are made and removed as steps need them; the triangles with
+ * their corner positions filled in (path.soup) are kept between steps.
+ *
+ * Steps that would need to look up vertices at random (every corner of
+ * every triangle) instead go through the vertices a block at a time, as
+ * many as fit in memory, and through all the triangles for every block:
+ * a mesh whose vertices take n times the memory limit is read about n
+ * times. Welding sorts the vertices on disk (see ExternalSort). The level
+ * of detail is made by vertex clustering with quadric error (Lindstrom's
+ * out-of-core simplification), which reads the triangles once and only
+ * keeps the cells of a grid that the surface passes through.
+ */
+class OutOfCoreMesh
+{
+public:
+    /*
+     * The mesh in the files at a path (without their extensions). If there
+     * are no such files, the mesh is empty.
+     */
+    OutOfCoreMesh(const string& path,const OutOfCoreOptions& options=OutOfCoreOptions())
+        :path(path),options(options)
+    {
+        boundsKnown = soupKnown = false;
+        peakWorkingBytes = 0;
+        countElements();
+        soupKnown = (triangleCount>0)
+                && (MappedWindow::fileSize(file(SOUP))==triangleCount*sizeof(SoupTriangle));
+    }
+
+    /*
+     * Empty the mesh, removing all its files
+     */
+    void clear()
+    {
+        for (int f=0;f<FILE_COUNT;f++)
+            remove(file(f).c_str());
+        countElements();
+        boundsKnown = soupKnown = false;
+    }
+
+    /*
+     * Add vertices and triangles to the end of the mesh. The indices count
+     * from the first vertex of the whole mesh, not of the vertices added.
+     * Normals that were computed are dropped.
+     * \throws runtime_error if the files cannot be written
+     */
+    void addVertices(const glm::vec3 *positions,size_t count) throw(runtime_error)
+    {
+        append(POSITIONS,positions,count*sizeof(glm::vec3));
+        remove(file(NORMALS).c_str());
+        boundsKnown = false;
+        soupKnown = false;
+    }
+
+    void addTriangles(const glm::uvec3 *triangles,size_t count) throw(runtime_error)
+    {
+        append(TRIANGLES,triangles,count*sizeof(glm::uvec3));
+        remove(file(NORMALS).c_str());
+        soupKnown = false;
+    }
+
+    /*
+     * Replace the mesh with the positions and faces of an OBJ file, read a
+     * block at a time. Polygons become triangle fans. Texture coordinates,
+     * normals and parts are left out.
+     * \throws runtime_error if the file cannot be read or is malformed
+     */
+    void importObj(const string& filename) throw(runtime_error)
+    {
+        ifstream in(filename.c_str(),ios::binary);
+
+        if (!in)
+            throw runtime_error("Could not open file: "+filename);
+        clear();
+
+        Importer importer(*this,max(options.memoryLimit/2,(size_t)1));
+        try
+        {
+            ObjReader::readStream(in,importer);
+        }
+        catch (string& e)
+        {
+            throw runtime_error(e);
+        }
+        importer.flush();
+        useMemory(importer.getBufferBytes()+(1<<20));
+    }
+
+    size_t getVertexCount() const
+    {
+        return vertexCount;
+    }
+
+    size_t getTriangleCount() const
+    {
+        return triangleCount;
+    }
+
+    bool hasNormals() const
+    {
+        return (vertexCount>0) && (MappedWindow::fileSize(file(NORMALS))==vertexCount*sizeof(glm::vec3));
+    }
+
+    /*
+     * The most memory any step has taken so far, in bytes, by its own
+     * account
+     */
+    size_t getPeakWorkingBytes() const
+    {
+        return peakWorkingBytes;
+    }
+
+    /*
+     * The bounding box of the positions, computed the first time it is
+     * asked for. Positions that are not proper numbers are left out.
+     */
+    glm::vec3 getMinimumBounds() throw(runtime_error)
+    {
+        computeBounds();
+        return minBounds;
+    }
+
+    glm::vec3 getMaximumBounds() throw(runtime_error)
+    {
+        computeBounds();
+        return maxBounds;
+    }
+
+    /*
+     * Compute the normals of the vertices, as PolygonMesh::computeNormals
+     * does for a mesh of triangles. Vertices are never split, so there is
+     * no crease angle.
+     * \throws runtime_error if the files cannot be read or written
+     */
+    void computeNormals(NormalOptions::Weighting weighting=NormalOptions::UNIFORM) throw(runtime_error)
+    {
+        buildSoup();
+
+        //the sums of a block of vertices, and windows on the triangles and
+        //their corners
+        size_t blockVertices = window(options.memoryLimit/2/sizeof(glm::vec3),vertexCount);
+        size_t windowTriangles = window(options.memoryLimit/4/(sizeof(glm::uvec3)+sizeof(SoupTriangle)),triangleCount);
+        MappedWindow triangles,soup,normals;
+
+        MappedWindow::resize(file(NORMALS),(unsigned long long)vertexCount*sizeof(glm::vec3));
+        for (size_t first=0;first<vertexCount;first+=blockVertices)
+        {
+            size_t last = min(first+blockVertices,vertexCount);
+            vector<glm::vec3> sums(last-first,glm::vec3(0,0,0));
+
+            useMemory(sums.size()*sizeof(glm::vec3)
+                      +windowTriangles*(sizeof(glm::uvec3)+sizeof(SoupTriangle)));
+            for (size_t t=0;t<triangleCount;t+=windowTriangles)
+            {
+                size_t n = min(windowTriangles,triangleCount-t);
+
+                triangles.map(file(TRIANGLES),(unsigned long long)t*sizeof(glm::uvec3),n*sizeof(glm::uvec3),false);
+                soup.map(file(SOUP),(unsigned long long)t*sizeof(SoupTriangle),n*sizeof(SoupTriangle),false);
+
+                const glm::uvec3 *v = (const glm::uvec3 *)triangles.data();
+                const SoupTriangle *corners = (const SoupTriangle *)soup.data();
+                for (size_t i=0;i<n;i++)
+                {
+                    int k;
+
+                    for (k=0;(k<3) && !((v[i][k]>=first) && (v[i][k]<last));k++)
+                        ;
+                    if (k==3)
+                        continue;
+
+                    glm::vec3 normal;
+                    float weights[3];
+                    weighTriangle(corners[i].corners,weighting,normal,weights);
+                    for (k=0;k<3;k++)
+                    {
+                        if ((v[i][k]>=first) && (v[i][k]<last))
+                            sums[v[i][k]-first] += weights[k]*normal;
+                    }
+                }
+            }
+
+            normals.map(file(NORMALS),(unsigned long long)first*sizeof(glm::vec3),
+                        (last-first)*sizeof(glm::vec3),true);
+            glm::vec3 *out = (glm::vec3 *)normals.data();
+            for (size_t i=0;i<sums.size();i++)
+            {
+                float length = glm::length(sums[i]);
+                out[i] = (length>0)?sums[i]/length:glm::vec3(0,0,0);
+            }
+        }
+    }
+
+    /*
+     * Weld vertices that fall in the same cube of a grid whose cubes are as
+     * big as the tolerance (so welded vertices are at most the diagonal of
+     * a cube apart), onto the first of them, and remove the triangles that
+     * have two corners welded together. Unlike VertexWelder, vertices a
+     * little apart on either side of a face of a cube are not welded. A
+     * tolerance of 0 welds only vertices at exactly the same position. The
+     * vertices that are left are in the order of their cubes, which keeps
+     * vertices near each other in space near each other in the files.
+     * Normals that were computed are dropped.
+     * \param options the tolerance, as a fraction of the diagonal of the
+     *        bounding box. The attribute tolerance and threads are not used
+     * \return what was welded and removed
+     * \throws runtime_error if the files cannot be read or written
+     */
+    WeldStats weld(const WeldOptions& weldOptions=WeldOptions()) throw(runtime_error)
+    {
+        WeldStats stats;
+        size_t i;
+
+        stats.verticesBefore = vertexCount;
+        stats.trianglesBefore = triangleCount;
+        computeBounds();
+
+        //every vertex with its cube, sorted by cube
+        double cellSize = weldOptions.tolerance*glm::length(maxBounds-minBounds);
+        {
+            ofstream out(file(CELLS).c_str(),ios::binary | ios::trunc);
+            vector<CellRecord> records;
+            MappedWindow positions;
+            size_t windowVertices = window(options.memoryLimit/2/(sizeof(glm::vec3)+sizeof(CellRecord)),vertexCount);
+
+            useMemory(windowVertices*(sizeof(glm::vec3)+sizeof(CellRecord)));
+            for (size_t first=0;first<vertexCount;first+=windowVertices)
+            {
+                size_t n = min(windowVertices,vertexCount-first);
+
+                positions.map(file(POSITIONS),(unsigned long long)first*sizeof(glm::vec3),n*sizeof(glm::vec3),false);
+                records.resize(n);
+                for (i=0;i<n;i++)
+                {
+                    records[i].position = ((const glm::vec3 *)positions.data())[i];
+                    records[i].vertex = (unsigned int)(first+i);
+                    findCell(records[i].position,cellSize,records[i].vertex,records[i].cell);
+                }
+                out.write((const char *)&records[0],n*sizeof(CellRecord));
+            }
+            if (!out)
+                throw runtime_error("Could not write file: "+file(CELLS));
+        }
+        useMemory(min(options.memoryLimit,vertexCount*sizeof(CellRecord)));
+        ExternalSort::sort<CellRecord>(file(CELLS),file(CELLS),options.memoryLimit,CellRecord::Less());
+
+        //the first vertex of every cube is kept, and numbered in the order
+        //of the cubes. Every vertex's new number is written out with it,
+        //and sorted back into the order of the vertices
+        size_t kept = 0;
+        {
+            ifstream in(file(CELLS).c_str(),ios::binary);
+            ofstream positions(file(WELDED_POSITIONS).c_str(),ios::binary | ios::trunc);
+            ofstream remap(file(REMAP).c_str(),ios::binary | ios::trunc);
+            size_t bufferRecords = window(options.memoryLimit/4/sizeof(CellRecord),vertexCount);
+            vector<CellRecord> records(bufferRecords);
+            vector<glm::vec3> cubes;
+            vector<RemapRecord> numbers;
+            CellRecord previous;
+
+            useMemory(bufferRecords*(sizeof(CellRecord)+sizeof(glm::vec3)+sizeof(RemapRecord)));
+            while (in)
+            {
+                in.read((char *)&records[0],bufferRecords*sizeof(CellRecord));
+                size_t n = (size_t)in.gcount()/sizeof(CellRecord);
+
+                cubes.clear();
+                numbers.resize(n);
+                for (i=0;i<n;i++)
+                {
+                    const CellRecord& r = records[i];
+
+                    if ((kept==0) || !r.sameCell(previous))
+                    {
+                        cubes.push_back(r.position);
+                        kept++;
+                    }
+                    numbers[i].vertex = r.vertex;
+                    numbers[i].number = (unsigned int)(kept-1);
+                    previous = r;
+                }
+                if (!cubes.empty())
+                    positions.write((const char *)&cubes[0],cubes.size()*sizeof(glm::vec3));
+                if (n>0)
+                    remap.write((const char *)&numbers[0],n*sizeof(RemapRecord));
+            }
+            if (!positions || !remap)
+                throw runtime_error("Could not write the welded vertices of: "+path);
+        }
+        remove(file(CELLS).c_str());
+        ExternalSort::sort<RemapRecord>(file(REMAP),file(REMAP),options.memoryLimit,RemapRecord::Less());
+
+        //the triangles with their new numbers, a block of vertices at a
+        //time, into a new file so that a corner is never renumbered twice
+        size_t blockVertices = window(options.memoryLimit/2/sizeof(RemapRecord),vertexCount);
+        size_t windowTriangles = window(options.memoryLimit/4/(2*sizeof(glm::uvec3)),triangleCount);
+        MappedWindow block,in,out;
+        MappedWindow::resize(file(WELDED_TRIANGLES),(unsigned long long)triangleCount*sizeof(glm::uvec3));
+        for (size_t first=0;(first==0) || (first<vertexCount);first+=blockVertices)
+        {
+            size_t last = min(first+blockVertices,vertexCount);
+
+            if (last>first)
+                block.map(file(REMAP),(unsigned long long)first*sizeof(RemapRecord),(last-first)*sizeof(RemapRecord),false);
+            useMemory((last-first)*sizeof(RemapRecord)+windowTriangles*2*sizeof(glm::uvec3));
+
+            const RemapRecord *numbers = (const RemapRecord *)block.data();
+            for (size_t t=0;t<triangleCount;t+=windowTriangles)
+            {
+                size_t n = min(windowTriangles,triangleCount-t);
+
+                in.map(file(TRIANGLES),(unsigned long long)t*sizeof(glm::uvec3),n*sizeof(glm::uvec3),false);
+                out.map(file(WELDED_TRIANGLES),(unsigned long long)t*sizeof(glm::uvec3),n*sizeof(glm::uvec3),true);
+
+                const glm::uvec3 *from = (const glm::uvec3 *)in.data();
+                glm::uvec3 *to = (glm::uvec3 *)out.data();
+                for (i=0;i<n;i++)
+                {
+                    for (int k=0;k<3;k++)
+                    {
+                        unsigned int v = from[i][k];
+
+                        if ((v>=first) && (v<last))
+                            to[i][k] = numbers[v-first].number;
+                        else if (first==0)
+                            to[i][k] = (unsigned int)NONE;
+                    }
+                }
+            }
+            if (last==vertexCount)
+                break;
+        }
+        block.unmap();
+        in.unmap();
+        out.unmap();
+
+        //the triangles that are left
+        {
+            ofstream triangles(file(TRIANGLES).c_str(),ios::binary | ios::trunc);
+            vector<glm::uvec3> buffer;
+
+            for (size_t t=0;t<triangleCount;t+=windowTriangles)
+            {
+                size_t n = min(windowTriangles,triangleCount-t);
+
+                in.map(file(WELDED_TRIANGLES),(unsigned long long)t*sizeof(glm::uvec3),n*sizeof(glm::uvec3),false);
+                const glm::uvec3 *v = (const glm::uvec3 *)in.data();
+                buffer.clear();
+                for (i=0;i<n;i++)
+                {
+                    if ((v[i][0]!=v[i][1]) && (v[i][1]!=v[i][2]) && (v[i][2]!=v[i][0])
+                            && (v[i][0]!=(unsigned int)NONE) && (v[i][1]!=(unsigned int)NONE)
+                            && (v[i][2]!=(unsigned int)NONE))
+                        buffer.push_back(v[i]);
+                }
+                if (!buffer.empty())
+                    triangles.write((const char *)&buffer[0],buffer.size()*sizeof(glm::uvec3));
+            }
+            in.unmap();
+            if (!triangles)
+                throw runtime_error("Could not write file: "+file(TRIANGLES));
+        }
+
+        remove(file(WELDED_TRIANGLES).c_str());
+        remove(file(REMAP).c_str());
+        remove(file(POSITIONS).c_str());
+        if (rename(file(WELDED_POSITIONS).c_str(),file(POSITIONS).c_str())!=0)
+            throw runtime_error("Could not write file: "+file(POSITIONS));
+        remove(file(NORMALS).c_str());
+        remove(file(SOUP).c_str());
+        soupKnown = false;
+        countElements();
+
+        stats.verticesAfter = vertexCount;
+        stats.trianglesAfter = triangleCount;
+        stats.weldedVertices = stats.verticesBefore-stats.verticesAfter;
+        stats.degenerateTriangles = stats.trianglesBefore-stats.trianglesAfter;
+        return stats;
+    }
+
+    /*
+     * Make a level of detail of the mesh in memory, by clustering its
+     * vertices in a grid with resolution cells along the longest side of
+     * the bounding box. The vertices in a cell become one, placed where it
+     * is closest to the planes of their triangles (or at their mean, if
+     * the planes do not pin a point down inside the cell). The triangles
+     * whose corners are not all in different cells are dropped, as are
+     * repeated ones. The mesh gets normals as computeNormals gives them.
+     * \param resolution the number of cells along the longest side, at most
+     *        2^21
+     * \param result filled with the simplified mesh, of separate triangles
+     * \throws runtime_error if the cells the surface passes through do not
+     *         fit in the memory limit, or the files cannot be read
+     */
+    template <class K>
+    void extractLevelOfDetail(unsigned int resolution,PolygonMesh<K>& result) throw(runtime_error)
+    {
+        const unsigned int MAX_RESOLUTION = 1u<<21;
+
+        resolution = max(1u,min(resolution,MAX_RESOLUTION));
+        computeBounds();
+        buildSoup();
+
+        glm::vec3 size = maxBounds-minBounds;
+        float cellSize = max(size.x,max(size.y,size.z))/resolution;
+        if (!(cellSize>0))
+            cellSize = 1;
+
+        //the cells the surface passes through, and the triangles between
+        //them
+        unordered_map<unsigned long long,unsigned int> cellNumbers;
+        vector<Cell> cells;
+        vector<glm::uvec3> triangles;
+        size_t windowTriangles = window(options.memoryLimit/4/sizeof(SoupTriangle),triangleCount);
+        MappedWindow soup;
+        //a cell in the table, with its node and its share of the buckets
+        const size_t CELL_BYTES = sizeof(Cell)+sizeof(pair<unsigned long long,unsigned int>)+4*sizeof(void *);
+
+        for (size_t t=0;t<triangleCount;t+=windowTriangles)
+        {
+            size_t n = min(windowTriangles,triangleCount-t);
+
+            soup.map(file(SOUP),(unsigned long long)t*sizeof(SoupTriangle),n*sizeof(SoupTriangle),false);
+            const SoupTriangle *corners = (const SoupTriangle *)soup.data();
+            for (size_t i=0;i<n;i++)
+            {
+                const glm::vec3 *p = corners[i].corners;
+                unsigned int c[3];
+                int k;
+
+                //twice the area, along the normal
+                glm::dvec3 normal = glm::cross(glm::dvec3(p[1]-p[0]),glm::dvec3(p[2]-p[0]));
+                double length = glm::length(normal);
+                if (!((length>0) && (length<=numeric_limits<double>::max())))
+                    continue;
+                normal /= length;
+
+                for (k=0;k<3;k++)
+                {
+                    glm::uvec3 g = glm::uvec3(glm::clamp(glm::floor((p[k]-minBounds)/cellSize),
+                                                         glm::vec3(0),glm::vec3((float)(resolution-1))));
+                    unsigned long long key = (unsigned long long)g.x
+                            | ((unsigned long long)g.y<<21) | ((unsigned long long)g.z<<42);
+                    pair<unordered_map<unsigned long long,unsigned int>::iterator,bool> found =
+                            cellNumbers.insert(make_pair(key,(unsigned int)cells.size()));
+
+                    if (found.second)
+                        cells.push_back(Cell(g));
+                    c[k] = found.first->second;
+
+                    Cell& cell = cells[c[k]];
+                    cell.quadric.addPlane(normal,-glm::dot(normal,glm::dvec3(p[k])),0.5*length);
+                    cell.sum += glm::dvec3(p[k]);
+                    cell.count++;
+                }
+                if ((c[0]!=c[1]) && (c[1]!=c[2]) && (c[2]!=c[0]))
+                    triangles.push_back(glm::uvec3(c[0],c[1],c[2]));
+            }
+
+            size_t working = cells.size()*CELL_BYTES+triangles.capacity()*sizeof(glm::uvec3)
+                    +windowTriangles*sizeof(SoupTriangle);
+            useMemory(working);
+            if (working>options.memoryLimit)
+                throw runtime_error("A level of detail this fine needs more memory than the limit");
+        }
+        soup.unmap();
+        cellNumbers.clear();
+
+        //the same triangle made by several triangles of the mesh is kept
+        //once, starting from its smallest corner so that the way it faces
+        //is kept
+        for (size_t i=0;i<triangles.size();i++)
+        {
+            glm::uvec3& v = triangles[i];
+
+            while ((v[0]>v[1]) || (v[0]>v[2]))
+                v = glm::uvec3(v[1],v[2],v[0]);
+        }
+        sort(triangles.begin(),triangles.end(),TriangleLess());
+        triangles.erase(unique(triangles.begin(),triangles.end()),triangles.end());
+
+        //the cells the triangles use, as vertices
+        vector<unsigned int> numbers(cells.size(),(unsigned int)NONE);
+        vector<K> vertices;
+        K probe;
+        VertexAccess<K> position("position",probe);
+        for (size_t i=0;i<triangles.size();i++)
+        {
+            for (int k=0;k<3;k++)
+            {
+                unsigned int& number = numbers[triangles[i][k]];
+
+                if (number==(unsigned int)NONE)
+                {
+                    const Cell& cell = cells[triangles[i][k]];
+                    glm::vec3 low = minBounds+glm::vec3(cell.grid)*cellSize;
+                    glm::vec4 p(cell.place(low,low+glm::vec3(cellSize)),1.0f);
+                    K vertex;
+
+                    position.write(vertex,&p.x,4);
+                    number = (unsigned int)vertices.size();
+                    vertices.push_back(vertex);
+                }
+                triangles[i][k] = number;
+            }
+        }
+
+        vector<unsigned int> indices(3*triangles.size());
+        for (size_t i=0;i<triangles.size();i++)
+        {
+            for (int k=0;k<3;k++)
+                indices[3*i+k] = triangles[i][k];
+        }
+        result = PolygonMesh<K>();
+        result.setVertexData(std::move(vertices));
+        result.setPrimitives(std::move(indices));
+        result.setPrimitiveType(GL_TRIANGLES);
+        result.setPrimitiveSize(3);
+        result.computeNormals();
+    }
+
+    /*
+     * Bring the whole mesh into memory, with its normals if they have been
+     * computed. Only the result is allowed past the memory limit.
+     * \throws runtime_error if the files cannot be read
+     */
+    template <class K>
+    void load(PolygonMesh<K>& result) throw(runtime_error)
+    {
+        vector<K> vertices(vertexCount);
+        vector<unsigned int> indices(3*triangleCount);
+        bool normals = hasNormals();
+        K probe;
+        VertexAccess<K> position("position",probe);
+        MappedWindow window;
+        size_t i;
+
+        if (vertexCount>0)
+        {
+            window.map(file(POSITIONS),0,vertexCount*sizeof(glm::vec3),false);
+            for (i=0;i<vertexCount;i++)
+            {
+                glm::vec4 p(((const glm::vec3 *)window.data())[i],1.0f);
+                position.write(vertices[i],&p.x,4);
+            }
+        }
+        if (normals && probe.hasData("normal"))
+        {
+            VertexAccess<K> normal("normal",probe);
+
+            window.map(file(NORMALS),0,vertexCount*sizeof(glm::vec3),false);
+            for (i=0;i<vertexCount;i++)
+            {
+                glm::vec4 n(((const glm::vec3 *)window.data())[i],0.0f);
+                normal.write(vertices[i],&n.x,4);
+            }
+        }
+        if (triangleCount>0)
+        {
+            window.map(file(TRIANGLES),0,triangleCount*sizeof(glm::uvec3),false);
+            memcpy(&indices[0],window.data(),indices.size()*sizeof(unsigned int));
+        }
+        window.unmap();
+
+        result = PolygonMesh<K>();
+        result.setVertexData(std::move(vertices));
+        result.setPrimitives(std::move(indices));
+        result.setPrimitiveType(GL_TRIANGLES);
+        result.setPrimitiveSize(3);
+    }
+
+private:
+    //an OutOfCoreMesh owns its files
+    OutOfCoreMesh(const OutOfCoreMesh&);
+    OutOfCoreMesh& operator=(const OutOfCoreMesh&);
+
+    enum { NONE = -1 };
+    enum
+    {
+        POSITIONS, TRIANGLES, NORMALS, SOUP,
+        //made and removed by weld
+        CELLS, REMAP, WELDED_POSITIONS, WELDED_TRIANGLES,
+        FILE_COUNT
+    };
+
+    /*
+     * A triangle with its corners' positions, so that a step can go through
+     * triangles without looking up their vertices
+     */
+    class SoupTriangle
+    {
+    public:
+        glm::vec3 corners[3];
+    };
+
+    /*
+     * A vertex and the cube of the grid it is in, to sort vertices by cube
+     */
+    class CellRecord
+    {
+    public:
+        class Less
+        {
+        public:
+            bool operator()(const CellRecord& a,const CellRecord& b) const
+            {
+                for (int c=0;c<3;c++)
+                {
+                    if (a.cell[c]!=b.cell[c])
+                        return a.cell[c]<b.cell[c];
+                }
+                return a.vertex<b.vertex;
+            }
+        };
+
+        bool sameCell(const CellRecord& other) const
+        {
+            return (cell[0]==other.cell[0]) && (cell[1]==other.cell[1]) && (cell[2]==other.cell[2]);
+        }
+
+        long long cell[3];
+        glm::vec3 position;
+        unsigned int vertex;
+    };
+
+    /*
+     * The new number of a vertex
+     */
+    class RemapRecord
+    {
+    public:
+        class Less
+        {
+        public:
+            bool operator()(const RemapRecord& a,const RemapRecord& b) const
+            {
+                return a.vertex<b.vertex;
+            }
+        };
+
+        unsigned int vertex,number;
+    };
+
+    /*
+     * A symmetric 4x4 matrix summing the squared distances to planes
+     */
+    class Quadric
+    {
+    public:
+        Quadric()
+        {
+            memset(q,0,sizeof(q));
+        }
+
+        void addPlane(const glm::dvec3& n,double d,double w)
+        {
+            q[0] += w*n.x*n.x; q[1] += w*n.x*n.y; q[2] += w*n.x*n.z; q[3] += w*n.x*d;
+            q[4] += w*n.y*n.y; q[5] += w*n.y*n.z; q[6] += w*n.y*d;
+            q[7] += w*n.z*n.z; q[8] += w*n.z*d;
+            q[9] += w*d*d;
+        }
+
+        double q[10];
+    };
+
+    /*
+     * A cell of the grid of a level of detail, and what the triangles
+     * through it have added to it
+     */
+    class Cell
+    {
+    public:
+        Cell(const glm::uvec3& grid)
+            :grid(grid),sum(0,0,0)
+        {
+            count = 0;
+        }
+
+        /*
+         * Where the vertex of the cell goes: the point closest to the planes
+         * if it is well defined and in (or near) the cell, the mean of the
+         * corners in the cell otherwise
+         */
+        glm::vec3 place(const glm::vec3& low,const glm::vec3& high) const
+        {
+            const double *q = quadric.q;
+            glm::dvec3 mean = sum/(double)max(count,1u);
+            //the 3x3 part, and the rest of the equations it is solved with
+            double a[3][3] = {{q[0],q[1],q[2]},{q[1],q[4],q[5]},{q[2],q[5],q[7]}};
+            double b[3] = {-q[3],-q[6],-q[8]};
+            double det = a[0][0]*(a[1][1]*a[2][2]-a[1][2]*a[2][1])
+                    -a[0][1]*(a[1][0]*a[2][2]-a[1][2]*a[2][0])
+                    +a[0][2]*(a[1][0]*a[2][1]-a[1][1]*a[2][0]);
+            double trace = a[0][0]+a[1][1]+a[2][2];
+
+            //planes nearly all alike (a flat or creased patch) do not pin
+            //the point down
+            if (!(fabs(det)>1e-6*trace*trace*trace))
+                return glm::vec3(mean);
+
+            glm::dvec3 x;
+            for (int c=0;c<3;c++)
+            {
+                double m[3][3];
+                memcpy(m,a,sizeof(m));
+                for (int r=0;r<3;r++)
+                    m[r][c] = b[r];
+                x[c] = (m[0][0]*(m[1][1]*m[2][2]-m[1][2]*m[2][1])
+                        -m[0][1]*(m[1][0]*m[2][2]-m[1][2]*m[2][0])
+                        +m[0][2]*(m[1][0]*m[2][1]-m[1][1]*m[2][0]))/det;
+            }
+
+            //a point far outside the cell folds the surface over
+            glm::dvec3 margin = 0.5*glm::dvec3(high-low);
+            if (glm::any(glm::lessThan(x,glm::dvec3(low)-margin))
+                    || glm::any(glm::greaterThan(x,glm::dvec3(high)+margin)))
+                return glm::vec3(mean);
+            return glm::vec3(x);
+        }
+
+        glm::uvec3 grid;
+        Quadric quadric;
+        glm::dvec3 sum;
+        unsigned int count;
+    };
+
+    class TriangleLess
+    {
+    public:
+        bool operator()(const glm::uvec3& a,const glm::uvec3& b) const
+        {
+            for (int k=0;k<3;k++)
+            {
+                if (a[k]!=b[k])
+                    return a[k]<b[k];
+            }
+            return false;
+        }
+    };
+
+    /*
+     * Writes the vertices and triangles of an OBJ file to the mesh as they
+     * are read, a buffer at a time
+     */
+    class Importer: public ObjHandler
+    {
+    public:
+        Importer(OutOfCoreMesh& mesh,size_t bufferBytes)
+            :mesh(mesh)
+        {
+            bufferVertices = max(bufferBytes/2/sizeof(glm::vec3),(size_t)1);
+            bufferTriangles = max(bufferBytes/2/sizeof(glm::uvec3),(size_t)1);
+        }
+
+        void onVertex(const glm::vec4& position)
+        {
+            vertices.push_back(glm::vec3(position));
+            if (vertices.size()>=bufferVertices)
+                flush();
+        }
+
+        void onFace(const ObjFaceCorner *corners,unsigned int count)
+        {
+            for (unsigned int i=2;i<count;i++)
+                triangles.push_back(glm::uvec3(corners[0].position,corners[i-1].position,corners[i].position));
+            if (triangles.size()>=bufferTriangles)
+                flush();
+        }
+
+        void flush()
+        {
+            mesh.addVertices(vertices.empty()?NULL:&vertices[0],vertices.size());
+            mesh.addTriangles(triangles.empty()?NULL:&triangles[0],triangles.size());
+            vertices.clear();
+            triangles.clear();
+        }
+
+        size_t getBufferBytes() const
+        {
+            return vertices.capacity()*sizeof(glm::vec3)+triangles.capacity()*sizeof(glm::uvec3);
+        }
+
+    private:
+        OutOfCoreMesh& mesh;
+        vector<glm::vec3> vertices;
+        vector<glm::uvec3> triangles;
+        size_t bufferVertices,bufferTriangles;
+    };
+
+    string file(int which) const
+    {
+        static const char *extensions[FILE_COUNT] =
+        {
+            ".positions", ".triangles", ".normals", ".soup",
+            ".cells", ".remap", ".welded-positions", ".welded-triangles"
+        };
+
+        return path+extensions[which];
+    }
+
+    void countElements()
+    {
+        vertexCount = (size_t)(MappedWindow::fileSize(file(POSITIONS))/sizeof(glm::vec3));
+        triangleCount = (size_t)(MappedWindow::fileSize(file(TRIANGLES))/sizeof(glm::uvec3));
+    }
+
+    void append(int which,const void *data,size_t bytes) throw(runtime_error)
+    {
+        if (bytes==0)
+            return;
+
+        ofstream out(file(which).c_str(),ios::binary | ios::app);
+        out.write((const char *)data,bytes);
+        out.close();
+        if (!out)
+            throw runtime_error("Could not write file: "+file(which));
+        countElements();
+    }
+
+    /*
+     * The number of elements to work on at a time: as many as fit in the
+     * memory given, but no more than there are
+     */
+    static size_t window(size_t fit,size_t count)
+    {
+        return max(min(fit,count),(size_t)1);
+    }
+
+    void useMemory(size_t bytes)
+    {
+        peakWorkingBytes = max(peakWorkingBytes,bytes);
+    }
+
+    void computeBounds() throw(runtime_error)
+    {
+        if (boundsKnown)
+            return;
+
+        size_t windowVertices = window(options.memoryLimit/sizeof(glm::vec3),vertexCount);
+        MappedWindow positions;
+        bool any = false;
+
+        minBounds = maxBounds = glm::vec3(0,0,0);
+        useMemory(windowVertices*sizeof(glm::vec3));
+        for (size_t first=0;first<vertexCount;first+=windowVertices)
+        {
+            size_t n = min(windowVertices,vertexCount-first);
+
+            positions.map(file(POSITIONS),(unsigned long long)first*sizeof(glm::vec3),n*sizeof(glm::vec3),false);
+            const glm::vec3 *p = (const glm::vec3 *)positions.data();
+            for (size_t i=0;i<n;i++)
+            {
+                if (!(fabs(p[i].x)+fabs(p[i].y)+fabs(p[i].z)<=numeric_limits<float>::max()))
+                    continue;
+                if (!any)
+                    minBounds = maxBounds = p[i];
+                minBounds = glm::min(minBounds,p[i]);
+                maxBounds = glm::max(maxBounds,p[i]);
+                any = true;
+            }
+        }
+        boundsKnown = true;
+    }
+
+    /*
+     * Fill in the corners of every triangle, a block of vertices at a time.
+     * A corner that is not a vertex is left NaN.
+     */
+    void buildSoup() throw(runtime_error)
+    {
+        if (soupKnown)
+            return;
+
+        size_t blockVertices = window(options.memoryLimit/2/sizeof(glm::vec3),vertexCount);
+        size_t windowTriangles = window(options.memoryLimit/4/(sizeof(glm::uvec3)+sizeof(SoupTriangle)),triangleCount);
+        MappedWindow block,triangles,soup;
+        glm::vec3 none(numeric_limits<float>::quiet_NaN());
+
+        MappedWindow::resize(file(SOUP),(unsigned long long)triangleCount*sizeof(SoupTriangle));
+        for (size_t first=0;(first==0) || (first<vertexCount);first+=blockVertices)
+        {
+            size_t last = min(first+blockVertices,vertexCount);
+
+            if (last>first)
+                block.map(file(POSITIONS),(unsigned long long)first*sizeof(glm::vec3),(last-first)*sizeof(glm::vec3),false);
+            useMemory((last-first)*sizeof(glm::vec3)+windowTriangles*(sizeof(glm::uvec3)+sizeof(SoupTriangle)));
+
+            const glm::vec3 *positions = (const glm::vec3 *)block.data();
+            for (size_t t=0;t<triangleCount;t+=windowTriangles)
+            {
+                size_t n = min(windowTriangles,triangleCount-t);
+
+                triangles.map(file(TRIANGLES),(unsigned long long)t*sizeof(glm::uvec3),n*sizeof(glm::uvec3),false);
+                soup.map(file(SOUP),(unsigned long long)t*sizeof(SoupTriangle),n*sizeof(SoupTriangle),true);
+
+                const glm::uvec3 *v = (const glm::uvec3 *)triangles.data();
+                SoupTriangle *corners = (SoupTriangle *)soup.data();
+                for (size_t i=0;i<n;i++)
+                {
+                    for (int k=0;k<3;k++)
+                    {
+                        if ((v[i][k]>=first) && (v[i][k]<last))
+                            corners[i].corners[k] = positions[v[i][k]-first];
+                        else if (first==0)
+                            corners[i].corners[k] = none;
+                    }
+                }
+            }
+            if (last==vertexCount)
+                break;
+        }
+        soupKnown = true;
+    }
+
+    /*
+     * The cube of the weld grid a position is in. With no cube size, the
+     * cube is the bits of the position. A position that is not a proper
+     * number gets a cube of its own.
+     */
+    static void findCell(const glm::vec3& p,double cellSize,unsigned int vertex,long long *cell)
+    {
+        //cubes are clamped far beyond any model, so that the conversion
+        //cannot overflow
+        const double LIMIT = 4e18;
+
+        if (!(fabs(p.x)+fabs(p.y)+fabs(p.z)<=numeric_limits<float>::max()))
+        {
+            cell[0] = cell[1] = numeric_limits<long long>::max();
+            cell[2] = vertex;
+            return;
+        }
+        for (int c=0;c<3;c++)
+        {
+            if (cellSize>0)
+                cell[c] = (long long)max(-LIMIT,min(LIMIT,floor(p[c]/cellSize)));
+            else
+            {
+                unsigned int bits;
+                float x = p[c]+0.0f; //-0 and 0 are the same place
+                memcpy(&bits,&x,sizeof(bits));
+                cell[c] = bits;
+            }
+        }
+    }
+
+    /*
+     * The unit normal of a triangle (by Newell's method, as
+     * PolygonMesh::computeNormals finds it) and the weight of each of its
+     * corners, zero if it has no area
+     */
+    static void weighTriangle(const glm::vec3 *p,NormalOptions::Weighting weighting,
+                              glm::vec3& normal,float *weights)
+    {
+        int k;
+
+        normal = glm::vec3(0,0,0);
+        for (k=0;k<3;k++)
+        {
+            const glm::vec3& a = p[k];
+            const glm::vec3& b = p[(k+1)%3];
+
+            normal.x += (a[1]-b[1])*(a[2]+b[2]);
+            normal.y += (a[2]-b[2])*(a[0]+b[0]);
+            normal.z += (a[0]-b[0])*(a[1]+b[1]);
+        }
+
+        float length = glm::length(normal);
+        if (!((length>0) && (length<=numeric_limits<float>::max())))
+        {
+            normal = glm::vec3(0,0,0);
+            weights[0] = weights[1] = weights[2] = 0;
+            return;
+        }
+        normal /= length;
+
+        for (k=0;k<3;k++)
+        {
+            switch (weighting)
+            {
+            case NormalOptions::AREA:
+                weights[k] = 0.5f*length;
+                break;
+            case NormalOptions::ANGLE:
+            {
+                glm::vec3 e1 = p[(k+2)%3]-p[k],e2 = p[(k+1)%3]-p[k];
+                weights[k] = atan2(glm::length(glm::cross(e1,e2)),glm::dot(e1,e2));
+                break;
+            }
+            default:
+                weights[k] = 1;
+            }
+        }
+    }
+
+    string path;
+    OutOfCoreOptions options;
+    size_t vertexCount,triangleCount;
+    glm::vec3 minBounds,maxBounds;
+    bool boundsKnown,soupKnown;
+    size_t peakWorkingBytes;
+};
+
+}
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef _PARALLEL_H_
+#define _PARALLEL_H_
+
+#include <thread>
+#include <vector>
+#include <functional>
+using namespace std;
+
+namespace util
+{
+
+/*
+ * Returns how many threads to use for a parallel operation.
+ * \param requested the number of threads asked for. 0 means one thread per
+ *        hardware core
+ */
+inline unsigned int resolveThreadCount(unsigned int requested)
+{
+    if (requested>0)
+        return requested;
+
+    unsigned int cores = thread::hardware_concurrency();
+    return (cores>0)?cores:1;
+}
+
+/*
+ * Splits the range [begin,end) into contiguous blocks, one per thread, and
+ * calls body(blockBegin,blockEnd,blockNumber) for each block. The calling
+ * thread runs the first block itself. Returns only after all blocks are done.
+ * The body must not throw: errors should be recorded and checked afterwards.
+ *
+ * \param begin the first index of the range
+ * \param end one past the last index of the range
+ * \param threads the number of threads to use, 0 for one per core
+ * \param body the work to be done on one block
+ */
+inline void parallelFor(size_t begin,
+                        size_t end,
+                        unsigned int threads,
+                        const function<void(size_t,size_t,unsigned int)>& body)
+{
+    if (end<=begin)
+        return;
+
+    size_t count = end-begin;
+    threads = resolveThreadCount(threads);
+    if (threads>count)
+        threads = (unsigned int)count;
+
+    if (threads<=1)
+    {
+        body(begin,end,0);
+        return;
+    }
+
+    vector<thread> workers;
+    size_t blockSize = count/threads;
+    size_t extra = count%threads;
+    size_t start = begin + blockSize + (extra>0?1:0);
+
+    for (unsigned int t=1;t<threads;t++)
+    {
+        size_t size = blockSize + ((t<extra)?1:0);
+        workers.push_back(thread(body,start,start+size,t));
+        start += size;
+    }
+    body(begin,begin + blockSize + (extra>0?1:0),0);
+
+    for (unsigned int t=0;t<workers.size();t++)
+        workers[t].join();
+}
+}
+
+#endif
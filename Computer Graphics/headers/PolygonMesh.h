@@ -3,12 +3,100 @@
 
 #define GLM_SWIZZLE
 #include <glm/glm.hpp>
+#include <string>
 #include <vector>
+#include <utility>
+#include <type_traits>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <stdexcept>
+#include "VertexLayout.h"
+#include "BoundingVolumes.h"
+#include "VertexCache.h"
+#include "MeshSimplifier.h"
+#include "Stripifier.h"
+#include "VertexWelder.h"
+#include "MeshBVH.h"
+#include "CornerTable.h"
+#include "DirtyRanges.h"
+#include "Parallel.h"
 using namespace std;
 
 namespace util
 {
 
+/*
+ * A named part of a polygon mesh: a contiguous range of its indices,
+ * usually drawn with a material of its own. All the parts of a mesh share
+ * its vertices and index list, so they can live in one set of buffers.
+ */
+class SubMesh
+{
+public:
+    SubMesh()
+    {
+        firstIndex = indexCount = 0;
+    }
+
+    SubMesh(unsigned int firstIndex,unsigned int indexCount,
+            const string& name,const string& materialName)
+    {
+        this->firstIndex = firstIndex;
+        this->indexCount = indexCount;
+        this->name = name;
+        this->materialName = materialName;
+    }
+
+    //the range [firstIndex,firstIndex+indexCount) of the mesh's indices
+    unsigned int firstIndex,indexCount;
+    //the name of the object or group this part came from, may be empty
+    string name;
+    //the name of the material this part is drawn with, may be empty
+    string materialName;
+};
+
+/*
+ * Settings for computing vertex normals
+ */
+class NormalOptions
+{
+public:
+    /*
+     * How much each polygon around a vertex counts towards its normal
+     */
+    enum Weighting
+    {
+        //every polygon counts the same
+        UNIFORM,
+        //by the area of the polygon, so that slivers count for little
+        AREA,
+        //by the angle of the polygon at the vertex, so that the normal does
+        //not depend on how the surface around the vertex is divided up
+        ANGLE
+    };
+
+    NormalOptions()
+    {
+        weighting = UNIFORM;
+        creaseAngle = 180;
+        threads = 1;
+    }
+
+    Weighting weighting;
+    /*
+     * In degrees. Polygons around a vertex whose normals are further apart
+     * than this are smoothed separately, and the vertex is split into one
+     * vertex per smooth group, so that hard edges stay hard. 180 or more
+     * smooths all the polygons around a vertex together and never splits
+     * vertices.
+     */
+    float creaseAngle;
+    /*
+     * The number of threads to compute normals with, 0 for one per core
+     */
+    unsigned int threads;
+};
 
 /*
  * This class represents a polygon mesh. This class works with any
@@ -39,6 +127,14 @@ class PolygonMesh
 public:
     PolygonMesh();
     ~PolygonMesh();
+    PolygonMesh(const PolygonMesh<VertexType>& other);
+    /*
+     * Take over the vertices, indices and parts of another mesh, which is
+     * left empty, instead of copying them
+     */
+    PolygonMesh(PolygonMesh<VertexType>&& other);
+    PolygonMesh<VertexType>& operator=(const PolygonMesh<VertexType>& other);
+    PolygonMesh<VertexType>& operator=(PolygonMesh<VertexType>&& other);
     /*
      * Set the primitive type. The primitive type is represented by an integer.
      * For example in OpenGL, these would be GL_TRIANGLES, GL_TRIANGLE_FAN,
@@ -58,35 +154,327 @@ public:
 
     glm::vec4 getMinimumBounds() const;
     glm::vec4 getMaximumBounds() const;
+    /*
+     * A sphere and an oriented box around the vertices, which are tighter
+     * than the bounding box for most shapes, for culling
+     */
+    BoundingSphere getBoundingSphere() const;
+    OrientedBox getOrientedBox() const;
+    /*
+     * These return copies. To only read the data, use the ...Ref versions
+     * below instead.
+     */
     vector<VertexType> getVertexAttributes() const;
     vector<unsigned int> getPrimitives() const;
+    vector<SubMesh> getSubMeshes() const;
+    /*
+     * The vertex attributes, indices and parts of this mesh, without
+     * copying them. A reference is good until the same data of this mesh is
+     * next set.
+     */
+    const vector<VertexType>& getVertexAttributesRef() const;
+    const vector<unsigned int>& getPrimitivesRef() const;
+    const vector<SubMesh>& getSubMeshesRef() const;
     void setVertexData(const vector<VertexType>& vp);
     void setPrimitives(const vector<unsigned int>& t);
+    /*
+     * Take over the given vertex data or indices instead of copying them.
+     * The vector passed in is left empty.
+     */
+    void setVertexData(vector<VertexType>&& vp);
+    void setPrimitives(vector<unsigned int>&& t);
+    /*
+     * Take over vertex data whose bounding box is already known (for example
+     * because it was saved along with the vertices), so that it is not
+     * computed again. The bounding sphere and oriented box still are.
+     */
+    void setVertexData(vector<VertexType>&& vp,
+                       const glm::vec4& minimum,
+                       const glm::vec4& maximum);
+    /*
+     * Take over vertex data whose bounding volumes are all already known
+     */
+    void setVertexData(vector<VertexType>&& vp,
+                       const glm::vec4& minimum,
+                       const glm::vec4& maximum,
+                       const BoundingSphere& sphere,
+                       const OrientedBox& box);
+    /*
+     * Divide the indices of this mesh into parts. The ranges should not
+     * overlap. A mesh without parts is drawn as a whole.
+     */
+    void setSubMeshes(const vector<SubMesh>& s);
+    void setSubMeshes(vector<SubMesh>&& s);
+    int getSubMeshCount() const;
     /*
      * Compute vertex normals in this polygon mesh using Newell's method, if
      * position data exists
      */
     void computeNormals();
     /*
-     * Compute the bounding box of this polygon mesh, if there is position data
+     * The same, with a choice of weighting, threads, and a crease angle at
+     * which vertices are split (which changes the number of vertices and
+     * the indices). Polygons with no area are left out of the normals; a
+     * vertex used by none but those gets a zero normal.
+     */
+    void computeNormals(const NormalOptions& options);
+    /*
+     * Compute the bounding box, bounding sphere and oriented box of this
+     * polygon mesh, if there is position data
      */
     void computeBoundingBox();
+    /*
+     * How well the indices of this mesh use a post-transform vertex cache
+     * of the given size. Only a mesh of separate triangles (primitive size
+     * 3) is measured; for any other every figure is 0.
+     */
+    VertexCacheStats getVertexCacheStats(unsigned int cacheSize=VertexCache::DEFAULT_SIZE) const;
+    /*
+     * Reorder the triangles of this mesh for a post-transform vertex cache
+     * of the given size, and then the vertices in the order the triangles
+     * first use them, so that they are fetched mostly in order. Each part
+     * is reordered within its own range of indices, so the parts are
+     * unchanged. This changes the indices and the order of the vertices,
+     * but not what is drawn. Only a mesh of separate triangles (primitive
+     * size 3) is changed.
+     */
+    void optimizeVertexCache(unsigned int cacheSize=VertexCache::DEFAULT_SIZE);
+    /*
+     * Turn the triangles of this mesh into triangle strips (see Stripifier)
+     * separated by Stripifier::RESTART_INDEX, to be drawn as
+     * GL_TRIANGLE_STRIP with primitive restart. Each part becomes its own
+     * strips, with a restart index between it and the part before, so the
+     * parts can still be drawn apart or together. A strip has no fixed
+     * number of indices per primitive, so the primitive size becomes 0, and
+     * the functions above that only work on separate triangles leave the
+     * mesh alone from then on: this is the last thing to do to a mesh
+     * before it is drawn. Only a mesh of separate triangles (primitive size
+     * 3) is changed.
+     * \param window how far ahead of the triangle list a strip may run, as
+     *        for Stripifier::stripify
+     */
+    void stripify(unsigned int window=Stripifier::DEFAULT_WINDOW);
+    /*
+     * Simplify this mesh by collapsing edges (see MeshSimplifier) until
+     * about ratio of its triangles are left. Attribute seams and borders
+     * only move along themselves, and the borders between parts do not
+     * move at all. Vertices no
+     * triangle uses any more are dropped. Only a mesh of separate triangles
+     * (primitive size 3) is simplified.
+     * \return the geometric error of the result: about how far, in the
+     *         units of the positions, the surface has moved
+     */
+    float simplify(float ratio);
+    /*
+     * Make a chain of levels of detail of this mesh, each simplified from
+     * the one before, as simplify does
+     * \param ratios the share of the triangles of this mesh each level
+     *        should keep, from largest to smallest
+     * \param levels filled with one mesh for every ratio
+     * \param errors filled with the geometric error of every level,
+     *        measured against this mesh
+     */
+    void buildLevelsOfDetail(const vector<float>& ratios,
+                             vector<PolygonMesh<VertexType> >& levels,
+                             vector<float>& errors) const;
+    /*
+     * Clean up this mesh: weld vertices that are within a tolerance of each
+     * other and whose other attributes match (see VertexWelder), remove
+     * the triangles that have no area and those that repeat another in the
+     * same part, and drop the vertices no triangle uses any more. The
+     * triangles and vertices that are left keep their order, and the parts
+     * their triangles. Only a mesh of separate triangles (primitive size 3)
+     * is changed.
+     * \return what was welded and removed
+     */
+    WeldStats weld(const WeldOptions& options=WeldOptions());
+    /*
+     * Build a bounding volume hierarchy of the triangles of this mesh, to
+     * find the triangle a ray hits (see MeshBVH). The triangles of strips
+     * are numbered in the order the strips draw them. A mesh that is
+     * neither separate triangles (primitive size 3) nor strips makes an
+     * empty tree.
+     * \param threads the number of threads, 0 for one per core
+     */
+    void buildBVH(MeshBVH& bvh,unsigned int threads=1) const;
+    /*
+     * Build the adjacency of the triangles of this mesh (see CornerTable).
+     * The triangles of strips are numbered in the order the strips draw
+     * them. A mesh that is neither separate triangles (primitive size 3)
+     * nor strips makes an empty table.
+     */
+    void buildCornerTable(CornerTable& table) const;
+    /*
+     * Change vertices in place, from the vertex first on, without changing
+     * their number: vertices that would go past the last one are left out.
+     * The bounding volumes grow to take in the new positions but never
+     * shrink, so they stay good for culling while the mesh is being edited;
+     * computeBoundingBox makes them tight again. The normals are left as
+     * they are until updateNormals.
+     */
+    void setVertices(unsigned int first,const vector<VertexType>& vertices);
+    void setVertex(unsigned int index,const VertexType& vertex);
+    /*
+     * Change indices in place, from the index first on, without changing
+     * their number. A mesh of separate triangles should be given whole
+     * triangles.
+     * \throws runtime_error if an index is not a vertex of this mesh (or,
+     *         in strips, Stripifier::RESTART_INDEX). Nothing is changed then
+     */
+    void setPrimitives(unsigned int first,const vector<unsigned int>& indices) throw(runtime_error);
+    /*
+     * Compute the normals again for only the vertices that share a polygon
+     * with a vertex that was moved, or whose polygons were changed, by the
+     * edits above since the normals were last computed. The normals are the
+     * same as computeNormals would give. With a crease angle under 180
+     * (which splits vertices) or many vertices changed, this is
+     * computeNormals.
+     */
+    void updateNormals(const NormalOptions& options=NormalOptions());
+    /*
+     * The ranges of vertices and indices that have changed since
+     * clearDirtyRanges was last called, to copy only them again to the
+     * buffers the mesh is drawn from. Anything that replaces or reorders all
+     * the vertices or indices makes them all dirty.
+     */
+    const DirtyRanges& getDirtyVertices() const;
+    const DirtyRanges& getDirtyPrimitives() const;
+    void clearDirtyRanges();
 
 
 
 protected:
     vector<VertexType> vertexData;
     vector<unsigned int> primitives;
+    vector<SubMesh> subMeshes;
     int primitiveType;
     int primitiveSize;
     glm::vec4 minBounds,maxBounds; //bounding box
+    BoundingSphere boundingSphere;
+    OrientedBox orientedBox;
+    DirtyRanges dirtyVertices,dirtyPrimitives;
+    //the vertices whose polygons have changed since the normals were last
+    //computed, maybe more than once
+    vector<unsigned int> changedVertices;
+
+private:
+    void computeBoundingVolumes(bool box);
+    /*
+     * Mark all the vertices or indices as changed, when they have all been
+     * replaced or reordered
+     */
+    void touchAllVertices();
+    void touchAllPrimitives();
+    /*
+     * The unit normal of the polygon made of the indices from
+     * first*primitiveSize, and the weight of each of its corners (zero if
+     * it has no area)
+     */
+    void weighPolygon(const float *positions,size_t stride,size_t first,
+                      NormalOptions::Weighting weighting,
+                      glm::vec3& normal,float *weights) const;
+    void splitAtCreases(const vector<glm::vec3>& polygonNormals,
+                        const vector<float>& cornerWeights,
+                        float creaseAngle,unsigned int threads);
+    /*
+     * The part of every triangle: the number of the part whose range it is
+     * in, or the number of parts if it is in none. Empty if there are no
+     * parts.
+     */
+    void findTriangleParts(vector<unsigned int>& parts) const;
+    /*
+     * Where the positions of the vertices can be read, as glm::vec4s
+     * \param copy the positions are copied here if they cannot be read in
+     *        place
+     * \param stride set to the distance between two positions, in bytes
+     * \return the first position, or NULL if there are none
+     */
+    const float *getPositions(vector<glm::vec4>& copy,size_t& stride);
+    const float *getPositions(vector<glm::vec4>& copy,size_t& stride,true_type);
+    const float *getPositions(vector<glm::vec4>& copy,size_t& stride,false_type);
 
 };
 
 template<class VertexType>
 PolygonMesh<VertexType>::PolygonMesh()
 {
+    primitiveType = primitiveSize = 0;
+}
 
+template<class VertexType>
+PolygonMesh<VertexType>::PolygonMesh(const PolygonMesh<VertexType>& other)
+    :vertexData(other.vertexData),
+      primitives(other.primitives),
+      subMeshes(other.subMeshes),
+      primitiveType(other.primitiveType),
+      primitiveSize(other.primitiveSize),
+      minBounds(other.minBounds),
+      maxBounds(other.maxBounds),
+      boundingSphere(other.boundingSphere),
+      orientedBox(other.orientedBox),
+      dirtyVertices(other.dirtyVertices),
+      dirtyPrimitives(other.dirtyPrimitives),
+      changedVertices(other.changedVertices)
+{
+}
+
+template<class VertexType>
+PolygonMesh<VertexType>::PolygonMesh(PolygonMesh<VertexType>&& other)
+    :vertexData(std::move(other.vertexData)),
+      primitives(std::move(other.primitives)),
+      subMeshes(std::move(other.subMeshes)),
+      primitiveType(other.primitiveType),
+      primitiveSize(other.primitiveSize),
+      minBounds(other.minBounds),
+      maxBounds(other.maxBounds),
+      boundingSphere(other.boundingSphere),
+      orientedBox(other.orientedBox),
+      dirtyVertices(std::move(other.dirtyVertices)),
+      dirtyPrimitives(std::move(other.dirtyPrimitives)),
+      changedVertices(std::move(other.changedVertices))
+{
+}
+
+template<class VertexType>
+PolygonMesh<VertexType>& PolygonMesh<VertexType>::operator=(const PolygonMesh<VertexType>& other)
+{
+    if (this!=&other)
+    {
+        vertexData = other.vertexData;
+        primitives = other.primitives;
+        subMeshes = other.subMeshes;
+        primitiveType = other.primitiveType;
+        primitiveSize = other.primitiveSize;
+        minBounds = other.minBounds;
+        maxBounds = other.maxBounds;
+        boundingSphere = other.boundingSphere;
+        orientedBox = other.orientedBox;
+        dirtyVertices = other.dirtyVertices;
+        dirtyPrimitives = other.dirtyPrimitives;
+        changedVertices = other.changedVertices;
+    }
+    return *this;
+}
+
+template<class VertexType>
+PolygonMesh<VertexType>& PolygonMesh<VertexType>::operator=(PolygonMesh<VertexType>&& other)
+{
+    if (this!=&other)
+    {
+        vertexData = std::move(other.vertexData);
+        primitives = std::move(other.primitives);
+        subMeshes = std::move(other.subMeshes);
+        primitiveType = other.primitiveType;
+        primitiveSize = other.primitiveSize;
+        minBounds = other.minBounds;
+        maxBounds = other.maxBounds;
+        boundingSphere = other.boundingSphere;
+        orientedBox = other.orientedBox;
+        dirtyVertices = std::move(other.dirtyVertices);
+        dirtyPrimitives = std::move(other.dirtyPrimitives);
+        changedVertices = std::move(other.changedVertices);
+    }
+    return *this;
 }
 
 template<class VertexType>
@@ -143,187 +531,1073 @@ glm::vec4 PolygonMesh<VertexType>::getMaximumBounds() const
 
 
 
+template<class VertexType>
+BoundingSphere PolygonMesh<VertexType>::getBoundingSphere() const
+{
+    return boundingSphere;
+}
+
+template<class VertexType>
+OrientedBox PolygonMesh<VertexType>::getOrientedBox() const
+{
+    return orientedBox;
+}
+
 template<class VertexType>
 vector<VertexType> PolygonMesh<VertexType>::getVertexAttributes() const
 {
     return vector<VertexType>(vertexData);
 }
 
+template<class VertexType>
+const vector<VertexType>& PolygonMesh<VertexType>::getVertexAttributesRef() const
+{
+    return vertexData;
+}
+
 template<class VertexType>
 vector<unsigned int> PolygonMesh<VertexType>::getPrimitives() const
 {
     return vector<unsigned int>(primitives);
 }
 
+template<class VertexType>
+const vector<unsigned int>& PolygonMesh<VertexType>::getPrimitivesRef() const
+{
+    return primitives;
+}
+
 template <class VertexType>
 void PolygonMesh<VertexType>::setVertexData(const vector<VertexType>& vp)
 {
     vertexData = vector<VertexType>(vp);
     computeBoundingBox();
+    touchAllVertices();
 }
 
 template<class VertexType>
 void PolygonMesh<VertexType>::setPrimitives(const vector<unsigned int>& t)
 {
     primitives = vector<unsigned int>(t);
+    touchAllPrimitives();
+}
+
+template <class VertexType>
+void PolygonMesh<VertexType>::setVertexData(vector<VertexType>&& vp)
+{
+    vertexData.clear();
+    vertexData.swap(vp);
+    computeBoundingBox();
+    touchAllVertices();
 }
 
+template <class VertexType>
+void PolygonMesh<VertexType>::setVertexData(vector<VertexType>&& vp,
+                                            const glm::vec4& minimum,
+                                            const glm::vec4& maximum)
+{
+    vertexData.clear();
+    vertexData.swap(vp);
+    minBounds = minimum;
+    maxBounds = maximum;
+    computeBoundingVolumes(false);
+    touchAllVertices();
+}
+
+template <class VertexType>
+void PolygonMesh<VertexType>::setVertexData(vector<VertexType>&& vp,
+                                            const glm::vec4& minimum,
+                                            const glm::vec4& maximum,
+                                            const BoundingSphere& sphere,
+                                            const OrientedBox& box)
+{
+    vertexData.clear();
+    vertexData.swap(vp);
+    minBounds = minimum;
+    maxBounds = maximum;
+    boundingSphere = sphere;
+    orientedBox = box;
+    touchAllVertices();
+}
+
+template<class VertexType>
+void PolygonMesh<VertexType>::setPrimitives(vector<unsigned int>&& t)
+{
+    primitives.clear();
+    primitives.swap(t);
+    touchAllPrimitives();
+}
+
+template<class VertexType>
+void PolygonMesh<VertexType>::setSubMeshes(const vector<SubMesh>& s)
+{
+    subMeshes = vector<SubMesh>(s);
+}
+
+template<class VertexType>
+void PolygonMesh<VertexType>::setSubMeshes(vector<SubMesh>&& s)
+{
+    subMeshes.clear();
+    subMeshes.swap(s);
+}
+
+template<class VertexType>
+vector<SubMesh> PolygonMesh<VertexType>::getSubMeshes() const
+{
+    return vector<SubMesh>(subMeshes);
+}
+
+template<class VertexType>
+const vector<SubMesh>& PolygonMesh<VertexType>::getSubMeshesRef() const
+{
+    return subMeshes;
+}
+
+template<class VertexType>
+int PolygonMesh<VertexType>::getSubMeshCount() const
+{
+    return subMeshes.size();
+}
 
 template<class VertexType>
 void PolygonMesh<VertexType>::computeBoundingBox()
 {
-    unsigned int i,j;
+    computeBoundingVolumes(true);
+}
 
-    if (vertexData.size()<=0)
+template<class VertexType>
+void PolygonMesh<VertexType>::computeBoundingVolumes(bool box)
+{
+    vector<glm::vec4> copy;
+    size_t stride;
+    const float *positions = getPositions(copy,stride);
+
+    if (positions==NULL)
         return;
 
-    if (!vertexData[0].hasData("position"))
+    if (box)
     {
-        return;
+        glm::vec3 minimum,maximum;
+
+        BoundingVolumes::box(positions,vertexData.size(),stride,minimum,maximum);
+        //the w of the bounds is that of the first vertex
+        minBounds = glm::vec4(minimum,positions[3]);
+        maxBounds = glm::vec4(maximum,positions[3]);
     }
+    boundingSphere = BoundingVolumes::sphere(positions,vertexData.size(),stride);
+    orientedBox = BoundingVolumes::orientedBox(positions,vertexData.size(),stride);
+}
+
+template<class VertexType>
+VertexCacheStats PolygonMesh<VertexType>::getVertexCacheStats(unsigned int cacheSize) const
+{
+    if ((primitiveSize!=3) || (primitives.size()==0))
+        return VertexCacheStats();
+
+    return VertexCache::measure(&primitives[0],primitives.size(),vertexData.size(),cacheSize);
+}
+
+template<class VertexType>
+void PolygonMesh<VertexType>::optimizeVertexCache(unsigned int cacheSize)
+{
+    if ((primitiveSize!=3) || (primitives.size()==0))
+        return;
 
-    vector<glm::vec4> positions;
+    //a mesh without parts is one range of indices
+    vector<SubMesh> ranges = subMeshes;
+    if (ranges.size()==0)
+        ranges.push_back(SubMesh(0,(unsigned int)primitives.size(),"",""));
 
-    for (i=0;i<vertexData.size();i++)
+    for (unsigned int i=0;i<ranges.size();i++)
     {
-        vector<float> data = vertexData[i].getData("position");
-        glm::vec4 pos = glm::vec4(0,0,0,1);
-        switch (data.size()) {
-        case 4: pos.w = data[3];
-        case 3: pos.z = data[2];
-        case 2: pos.y = data[1];
-        case 1: pos.x = data[0];
-        }
-        positions.push_back(pos);
+        size_t first = min((size_t)ranges[i].firstIndex,primitives.size());
+        size_t count = min((size_t)ranges[i].indexCount,primitives.size()-first);
+
+        VertexCache::optimizeTriangles(&primitives[first],count,vertexData.size(),cacheSize);
     }
 
-    minBounds = glm::vec4(positions[0]);
-    maxBounds = glm::vec4(positions[0]);
+    vector<unsigned int> remap;
+    VertexCache::optimizeFetch(&primitives[0],primitives.size(),vertexData.size(),remap);
+
+    vector<VertexType> reordered(vertexData.size());
+    for (size_t i=0;i<vertexData.size();i++)
+        reordered[remap[i]] = std::move(vertexData[i]);
+    vertexData.swap(reordered);
+    touchAllVertices();
+    touchAllPrimitives();
+}
+
+template<class VertexType>
+void PolygonMesh<VertexType>::stripify(unsigned int window)
+{
+    if ((primitiveSize!=3) || (primitives.size()==0))
+        return;
+
+    //a mesh without parts is one range of indices
+    vector<SubMesh> ranges = subMeshes;
+    if (ranges.size()==0)
+        ranges.push_back(SubMesh(0,(unsigned int)primitives.size(),"",""));
 
-    for (j=0;j<positions.size();j++)
+    vector<unsigned int> strips;
+    strips.reserve(primitives.size()/2);
+    for (unsigned int i=0;i<ranges.size();i++)
     {
-        glm::vec4 p = positions[j];
+        size_t first = min((size_t)ranges[i].firstIndex,primitives.size());
+        size_t count = min((size_t)ranges[i].indexCount,primitives.size()-first);
+        size_t before = strips.size();
+
+        Stripifier::stripify(&primitives[first],count,vertexData.size(),strips,window);
+        //the restart index that ends the part before is not in this part
+        if ((before>0) && (strips.size()>before))
+            before++;
+        ranges[i].firstIndex = (unsigned int)before;
+        ranges[i].indexCount = (unsigned int)(strips.size()-before);
+    }
+
+    primitives.swap(strips);
+    touchAllPrimitives();
+    if (subMeshes.size()>0)
+        subMeshes.swap(ranges);
+    primitiveType = GL_TRIANGLE_STRIP;
+    primitiveSize = 0;
+}
 
-        if (p.x<minBounds.x)
+template<class VertexType>
+float PolygonMesh<VertexType>::simplify(float ratio)
+{
+    vector<PolygonMesh<VertexType> > levels;
+    vector<float> errors;
+
+    buildLevelsOfDetail(vector<float>(1,ratio),levels,errors);
+    if (levels.size()==0)
+        return 0;
+    *this = std::move(levels[0]);
+    return errors[0];
+}
+
+template<class VertexType>
+void PolygonMesh<VertexType>::buildLevelsOfDetail(const vector<float>& ratios,
+                                                  vector<PolygonMesh<VertexType> >& levels,
+                                                  vector<float>& errors) const
+{
+    vector<glm::vec4> copy;
+    size_t stride;
+    //getPositions only reads the vertices, but IVertexData::hasData is not const
+    const float *positions = const_cast<PolygonMesh<VertexType> *>(this)->getPositions(copy,stride);
+    size_t triangleCount = primitives.size()/3;
+    size_t i;
+
+    levels.clear();
+    errors.clear();
+    if ((positions==NULL) || (primitiveSize!=3) || (triangleCount==0))
+        return;
+
+    //the part of every triangle, so that vertices between parts stay put
+    vector<unsigned int> parts;
+    findTriangleParts(parts);
+
+    MeshSimplifier simplifier(positions,stride,vertexData.size(),
+                              &primitives[0],primitives.size(),
+                              parts.empty()?NULL:&parts[0]);
+
+    for (unsigned int l=0;l<ratios.size();l++)
+    {
+        size_t target = (size_t)(max(ratios[l],0.0f)*triangleCount);
+        simplifier.simplify(target);
+
+        //the triangles that are left keep their order, so each part is
+        //still a range: it starts where as many triangles are left before it
+        vector<size_t> keptBefore(triangleCount+1,0);
+        vector<unsigned int> indices;
+        indices.reserve(simplifier.getTriangleCount()*3);
+        for (i=0;i<triangleCount;i++)
         {
-            minBounds.x = p.x;
+            keptBefore[i+1] = keptBefore[i];
+            if (!simplifier.isRemoved(i))
+            {
+                const unsigned int *t = simplifier.getTriangle(i);
+                indices.insert(indices.end(),t,t+3);
+                keptBefore[i+1]++;
+            }
         }
 
-        if (p.x>maxBounds.x)
+        vector<SubMesh> levelParts = subMeshes;
+        for (i=0;i<levelParts.size();i++)
         {
-            maxBounds.x = p.x;
+            size_t first = min((size_t)levelParts[i].firstIndex/3,triangleCount);
+            size_t last = min((size_t)(levelParts[i].firstIndex+levelParts[i].indexCount)/3,triangleCount);
+
+            levelParts[i].firstIndex = (unsigned int)(3*keptBefore[first]);
+            levelParts[i].indexCount = (unsigned int)(3*(keptBefore[last]-keptBefore[first]));
         }
 
-        if (p.y<minBounds.y)
+        //keep only the vertices that are still used, in the order they are
+        //first used
+        vector<unsigned int> remap;
+        size_t used = 0;
+        if (indices.size()>0)
+            VertexCache::optimizeFetch(&indices[0],indices.size(),vertexData.size(),remap);
+        for (i=0;i<indices.size();i++)
+            used = max(used,(size_t)indices[i]+1);
+        vector<VertexType> levelVertices(used);
+        for (i=0;(i<remap.size()) && (used>0);i++)
         {
-            minBounds.y = p.y;
+            if (remap[i]<used)
+                levelVertices[remap[i]] = vertexData[i];
         }
 
-        if (p.y>maxBounds.y)
+        PolygonMesh<VertexType> level;
+        level.setVertexData(std::move(levelVertices));
+        level.setPrimitives(std::move(indices));
+        level.setSubMeshes(std::move(levelParts));
+        level.setPrimitiveType(primitiveType);
+        level.setPrimitiveSize(primitiveSize);
+        levels.push_back(std::move(level));
+        errors.push_back(simplifier.getError());
+    }
+}
+
+template<class VertexType>
+WeldStats PolygonMesh<VertexType>::weld(const WeldOptions& options)
+{
+    WeldStats stats;
+    size_t vertexCount = vertexData.size();
+    size_t triangleCount = primitives.size()/3;
+    vector<glm::vec4> copy;
+    size_t stride;
+    size_t i;
+
+    stats.verticesBefore = stats.verticesAfter = vertexCount;
+    stats.trianglesBefore = stats.trianglesAfter = triangleCount;
+    const float *positions = getPositions(copy,stride);
+    if ((positions==NULL) || (primitiveSize!=3))
+        return stats;
+    for (i=0;i<primitives.size();i++)
+    {
+        if (primitives[i]>=vertexCount)
+            return stats;
+    }
+    unsigned int threads = resolveThreadCount(options.threads);
+
+    //the other attributes of every vertex, one after the other, to compare
+    VertexType probe = vertexData[0];
+    vector<string> names = probe.getAllAttributes();
+    vector<VertexAccess<VertexType> > others;
+    vector<size_t> offsets;
+    unsigned int attributeSize = 0;
+    for (i=0;i<names.size();i++)
+    {
+        if (names[i]!="position")
+        {
+            others.push_back(VertexAccess<VertexType>(names[i],probe));
+            offsets.push_back(attributeSize);
+            attributeSize += others.back().getSize();
+        }
+    }
+    vector<float> attributes(vertexCount*attributeSize);
+    parallelFor(0,vertexCount,threads,
+                [&](size_t first,size_t last,unsigned int)
+    {
+        for (size_t v=first;v<last;v++)
         {
-            maxBounds.y = p.y;
+            for (unsigned int a=0;a<others.size();a++)
+                others[a].read(vertexData[v],&attributes[v*attributeSize+offsets[a]]);
         }
+    });
+
+    float tolerance = options.tolerance*glm::length(glm::vec3(maxBounds-minBounds));
+    vector<unsigned int> representative;
+    stats.weldedVertices = VertexWelder::weld(positions,stride,
+                                              attributes.empty()?NULL:&attributes[0],attributeSize,
+                                              vertexCount,tolerance,options.attributeTolerance,
+                                              threads,representative);
+
+    //a triangle has no area if two of its corners are welded together, or
+    //its third corner is within the tolerance of the line through the
+    //other two
+    vector<unsigned int> triangles(primitives.size());
+    vector<unsigned char> kept(triangleCount);
+    vector<size_t> degenerate(threads,0);
+    parallelFor(0,triangleCount,threads,
+                [&](size_t first,size_t last,unsigned int block)
+    {
+        for (size_t t=first;t<last;t++)
+        {
+            unsigned int *v = &triangles[3*t];
+            glm::vec3 p[3];
+
+            for (int k=0;k<3;k++)
+            {
+                v[k] = representative[primitives[3*t+k]];
+                const float *q = (const float *)((const char *)positions + v[k]*stride);
+                p[k] = glm::vec3(q[0],q[1],q[2]);
+            }
+
+            float longest = max(glm::length(p[1]-p[0]),
+                                max(glm::length(p[2]-p[1]),glm::length(p[0]-p[2])));
+            float area = glm::length(glm::cross(p[1]-p[0],p[2]-p[0]));
+            kept[t] = (v[0]!=v[1]) && (v[1]!=v[2]) && (v[2]!=v[0]) && !(area<=tolerance*longest);
+            if (!kept[t])
+                degenerate[block]++;
+        }
+    });
+    for (i=0;i<degenerate.size();i++)
+        stats.degenerateTriangles += degenerate[i];
+
+    //a triangle repeats another if it has the same corners going round it
+    //the same way, starting anywhere. One facing the other way is kept,
+    //as it is the back of a two-sided surface
+    vector<unsigned int> parts;
+    findTriangleParts(parts);
+    vector<pair<pair<unsigned int,unsigned long long>,pair<unsigned int,unsigned int> > > order;
+    order.reserve(triangleCount);
+    for (i=0;i<triangleCount;i++)
+    {
+        const unsigned int *v = &triangles[3*i];
+        int k = 0;
+
+        if (!kept[i])
+            continue;
+        if (v[1]<v[k])
+            k = 1;
+        if (v[2]<v[k])
+            k = 2;
+        order.push_back(make_pair(make_pair(parts.empty()?0:parts[i],
+                                            ((unsigned long long)v[k]<<32) | v[(k+1)%3]),
+                                  make_pair(v[(k+2)%3],(unsigned int)i)));
+    }
+    sort(order.begin(),order.end());
+    for (i=1;i<order.size();i++)
+    {
+        if ((order[i].first==order[i-1].first)
+                && (order[i].second.first==order[i-1].second.first))
+        {
+            kept[order[i].second.second] = false;
+            stats.duplicateTriangles++;
+        }
+    }
 
-        if (p.z<minBounds.z)
+    //the triangles that are left keep their order, so each part is still
+    //a range: it starts where as many triangles are left before it
+    vector<size_t> keptBefore(triangleCount+1,0);
+    vector<bool> used(vertexCount,false);
+    size_t next = 0;
+    for (i=0;i<triangleCount;i++)
+    {
+        keptBefore[i+1] = keptBefore[i];
+        if (kept[i])
         {
-            minBounds.z = p.z;
+            for (int k=0;k<3;k++)
+            {
+                triangles[next++] = triangles[3*i+k];
+                used[triangles[3*i+k]] = true;
+            }
+            keptBefore[i+1]++;
         }
+    }
+    triangles.resize(next);
+    for (i=0;i<subMeshes.size();i++)
+    {
+        size_t first = min((size_t)subMeshes[i].firstIndex/3,triangleCount);
+        size_t last = min((size_t)(subMeshes[i].firstIndex+subMeshes[i].indexCount)/3,triangleCount);
+
+        subMeshes[i].firstIndex = (unsigned int)(3*keptBefore[first]);
+        subMeshes[i].indexCount = (unsigned int)(3*(keptBefore[last]-keptBefore[first]));
+    }
 
-        if (p.z>maxBounds.z)
+    //the vertices that are left keep their order
+    vector<unsigned int> remap(vertexCount);
+    vector<VertexType> compacted;
+    compacted.reserve(vertexCount-stats.weldedVertices);
+    for (i=0;i<vertexCount;i++)
+    {
+        if (used[i])
         {
-            maxBounds.z = p.z;
+            remap[i] = (unsigned int)compacted.size();
+            compacted.push_back(std::move(vertexData[i]));
         }
+        else if (representative[i]==i)
+            stats.unusedVertices++;
     }
+    parallelFor(0,triangles.size(),threads,
+                [&](size_t first,size_t last,unsigned int)
+    {
+        for (size_t c=first;c<last;c++)
+            triangles[c] = remap[triangles[c]];
+    });
+
+    stats.verticesAfter = compacted.size();
+    stats.trianglesAfter = triangles.size()/3;
+    setVertexData(std::move(compacted));
+    setPrimitives(std::move(triangles));
+    return stats;
 }
 
-/*
- * Compute vertex normals in this polygon mesh using Newell's method, if
- * position data exists
- */
+template<class VertexType>
+void PolygonMesh<VertexType>::findTriangleParts(vector<unsigned int>& parts) const
+{
+    size_t triangleCount = primitives.size()/3;
+
+    parts.clear();
+    if (subMeshes.size()==0)
+        return;
+
+    parts.assign(triangleCount,(unsigned int)subMeshes.size());
+    for (size_t i=0;i<subMeshes.size();i++)
+    {
+        size_t first = min((size_t)subMeshes[i].firstIndex/3,triangleCount);
+        size_t last = min((size_t)(subMeshes[i].firstIndex+subMeshes[i].indexCount)/3,triangleCount);
+
+        fill(parts.begin()+first,parts.begin()+last,(unsigned int)i);
+    }
+}
 
 template<class VertexType>
-void PolygonMesh<VertexType>::computeNormals()
+void PolygonMesh<VertexType>::buildBVH(MeshBVH& bvh,unsigned int threads) const
 {
-    int i,j,k;
+    vector<glm::vec4> copy;
+    size_t stride;
+    //getPositions only reads the vertices, but IVertexData::hasData is not const
+    const float *positions = const_cast<PolygonMesh<VertexType> *>(this)->getPositions(copy,stride);
+    vector<unsigned int> triangles;
+    const vector<unsigned int> *indices = &primitives;
+
+    if ((primitiveSize==0) && (primitiveType==GL_TRIANGLE_STRIP))
+    {
+        Stripifier::unstripify(primitives.empty()?NULL:&primitives[0],primitives.size(),triangles);
+        indices = &triangles;
+    }
+    else if (primitiveSize!=3)
+        positions = NULL;
 
-    if (vertexData.size()<=0)
+    if ((positions==NULL) || indices->empty())
+    {
+        bvh.build(NULL,0,0,NULL,0);
         return;
+    }
+    bvh.build(positions,stride,vertexData.size(),&(*indices)[0],indices->size(),threads);
+}
 
-    if (!vertexData[0].hasData("position"))
+template<class VertexType>
+void PolygonMesh<VertexType>::buildCornerTable(CornerTable& table) const
+{
+    vector<unsigned int> triangles;
+    const vector<unsigned int> *indices = &primitives;
+
+    if ((primitiveSize==0) && (primitiveType==GL_TRIANGLE_STRIP))
     {
+        Stripifier::unstripify(primitives.empty()?NULL:&primitives[0],primitives.size(),triangles);
+        indices = &triangles;
+    }
+    else if (primitiveSize!=3)
+        indices = &triangles;
+
+    table.build(indices->empty()?NULL:&(*indices)[0],indices->size(),vertexData.size());
+}
+
+template<class VertexType>
+void PolygonMesh<VertexType>::setVertices(unsigned int first,const vector<VertexType>& vertices)
+{
+    if (first>=vertexData.size())
         return;
+
+    size_t count = min(vertices.size(),vertexData.size()-first);
+    size_t i;
+
+    for (i=0;i<count;i++)
+    {
+        vertexData[first+i] = vertices[i];
+        //once every vertex might have changed, all the normals are
+        //computed again anyway
+        if (changedVertices.size()<vertexData.size())
+            changedVertices.push_back((unsigned int)(first+i));
     }
+    dirtyVertices.add(first,count);
 
-    if (!vertexData[0].hasData("normal"))
+    if (!vertexData[0].hasData("position"))
         return;
 
-    vector<glm::vec4> positions;
+    VertexAccess<VertexType> position("position",vertexData[0]);
+    if (position.getSize()>4)
+        return;
 
-    for (i=0;i<positions.size();i++) {
-        vector<float> data = vertexData[i].getData("position");
-        glm::vec4 pos;
-        switch (data.size()) {
-        case 4: pos.w = data[3];
-        case 3: pos.z = data[2];
-        case 2: pos.y = data[1];
-        case 1: pos.x = data[0];
+    for (i=0;i<count;i++)
+    {
+        glm::vec4 p(0,0,0,1);
+
+        position.read(vertexData[first+i],&p.x);
+        //a position that is not a proper number is left out, as it is from
+        //the bounding volumes of the whole mesh
+        if (!(fabs(p.x)+fabs(p.y)+fabs(p.z)<=numeric_limits<float>::max()))
+            continue;
+
+        glm::vec3 q(p);
+        minBounds = glm::vec4(glm::min(glm::vec3(minBounds),q),minBounds.w);
+        maxBounds = glm::vec4(glm::max(glm::vec3(maxBounds),q),maxBounds.w);
+        BoundingVolumes::grow(boundingSphere,q);
+        BoundingVolumes::grow(orientedBox,q);
+    }
+}
+
+template<class VertexType>
+void PolygonMesh<VertexType>::setVertex(unsigned int index,const VertexType& vertex)
+{
+    setVertices(index,vector<VertexType>(1,vertex));
+}
+
+template<class VertexType>
+void PolygonMesh<VertexType>::setPrimitives(unsigned int first,const vector<unsigned int>& indices) throw(runtime_error)
+{
+    if (first>=primitives.size())
+        return;
+
+    size_t count = min(indices.size(),primitives.size()-first);
+    bool strips = (primitiveSize==0) && (primitiveType==GL_TRIANGLE_STRIP);
+
+    for (size_t i=0;i<count;i++)
+    {
+        if ((indices[i]>=vertexData.size())
+                && !(strips && (indices[i]==(unsigned int)Stripifier::RESTART_INDEX)))
+            throw runtime_error("Index is not a vertex of the mesh");
+    }
+
+    //the vertices a changed polygon had, and those it has now, both get
+    //new normals
+    for (size_t i=0;i<count;i++)
+    {
+        if (changedVertices.size()+1<vertexData.size())
+        {
+            changedVertices.push_back(primitives[first+i]);
+            changedVertices.push_back(indices[i]);
         }
-        positions.push_back(pos);
+        primitives[first+i] = indices[i];
     }
-    vector<glm::vec4> normals;
+    dirtyPrimitives.add(first,count);
+}
 
-    for (i=0;i<positions.size();i++)
+template<class VertexType>
+void PolygonMesh<VertexType>::updateNormals(const NormalOptions& options)
+{
+    if (changedVertices.empty())
+        return;
+
+    //past a quarter of the vertices, weighing every polygon costs little
+    //more than finding the ones that changed
+    if ((options.creaseAngle<180) || (changedVertices.size()*4>=vertexData.size()))
     {
-        normals.push_back(glm::vec4(0.0f,0.0f,0.0f,0.0f));
+        computeNormals(options);
+        changedVertices.clear();
+        return;
     }
 
-    for (i=0;i<primitives.size();i+=primitiveSize)
+    vector<glm::vec4> copy;
+    size_t stride;
+    const float *positions = getPositions(copy,stride);
+
+    if ((positions==NULL) || (primitiveSize<=0) || !vertexData[0].hasData("normal"))
     {
-        glm::vec4 norm = glm::vec4(0.0f,0.0f,0.0f,0.0f);
+        changedVertices.clear();
+        return;
+    }
 
+    size_t vertexCount = vertexData.size();
+    size_t polygonCount = primitives.size()/primitiveSize;
+    size_t i,f;
+    int k;
 
+    vector<unsigned char> changed(vertexCount,0);
+    for (i=0;i<changedVertices.size();i++)
+    {
+        if (changedVertices[i]<vertexCount)
+            changed[changedVertices[i]] = 1;
+    }
 
-        //compute the normal of this triangle
-        vector<unsigned int>v;
+    //the vertices whose normals change: the changed ones, and every vertex
+    //of a polygon with a changed vertex. slots[v] is 1 more than where the
+    //normal of v is summed, 0 if it is not
+    vector<unsigned int> affected;
+    vector<unsigned int> slots(vertexCount,0);
+    for (i=0;i<vertexCount;i++)
+    {
+        if (changed[i])
+        {
+            affected.push_back((unsigned int)i);
+            slots[i] = (unsigned int)affected.size();
+        }
+    }
+    for (f=0;f<polygonCount;f++)
+    {
+        const unsigned int *v = &primitives[f*primitiveSize];
 
+        for (k=0;(k<primitiveSize) && !changed[v[k]];k++)
+            ;
+        if (k==primitiveSize)
+            continue;
         for (k=0;k<primitiveSize;k++)
         {
-            v.push_back(primitives[i+k]);
+            if (slots[v[k]]==0)
+            {
+                affected.push_back(v[k]);
+                slots[v[k]] = (unsigned int)affected.size();
+            }
         }
+    }
 
-        //the newell's method to calculate normal
-
+    //the normals of those vertices, from all their polygons, summed in the
+    //same order as computeNormals sums them
+    vector<glm::vec3> sums(affected.size(),glm::vec3(0,0,0));
+    vector<float> weights(primitiveSize);
+    for (f=0;f<polygonCount;f++)
+    {
+        const unsigned int *v = &primitives[f*primitiveSize];
+        glm::vec3 n;
+
+        for (k=0;(k<primitiveSize) && (slots[v[k]]==0);k++)
+            ;
+        if (k==primitiveSize)
+            continue;
+        weighPolygon(positions,stride,f,options.weighting,n,&weights[0]);
         for (k=0;k<primitiveSize;k++)
         {
-            norm.x += (positions[v[k]].y-positions[v[(k+1)%primitiveSize]].y)*
-                      (positions[v[k]].z+positions[v[(k+1)%primitiveSize]].z);
-            norm.y += (positions[v[k]].z-positions[v[(k+1)%primitiveSize]].z)*
-                      (positions[v[k]].x+positions[v[(k+1)%primitiveSize]].x);
-            norm.z += (positions[v[k]].x-positions[v[(k+1)%primitiveSize]].x)*
-                      (positions[v[k]].y+positions[v[(k+1)%primitiveSize]].y);
+            if (slots[v[k]]>0)
+                sums[slots[v[k]]-1] += weights[k]*n;
         }
-        norm = glm::normalize(norm);
+    }
 
-        for (k=0;k<primitiveSize;k++)
+    VertexAccess<VertexType> normal("normal",vertexData[0]);
+    sort(affected.begin(),affected.end());
+    for (i=0;i<affected.size();i++)
+    {
+        glm::vec3 n = sums[slots[affected[i]]-1];
+        float length = glm::length(n);
+        glm::vec4 result = (length>0)?glm::vec4(n/length,0.0f):glm::vec4(0,0,0,0);
+
+        normal.write(vertexData[affected[i]],&result.x,4);
+        dirtyVertices.add(affected[i],1);
+    }
+    changedVertices.clear();
+}
+
+template<class VertexType>
+const DirtyRanges& PolygonMesh<VertexType>::getDirtyVertices() const
+{
+    return dirtyVertices;
+}
+
+template<class VertexType>
+const DirtyRanges& PolygonMesh<VertexType>::getDirtyPrimitives() const
+{
+    return dirtyPrimitives;
+}
+
+template<class VertexType>
+void PolygonMesh<VertexType>::clearDirtyRanges()
+{
+    dirtyVertices.clear();
+    dirtyPrimitives.clear();
+}
+
+template<class VertexType>
+void PolygonMesh<VertexType>::touchAllVertices()
+{
+    dirtyVertices.addAll(vertexData.size());
+    changedVertices.clear();
+}
+
+template<class VertexType>
+void PolygonMesh<VertexType>::touchAllPrimitives()
+{
+    dirtyPrimitives.addAll(primitives.size());
+    changedVertices.clear();
+}
+
+template<class VertexType>
+const float *PolygonMesh<VertexType>::getPositions(vector<glm::vec4>& copy,size_t& stride)
+{
+    if (vertexData.size()<=0)
+        return NULL;
+
+    if (!vertexData[0].hasData("position"))
+    {
+        return NULL;
+    }
+
+    return getPositions(copy,stride,integral_constant<bool,VertexLayout<VertexType>::KNOWN!=0>());
+}
+
+template<class VertexType>
+const float *PolygonMesh<VertexType>::getPositions(vector<glm::vec4>& copy,size_t& stride,true_type)
+{
+    VertexAccess<VertexType> position("position",vertexData[0]);
+
+    if (position.getSize()!=4)
+        return getPositions(copy,stride,false_type());
+
+    //read the positions where they are, a vertex apart
+    stride = sizeof(VertexType);
+    return (const float *)((const char *)&vertexData[0] + position.getOffset());
+}
+
+template<class VertexType>
+const float *PolygonMesh<VertexType>::getPositions(vector<glm::vec4>& copy,size_t& stride,false_type)
+{
+    VertexAccess<VertexType,false> position("position",vertexData[0]);
+
+    if (position.getSize()>4)
+        return NULL;
+
+    copy.resize(vertexData.size());
+    for (size_t i=0;i<vertexData.size();i++)
+    {
+        copy[i] = glm::vec4(0,0,0,1);
+        position.read(vertexData[i],&copy[i].x);
+    }
+    stride = sizeof(glm::vec4);
+    return &copy[0].x;
+}
+
+/*
+ * Compute vertex normals in this polygon mesh using Newell's method, if
+ * position data exists
+ */
+
+template<class VertexType>
+void PolygonMesh<VertexType>::computeNormals()
+{
+    computeNormals(NormalOptions());
+}
+
+template<class VertexType>
+void PolygonMesh<VertexType>::computeNormals(const NormalOptions& options)
+{
+    vector<glm::vec4> copy;
+    size_t stride;
+    const float *positions = getPositions(copy,stride);
+
+    if ((positions==NULL) || (primitiveSize<=0))
+        return;
+
+    if (!vertexData[0].hasData("normal"))
+        return;
+
+    size_t vertexCount = vertexData.size();
+    size_t polygonCount = primitives.size()/primitiveSize;
+    unsigned int threads = resolveThreadCount(options.threads);
+    vector<glm::vec3> polygonNormals(polygonCount);
+    vector<float> cornerWeights(polygonCount*primitiveSize);
+
+    parallelFor(0,polygonCount,threads,
+                [&](size_t first,size_t last,unsigned int)
+    {
+        for (size_t f=first;f<last;f++)
+            weighPolygon(positions,stride,f,options.weighting,
+                         polygonNormals[f],&cornerWeights[f*primitiveSize]);
+    });
+
+    if (options.creaseAngle<180)
+    {
+        splitAtCreases(polygonNormals,cornerWeights,options.creaseAngle,threads);
+        return;
+    }
+
+    //every thread adds the normals of its share of the polygons into its
+    //own sums, so that no two threads write to the same vertex; the sums
+    //are then added up a range of vertices per thread
+    unsigned int blocks = (unsigned int)min((size_t)threads,max(polygonCount,(size_t)1));
+    vector<vector<glm::vec3> > sums(blocks);
+
+    parallelFor(0,polygonCount,blocks,
+                [&](size_t first,size_t last,unsigned int block)
+    {
+        vector<glm::vec3>& sum = sums[block];
+
+        sum.assign(vertexCount,glm::vec3(0,0,0));
+        for (size_t f=first;f<last;f++)
+        {
+            const unsigned int *v = &primitives[f*primitiveSize];
+            const float *w = &cornerWeights[f*primitiveSize];
+
+            for (int k=0;k<primitiveSize;k++)
+                sum[v[k]] += w[k]*polygonNormals[f];
+        }
+    });
+    if (sums[0].empty())
+        sums[0].assign(vertexCount,glm::vec3(0,0,0));
+
+    VertexAccess<VertexType> normal("normal",vertexData[0]);
+    parallelFor(0,vertexCount,threads,
+                [&](size_t first,size_t last,unsigned int)
+    {
+        for (size_t i=first;i<last;i++)
         {
-            normals[v[k]] = normals[v[k]] + norm;
+            glm::vec3 n = sums[0][i];
+            for (unsigned int b=1;b<sums.size();b++)
+                n += sums[b][i];
+
+            float length = glm::length(n);
+            glm::vec4 result = (length>0)?glm::vec4(n/length,0.0f):glm::vec4(0,0,0,0);
+            normal.write(vertexData[i],&result.x,4);
         }
+    });
+    dirtyVertices.addAll(vertexCount);
+    changedVertices.clear();
+}
+
+template<class VertexType>
+void PolygonMesh<VertexType>::weighPolygon(const float *positions,size_t stride,size_t first,
+                                           NormalOptions::Weighting weighting,
+                                           glm::vec3& normal,float *weights) const
+{
+    const unsigned int *v = &primitives[first*primitiveSize];
+    glm::vec3 p[3];
+    int k;
+
+    //the newell's method to calculate normal
+    normal = glm::vec3(0,0,0);
+    for (k=0;k<primitiveSize;k++)
+    {
+        const float *a = (const float *)((const char *)positions + v[k]*stride);
+        const float *b = (const float *)((const char *)positions + v[(k+1)%primitiveSize]*stride);
+
+        normal.x += (a[1]-b[1])*(a[2]+b[2]);
+        normal.y += (a[2]-b[2])*(a[0]+b[0]);
+        normal.z += (a[0]-b[0])*(a[1]+b[1]);
     }
 
-    for (i=0;i<normals.size();i++)
+    //twice the area of the polygon
+    float length = glm::length(normal);
+    if (!((length>0) && (length<=numeric_limits<float>::max())))
     {
+        normal = glm::vec3(0,0,0);
+        for (k=0;k<primitiveSize;k++)
+            weights[k] = 0;
+        return;
+    }
+    normal /= length;
 
-        normals[i] = glm::normalize(normals[i]);
+    for (k=0;k<primitiveSize;k++)
+    {
+        switch (weighting)
+        {
+        case NormalOptions::AREA:
+            weights[k] = 0.5f*length;
+            break;
+        case NormalOptions::ANGLE:
+        {
+            for (int j=0;j<3;j++)
+            {
+                const float *a = (const float *)((const char *)positions
+                                                 + v[(k+primitiveSize-1+j)%primitiveSize]*stride);
+                p[j] = glm::vec3(a[0],a[1],a[2]);
+            }
+            glm::vec3 e1 = p[0]-p[1],e2 = p[2]-p[1];
+            weights[k] = atan2(glm::length(glm::cross(e1,e2)),glm::dot(e1,e2));
+            break;
+        }
+        default:
+            weights[k] = 1;
+        }
     }
-    for (i=0;i<vertexData.size();i++) {
-        vector<float> n;
+}
 
-        n.push_back(normals[i].x);
-        n.push_back(normals[i].y);
-        n.push_back(normals[i].z);
-        n.push_back(normals[i].w);
-        vertexData[i].setData("normal",n);
+template<class VertexType>
+void PolygonMesh<VertexType>::splitAtCreases(const vector<glm::vec3>& polygonNormals,
+                                             const vector<float>& cornerWeights,
+                                             float creaseAngle,unsigned int threads)
+{
+    size_t vertexCount = vertexData.size();
+    size_t cornerCount = polygonNormals.size()*primitiveSize;
+    float cosCrease = cos(glm::radians(creaseAngle));
+    size_t i;
+
+    //the corners at every vertex, sorted by vertex with a counting sort:
+    //corners[cornerStart[v]] to corners[cornerStart[v+1]-1]
+    vector<size_t> cornerStart(vertexCount+1,0);
+    vector<unsigned int> corners(cornerCount);
+    for (i=0;i<cornerCount;i++)
+        cornerStart[primitives[i]+1]++;
+    for (i=0;i<vertexCount;i++)
+        cornerStart[i+1] += cornerStart[i];
+    {
+        vector<size_t> next(cornerStart.begin(),cornerStart.end()-1);
+        for (i=0;i<cornerCount;i++)
+            corners[next[primitives[i]]++] = (unsigned int)i;
     }
+
+    //the normal at each corner smooths only the polygons at its vertex that
+    //are within the crease angle of its own polygon. Corners of a vertex
+    //that end up with the same normal share a vertex; the others each get
+    //a copy of it.
+    vector<glm::vec3> cornerNormals(cornerCount);
+    vector<size_t> copies(vertexCount+1,0);
+    vector<unsigned int> copyOfCorner(cornerCount);
+    parallelFor(0,vertexCount,threads,
+                [&](size_t first,size_t last,unsigned int)
+    {
+        for (size_t v=first;v<last;v++)
+        {
+            size_t begin = cornerStart[v],end = cornerStart[v+1];
+            unsigned int distinct = 0;
+
+            for (size_t c=begin;c<end;c++)
+            {
+                const glm::vec3& own = polygonNormals[corners[c]/primitiveSize];
+                bool flat = (own==glm::vec3(0,0,0));
+                glm::vec3 n(0,0,0);
+
+                for (size_t d=begin;d<end;d++)
+                {
+                    const glm::vec3& other = polygonNormals[corners[d]/primitiveSize];
+                    if (flat || (glm::dot(own,other)>=cosCrease))
+                        n += cornerWeights[corners[d]]*other;
+                }
+                float length = glm::length(n);
+                cornerNormals[corners[c]] = (length>0)?n/length:glm::vec3(0,0,0);
+
+                size_t e;
+                for (e=begin;e<c;e++)
+                {
+                    if (cornerNormals[corners[e]]==cornerNormals[corners[c]])
+                        break;
+                }
+                copyOfCorner[corners[c]] = (e<c)?copyOfCorner[corners[e]]:distinct++;
+            }
+            //a vertex that no polygon uses is kept as it is
+            copies[v+1] = (distinct>0)?distinct:1;
+        }
+    });
+
+    for (i=0;i<vertexCount;i++)
+        copies[i+1] += copies[i];
+
+    vector<VertexType> split(copies[vertexCount]);
+    VertexAccess<VertexType> normal("normal",vertexData[0]);
+    parallelFor(0,vertexCount,threads,
+                [&](size_t first,size_t last,unsigned int)
+    {
+        for (size_t v=first;v<last;v++)
+        {
+            glm::vec4 zero(0,0,0,0);
+
+            for (size_t c=copies[v];c<copies[v+1];c++)
+            {
+                split[c] = vertexData[v];
+                normal.write(split[c],&zero.x,4);
+            }
+            for (size_t c=cornerStart[v];c<cornerStart[v+1];c++)
+            {
+                unsigned int corner = corners[c];
+                glm::vec4 n(cornerNormals[corner],0.0f);
+
+                primitives[corner] = (unsigned int)(copies[v]+copyOfCorner[corner]);
+                normal.write(split[primitives[corner]],&n.x,4);
+            }
+        }
+    });
+
+    vertexData.swap(split);
+    touchAllVertices();
+    touchAllPrimitives();
 }
 }
 #endif
@@ -0,0 +1,369 @@
+#ifndef _SOAPOLYGONMESH_H_
+#define _SOAPOLYGONMESH_H_
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_inverse.hpp>
+#include <string>
+#include <vector>
+#include <cmath>
+#include "PolygonMesh.h"
+#include "VertexLayout.h"
+#include "BoundingVolumes.h"
+using namespace std;
+
+namespace util
+{
+
+/*
+ * A polygon mesh whose vertex attributes are stored as a structure of
+ * arrays: every component of every attribute (the x of all the positions,
+ * the y of all the positions, ..., the x of all the normals, ...) is a
+ * separate contiguous array of floats.
+ *
+ * A PolygonMesh stores one vertex object after another, so a loop over one
+ * attribute strides over all the others (and, for VertexAttrib, over a
+ * vtable pointer). Here such a loop reads consecutive floats, which the
+ * compiler can turn into vector instructions. This suits whole-mesh
+ * computations like bounds, normals and transforms; a PolygonMesh can be
+ * converted to one of these for them, and back.
+ *
+ * The indices, primitive type and size, and parts are kept as in a
+ * PolygonMesh. VertexInterleaver packs these meshes for vertex buffers
+ * just as it packs PolygonMeshes.
+ */
+class SoAPolygonMesh
+{
+public:
+    //no attribute has more components than a glm::vec4
+    static const unsigned int MAX_COMPONENTS = 4;
+
+    /*
+     * One vertex attribute: a stream of floats for each of its components
+     */
+    class Attribute
+    {
+    public:
+        Attribute()
+        {
+            components = 0;
+        }
+
+        string name;
+        unsigned int components;
+        vector<float> streams[MAX_COMPONENTS];
+    };
+
+    SoAPolygonMesh()
+    {
+        vertexCount = 0;
+        primitiveType = primitiveSize = 0;
+    }
+
+    /*
+     * Copy a polygon mesh, splitting each of its vertex attributes into
+     * streams
+     * \throws runtime_error if an attribute of the vertex type has more
+     *         than MAX_COMPONENTS components
+     */
+    template <class K>
+    explicit SoAPolygonMesh(const PolygonMesh<K>& mesh) throw(runtime_error)
+    {
+        const vector<K>& vertexData = mesh.getVertexAttributesRef();
+        K probe;
+        vector<string> names = probe.getAllAttributes();
+        vector<float> data;
+
+        vertexCount = vertexData.size();
+        primitives = mesh.getPrimitivesRef();
+        subMeshes = mesh.getSubMeshesRef();
+        primitiveType = mesh.getPrimitiveType();
+        primitiveSize = mesh.getPrimitiveSize();
+        minBounds = mesh.getMinimumBounds();
+        maxBounds = mesh.getMaximumBounds();
+
+        for (unsigned int a=0;a<names.size();a++)
+        {
+            VertexAccess<K> access(names[a],(vertexCount>0)?vertexData[0]:probe);
+            Attribute attribute;
+
+            if (access.getSize()>MAX_COMPONENTS)
+                throw runtime_error("Too much data for attribute: "+names[a]);
+
+            attribute.name = names[a];
+            attribute.components = access.getSize();
+            for (unsigned int c=0;c<attribute.components;c++)
+                attribute.streams[c].resize(vertexCount);
+
+            data.resize(attribute.components);
+            for (size_t i=0;(i<vertexCount) && (attribute.components>0);i++)
+            {
+                access.read(vertexData[i],&data[0]);
+                for (unsigned int c=0;c<attribute.components;c++)
+                    attribute.streams[c][i] = data[c];
+            }
+            attributes.push_back(attribute);
+        }
+    }
+
+    /*
+     * Copy this mesh into a polygon mesh, putting each vertex back together
+     */
+    template <class K>
+    PolygonMesh<K> toPolygonMesh() const
+    {
+        PolygonMesh<K> mesh;
+        vector<K> vertexData(vertexCount);
+        float data[MAX_COMPONENTS];
+
+        for (unsigned int a=0;a<attributes.size();a++)
+        {
+            const Attribute& attribute = attributes[a];
+            VertexAccess<K> access(attribute.name);
+
+            for (size_t i=0;i<vertexCount;i++)
+            {
+                for (unsigned int c=0;c<attribute.components;c++)
+                    data[c] = attribute.streams[c][i];
+                access.write(vertexData[i],data,attribute.components);
+            }
+        }
+
+        mesh.setVertexData(std::move(vertexData),minBounds,maxBounds);
+        mesh.setPrimitives(primitives);
+        mesh.setSubMeshes(subMeshes);
+        mesh.setPrimitiveType(primitiveType);
+        mesh.setPrimitiveSize(primitiveSize);
+        return mesh;
+    }
+
+    int getVertexCount() const
+    {
+        return (int)vertexCount;
+    }
+
+    int getPrimitiveType() const
+    {
+        return primitiveType;
+    }
+
+    int getPrimitiveSize() const
+    {
+        return primitiveSize;
+    }
+
+    const vector<unsigned int>& getPrimitives() const
+    {
+        return primitives;
+    }
+
+    const vector<SubMesh>& getSubMeshes() const
+    {
+        return subMeshes;
+    }
+
+    glm::vec4 getMinimumBounds() const
+    {
+        return minBounds;
+    }
+
+    glm::vec4 getMaximumBounds() const
+    {
+        return maxBounds;
+    }
+
+    const vector<Attribute>& getAttributes() const
+    {
+        return attributes;
+    }
+
+    /*
+     * \return the attribute of the given name, or NULL if there is none
+     */
+    const Attribute *getAttribute(const string& name) const
+    {
+        return const_cast<SoAPolygonMesh *>(this)->findAttribute(name);
+    }
+
+    /*
+     * Compute the bounding box of this mesh, if there is position data. As
+     * in PolygonMesh, the w of the bounds is that of the first vertex.
+     */
+    void computeBoundingBox()
+    {
+        const Attribute *position = getAttribute("position");
+        unsigned int c;
+
+        if ((vertexCount==0) || (position==NULL))
+            return;
+
+        for (c=0;c<MAX_COMPONENTS;c++)
+        {
+            minBounds[c] = maxBounds[c] = (c==3)?1.0f:0.0f;
+            if (c<position->components)
+                minBounds[c] = maxBounds[c] = position->streams[c][0];
+        }
+
+        if (position->components>=3)
+        {
+            glm::vec3 minimum,maximum;
+
+            BoundingVolumes::box(&position->streams[0][0],&position->streams[1][0],
+                                 &position->streams[2][0],vertexCount,minimum,maximum);
+            minBounds = glm::vec4(minimum,minBounds.w);
+            maxBounds = glm::vec4(maximum,maxBounds.w);
+        }
+    }
+
+    /*
+     * Compute vertex normals in this polygon mesh using Newell's method, if
+     * position and normal data exist, as PolygonMesh::computeNormals does
+     * with its default options
+     */
+    void computeNormals()
+    {
+        Attribute *position = findAttribute("position");
+        Attribute *normal = findAttribute("normal");
+        size_t i;
+        int k;
+
+        if ((vertexCount==0) || (position==NULL) || (normal==NULL)
+                || (position->components<3) || (normal->components<3)
+                || (primitiveSize<=0))
+            return;
+
+        for (unsigned int c=0;c<normal->components;c++)
+            normal->streams[c].assign(vertexCount,0.0f);
+
+        const float *px = &position->streams[0][0];
+        const float *py = &position->streams[1][0];
+        const float *pz = &position->streams[2][0];
+        float *nx = &normal->streams[0][0];
+        float *ny = &normal->streams[1][0];
+        float *nz = &normal->streams[2][0];
+
+        for (i=0;i+primitiveSize<=primitives.size();i+=primitiveSize)
+        {
+            const unsigned int *v = &primitives[i];
+            float x = 0,y = 0,z = 0;
+
+            for (k=0;k<primitiveSize;k++)
+            {
+                unsigned int a = v[k],b = v[(k+1)%primitiveSize];
+
+                x += (py[a]-py[b])*(pz[a]+pz[b]);
+                y += (pz[a]-pz[b])*(px[a]+px[b]);
+                z += (px[a]-px[b])*(py[a]+py[b]);
+            }
+
+            //polygons with no area are left out
+            float length = sqrt(x*x+y*y+z*z);
+            if (!(length>0))
+                continue;
+            x /= length;
+            y /= length;
+            z /= length;
+            for (k=0;k<primitiveSize;k++)
+            {
+                nx[v[k]] += x;
+                ny[v[k]] += y;
+                nz[v[k]] += z;
+            }
+        }
+
+        for (i=0;i<vertexCount;i++)
+        {
+            float length = sqrt(nx[i]*nx[i]+ny[i]*ny[i]+nz[i]*nz[i]);
+
+            if (length>0)
+            {
+                nx[i] /= length;
+                ny[i] /= length;
+                nz[i] /= length;
+            }
+        }
+    }
+
+    /*
+     * Transform the positions of this mesh by a matrix, and its normals by
+     * the inverse transpose of the matrix (normalizing them again). The
+     * bounding box is computed again as the positions are transformed.
+     */
+    void transform(const glm::mat4& m)
+    {
+        Attribute *position = findAttribute("position");
+        Attribute *normal = findAttribute("normal");
+        size_t i;
+
+        if ((position!=NULL) && (position->components>=3) && (vertexCount>0))
+        {
+            float *x = &position->streams[0][0];
+            float *y = &position->streams[1][0];
+            float *z = &position->streams[2][0];
+            float *w = (position->components>3)?&position->streams[3][0]:NULL;
+
+            for (i=0;i<vertexCount;i++)
+            {
+                float pw = (w!=NULL)?w[i]:1.0f;
+                float tx = m[0][0]*x[i] + m[1][0]*y[i] + m[2][0]*z[i] + m[3][0]*pw;
+                float ty = m[0][1]*x[i] + m[1][1]*y[i] + m[2][1]*z[i] + m[3][1]*pw;
+                float tz = m[0][2]*x[i] + m[1][2]*y[i] + m[2][2]*z[i] + m[3][2]*pw;
+
+                if (w!=NULL)
+                    w[i] = m[0][3]*x[i] + m[1][3]*y[i] + m[2][3]*z[i] + m[3][3]*pw;
+                x[i] = tx;
+                y[i] = ty;
+                z[i] = tz;
+            }
+            computeBoundingBox();
+        }
+
+        if ((normal!=NULL) && (normal->components>=3) && (vertexCount>0))
+        {
+            glm::mat3 n = glm::inverseTranspose(glm::mat3(m));
+            float *x = &normal->streams[0][0];
+            float *y = &normal->streams[1][0];
+            float *z = &normal->streams[2][0];
+
+            for (i=0;i<vertexCount;i++)
+            {
+                float tx = n[0][0]*x[i] + n[1][0]*y[i] + n[2][0]*z[i];
+                float ty = n[0][1]*x[i] + n[1][1]*y[i] + n[2][1]*z[i];
+                float tz = n[0][2]*x[i] + n[1][2]*y[i] + n[2][2]*z[i];
+                float length = sqrt(tx*tx+ty*ty+tz*tz);
+
+                //a zero normal stays zero
+                if (length>0)
+                {
+                    tx /= length;
+                    ty /= length;
+                    tz /= length;
+                }
+                x[i] = tx;
+                y[i] = ty;
+                z[i] = tz;
+            }
+        }
+    }
+
+private:
+    Attribute *findAttribute(const string& name)
+    {
+        for (unsigned int a=0;a<attributes.size();a++)
+        {
+            if (attributes[a].name==name)
+                return &attributes[a];
+        }
+        return NULL;
+    }
+
+    size_t vertexCount;
+    vector<Attribute> attributes;
+    vector<unsigned int> primitives;
+    vector<SubMesh> subMeshes;
+    int primitiveType;
+    int primitiveSize;
+    glm::vec4 minBounds,maxBounds;
+};
+}
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef _STRINGSLICE_H_
+#define _STRINGSLICE_H_
+
+#include <string>
+#include <cstring>
+using namespace std;
+
+namespace util
+{
+
+/*
+ * A non-owning view of a run of characters inside a larger buffer (for
+ * example a memory-mapped file). It is used to tokenize text in place,
+ * without allocating a string for every token.
+ *
+ * The characters are not null-terminated, and the slice is only valid as
+ * long as the buffer it points into.
+ */
+class StringSlice
+{
+public:
+    StringSlice()
+    {
+        first = last = NULL;
+    }
+
+    StringSlice(const char *first,const char *last)
+    {
+        this->first = first;
+        this->last = last;
+    }
+
+    const char *begin() const
+    {
+        return first;
+    }
+
+    const char *end() const
+    {
+        return last;
+    }
+
+    size_t length() const
+    {
+        return (size_t)(last-first);
+    }
+
+    bool empty() const
+    {
+        return first==last;
+    }
+
+    char operator[](size_t i) const
+    {
+        return first[i];
+    }
+
+    /*
+     * Compare this slice to a null-terminated string
+     */
+    bool operator==(const char *s) const
+    {
+        size_t n = strlen(s);
+        return (n==length()) && (memcmp(first,s,n)==0);
+    }
+
+    bool operator!=(const char *s) const
+    {
+        return !(*this==s);
+    }
+
+    string toString() const
+    {
+        return string(first,last);
+    }
+
+private:
+    const char *first,*last;
+};
+}
+
+#endif
@@ -0,0 +1,114 @@
+#ifndef _THREADPOOL_H_
+#define _THREADPOOL_H_
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <functional>
+#include <memory>
+#include <deque>
+#include <vector>
+#include <type_traits>
+#include "Parallel.h"
+using namespace std;
+
+namespace util
+{
+
+/*
+ * A fixed set of worker threads that run queued jobs in the order they were
+ * submitted. Submitting a job returns a future for its result, so the
+ * caller can go on with other work and collect the result later. If the
+ * job throws, the exception is thrown again from the future's get().
+ *
+ * Destroying the pool waits for all the jobs already queued to finish.
+ */
+class ThreadPool
+{
+public:
+    /*
+     * Start the workers
+     * \param threads the number of worker threads, 0 for one per core
+     */
+    ThreadPool(unsigned int threads=0)
+    {
+        stopping = false;
+        threads = resolveThreadCount(threads);
+        for (unsigned int i=0;i<threads;i++)
+            workers.push_back(thread(&ThreadPool::work,this));
+    }
+
+    ~ThreadPool()
+    {
+        {
+            unique_lock<mutex> lock(queueLock);
+            stopping = true;
+        }
+        wakeUp.notify_all();
+        for (unsigned int i=0;i<workers.size();i++)
+            workers[i].join();
+    }
+
+    /*
+     * Queue a job, to be run on one of the workers
+     * \param job anything that can be called with no arguments
+     * \return a future that becomes ready when the job has finished
+     */
+    template <class F>
+    future<typename result_of<F()>::type> submit(F job)
+    {
+        typedef typename result_of<F()>::type R;
+        //a packaged_task cannot be copied, and a function must be
+        shared_ptr<packaged_task<R()> > task(new packaged_task<R()>(job));
+        future<R> result = task->get_future();
+
+        {
+            unique_lock<mutex> lock(queueLock);
+            jobs.push_back([task]() { (*task)(); });
+        }
+        wakeUp.notify_one();
+        return result;
+    }
+
+    /*
+     * \return the number of worker threads
+     */
+    unsigned int getThreadCount() const
+    {
+        return (unsigned int)workers.size();
+    }
+
+private:
+    ThreadPool(const ThreadPool&);
+    ThreadPool& operator=(const ThreadPool&);
+
+    void work()
+    {
+        while (true)
+        {
+            function<void()> job;
+
+            {
+                unique_lock<mutex> lock(queueLock);
+                while (!stopping && jobs.empty())
+                    wakeUp.wait(lock);
+                //finish what is queued before stopping
+                if (jobs.empty())
+                    return;
+                job = jobs.front();
+                jobs.pop_front();
+            }
+            job();
+        }
+    }
+
+    vector<thread> workers;
+    deque<function<void()> > jobs;
+    mutex queueLock;
+    condition_variable wakeUp;
+    bool stopping;
+};
+}
+
+#endif
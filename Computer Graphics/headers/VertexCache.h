@@ -0,0 +1,312 @@
+#ifndef _VERTEXCACHE_H_
+#define _VERTEXCACHE_H_
+
+#include <vector>
+#include <cstddef>
+#include <cmath>
+#include <algorithm>
+using namespace std;
+
+namespace util
+{
+
+/*
+ * How well an index list uses the post-transform vertex cache, the small
+ * cache of shaded vertices the GPU keeps so that a vertex shared by
+ * neighbouring triangles is not shaded again
+ */
+class VertexCacheStats
+{
+public:
+    VertexCacheStats()
+    {
+        triangles = vertices = misses = 0;
+        acmr = atvr = 0;
+    }
+
+    size_t triangles;
+    //the number of distinct vertices the triangles use
+    size_t vertices;
+    //the number of times a vertex had to be shaded
+    size_t misses;
+    //average cache miss ratio: misses per triangle. 3 is the worst, about
+    //0.5 the best possible for a large regular mesh
+    float acmr;
+    //average transformed vertex ratio: misses per vertex. 1 is perfect
+    float atvr;
+};
+
+/*
+ * Reorders triangle lists for the post-transform vertex cache, and vertices
+ * for fetch locality. All functions work on an index list of triangles,
+ * three indices each, into vertices numbered from 0 to vertexCount-1.
+ */
+class VertexCache
+{
+public:
+    //the cache size triangles are ordered for, and measured with, unless
+    //another is given. Real caches are between 16 and 32 vertices; an
+    //order made for 32 is also good for the smaller ones
+    enum { DEFAULT_SIZE = 32 };
+
+    /*
+     * Simulate a FIFO cache of the given size over an index list
+     */
+    static VertexCacheStats measure(const unsigned int *indices,size_t count,
+                                    size_t vertexCount,
+                                    unsigned int cacheSize=DEFAULT_SIZE)
+    {
+        VertexCacheStats stats;
+        //the time at which each vertex last entered the cache: a vertex is
+        //in the cache if fewer than cacheSize misses have happened since
+        vector<size_t> entered(vertexCount,0);
+        vector<bool> used(vertexCount,false);
+
+        stats.triangles = count/3;
+        for (size_t i=0;i<stats.triangles*3;i++)
+        {
+            unsigned int v = indices[i];
+
+            if (v>=vertexCount)
+                continue;
+            if (!used[v])
+            {
+                used[v] = true;
+                stats.vertices++;
+            }
+            else if (stats.misses-entered[v]<cacheSize)
+                continue;
+            stats.misses++;
+            entered[v] = stats.misses;
+        }
+        if (stats.triangles>0)
+            stats.acmr = (float)stats.misses/stats.triangles;
+        if (stats.vertices>0)
+            stats.atvr = (float)stats.misses/stats.vertices;
+        return stats;
+    }
+
+    /*
+     * Reorder the triangles of an index list in place so that triangles
+     * sharing vertices are drawn close together, using Tom Forsyth's
+     * "Linear-Speed Vertex Cache Optimisation": each vertex is scored by
+     * where it is in a simulated LRU cache and by how many triangles still
+     * use it, and the triangle with the best vertices is drawn next. The
+     * corners of each triangle keep their order, so its facing does not
+     * change.
+     */
+    static void optimizeTriangles(unsigned int *indices,size_t count,
+                                  size_t vertexCount,
+                                  unsigned int cacheSize=DEFAULT_SIZE)
+    {
+        size_t triangleCount = count/3;
+        size_t i;
+
+        if ((triangleCount<2) || (cacheSize<4))
+            return;
+
+        //the vertices of the list are renumbered from 0, in the order they
+        //are first used, so that only they need bookkeeping
+        vector<unsigned int> local(vertexCount,(unsigned int)NONE);
+        vector<unsigned int> global;
+        vector<unsigned int> triangles(triangleCount*3);
+        for (i=0;i<triangleCount*3;i++)
+        {
+            unsigned int v = indices[i];
+
+            if (v>=vertexCount)
+                return;
+            if (local[v]==(unsigned int)NONE)
+            {
+                local[v] = (unsigned int)global.size();
+                global.push_back(v);
+            }
+            triangles[i] = local[v];
+        }
+        size_t localCount = global.size();
+
+        //the triangles that use each vertex, with a counting sort:
+        //adjacent[adjacentStart[v]] to adjacent[adjacentStart[v]+valence[v]-1]
+        //are the ones not yet drawn
+        vector<unsigned int> valence(localCount,0);
+        vector<size_t> adjacentStart(localCount+1,0);
+        vector<unsigned int> adjacent(triangleCount*3);
+        for (i=0;i<triangleCount*3;i++)
+            adjacentStart[triangles[i]+1]++;
+        for (i=0;i<localCount;i++)
+            adjacentStart[i+1] += adjacentStart[i];
+        for (i=0;i<triangleCount*3;i++)
+        {
+            unsigned int v = triangles[i];
+            adjacent[adjacentStart[v]+valence[v]++] = (unsigned int)(i/3);
+        }
+
+        //the constants from Forsyth's article
+        const float CACHE_DECAY_POWER = 1.5f;
+        const float LAST_TRIANGLE_SCORE = 0.75f;
+        const float VALENCE_BOOST_SCALE = 2.0f;
+        const float VALENCE_BOOST_POWER = 0.5f;
+
+        //scores by cache position (the last entry is for vertices not in
+        //the cache) and by valence
+        vector<float> cacheScores(cacheSize+1),valenceScores(VALENCE_SCORES);
+        for (i=0;i<cacheSize;i++)
+        {
+            //the vertices of the triangle just drawn all score the same, so
+            //that the order of its corners makes no difference
+            if (i<3)
+                cacheScores[i] = LAST_TRIANGLE_SCORE;
+            else
+                cacheScores[i] = pow(1.0f-(float)(i-3)/(cacheSize-3),CACHE_DECAY_POWER);
+        }
+        cacheScores[cacheSize] = 0;
+        valenceScores[0] = 0;
+        for (i=1;i<VALENCE_SCORES;i++)
+            valenceScores[i] = VALENCE_BOOST_SCALE*pow((float)i,-VALENCE_BOOST_POWER);
+
+        vector<float> vertexScores(localCount);
+        for (i=0;i<localCount;i++)
+            vertexScores[i] = score(cacheScores,valenceScores,cacheSize,valence[i]);
+
+        vector<float> triangleScores(triangleCount);
+        vector<bool> drawn(triangleCount,false);
+        size_t best = 0;
+        for (i=0;i<triangleCount;i++)
+        {
+            triangleScores[i] = vertexScores[triangles[3*i]]
+                    + vertexScores[triangles[3*i+1]]
+                    + vertexScores[triangles[3*i+2]];
+            if (triangleScores[i]>triangleScores[best])
+                best = i;
+        }
+
+        //the cache, most recent first, with room for the three vertices of
+        //the next triangle before the oldest ones fall out
+        vector<unsigned int> cache,nextCache;
+        cache.reserve(cacheSize+3);
+        nextCache.reserve(cacheSize+3);
+        size_t nextUndrawn = 0;
+        unsigned int *out = indices;
+
+        for (size_t drawnCount=0;drawnCount<triangleCount;drawnCount++)
+        {
+            //when no triangle touches the cache, carry on in the input order
+            if (best==(size_t)NONE)
+            {
+                while (drawn[nextUndrawn])
+                    nextUndrawn++;
+                best = nextUndrawn;
+            }
+
+            const unsigned int *t = &triangles[3*best];
+            drawn[best] = true;
+            for (int k=0;k<3;k++)
+            {
+                unsigned int v = t[k];
+                unsigned int *first = &adjacent[adjacentStart[v]];
+                unsigned int *last = first+valence[v];
+
+                *out++ = global[v];
+                //take the triangle out of those waiting at its vertices
+                *find(first,last,(unsigned int)best) = *(last-1);
+                valence[v]--;
+            }
+
+            //a triangle with a repeated corner puts its vertex in only once
+            nextCache.clear();
+            nextCache.push_back(t[0]);
+            if (t[1]!=t[0])
+                nextCache.push_back(t[1]);
+            if ((t[2]!=t[0]) && (t[2]!=t[1]))
+                nextCache.push_back(t[2]);
+            for (i=0;i<cache.size();i++)
+            {
+                if ((cache[i]!=t[0]) && (cache[i]!=t[1]) && (cache[i]!=t[2]))
+                    nextCache.push_back(cache[i]);
+            }
+            cache.swap(nextCache);
+
+            //rescore the vertices whose position or valence changed, and
+            //the triangles still waiting at them
+            for (i=0;i<cache.size();i++)
+            {
+                unsigned int v = cache[i];
+                unsigned int position = (i<cacheSize)?(unsigned int)i:cacheSize;
+                float vertexScore = score(cacheScores,valenceScores,position,valence[v]);
+                float change = vertexScore - vertexScores[v];
+                vertexScores[v] = vertexScore;
+                for (unsigned int j=0;j<valence[v];j++)
+                    triangleScores[adjacent[adjacentStart[v]+j]] += change;
+            }
+            if (cache.size()>cacheSize)
+                cache.resize(cacheSize);
+
+            //the next triangle is the best one that uses a cached vertex
+            best = (size_t)NONE;
+            float bestScore = -1;
+            for (i=0;i<cache.size();i++)
+            {
+                unsigned int v = cache[i];
+                for (unsigned int j=0;j<valence[v];j++)
+                {
+                    unsigned int candidate = adjacent[adjacentStart[v]+j];
+                    if (triangleScores[candidate]>bestScore)
+                    {
+                        bestScore = triangleScores[candidate];
+                        best = candidate;
+                    }
+                }
+            }
+        }
+    }
+
+    /*
+     * Number the vertices in the order the index list first uses them, so
+     * that vertices are fetched from memory mostly in order
+     * \param indices rewritten to use the new numbers
+     * \param remap set to the new number of every vertex. Vertices the list
+     *        does not use are numbered after all the others, keeping their
+     *        order
+     */
+    static void optimizeFetch(unsigned int *indices,size_t count,
+                              size_t vertexCount,vector<unsigned int>& remap)
+    {
+        unsigned int next = 0;
+        size_t i;
+
+        remap.assign(vertexCount,(unsigned int)NONE);
+        for (i=0;i<count;i++)
+        {
+            unsigned int& v = indices[i];
+
+            if (v>=vertexCount)
+                continue;
+            if (remap[v]==(unsigned int)NONE)
+                remap[v] = next++;
+            v = remap[v];
+        }
+        for (i=0;i<vertexCount;i++)
+        {
+            if (remap[i]==(unsigned int)NONE)
+                remap[i] = next++;
+        }
+    }
+
+private:
+    enum { NONE = -1, VALENCE_SCORES = 32 };
+
+    static float score(const vector<float>& cacheScores,
+                       const vector<float>& valenceScores,
+                       unsigned int cachePosition,unsigned int valence)
+    {
+        //a vertex no triangle waits at any more cannot help
+        if (valence==0)
+            return -1;
+        return cacheScores[cachePosition]
+                + valenceScores[min(valence,(unsigned int)VALENCE_SCORES-1)];
+    }
+};
+
+}
+
+#endif
@@ -0,0 +1,149 @@
+#ifndef _VERTEXINTERLEAVER_H_
+#define _VERTEXINTERLEAVER_H_
+
+#include <string>
+#include <vector>
+#include <map>
+#include "PolygonMesh.h"
+#include "VertexLayout.h"
+#include "SoAPolygonMesh.h"
+using namespace std;
+
+namespace util
+{
+
+/*
+ * The vertex attributes of a mesh packed into one array of floats, one
+ * vertex after the other, as they are sent to a vertex buffer
+ */
+class InterleavedVertices
+{
+public:
+    InterleavedVertices()
+    {
+        floatsPerVertex = 0;
+    }
+
+    vector<float> data;
+    //the number of floats that make up one vertex
+    int floatsPerVertex;
+    //for each attribute, where it starts within a vertex, in floats
+    map<string,int> offsets;
+    //for each attribute, how many floats it has
+    map<string,int> sizes;
+};
+
+/*
+ * Packs the vertex attributes of a polygon mesh into an InterleavedVertices.
+ * This does not need OpenGL, so it can be used (and measured) without a
+ * window.
+ */
+class VertexInterleaver
+{
+public:
+    /*
+     * \param mesh the mesh whose vertices are packed
+     * \param shaderVarsToAttributeNames a mapping of
+     *        shader variable -> vertex attributes in the mesh. The
+     *        attributes are packed in the order of the shader variables
+     * \param result filled with the packed vertices
+     */
+    template <class K>
+    static void interleave(const PolygonMesh<K>& mesh,
+                           const map<string,string>& shaderVarsToAttributeNames,
+                           InterleavedVertices& result)
+    {
+        vector<VertexAccess<K> > attributes;
+        vector<int> offsets;
+
+        result.data.clear();
+        result.offsets.clear();
+        result.sizes.clear();
+        result.floatsPerVertex = 0;
+
+        const vector<K>& vertexDataList = mesh.getVertexAttributesRef();
+        if (vertexDataList.size()==0)
+            return;
+
+        //look every attribute up by name once, not once per vertex
+        for (map<string,string>::const_iterator it=shaderVarsToAttributeNames.cbegin();
+             it!=shaderVarsToAttributeNames.cend();it++)
+        {
+            attributes.push_back(VertexAccess<K>(it->second,vertexDataList[0]));
+            int size = attributes.back().getSize();
+
+            offsets.push_back(result.floatsPerVertex);
+            result.offsets[it->second] = result.floatsPerVertex;
+            result.sizes[it->second] = size;
+            result.floatsPerVertex += size;
+        }
+        if (result.floatsPerVertex==0)
+            return;
+
+        //each attribute is copied for all the vertices at once, from its
+        //place in one vertex to its place in the next
+        result.data.resize(vertexDataList.size()*result.floatsPerVertex);
+        for (unsigned int i=0;i<attributes.size();i++)
+        {
+            attributes[i].read(&vertexDataList[0],vertexDataList.size(),
+                               &result.data[offsets[i]],result.floatsPerVertex);
+        }
+    }
+
+    /*
+     * Packs a mesh whose attributes are stored as separate streams, with the
+     * same layout a PolygonMesh with the same attributes would be packed in
+     * \throws runtime_error if the mesh has no attribute a shader variable
+     *         is mapped to
+     */
+    static void interleave(const SoAPolygonMesh& mesh,
+                           const map<string,string>& shaderVarsToAttributeNames,
+                           InterleavedVertices& result) throw(runtime_error)
+    {
+        vector<const SoAPolygonMesh::Attribute *> attributes;
+        vector<int> offsets;
+        size_t vertexCount = mesh.getVertexCount();
+
+        result.data.clear();
+        result.offsets.clear();
+        result.sizes.clear();
+        result.floatsPerVertex = 0;
+
+        if (vertexCount==0)
+            return;
+
+        for (map<string,string>::const_iterator it=shaderVarsToAttributeNames.cbegin();
+             it!=shaderVarsToAttributeNames.cend();it++)
+        {
+            const SoAPolygonMesh::Attribute *attribute = mesh.getAttribute(it->second);
+            if (attribute==NULL)
+                throw runtime_error("No attribute: "+it->second+" found!");
+
+            attributes.push_back(attribute);
+            offsets.push_back(result.floatsPerVertex);
+            result.offsets[it->second] = result.floatsPerVertex;
+            result.sizes[it->second] = attribute->components;
+            result.floatsPerVertex += attribute->components;
+        }
+        if (result.floatsPerVertex==0)
+            return;
+
+        //each stream is read straight through, and scattered into every
+        //vertex of the packed array
+        result.data.resize(vertexCount*result.floatsPerVertex);
+        for (unsigned int a=0;a<attributes.size();a++)
+        {
+            for (unsigned int c=0;c<attributes[a]->components;c++)
+            {
+                const float *in = &attributes[a]->streams[c][0];
+                float *out = &result.data[offsets[a]+c];
+
+                for (size_t i=0;i<vertexCount;i++,out+=result.floatsPerVertex)
+                    *out = in[i];
+            }
+        }
+    }
+};
+}
+
+#endif
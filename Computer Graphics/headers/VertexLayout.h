@@ -0,0 +1,167 @@
+#ifndef _VERTEXLAYOUT_H_
+#define _VERTEXLAYOUT_H_
+
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <cstring>
+#include <cstddef>
+#include <algorithm>
+using namespace std;
+
+namespace util
+{
+
+/*
+ * Describes, at compile time, where the attributes of a vertex type are
+ * stored, so that they can be copied straight out of (and into) the vertex
+ * instead of through the string-keyed IVertexData functions, which build a
+ * new vector for every attribute of every vertex.
+ *
+ * A vertex type does not need a layout: without one, it is used through
+ * IVertexData as before. To give a vertex type K a layout, specialize this
+ * class for K with:
+ *
+ * enum { KNOWN = 1, ATTRIBUTE_COUNT = n };
+ * static const char *name(unsigned int attribute);
+ * static unsigned int components(unsigned int attribute);
+ * static const float *data(const K& v,unsigned int attribute);
+ * static float *data(K& v,unsigned int attribute);
+ *
+ * where data() returns the components of the attribute, which must be
+ * contiguous floats at the same place in every vertex, and the attribute
+ * names are the ones IVertexData uses for the same data.
+ */
+template <class K>
+class VertexLayout
+{
+public:
+    enum { KNOWN = 0, ATTRIBUTE_COUNT = 0 };
+};
+
+/*
+ * Reads and writes one attribute of vertices of type K as plain floats.
+ * Setting one up looks the attribute up by name once; after that, a vertex
+ * type with a VertexLayout is read with a memcpy from a fixed offset within
+ * the vertex, and any other vertex type through IVertexData.
+ */
+template <class K,bool known=(VertexLayout<K>::KNOWN!=0)>
+class VertexAccess
+{
+public:
+    /*
+     * \param attribName the name of the attribute
+     * \param probe a vertex whose attribute has as many components as the
+     *        ones that will be read
+     * \throws runtime_error if the vertex type has no such attribute
+     */
+    VertexAccess(const string& attribName,const K& probe=K()) throw(runtime_error)
+    {
+        unsigned int i;
+
+        for (i=0;i<(unsigned int)VertexLayout<K>::ATTRIBUTE_COUNT;i++)
+        {
+            if (attribName==VertexLayout<K>::name(i))
+                break;
+        }
+        if (i>=(unsigned int)VertexLayout<K>::ATTRIBUTE_COUNT)
+            throw runtime_error("No attribute: "+attribName+" found!");
+
+        size = VertexLayout<K>::components(i);
+        offset = (const char *)VertexLayout<K>::data(probe,i) - (const char *)&probe;
+    }
+
+    /*
+     * \return the number of floats in the attribute
+     */
+    unsigned int getSize() const
+    {
+        return size;
+    }
+
+    /*
+     * \return where the attribute is within a vertex, in bytes. Only vertex
+     *         types with a layout have this, so code that uses it directly
+     *         (for example to walk a vector of vertices with a stride) is
+     *         compiled only for them.
+     */
+    size_t getOffset() const
+    {
+        return offset;
+    }
+
+    void read(const K& v,float *out) const
+    {
+        memcpy(out,(const char *)&v + offset,size*sizeof(float));
+    }
+
+    /*
+     * Set the attribute from count floats. Components past count keep the
+     * values they have.
+     */
+    void write(K& v,const float *in,unsigned int count) const
+    {
+        memcpy((char *)&v + offset,in,min(count,size)*sizeof(float));
+    }
+
+    /*
+     * Copy the attribute of count consecutive vertices into an array, the
+     * values for one vertex stride floats after those of the previous one
+     */
+    void read(const K *vertices,size_t count,float *out,size_t stride) const
+    {
+        const char *p = (const char *)vertices + offset;
+
+        for (size_t i=0;i<count;i++,p+=sizeof(K),out+=stride)
+            memcpy(out,p,size*sizeof(float));
+    }
+
+private:
+    unsigned int size;
+    size_t offset;
+};
+
+/*
+ * The same, for vertex types without a layout
+ */
+template <class K>
+class VertexAccess<K,false>
+{
+public:
+    VertexAccess(const string& attribName,const K& probe=K()) throw(runtime_error)
+        :name(attribName)
+    {
+        size = (unsigned int)const_cast<K&>(probe).getData(name).size();
+    }
+
+    unsigned int getSize() const
+    {
+        return size;
+    }
+
+    void read(const K& v,float *out) const
+    {
+        vector<float> data = const_cast<K&>(v).getData(name);
+
+        if (data.size()>0)
+            memcpy(out,&data[0],min(data.size(),(size_t)size)*sizeof(float));
+    }
+
+    void write(K& v,const float *in,unsigned int count) const
+    {
+        v.setData(name,vector<float>(in,in+count));
+    }
+
+    void read(const K *vertices,size_t count,float *out,size_t stride) const
+    {
+        for (size_t i=0;i<count;i++,out+=stride)
+            read(vertices[i],out);
+    }
+
+private:
+    string name;
+    unsigned int size;
+};
+}
+
+#endif
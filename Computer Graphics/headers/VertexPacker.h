@@ -0,0 +1,484 @@
+#ifndef _VERTEXPACKER_H_
+#define _VERTEXPACKER_H_
+
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+#include <map>
+#include <stdexcept>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include "PolygonMesh.h"
+#include "VertexLayout.h"
+using namespace std;
+
+namespace util
+{
+
+/*
+ * How the position, normal and texture coordinates of a vertex are stored
+ * in a vertex buffer. Every other attribute is stored as floats.
+ */
+class VertexFormat
+{
+public:
+    enum PositionEncoding
+    {
+        //four floats, 16 bytes
+        POSITION_FLOAT,
+        //x, y and z relative to the bounding box of the mesh, as half
+        //floats, 8 bytes
+        POSITION_HALF,
+        //x, y and z relative to the bounding box of the mesh, as 16-bit
+        //integers spanning the box, 8 bytes
+        POSITION_INT16
+    };
+
+    enum NormalEncoding
+    {
+        //four floats, 16 bytes
+        NORMAL_FLOAT,
+        //x, y and z as 10-bit normalized integers (GL_INT_2_10_10_10_REV),
+        //4 bytes. The w of a normal is taken to be 0
+        NORMAL_INT_2_10_10_10
+    };
+
+    enum TexcoordEncoding
+    {
+        //four floats, 16 bytes
+        TEXCOORD_FLOAT,
+        //s and t as half floats, 4 bytes. The other two are 0 and 1, as
+        //for any attribute with two components
+        TEXCOORD_HALF
+    };
+
+    VertexFormat()
+    {
+        position = POSITION_FLOAT;
+        normal = NORMAL_FLOAT;
+        texcoord = TEXCOORD_FLOAT;
+    }
+
+    /*
+     * The smallest format: 16 bytes a vertex instead of 48
+     */
+    static VertexFormat compact()
+    {
+        VertexFormat format;
+
+        format.position = POSITION_INT16;
+        format.normal = NORMAL_INT_2_10_10_10;
+        format.texcoord = TEXCOORD_HALF;
+        return format;
+    }
+
+    PositionEncoding position;
+    NormalEncoding normal;
+    TexcoordEncoding texcoord;
+};
+
+/*
+ * Where one attribute is in a packed vertex, and how it is stored. The type
+ * names the OpenGL type it is to be read as, without needing OpenGL here.
+ */
+class PackedAttribute
+{
+public:
+    enum Type { FLOAT, HALF_FLOAT, SHORT, INT_2_10_10_10_REV };
+
+    PackedAttribute()
+    {
+        type = FLOAT;
+        components = 0;
+        normalized = false;
+        offset = 0;
+    }
+
+    Type type;
+    int components;
+    //whether integers are read as values in [-1,1] rather than as they are
+    bool normalized;
+    //from the start of the vertex, in bytes
+    int offset;
+};
+
+/*
+ * The vertex attributes of a mesh packed into one array of bytes, one
+ * vertex after the other, as they are sent to a vertex buffer
+ */
+class PackedVertices
+{
+public:
+    PackedVertices()
+        :positionScale(1,1,1),positionOffset(0,0,0)
+    {
+        bytesPerVertex = 0;
+    }
+
+    vector<unsigned char> data;
+    int bytesPerVertex;
+    //for each vertex attribute in the mesh that was packed
+    map<string,PackedAttribute> attributes;
+    //the x, y and z of a position are what is stored, times the scale, plus
+    //the offset. The vertex shader does this
+    glm::vec3 positionScale,positionOffset;
+};
+
+/*
+ * Packs the vertex attributes of a polygon mesh into smaller types than
+ * floats, and its indices into 16 bits where they fit. Like
+ * VertexInterleaver, this does not need OpenGL.
+ *
+ * Positions are stored relative to the bounding box of the mesh, so that
+ * all the precision of the smaller type is spent inside the box. With
+ * 16-bit integers, a model a meter across is stored to about 0.03 mm.
+ */
+class VertexPacker
+{
+public:
+    /*
+     * \param mesh the mesh whose vertices are packed
+     * \param shaderVarsToAttributeNames a mapping of
+     *        shader variable -> vertex attributes in the mesh. The
+     *        attributes are packed in the order of the shader variables
+     * \param format how the position, normal and texture coordinates are
+     *        stored
+     * \param result filled with the packed vertices
+     * \throws runtime_error if an attribute cannot be stored as asked (a
+     *         position, for example, with fewer than 3 components)
+     */
+    template <class K>
+    static void pack(const PolygonMesh<K>& mesh,
+                     const map<string,string>& shaderVarsToAttributeNames,
+                     const VertexFormat& format,
+                     PackedVertices& result) throw(runtime_error)
+    {
+        result = PackedVertices();
+
+        const vector<K>& vertexDataList = mesh.getVertexAttributesRef();
+        if (vertexDataList.size()==0)
+            return;
+
+        glm::vec3 minimum(mesh.getMinimumBounds()),maximum(mesh.getMaximumBounds());
+        glm::vec3 center = 0.5f*(minimum+maximum);
+        glm::vec3 halfSize = 0.5f*(maximum-minimum);
+        for (int c=0;c<3;c++)
+        {
+            //a flat box, or one that NaNs have spoilt, stores its
+            //positions as they are
+            if (!(halfSize[c]>0))
+                halfSize[c] = 1;
+            if (!(fabs(center[c])<=numeric_limits<float>::max()))
+                center[c] = 0;
+        }
+
+        for (map<string,string>::const_iterator it=shaderVarsToAttributeNames.cbegin();
+             it!=shaderVarsToAttributeNames.cend();it++)
+        {
+            unsigned int size = VertexAccess<K>(it->second,vertexDataList[0]).getSize();
+            PackedAttribute& attribute = result.attributes[it->second];
+            int bytes;
+
+            if (size>4)
+                throw runtime_error("Too much data for attribute: "+it->second);
+
+            if ((it->second=="position") && (format.position!=VertexFormat::POSITION_FLOAT))
+            {
+                if (size<3)
+                    throw runtime_error("Cannot pack a position with fewer than 3 components");
+                attribute.components = 4;
+                bytes = 8;
+                if (format.position==VertexFormat::POSITION_HALF)
+                {
+                    attribute.type = PackedAttribute::HALF_FLOAT;
+                    result.positionScale = halfSize;
+                }
+                else
+                {
+                    //the integers are read as they are, and scaled by the
+                    //shader, as OpenGL versions differ in how they map
+                    //normalized integers to [-1,1]
+                    attribute.type = PackedAttribute::SHORT;
+                    result.positionScale = halfSize/32767.0f;
+                }
+                result.positionOffset = center;
+            }
+            else if ((it->second=="normal") && (format.normal==VertexFormat::NORMAL_INT_2_10_10_10))
+            {
+                if (size<3)
+                    throw runtime_error("Cannot pack a normal with fewer than 3 components");
+                attribute.type = PackedAttribute::INT_2_10_10_10_REV;
+                attribute.components = 4;
+                attribute.normalized = true;
+                bytes = 4;
+            }
+            else if ((it->second=="texcoord") && (format.texcoord==VertexFormat::TEXCOORD_HALF))
+            {
+                attribute.type = PackedAttribute::HALF_FLOAT;
+                attribute.components = min(size,2u);
+                bytes = 4;
+            }
+            else
+            {
+                attribute.type = PackedAttribute::FLOAT;
+                attribute.components = size;
+                bytes = size*sizeof(float);
+            }
+            attribute.offset = result.bytesPerVertex;
+            result.bytesPerVertex += bytes;
+        }
+        if (result.bytesPerVertex==0)
+            return;
+
+        result.data.resize(vertexDataList.size()*result.bytesPerVertex);
+        packRange(mesh,shaderVarsToAttributeNames,result,0,vertexDataList.size(),&result.data[0]);
+    }
+
+    /*
+     * Pack some of the vertices of a mesh the way pack packed them before,
+     * to copy only the vertices that have changed to a vertex buffer
+     * \param mesh the mesh whose vertices are packed
+     * \param shaderVarsToAttributeNames as given to pack
+     * \param layout what pack made; only where the attributes are and how
+     *        they are stored are used, not its data
+     * \param first the first vertex to pack
+     * \param count the number of vertices to pack
+     * \param out where the vertices are written,
+     *        count*layout.bytesPerVertex bytes
+     * \return false if a position is outside the box the positions were
+     *         packed relative to, so that it could not be stored as it is
+     *         and the whole mesh should be packed again
+     * \throws runtime_error if the mesh does not have the attributes
+     */
+    template <class K>
+    static bool packRange(const PolygonMesh<K>& mesh,
+                          const map<string,string>& shaderVarsToAttributeNames,
+                          const PackedVertices& layout,
+                          size_t first,size_t count,
+                          unsigned char *out) throw(runtime_error)
+    {
+        const vector<K>& vertexDataList = mesh.getVertexAttributesRef();
+        bool inside = true;
+
+        if ((first>=vertexDataList.size()) || (layout.bytesPerVertex==0))
+            return true;
+        count = min(count,vertexDataList.size()-first);
+
+        //the box the positions are stored relative to
+        glm::vec3 center = layout.positionOffset;
+        glm::vec3 halfSize = layout.positionScale;
+
+        for (map<string,string>::const_iterator it=shaderVarsToAttributeNames.cbegin();
+             it!=shaderVarsToAttributeNames.cend();it++)
+        {
+            VertexAccess<K> access(it->second,vertexDataList[first]);
+            const PackedAttribute& attribute = layout.attributes.at(it->second);
+            int encoding = encodingOf(it->second,attribute);
+            unsigned char *o = out+attribute.offset;
+            float v[4] = {0,0,0,1};
+
+            if (encoding==POSITION_INT16)
+                halfSize = layout.positionScale*32767.0f;
+
+            for (size_t i=first;i<first+count;i++,o+=layout.bytesPerVertex)
+            {
+                access.read(vertexDataList[i],v);
+                switch (encoding)
+                {
+                case FLOATS:
+                    memcpy(o,v,attribute.components*sizeof(float));
+                    break;
+                case POSITION_HALF:
+                case POSITION_INT16:
+                {
+                    unsigned short packed[4];
+
+                    for (int c=0;c<3;c++)
+                    {
+                        float x = (v[c]-center[c])/halfSize[c];
+
+                        //a little past the box is rounding, not a vertex
+                        //that has moved out of it
+                        if (fabs(x)>1.0001f)
+                            inside = false;
+                        if (encoding==POSITION_HALF)
+                            packed[c] = toHalf(x);
+                        else
+                            packed[c] = (unsigned short)toInt(x,32767);
+                    }
+                    //the w of a position is almost always 1, and is
+                    //stored as it is
+                    float w = (access.getSize()>3)?v[3]:1.0f;
+                    packed[3] = (encoding==POSITION_HALF)?toHalf(w):(unsigned short)(short)floor(w+0.5f);
+                    memcpy(o,packed,sizeof(packed));
+                    break;
+                }
+                case NORMAL_INT_2_10_10_10:
+                {
+                    unsigned int packed = (toInt(v[0],511) & 0x3ff)
+                            | ((toInt(v[1],511) & 0x3ff) << 10)
+                            | ((toInt(v[2],511) & 0x3ff) << 20);
+
+                    memcpy(o,&packed,sizeof(packed));
+                    break;
+                }
+                case TEXCOORD_HALF:
+                {
+                    unsigned short packed[2] = {toHalf(v[0]),toHalf(v[1])};
+
+                    memcpy(o,packed,sizeof(packed));
+                    break;
+                }
+                }
+            }
+        }
+        return inside;
+    }
+
+    /*
+     * The size of one index, in bytes: 2 if every vertex can be numbered
+     * in 16 bits, 4 otherwise. The largest 16 bit number is kept for the
+     * restart index between triangle strips.
+     */
+    static unsigned int indexSize(size_t vertexCount)
+    {
+        return (vertexCount<=0xffff)?2:4;
+    }
+
+    /*
+     * Copy indices into an array of indexSize(vertexCount)-byte indices. A
+     * restart index (Stripifier::RESTART_INDEX) becomes 0xFFFF in 16 bits.
+     */
+    static void packIndices(const vector<unsigned int>& indices,size_t vertexCount,
+                            vector<unsigned char>& result)
+    {
+        if (indexSize(vertexCount)==4)
+        {
+            result.resize(indices.size()*sizeof(unsigned int));
+            if (indices.size()>0)
+                memcpy(&result[0],&indices[0],result.size());
+            return;
+        }
+
+        result.resize(indices.size()*sizeof(unsigned short));
+        unsigned short *out = (unsigned short *)(result.empty()?NULL:&result[0]);
+        for (size_t i=0;i<indices.size();i++)
+            out[i] = (unsigned short)indices[i];
+    }
+
+    /*
+     * A float as the nearest half float, the way GPUs round it
+     */
+    static unsigned short toHalf(float f)
+    {
+        unsigned int x;
+        memcpy(&x,&f,sizeof(x));
+
+        unsigned int sign = (x>>16) & 0x8000;
+        unsigned int exponent = (x>>23) & 0xff;
+        unsigned int mantissa = x & 0x7fffff;
+
+        //infinities stay so, and NaNs stay NaNs
+        if (exponent==0xff)
+            return (unsigned short)(sign | 0x7c00 | ((mantissa!=0)?0x200:0));
+
+        int e = (int)exponent - 127 + 15;
+        if (e>=31)
+            return (unsigned short)(sign | 0x7c00);
+
+        unsigned int half,rest,halfway;
+        if (e<=0)
+        {
+            //too small for a normal half: a denormal, or 0
+            if (e<-10)
+                return (unsigned short)sign;
+            mantissa |= 0x800000;
+            unsigned int shift = 14-e;
+            half = mantissa >> shift;
+            rest = mantissa & ((1u<<shift)-1);
+            halfway = 1u << (shift-1);
+        }
+        else
+        {
+            half = ((unsigned int)e << 10) | (mantissa >> 13);
+            rest = mantissa & 0x1fff;
+            halfway = 0x1000;
+        }
+        //round to nearest even. A carry out of the mantissa goes into the
+        //exponent, which is the right result
+        if ((rest>halfway) || ((rest==halfway) && ((half&1)!=0)))
+            half++;
+        return (unsigned short)(sign | half);
+    }
+
+    /*
+     * Convert a half float back to a float
+     */
+    static float fromHalf(unsigned short h)
+    {
+        unsigned int sign = (h & 0x8000) << 16;
+        unsigned int exponent = (h>>10) & 0x1f;
+        unsigned int mantissa = h & 0x3ff;
+        unsigned int x;
+
+        if (exponent==0x1f)
+            x = sign | 0x7f800000 | (mantissa<<13);
+        else if (exponent!=0)
+            x = sign | ((exponent-15+127)<<23) | (mantissa<<13);
+        else if (mantissa==0)
+            x = sign;
+        else
+        {
+            //a denormal half is a normal float
+            exponent = 127-15+1;
+            while ((mantissa & 0x400)==0)
+            {
+                mantissa <<= 1;
+                exponent--;
+            }
+            x = sign | (exponent<<23) | ((mantissa & 0x3ff)<<13);
+        }
+
+        float f;
+        memcpy(&f,&x,sizeof(f));
+        return f;
+    }
+
+private:
+    enum { FLOATS, POSITION_HALF, POSITION_INT16, NORMAL_INT_2_10_10_10, TEXCOORD_HALF };
+
+    /*
+     * How an attribute is packed, from its name and what it is stored as
+     */
+    static int encodingOf(const string& name,const PackedAttribute& attribute)
+    {
+        if (name=="position")
+        {
+            if (attribute.type==PackedAttribute::HALF_FLOAT)
+                return POSITION_HALF;
+            if (attribute.type==PackedAttribute::SHORT)
+                return POSITION_INT16;
+        }
+        else if ((name=="normal") && (attribute.type==PackedAttribute::INT_2_10_10_10_REV))
+            return NORMAL_INT_2_10_10_10;
+        else if ((name=="texcoord") && (attribute.type==PackedAttribute::HALF_FLOAT))
+            return TEXCOORD_HALF;
+        return FLOATS;
+    }
+
+    /*
+     * A value in [-1,1] as the nearest integer in [-scale,scale]
+     */
+    static int toInt(float x,int scale)
+    {
+        if (!(x>-1))
+            x = -1;
+        else if (x>1)
+            x = 1;
+        return (int)floor(x*scale+0.5f);
+    }
+};
+}
+
+#endif
@@ -0,0 +1,334 @@
+#ifndef _VERTEXWELDER_H_
+#define _VERTEXWELDER_H_
+
+#include <vector>
+#include <cstddef>
+#include <cstring>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include "Parallel.h"
+using namespace std;
+
+namespace util
+{
+
+/*
+ * Settings for welding the vertices of a mesh and cleaning up its triangles
+ */
+class WeldOptions
+{
+public:
+    WeldOptions()
+    {
+        tolerance = 1e-6f;
+        attributeTolerance = 1e-5f;
+        threads = 1;
+    }
+
+    /*
+     * Vertices whose positions are closer than this are welded, if their
+     * other attributes match. It is a fraction of the diagonal of the
+     * bounding box, so that it does not depend on the units of the model.
+     * 0 welds only vertices at exactly the same position.
+     */
+    float tolerance;
+    /*
+     * How much each component of the other attributes (normals, texture
+     * coordinates, ...) of two vertices may differ for them to be welded,
+     * so that seams stay seams
+     */
+    float attributeTolerance;
+    /*
+     * The number of threads to weld with, 0 for one per core
+     */
+    unsigned int threads;
+};
+
+/*
+ * What welding and cleaning up did to a mesh
+ */
+class WeldStats
+{
+public:
+    WeldStats()
+    {
+        verticesBefore = verticesAfter = 0;
+        trianglesBefore = trianglesAfter = 0;
+        weldedVertices = unusedVertices = 0;
+        degenerateTriangles = duplicateTriangles = 0;
+    }
+
+    size_t verticesBefore,verticesAfter;
+    size_t trianglesBefore,trianglesAfter;
+    //vertices welded onto another one
+    size_t weldedVertices;
+    //vertices no triangle used, after welding and removing triangles
+    size_t unusedVertices;
+    //triangles with no area: two corners welded together, or all three in
+    //a line
+    size_t degenerateTriangles;
+    //triangles with the same corners in the same order as one before them
+    //in the same part
+    size_t duplicateTriangles;
+};
+
+/*
+ * Finds the vertices that are the same, or so close that they might as
+ * well be, with a spatial hash grid: space is divided into cubes twice as
+ * big as the tolerance, and a hash table finds the vertices in a cube, so
+ * only the vertices in the 8 cubes around a vertex are compared with it.
+ */
+class VertexWelder
+{
+public:
+    /*
+     * Find the vertex every vertex is welded onto. A vertex is welded onto
+     * the first vertex within the tolerance whose other attributes match,
+     * or the one that is welded onto, so vertices in a chain each within
+     * the tolerance of the next become one. A vertex whose position is not
+     * a proper number is never welded.
+     * \param positions the position of the first vertex, as three floats
+     * \param stride the distance from one position to the next, in bytes
+     * \param attributes the other attributes of the vertices, attributeSize
+     *        floats each, or NULL if there are none
+     * \param vertexCount the number of vertices
+     * \param tolerance the distance within which vertices are welded
+     * \param attributeTolerance how much each attribute may differ
+     * \param threads the number of threads, 0 for one per core
+     * \param representative set to the vertex every vertex is welded onto:
+     *        itself, or one before it
+     * \return the number of vertices welded onto another
+     */
+    static size_t weld(const float *positions,size_t stride,
+                       const float *attributes,unsigned int attributeSize,
+                       size_t vertexCount,float tolerance,float attributeTolerance,
+                       unsigned int threads,vector<unsigned int>& representative)
+    {
+        size_t i;
+
+        representative.resize(vertexCount);
+        if (vertexCount==0)
+            return 0;
+
+        //with cells twice as big as the tolerance, the vertices within the
+        //tolerance of a vertex are in its cell or the ones next to it on
+        //the side of the cell it is on: 8 cells to look in. With no
+        //tolerance, only the same position will do, and that is in the
+        //same cell
+        double cellSize = 2.0*tolerance;
+
+        //every vertex in its cell, sorted by cell
+        vector<Entry> entries(vertexCount);
+        parallelFor(0,vertexCount,threads,
+                    [&](size_t first,size_t last,unsigned int)
+        {
+            for (size_t v=first;v<last;v++)
+            {
+                long long cell[3];
+                int side[3];
+
+                entries[v].vertex = (unsigned int)v;
+                if (findCell(position(positions,stride,v),cellSize,cell,side))
+                    entries[v].key = key(cell[0],cell[1],cell[2]);
+                else
+                    entries[v].key = 0;
+            }
+        });
+        sort(entries.begin(),entries.end());
+
+        //the entries of every cell, in a hash table with open addressing
+        size_t tableSize = 1;
+        while (tableSize<2*vertexCount)
+            tableSize *= 2;
+        vector<Cell> table(tableSize);
+        for (i=0;i<vertexCount;)
+        {
+            size_t j = i;
+            while ((j<vertexCount) && (entries[j].key==entries[i].key))
+                j++;
+
+            size_t slot = entries[i].key & (tableSize-1);
+            while (table[slot].end>0)
+                slot = (slot+1) & (tableSize-1);
+            table[slot].key = entries[i].key;
+            table[slot].begin = i;
+            table[slot].end = j;
+            i = j;
+        }
+
+        //the first vertex every vertex may be welded onto
+        vector<unsigned int> nearest(vertexCount);
+        parallelFor(0,vertexCount,threads,
+                    [&](size_t first,size_t last,unsigned int)
+        {
+            for (size_t v=first;v<last;v++)
+            {
+                long long cell[3];
+                int side[3];
+
+                nearest[v] = (unsigned int)v;
+                if (!findCell(position(positions,stride,v),cellSize,cell,side))
+                    continue;
+
+                int reach = (tolerance>0)?1:0;
+                for (int dx=0;dx<=reach;dx++)
+                {
+                    for (int dy=0;dy<=reach;dy++)
+                    {
+                        for (int dz=0;dz<=reach;dz++)
+                        {
+                            unsigned long long k = key(cell[0]+dx*side[0],
+                                                       cell[1]+dy*side[1],
+                                                       cell[2]+dz*side[2]);
+                            size_t slot = k & (tableSize-1);
+
+                            while ((table[slot].end>0) && (table[slot].key!=k))
+                                slot = (slot+1) & (tableSize-1);
+
+                            //the vertices of a cell are in order, so the
+                            //first that matches is the first of the cell
+                            for (size_t e=table[slot].begin;
+                                 (e<table[slot].end) && (entries[e].vertex<nearest[v]);
+                                 e++)
+                            {
+                                if (matches(positions,stride,attributes,attributeSize,
+                                            entries[e].vertex,v,tolerance,attributeTolerance))
+                                {
+                                    nearest[v] = entries[e].vertex;
+                                    break;
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+        });
+
+        //the vertex welded onto comes first, so it already knows where it
+        //goes
+        size_t welded = 0;
+        for (i=0;i<vertexCount;i++)
+        {
+            if (nearest[i]==i)
+                representative[i] = (unsigned int)i;
+            else
+            {
+                representative[i] = representative[nearest[i]];
+                welded++;
+            }
+        }
+        return welded;
+    }
+
+private:
+    class Entry
+    {
+    public:
+        bool operator<(const Entry& other) const
+        {
+            if (key!=other.key)
+                return key<other.key;
+            return vertex<other.vertex;
+        }
+
+        unsigned long long key;
+        unsigned int vertex;
+    };
+
+    /*
+     * The entries of one cell: entries[begin] to entries[end-1]. A slot of
+     * the table with end 0 is empty.
+     */
+    class Cell
+    {
+    public:
+        Cell()
+        {
+            key = 0;
+            begin = end = 0;
+        }
+
+        unsigned long long key;
+        size_t begin,end;
+    };
+
+    static const float *position(const float *positions,size_t stride,size_t v)
+    {
+        return (const float *)((const char *)positions + v*stride);
+    }
+
+    /*
+     * The cell a position is in, and for every axis which way the nearer
+     * cell next to it is (-1 or 1). With no cell size, the cell is the bits
+     * of the position.
+     * \return false if the position is not a proper number
+     */
+    static bool findCell(const float *p,double cellSize,long long *cell,int *side)
+    {
+        //cells are clamped far beyond any model, so that the conversion
+        //cannot overflow; the distance is checked anyway
+        const double LIMIT = 4e18;
+
+        for (int c=0;c<3;c++)
+        {
+            if (!(fabs(p[c])<=numeric_limits<float>::max()))
+                return false;
+            if (cellSize>0)
+            {
+                double x = p[c]/cellSize;
+                double f = floor(x);
+
+                cell[c] = (long long)max(-LIMIT,min(LIMIT,f));
+                side[c] = (x-f<0.5)?-1:1;
+            }
+            else
+            {
+                unsigned int bits;
+                memcpy(&bits,&p[c],sizeof(bits));
+                cell[c] = bits;
+                side[c] = 0;
+            }
+        }
+        return true;
+    }
+
+    static unsigned long long key(long long x,long long y,long long z)
+    {
+        unsigned long long h = (unsigned long long)x*0x9E3779B185EBCA87ULL;
+
+        h = (h ^ (h>>29)) + (unsigned long long)y*0xC2B2AE3D27D4EB4FULL;
+        h = (h ^ (h>>31)) + (unsigned long long)z*0x165667B19E3779F9ULL;
+        return h ^ (h>>32);
+    }
+
+    static bool matches(const float *positions,size_t stride,
+                        const float *attributes,unsigned int attributeSize,
+                        size_t a,size_t b,float tolerance,float attributeTolerance)
+    {
+        const float *p = position(positions,stride,a);
+        const float *q = position(positions,stride,b);
+        unsigned int c;
+
+        if (tolerance>0)
+        {
+            float dx = p[0]-q[0],dy = p[1]-q[1],dz = p[2]-q[2];
+
+            if (!(dx*dx+dy*dy+dz*dz<=tolerance*tolerance))
+                return false;
+        }
+        else if (memcmp(p,q,3*sizeof(float))!=0)
+            return false;
+
+        for (c=0;(attributes!=NULL) && (c<attributeSize);c++)
+        {
+            if (!(fabs(attributes[a*attributeSize+c]-attributes[b*attributeSize+c])<=attributeTolerance))
+                return false;
+        }
+        return true;
+    }
+};
+
+}
+
+#endif
@@ -112,6 +112,11 @@ namespace sgraph
       throw runtime_error(getName()+" is not a transform node");
     }
 
+    void setTransform(const util::AffineTransform& /*t*/) throw(runtime_error)
+    {
+      throw runtime_error(getName()+" is not a transform node");
+    }
+
 
     /**
      * By default, throws an exception. Any nodes that are capable of storing transformations
@@ -124,6 +129,11 @@ namespace sgraph
       throw runtime_error(getName()+" is not a transform node");
     }
 
+    void setAnimationTransform(const util::AffineTransform& /*t*/) throw(runtime_error)
+    {
+      throw runtime_error(getName()+" is not a transform node");
+    }
+
     /**
      * By default, throws an exception. Any nodes that are capable of storing material should
      * override this method
@@ -10,9 +10,13 @@
 #include "ObjectInstance.h"
 #include "IVertexData.h"
 #include "ShaderLocationsVault.h"
+#include "AffineTransform.h"
 #include <string>
 #include <map>
+#include <set>
+#include <memory>
 #include <stack>
+#include <vector>
 using namespace std;
 
 namespace sgraph
@@ -49,6 +53,22 @@ protected :
      * A table of renderers for individual meshes
      */
     map<string, util::ObjectInstance *> meshRenderers;
+    /**
+     * The shared meshes that have been uploaded, and the renderer made for
+     * each. Several names may refer to one of these. A mesh is recognized by
+     * its address; the weak pointer tells whether it is still the same mesh
+     * at that address.
+     */
+    map<const void *, pair<weak_ptr<const void>, util::ObjectInstance *> > sharedMeshRenderers;
+    /**
+     * The shared meshes that have been uploaded, if they are kept
+     */
+    vector<shared_ptr<const void> > keptMeshes;
+    bool keepMeshes;
+    /**
+     * How the vertices of meshes added from now on are stored
+     */
+    util::VertexFormat vertexFormat;
 
     /**
      * A variable tracking whether shader locations have been set. This must be done before
@@ -60,6 +80,45 @@ public:
     GLScenegraphRenderer()
     {
         shaderLocationsSet = false;
+        keepMeshes = true;
+    }
+
+    /**
+     * Choose whether this renderer holds on to the shared meshes it uploads.
+     * Once a mesh is in its buffers it is not needed to draw it, so if this
+     * renderer lets go of it, its memory is given back as soon as its other
+     * owners (the scene info, the registry) let go of it too. They are kept
+     * by default.
+     */
+    void setKeepMeshes(bool keep)
+    {
+        keepMeshes = keep;
+        if (!keep)
+            keptMeshes.clear();
+    }
+
+    /**
+     * Choose how the vertices of meshes added from now on are stored in
+     * their buffers. A packed format needs a shader with the positionScale
+     * and positionOffset uniforms, which drawMesh sets for every mesh.
+     */
+    void setVertexFormat(const util::VertexFormat& format)
+    {
+        vertexFormat = format;
+    }
+
+    /**
+     * The GPU memory taken by the vertices and indices of a mesh, in bytes,
+     * or 0 if there is no mesh of that name. Meshes that share buffers each
+     * report all of them.
+     */
+    size_t getMeshBytes(const string& name) const
+    {
+        map<string,util::ObjectInstance *>::const_iterator it = meshRenderers.find(name);
+
+        if (it==meshRenderers.end())
+            return 0;
+        return it->second->getVertexBufferBytes() + it->second->getIndexBufferBytes();
     }
 
     /**
@@ -81,7 +140,7 @@ public:
      */
     template <class K>
     void addMesh(const string& name,
-                 util::PolygonMesh<K>& mesh) throw(runtime_error)
+                 const util::PolygonMesh<K>& mesh) throw(runtime_error)
     {
         if (!shaderLocationsSet)
             throw runtime_error("Attempting to add mesh before setting shader variables. Call initShaderProgram first");
@@ -91,7 +150,9 @@ public:
         //verify that the mesh has all the vertex attributes as specified in the map
         if (mesh.getVertexCount()<=0)
             return;
-        K vertexData = mesh.getVertexAttributes()[0];
+        //only the first vertex is looked at, so only it is copied (hasData
+        //is not const)
+        K vertexData = mesh.getVertexAttributesRef()[0];
         for (map<string,string>::iterator it=shaderVarsToVertexAttribs.begin();
              it!=shaderVarsToVertexAttribs.end();it++) {
             if (!vertexData.hasData(it->second))
@@ -101,10 +162,42 @@ public:
         mr->initPolygonMesh<K>(*glContext,
                             shaderLocations,
                             shaderVarsToVertexAttribs,
-                            mesh);
+                            mesh,
+                            vertexFormat);
         this->meshRenderers[name] = mr;
     }
 
+    /**
+     * Add a mesh that may be shared with other names or scenes. A mesh that
+     * has already been added under another name is not uploaded again: both
+     * names are drawn with the same buffers.
+     * \param name the name by which this mesh is referred to by the scene graph
+     * \param mesh the mesh, typically handed out by a util::MeshRegistry
+     */
+    template <class K>
+    void addMesh(const string& name,
+                 const shared_ptr<const util::PolygonMesh<K> >& mesh) throw(runtime_error)
+    {
+        map<const void *, pair<weak_ptr<const void>, util::ObjectInstance *> >::iterator it =
+                sharedMeshRenderers.find(mesh.get());
+
+        //a mesh that is gone may have left its address to this one
+        if ((it!=sharedMeshRenderers.end()) && !it->second.first.expired())
+        {
+            meshRenderers[name] = it->second.second;
+            return;
+        }
+
+        util::ObjectInstance *before = (meshRenderers.count(name)==1)?meshRenderers[name]:NULL;
+        addMesh<K>(name,*mesh);
+        if ((meshRenderers.count(name)==1) && (meshRenderers[name]!=before))
+        {
+            sharedMeshRenderers[mesh.get()] = make_pair(weak_ptr<const void>(mesh),meshRenderers[name]);
+            if (keepMeshes)
+                keptMeshes.push_back(mesh);
+        }
+    }
+
     void addTexture(const string& name,const string& path)
     {
         util::TextureImage *image = NULL;
@@ -128,11 +221,23 @@ public:
 
     void dispose()
     {
+        //several names may share one renderer, so release each only once
+        set<util::ObjectInstance *> instances;
+
         for (map<string,util::ObjectInstance *>::iterator it=meshRenderers.begin();
              it!=meshRenderers.end();it++)
           {
-            it->second->cleanup(*glContext);
+            instances.insert(it->second);
+          }
+        for (set<util::ObjectInstance *>::iterator it=instances.begin();
+             it!=instances.end();it++)
+          {
+            (*it)->cleanup(*glContext);
+            delete *it;
           }
+        meshRenderers.clear();
+        sharedMeshRenderers.clear();
+        keptMeshes.clear();
     }
     /**
      * Draws a specific mesh.
@@ -166,6 +271,23 @@ public:
                                   1,
                                   false,glm::value_ptr(transformation));
 
+            //for a shader that lights in view coordinates. The modelview is
+            //affine, so its normal matrix only needs its 3x3 part inverted
+            loc = shaderLocations.getLocation("normalmatrix");
+            if (loc>=0)
+            {
+                glm::mat4 normalMatrix(util::AffineTransform(transformation).normalMatrix());
+                glContext->glUniformMatrix4fv(loc,1,false,glm::value_ptr(normalMatrix));
+            }
+
+            //for a shader that reads packed positions
+            loc = shaderLocations.getLocation("positionScale");
+            if (loc>=0)
+                glContext->glUniform3fv(loc,1,glm::value_ptr(meshRenderers[name]->getPositionScale()));
+            loc = shaderLocations.getLocation("positionOffset");
+            if (loc>=0)
+                glContext->glUniform3fv(loc,1,glm::value_ptr(meshRenderers[name]->getPositionOffset()));
+
             meshRenderers[name]->draw(*glContext);
         }
     }
@@ -3,6 +3,7 @@
 
 #include "OpenGLFunctions.h"
 #include <glm/glm.hpp>
+#include "AffineTransform.h"
 #include "Light.h"
 #include "Material.h"
 #include <vector>
@@ -93,6 +94,13 @@ namespace sgraph
      */
     virtual void setTransform(const glm::mat4& m) throw(runtime_error)=0;
 
+    /**
+     * Set the transformation associated with this node, as an affine transform
+     * \param t the transformation associated with this node
+     * \throws runtime_error if this node is unable to store a transformation (all nodes except TransformNode)
+     */
+    virtual void setTransform(const util::AffineTransform& t) throw(runtime_error)=0;
+
 
     /**
      * Set the animation transformation associated with this node. Not all types of nodes can have transformations.
@@ -102,6 +110,13 @@ namespace sgraph
      */
     virtual void setAnimationTransform(const glm::mat4& m) throw(runtime_error)=0;
 
+    /**
+     * Set the animation transformation associated with this node, as an affine transform
+     * \param t the animation transformation associated with this node
+     * \throws runtime_error if this node is unable to store a transformation (all nodes except TransformNode)
+     */
+    virtual void setAnimationTransform(const util::AffineTransform& t) throw(runtime_error)=0;
+
 
     /**
      * Set the material associated with this node. Not all types of nodes can have materials associated with them.
@@ -7,6 +7,10 @@
 #include <QXmlDefaultHandler>
 #include <qxml.h>
 #include "ObjImporter.h"
+#include "MeshRegistry.h"
+#include "NumberParser.h"
+#include "ThreadPool.h"
+#include "AffineTransform.h"
 #include "INode.h"
 #include "TransformNode.h"
 #include "LeafNode.h"
@@ -16,6 +20,8 @@
 #include <vector>
 #include <map>
 #include <fstream>
+#include <future>
+#include <cctype>
 using namespace std;
 
 namespace sgraph
@@ -32,8 +38,22 @@ namespace sgraph
     template <class K>
     static sgraph::ScenegraphInfo<K> importScenegraph(const string& filename) throw(runtime_error)
     {
+      util::MeshRegistry<K> registry;
 
-      MyHandler<K> handler;
+      return importScenegraph<K>(filename,registry);
+    }
+
+    /**
+     * Import a scene graph, taking its meshes from the given registry. A
+     * mesh file used by several scenes read through one registry (or by
+     * several scenes included from this one) is loaded once and shared.
+     */
+    template <class K>
+    static sgraph::ScenegraphInfo<K> importScenegraph(const string& filename,
+                                                      util::MeshRegistry<K>& registry) throw(runtime_error)
+    {
+
+      MyHandler<K> handler(registry);
       QFile xmlFile(QString::fromStdString(filename));
       if (!xmlFile.open(QIODevice::ReadOnly | QIODevice::Text))
         throw runtime_error("Could not open file: "+filename);
@@ -46,13 +66,16 @@ namespace sgraph
 
       bool answer = reader.parse(source);
 
+      //the meshes have been loading while the rest of the file was parsed
+      handler.waitForMeshes();
+
       sgraph::ScenegraphInfo<K> info;
       info.scenegraph = NULL;
 
       if (answer)
         {
           info.scenegraph = handler.getScenegraph();
-          info.meshes = handler.getMeshes();
+          info.meshes.swap(handler.getMeshes());
         }
       else
         {
@@ -70,33 +93,75 @@ namespace sgraph
   {
   private:
     sgraph::Scenegraph *scenegraph;
-    map<string,util::PolygonMesh<K>> meshes;
+    map<string,shared_ptr<const util::PolygonMesh<K>>> meshes;
+    //where meshes are loaded from, shared with any scenes included from this one
+    util::MeshRegistry<K>& registry;
     INode *node;
     stack<INode *> stackNodes;
-    glm::mat4 transform;
+    util::AffineTransform transform;
     util::Material material;
     map<string, sgraph::INode *> subgraph;
     vector<float> data;
+    //meshes are loaded on these threads while the rest of the file is parsed
+    util::ThreadPool loaders;
+    //the loads that have been started, with the path each is loading from
+    map<string,future<shared_ptr<const util::PolygonMesh<K>>>> pendingMeshes;
+    map<string,string> pendingPaths;
 
   public:
     sgraph::Scenegraph *getScenegraph() {
       return scenegraph;
     }
 
-    map<string,util::PolygonMesh<K>> getMeshes()
+    /*
+     * The meshes of this scene. The caller may take them over (by swapping
+     * them out) once the scene has been read.
+     */
+    map<string,shared_ptr<const util::PolygonMesh<K>>>& getMeshes()
     {
       return meshes;
     }
 
-    MyHandler()
+    MyHandler(util::MeshRegistry<K>& registry)
+      :registry(registry)
     {
     }
 
+    /*
+     * Wait for all the meshes that are still loading, and add them to the
+     * meshes of this scene.
+     * \throws runtime_error if a mesh could not be loaded. All the loads
+     *         are waited for before this is thrown
+     */
+    void waitForMeshes() throw(runtime_error)
+    {
+      string error = "";
+
+      for (typename map<string,future<shared_ptr<const util::PolygonMesh<K>>>>::iterator it=pendingMeshes.begin();
+           it!=pendingMeshes.end();it++)
+        {
+          try
+          {
+            meshes[it->first] = it->second.get();
+          }
+          catch (string& e)
+          {
+            if (error.length()==0)
+              error = pendingPaths[it->first] + ": " + e;
+          }
+        }
+      pendingMeshes.clear();
+      pendingPaths.clear();
+
+      if (error.length()>0)
+        throw runtime_error(error);
+    }
+
     bool startDocument()
     {
       node = NULL;
       scenegraph = new sgraph::Scenegraph();
-      transform = glm::mat4(1.0);
+      transform = util::AffineTransform();
       return true;
     }
     
@@ -130,15 +195,19 @@ namespace sgraph
             }
           else if (fromfile.length() > 0)
             {
-              sgraph::ScenegraphInfo<K> tempsginfo;
-              tempsginfo = sgraph::SceneXMLReader::importScenegraph<K>(fromfile);
+              sgraph::ScenegraphInfo<K> tempsginfo =
+                  sgraph::SceneXMLReader::importScenegraph<K>(fromfile,registry);
 
               node = new sgraph::GroupNode(scenegraph,name);
 
-              for (typename map<string,util::PolygonMesh<K>>::iterator it=tempsginfo.meshes.begin();
+              for (typename map<string,shared_ptr<const util::PolygonMesh<K>>>::iterator it=tempsginfo.meshes.begin();
                    it!=tempsginfo.meshes.end();it++)
                 {
                   meshes[it->first] = it->second;
+                  //a mesh of the same name that is still loading was named
+                  //earlier in the file, so this one replaces it
+                  pendingMeshes.erase(it->first);
+                  pendingPaths.erase(it->first);
                 }
               //rename all the nodes in tempsg to prepend with the name of the group node
               map<string, INode *> nodes = tempsginfo.scenegraph->getNodes();
@@ -223,10 +292,22 @@ namespace sgraph
             }
           if ((name.length() > 0) && (path.length() > 0))
             {
-              util::PolygonMesh<K> mesh;
-              ifstream in(path.c_str());
-              mesh = util::ObjImporter<K>::importFile(in, false);
-              meshes[name] = mesh;
+              //start loading now and collect the mesh when the file has been
+              //read. The pool already uses every core, so each file is parsed
+              //on one thread
+              util::ObjImportOptions options;
+
+              options.useCache = true;
+              options.threads = 1;
+              options.optimizeVertexCache = true;
+              options.weldVertices = true;
+              util::MeshRegistry<K> *source = &registry;
+              pendingMeshes[name] = loaders.submit([source,path,options]()
+              {
+                return source->load(path, options);
+              });
+              pendingPaths[name] = path;
+              meshes.erase(name);
             }
         }
 	  else if (qName.compare("image")==0)
@@ -269,21 +350,20 @@ namespace sgraph
       else if (qName.compare("set")==0)
         {
           stackNodes.top()->setTransform(transform);
-          transform = glm::mat4(1.0);
+          transform = util::AffineTransform();
         }
       else if (qName.compare("scale")==0)
         {
           if (data.size()!=3)
             return false;
-          transform = transform * glm::scale(glm::mat4(1.0),glm::vec3(data[0],data[1],data[2]));
+          transform = transform * util::AffineTransform::scale(glm::vec3(data[0],data[1],data[2]));
           data.clear();
         }
       else if (qName.compare("rotate")==0)
         {
           if (data.size()!=4)
             return false;
-          transform = transform * glm::rotate(glm::mat4(1.0),
-                                              glm::radians(data[0]),
+          transform = transform * util::AffineTransform::rotate(glm::radians(data[0]),
               glm::vec3(data[1],data[2],data[3]));
           data.clear();
         }
@@ -291,7 +371,7 @@ namespace sgraph
         {
           if (data.size()!=3)
             return false;
-          transform = transform * glm::translate(glm::mat4(1.0),glm::vec3(data[0],data[1],data[2]));
+          transform = transform * util::AffineTransform::translate(glm::vec3(data[0],data[1],data[2]));
           data.clear();
         }
       else if (qName.compare("material")==0)
@@ -380,24 +460,24 @@ namespace sgraph
 
     bool characters(const QString& text)
     {
-      int c;
-      float f;
-      QString info;
-
-      info = text;
-      info.remove(QRegExp("[\n\t\r]*")); //remove tabs and newlines
-
-      QStringList list = info.split(' ',QString::SkipEmptyParts);
+      QByteArray bytes = text.toLatin1();
+      const char *p = bytes.constData();
+      const char *end = p + bytes.size();
 
-
-      for (int i=0;i<list.length();i++)
+      //read whitespace-separated numbers until the first thing that is not one
+      while (p<end)
         {
-          c=sscanf(list.at(i).toLatin1().constData(),"%f",&f);
-          printf("Read number: %f\n",f);
-          data.push_back(f);
-          if (c!=1)
+          while ((p<end) && isspace((unsigned char)*p))
+            p++;
+          if (p==end)
+            break;
+
+          float f;
+          const char *next = util::NumberParser::parseFloat(p,end,f);
+          if ((next==p) || ((next<end) && !isspace((unsigned char)*next)))
             return true;
-
+          data.push_back(f);
+          p = next;
         }
 
       //all the data numbers are in the data array
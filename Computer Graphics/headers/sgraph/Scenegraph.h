@@ -10,6 +10,7 @@
 #include "PolygonMesh.h"
 #include <string>
 #include <map>
+#include <memory>
 #include <iostream>
 
 using namespace std;
@@ -91,6 +92,26 @@ namespace sgraph
 
     }
 
+    /**
+     * Sets the renderer, and then adds all the meshes to the renderer. A mesh
+     * shared by several names is uploaded only once.
+     * \param renderer The IScenegraphRenderer object that will act as its renderer
+     * \throws Exception
+     */
+    template <class VertexType>
+    void setRenderer(GLScenegraphRenderer *renderer,map<string,
+                     shared_ptr<const util::PolygonMesh<VertexType> > >& meshes) throw(runtime_error)
+    {
+      this->renderer = renderer;
+
+      for (typename map<string,shared_ptr<const util::PolygonMesh<VertexType> > >::iterator it=meshes.begin();
+           it!=meshes.end();
+           it++)
+        {
+          this->renderer->addMesh<VertexType>(it->first,it->second);
+        }
+    }
+
 
     /**
      * Set the root of the scenegraph, and then pass a reference to this scene graph object
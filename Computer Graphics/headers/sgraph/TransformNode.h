@@ -4,6 +4,7 @@
 #include "AbstractNode.h"
 #include "OpenGLFunctions.h"
 #include "glm/glm.hpp"
+#include "AffineTransform.h"
 #include "Light.h"
 using namespace std;
 #include <vector>
@@ -23,11 +24,11 @@ namespace sgraph
   class TransformNode: public AbstractNode
   {
     /**
-     * Matrices storing the static and animation transformations separately, so that they can be
-     * changed separately
+     * The static and animation transformations, stored separately so that they can be
+     * changed separately. Both are affine, so only their first three rows are stored
      */
   protected:
-    glm::mat4 transform,animation_transform;
+    util::AffineTransform transform,animation_transform;
 
     /**
      * A reference to its only child
@@ -38,8 +39,8 @@ namespace sgraph
     TransformNode(sgraph::Scenegraph *graph,const string& name)
       :AbstractNode(graph,name)
     {
-      this->transform = glm::mat4(1.0);
-      animation_transform = glm::mat4(1.0);
+      this->transform = util::AffineTransform();
+      animation_transform = util::AffineTransform();
       child = NULL;
     }
 	
@@ -122,7 +123,8 @@ namespace sgraph
      * After preserving the current top of the modelview stack, this "post-multiplies" its
      * animation transform and then its transform in that order to the top of the model view
      * stack, and then recurses to its child. When the child is drawn, it restores the modelview
-     * matrix
+     * matrix. The two transforms are multiplied together as affine transforms, and only then
+     * onto the top of the stack
      * \param context the generic renderer context sgraph::IScenegraphRenderer
      * \param modelView the stack of modelview matrices
      */
@@ -131,8 +133,7 @@ namespace sgraph
     {
       modelView.push(modelView.top());
       modelView.top() = modelView.top()
-          * animation_transform
-          * transform;
+          * (animation_transform * transform);
       if (child!=NULL)
         child->draw(context,modelView);
       modelView.pop();
@@ -145,7 +146,12 @@ namespace sgraph
      */
     void setAnimationTransform(const glm::mat4& mat) throw(runtime_error)
     {
-      animation_transform = mat;
+      animation_transform = util::AffineTransform(mat);
+    }
+
+    void setAnimationTransform(const util::AffineTransform& t) throw(runtime_error)
+    {
+      animation_transform = t;
     }
 
     /**
@@ -153,15 +159,21 @@ namespace sgraph
      */
     glm::mat4 getTransform()
     {
-      return transform;
+      return transform.toMat4();
     }
 
     /**
-     * Sets the transformation of this node
+     * Sets the transformation of this node. Its last row must be (0,0,0,1), as it is kept as
+     * an affine transform
      * \param t
      * \throws runtime_error this implementation does not throw this exception
      */
     void setTransform(const glm::mat4& t) throw(runtime_error)
+    {
+      this->transform = util::AffineTransform(t);
+    }
+
+    void setTransform(const util::AffineTransform& t) throw(runtime_error)
     {
       this->transform = t;
     }
@@ -172,7 +184,7 @@ namespace sgraph
      */
     glm::mat4 getAnimationTransform()
     {
-      return animation_transform;
+      return animation_transform.toMat4();
     }
 
     /**
@@ -5,6 +5,7 @@
 #include "Scenegraph.h"
 #include <string>
 #include <map>
+#include <memory>
 using namespace std;
 
 namespace sgraph
@@ -14,7 +15,9 @@ namespace sgraph
     {
     public:
       sgraph::Scenegraph *scenegraph;
-      map<string,util::PolygonMesh<K> > meshes;
+      //meshes may be shared with other scenes loaded through the same
+      //util::MeshRegistry, so they are never changed
+      map<string,shared_ptr<const util::PolygonMesh<K> > > meshes;
     };
 }
 